@@ -63,6 +63,8 @@ void (*vnif_restart_interface)(PVNIF_ADAPTER adapter);
 void (*VNIF_FREE_SHARED_MEMORY)(VNIF_ADAPTER *adapter, void *va,
     PHYSICAL_ADDRESS pa, uint32_t len, NDIS_HANDLE _hndl);
 void (*VNIF_ADD_RCB_TO_RING)(VNIF_ADAPTER *adapter, RCB *rcb);
+void (*VNIF_RX_RING_PUBLISH)(VNIF_ADAPTER *adapter, UINT path_id);
+void (*VNIF_RX_RING_REARM)(VNIF_ADAPTER *adapter, UINT path_id);
 ULONG (*VNIF_RX_RING_SIZE)(VNIF_ADAPTER *adapter);
 ULONG (*VNIF_TX_RING_SIZE)(VNIF_ADAPTER *adapter);
 void (*VNIF_GET_TX_REQ_PROD_PVT)(VNIF_ADAPTER *adapter, UINT path_id, UINT *i);
@@ -144,6 +146,8 @@ vnifv_setup(void)
 
     VNIF_FREE_SHARED_MEMORY = VNIFV_FREE_SHARED_MEMORY;
     VNIF_ADD_RCB_TO_RING = VNIFV_ADD_RCB_TO_RING;
+    VNIF_RX_RING_PUBLISH = VNIFV_RX_RING_PUBLISH;
+    VNIF_RX_RING_REARM = VNIFV_RX_RING_REARM;
     VNIF_RX_RING_SIZE = VNIFV_RX_RING_SIZE;
     VNIF_TX_RING_SIZE = VNIFV_TX_RING_SIZE;
     VNIF_GET_TX_REQ_PROD_PVT = VNIFV_GET_TX_REQ_PROD_PVT;
@@ -222,6 +226,8 @@ vnifx_setup(void)
 
     VNIF_FREE_SHARED_MEMORY = VNIFX_FREE_SHARED_MEMORY;
     VNIF_ADD_RCB_TO_RING = VNIFX_ADD_RCB_TO_RING;
+    VNIF_RX_RING_PUBLISH = VNIFX_RX_RING_PUBLISH;
+    VNIF_RX_RING_REARM = VNIFX_RX_RING_REARM;
     VNIF_RX_RING_SIZE = VNIFX_RX_RING_SIZE;
     VNIF_TX_RING_SIZE = VNIFX_TX_RING_SIZE;
     VNIF_GET_TX_REQ_PROD_PVT = VNIFX_GET_TX_REQ_PROD_PVT;
@@ -81,6 +81,10 @@ extern void (*VNIF_FREE_SHARED_MEMORY)(struct _VNIF_ADAPTER *adapter, void *va,
     PHYSICAL_ADDRESS pa, uint32_t len, NDIS_HANDLE _hndl);
 extern void (*VNIF_ADD_RCB_TO_RING) (struct _VNIF_ADAPTER *adapter,
     struct _RCB *rcb);
+extern void (*VNIF_RX_RING_PUBLISH)(struct _VNIF_ADAPTER *adapter,
+                                    UINT path_id);
+extern void (*VNIF_RX_RING_REARM)(struct _VNIF_ADAPTER *adapter,
+                                  UINT path_id);
 extern ULONG (*VNIF_RX_RING_SIZE)(struct _VNIF_ADAPTER *adapter);
 extern ULONG (*VNIF_TX_RING_SIZE)(struct _VNIF_ADAPTER *adapter);
 extern void (*VNIF_GET_TX_REQ_PROD_PVT)(struct _VNIF_ADAPTER *adapter,
@@ -193,6 +193,7 @@ typedef struct virtio_device_s {
 
     ULONG maxQueues;
     char *drv_name;
+    BOOLEAN packed_ring;    /* Queues use the VIRTIO_F_RING_PACKED layout */
     /* virtio_per_queue_info_t info[MAX_QUEUES_PER_DEVICE_DEFAULT]; */
     /* do not add any members after info struct, it is extensible */
 } virtio_device_t;
@@ -336,6 +337,7 @@ void virtio_iowrite32(ULONG_PTR ulRegister, uint32_t val);
 BOOLEAN virtio_device_has_host_feature(virtio_device_t *vdev, uint64_t feature);
 NTSTATUS virtio_device_set_guest_feature_list(virtio_device_t *vdev,
                                               uint64_t list);
+void virtio_device_use_packed_ring(virtio_device_t *vdev, BOOLEAN enable);
 void virtio_device_reset_features(virtio_device_t *vdev);
 void virtio_device_add_status(virtio_device_t *vdev, uint8_t status);
 void virtio_device_remove_status(virtio_device_t *vdev, uint8_t status);
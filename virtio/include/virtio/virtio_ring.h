@@ -71,6 +71,25 @@
 
 #define SIZE_OF_SINGLE_INDIRECT_DESC 16
 
+/*
+ * Packed ring (VIRTIO_F_RING_PACKED) descriptor flags.  The avail and used
+ * flags are bit numbers and are toggled together with the wrap counters.
+ */
+#define VRING_PACKED_DESC_F_AVAIL   7
+#define VRING_PACKED_DESC_F_USED    15
+#define VRING_PACKED_DESC_F_AVAIL_USED                                  \
+    ((1 << VRING_PACKED_DESC_F_AVAIL) | (1 << VRING_PACKED_DESC_F_USED))
+
+/* Enable events */
+#define VRING_PACKED_EVENT_FLAG_ENABLE  0x0
+/* Disable events */
+#define VRING_PACKED_EVENT_FLAG_DISABLE 0x1
+/* Enable events for a specific descriptor, needs VIRTIO_RING_F_EVENT_IDX. */
+#define VRING_PACKED_EVENT_FLAG_DESC    0x2
+
+/* Wrap counter bit shift in the event suppression off_wrap field. */
+#define VRING_PACKED_EVENT_F_WRAP_CTR   15
+
 #pragma pack(push)
 #pragma pack(1)
 
@@ -112,21 +131,80 @@ typedef struct vring {
     struct vring_avail *avail;
     struct vring_used *used;
 } vring_t;
+
+/* Packed ring descriptors: 16 bytes.  Written in place by the device. */
+struct vring_packed_desc {
+    /* Buffer Address. */
+    uint64_t addr;
+    /* Buffer Length. */
+    uint32_t len;
+    /* Buffer ID. */
+    uint16_t id;
+    /* The flags depending on descriptor type. */
+    uint16_t flags;
+};
+
+/* Driver and device event suppression areas of a packed ring. */
+struct vring_packed_desc_event {
+    /* Descriptor Ring Change Event Offset/Wrap Counter. */
+    uint16_t off_wrap;
+    /* Descriptor Ring Change Event Flags. */
+    uint16_t flags;
+};
+
+typedef struct vring_packed {
+    unsigned int num;
+    struct vring_packed_desc *desc;
+    struct vring_packed_desc_event *driver;
+    struct vring_packed_desc_event *device;
+} vring_packed_t;
 #pragma pack(pop)
 
+/* Per buffer id state of a packed ring, kept after the data array. */
+typedef struct vring_packed_desc_state_s {
+    uint16_t num;               /* Descriptors used by this buffer id. */
+    uint16_t next;              /* Next free buffer id. */
+} vring_packed_desc_state_t;
+
+/*
+ * Submission and completion commonly run on different CPUs.  The queue is
+ * padded so that the fields written by each side never share a cache line
+ * with the other side or with the read mostly setup fields.
+ */
+#define VRING_CACHE_LINE_BYTES 64
 
 typedef struct virtio_queue_s {
+    /* Set up by the transport, read mostly afterwards. */
     vring_t vring;
-    uint32_t port;
+    vring_packed_t packed;
+    vring_packed_desc_state_t *desc_state;
     struct virtio_device_s *vdev;
     void *notification_addr;
-    uint32_t num_free;          /* Number of free buffers */
-    uint32_t free_head;         /* Head of free buffer list. */
-    uint32_t num_added;         /* Number we've added since last sync. */
+    uint32_t port;
     uint16_t qidx;
-    uint16_t last_used_idx;     /* Last used index we've seen. */
+    uint16_t num_mask;          /* vring.num - 1, split rings are 2^n. */
     uint16_t broken;
     BOOLEAN use_event_idx;
+    BOOLEAN packed_ring;        /* Queue uses the VIRTIO_F_RING_PACKED layout */
+    uint8_t pad_setup[VRING_CACHE_LINE_BYTES];
+
+    /* Producer: vring_add_buf*(), vring_publish_batch() and vring_kick(). */
+    uint32_t num_free;          /* Number of free buffers */
+    uint32_t free_head;         /* Head of free buffer list or buffer ids. */
+    uint32_t num_added;         /* Number we've added since last sync. */
+    uint16_t num_staged;        /* Added but not yet published to host. */
+    uint16_t staged_head;       /* Packed: first staged head descriptor. */
+    uint16_t staged_head_flags; /* Packed: flags held back for that head. */
+    uint16_t next_avail_idx;    /* Packed: next descriptor to make avail. */
+    uint16_t avail_used_flags;  /* Packed: avail/used flags for this lap. */
+    uint8_t avail_wrap_counter; /* Packed: driver ring wrap counter. */
+    uint8_t pad_producer[VRING_CACHE_LINE_BYTES];
+
+    /* Consumer: vring_get_buf() and the interrupt enable/disable calls. */
+    uint16_t last_used_idx;     /* Last used index we've seen. */
+    uint8_t used_wrap_counter;  /* Packed: device ring wrap counter. */
+    uint8_t pad_consumer[VRING_CACHE_LINE_BYTES];
+
     void *data[];
 } virtio_queue_t;
 
@@ -182,16 +260,59 @@ static __inline unsigned vring_size(unsigned int num, unsigned long align)
                 + (unsigned)sizeof(struct vring_used_elem) * num;
 }
 
+/*
+ * The packed layout is a single descriptor ring followed by the driver and
+ * device event suppression structures.  It is always smaller than the split
+ * layout for the same num, so vring_size() remains the allocation size.
+ */
+static __inline void vring_packed_init(vring_packed_t *vr, unsigned int num,
+                                       void *p, unsigned long align)
+{
+    vr->num = num;
+    vr->desc = p;
+    vr->driver = (void *)(((ULONG_PTR)&vr->desc[num] + align - 1)
+                & ~((ULONG_PTR)align - 1));
+    vr->device = vr->driver + 1;
+}
+
+static __inline unsigned vring_packed_size(unsigned int num,
+                                           unsigned long align)
+{
+    return (((unsigned)sizeof(struct vring_packed_desc) * num + align - 1)
+                & ~(align - 1))
+            + (unsigned)sizeof(struct vring_packed_desc_event) * 2;
+}
+
+/* Size of a virtio_queue_t including its per buffer tracking arrays. */
+static __inline unsigned long virtio_queue_heap_size(unsigned int num)
+{
+    return (unsigned long)(sizeof(virtio_queue_t)
+        + (sizeof(void *) + sizeof(vring_packed_desc_state_t)) * num);
+}
+
 static __inline BOOLEAN vring_need_event(u16 event_idx, u16 new_idx, u16 old)
 {
     return (u16)(new_idx - event_idx - 1) < (u16)(new_idx - old);
 }
 
+static __inline BOOLEAN vring_packed_more_used(virtio_queue_t *vq)
+{
+    uint16_t flags;
+    BOOLEAN avail;
+    BOOLEAN used;
+
+    flags = *(volatile uint16_t *)&vq->packed.desc[vq->last_used_idx].flags;
+    avail = !!(flags & (1 << VRING_PACKED_DESC_F_AVAIL));
+    used = !!(flags & (1 << VRING_PACKED_DESC_F_USED));
+    return avail == used && used == vq->used_wrap_counter;
+}
+
 #define VRING_HAS_UNCONSUMED_RESPONSES(_vq)                             \
-    ((_vq)->last_used_idx != (_vq)->vring.used->idx)
+    ((_vq)->packed_ring ? vring_packed_more_used(_vq)                   \
+        : ((_vq)->last_used_idx != (_vq)->vring.used->idx))
 
 #define VRING_FINAL_CHECK_FOR_RESPONSES(_vq, _more_to_do)               \
-    (_more_to_do) = ((_vq)->last_used_idx != (_vq)->vring.used->idx)
+    (_more_to_do) = VRING_HAS_UNCONSUMED_RESPONSES(_vq)
 
 int vring_add_buf(virtio_queue_t *vq,
     virtio_buffer_descriptor_t *sg,
@@ -205,14 +326,33 @@ int vring_add_buf_indirect(virtio_queue_t *vq,
     void *data,
     struct vring_desc *vr_desc,
     uint64_t pa);
+int vring_add_buf_batch(virtio_queue_t *vq,
+    virtio_buffer_descriptor_t *sg,
+    unsigned int out,
+    unsigned int in,
+    void *data);
+int vring_add_buf_indirect_batch(virtio_queue_t *vq,
+    virtio_buffer_descriptor_t *sg,
+    unsigned int out,
+    unsigned int in,
+    void *data,
+    struct vring_desc *vr_desc,
+    uint64_t pa);
+void vring_publish_batch(virtio_queue_t *vq);
 void *vring_get_buf(virtio_queue_t *vq, unsigned int *len);
 void *vring_detach_unused_buf(virtio_queue_t *vq);
 void vring_kick_always(virtio_queue_t *vq);
-void vring_kick(virtio_queue_t *vq);
+BOOLEAN vring_kick(virtio_queue_t *vq);
 void vring_disable_interrupt(virtio_queue_t *vq);
 BOOLEAN vring_enable_interrupt(virtio_queue_t *vq);
+BOOLEAN vring_enable_interrupt_delayed(virtio_queue_t *vq);
+BOOLEAN vring_enable_interrupt_after(virtio_queue_t *vq, uint16_t bufs);
 void vring_start_interrupts(virtio_queue_t *vq);
 void vring_stop_interrupts(virtio_queue_t *vq);
 void vring_transport_features(uint64_t *features);
+void vring_packed_init_queue(virtio_queue_t *vq,
+    unsigned int num,
+    void *p,
+    unsigned long align);
 
 #endif /* _LINUX_VIRTIO_RING_H */
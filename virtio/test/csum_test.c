@@ -0,0 +1,186 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host side test of the software checksum helpers.  Random buffers, start
+ * alignments and fragment splits are compared against the 16 bit word
+ * loop the helpers replaced.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ntddk.h>
+#include <win_stdint.h>
+#include <mp_csum.h>
+
+#define TEST_BUF_MAX    (65536 + 16)
+#define TEST_FRAG_MAX   8
+
+#define CHECK(_cond)                                                    \
+do {                                                                    \
+    if (!(_cond)) {                                                     \
+        printf("%s:%d: %s: CHECK(%s) failed\n",                         \
+               __FILE__, __LINE__, __func__, #_cond);                   \
+        test_failures++;                                                \
+        return;                                                         \
+    }                                                                   \
+} while (0)
+
+static unsigned int test_failures;
+
+static uint8_t test_buf[TEST_BUF_MAX];
+
+static uint32_t
+test_rand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+/* The 16 bit word loop and fold used before the 64 bit accumulator. */
+static uint16_t
+test_ref_sum(uint8_t *buffer, uint32_t len)
+{
+    uint32_t sum;
+
+    sum = 0;
+    while (len > 1) {
+        sum += *(uint16_t *)buffer;
+        buffer += 2;
+        len -= 2;
+    }
+    if (len) {
+        sum += *buffer;
+    }
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum += sum >> 16;
+    return (uint16_t)sum;
+}
+
+/* One's complement sums compare equal when 0 and 0xffff are the same. */
+static uint16_t
+test_norm(uint32_t sum)
+{
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum += sum >> 16;
+    sum &= 0xffff;
+    return (uint16_t)(sum == 0xffff ? 0 : sum);
+}
+
+static void
+test_fill(uint32_t *seed, uint32_t len, UINT pattern)
+{
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        switch (pattern) {
+        case 0:
+            test_buf[i] = (uint8_t)test_rand(seed);
+            break;
+        case 1:
+            test_buf[i] = 0xff;
+            break;
+        default:
+            test_buf[i] = 0;
+            break;
+        }
+    }
+}
+
+static void
+test_flat(void)
+{
+    uint32_t seed;
+    uint32_t len;
+    uint32_t align;
+    UINT round;
+
+    seed = 1;
+    for (round = 0; round < 20000; round++) {
+        len = test_rand(&seed) % (round < 10000 ? 128 : 9018);
+        align = test_rand(&seed) % 8;
+        test_fill(&seed, len + align, round % 7 == 0 ? 1 : round % 11 == 0);
+        CHECK(test_norm(vnif_csum_fold(vnif_csum_partial(test_buf + align,
+                                                         len, 0)))
+              == test_norm(test_ref_sum(test_buf + align, len)));
+    }
+
+    /* The largest buffer, all ones, exercises every carry in the fold. */
+    test_fill(&seed, TEST_BUF_MAX, 1);
+    CHECK(test_norm(vnif_csum_fold(vnif_csum_partial(test_buf, 65536, 0)))
+          == test_norm(test_ref_sum(test_buf, 65536)));
+    CHECK(vnif_csum_fold(0) == 0);
+}
+
+/* Sums continued across calls match one call over the whole buffer. */
+static void
+test_continue(void)
+{
+    uint64_t sum;
+    uint32_t seed;
+    uint32_t len;
+    uint32_t split;
+    UINT round;
+
+    seed = 2;
+    for (round = 0; round < 10000; round++) {
+        len = test_rand(&seed) % 4096;
+        split = (len ? test_rand(&seed) % len : 0) & ~3;
+        test_fill(&seed, len, 0);
+        sum = vnif_csum_partial(test_buf, split, 0);
+        sum = vnif_csum_partial(test_buf + split, len - split, sum);
+        CHECK(vnif_csum_fold(sum)
+              == vnif_csum_fold(vnif_csum_partial(test_buf, len, 0)));
+    }
+}
+
+/*
+ * Fragments of any length, as calculate_rx_checksum walks an RCB chain,
+ * sum to the same value as the flat packet.
+ */
+static void
+test_frags(void)
+{
+    uint32_t frag_len[TEST_FRAG_MAX];
+    uint32_t seed;
+    uint32_t len;
+    uint32_t offset;
+    uint32_t sum;
+    UINT frags;
+    UINT round;
+    UINT i;
+
+    seed = 3;
+    for (round = 0; round < 20000; round++) {
+        frags = 1 + test_rand(&seed) % TEST_FRAG_MAX;
+        len = 0;
+        for (i = 0; i < frags; i++) {
+            frag_len[i] = test_rand(&seed) % (i & 1 ? 7 : 1500);
+            len += frag_len[i];
+        }
+        test_fill(&seed, len, round % 13 == 0);
+
+        sum = 0;
+        offset = 0;
+        for (i = 0; i < frags; i++) {
+            sum += vnif_csum_frag(test_buf + offset, frag_len[i], offset);
+            offset += frag_len[i];
+        }
+        CHECK(test_norm(sum) == test_norm(test_ref_sum(test_buf, len)));
+    }
+}
+
+int
+main(void)
+{
+    test_flat();
+    test_continue();
+    test_frags();
+
+    if (test_failures) {
+        printf("csum_test: %u failure(s)\n", test_failures);
+        return 1;
+    }
+    printf("csum_test: passed\n");
+    return 0;
+}
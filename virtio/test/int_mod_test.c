@@ -0,0 +1,373 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host side simulation of the adaptive rx interrupt moderation engine.
+ * Ring drains are fed in from a model of how fast a path receives at each
+ * profile, with a simulated interrupt time, so every run takes the same
+ * path through the tuning states.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ntddk.h>
+#include <win_stdint.h>
+
+#define NdisZeroMemory(_dst, _len) memset((_dst), 0, (_len))
+
+#include <mp_int_mod.h>
+
+#define TEST_PKT_LEN    1500
+#define TEST_SAMPLES    200
+
+#define CHECK(_cond)                                                    \
+do {                                                                    \
+    if (!(_cond)) {                                                     \
+        printf("%s:%d: %s: CHECK(%s) failed\n",                         \
+               __FILE__, __LINE__, __func__, #_cond);                   \
+        test_failures++;                                                \
+        return;                                                         \
+    }                                                                   \
+} while (0)
+
+static unsigned int test_failures;
+
+/*
+ * Packets per ms the path receives at each profile.  Each drain takes
+ * rx_bufs packets, so a sample of VNIF_INT_MOD_NEVENTS drains lasts
+ * VNIF_INT_MOD_NEVENTS * rx_bufs / ppms ms.  Light traffic that the timer
+ * picks up sets drain_pkts instead, whatever the profile.
+ */
+typedef struct test_model_s {
+    uint64_t            ppms[VNIF_INT_MOD_NUM_PROFILES];
+    UINT                drain_pkts;
+} test_model_t;
+
+typedef struct test_sim_s {
+    vnif_int_mod_t      im;
+    uint64_t            now;            /* 100ns units */
+    UINT                changes;
+    UINT                visits[VNIF_INT_MOD_NUM_PROFILES];
+    BOOLEAN             was_tired;
+} test_sim_t;
+
+static void
+test_sim_init(test_sim_t *sim, uint32_t mode)
+{
+    memset(sim, 0, sizeof(*sim));
+    vnif_int_mod_init(&sim->im, mode);
+    sim->now = 1;
+}
+
+/* Run one drain and return whether rx_bufs changed. */
+static BOOLEAN
+test_sim_drain(test_sim_t *sim, const test_model_t *model)
+{
+    UINT pkts;
+
+    pkts = model->drain_pkts ? model->drain_pkts : sim->im.rx_bufs;
+    sim->now += pkts * 10000 / model->ppms[sim->im.profile];
+    return vnif_int_mod_update(&sim->im, sim->now, pkts,
+                               pkts * TEST_PKT_LEN);
+}
+
+static void
+test_sim_run(test_sim_t *sim, const test_model_t *model, UINT samples)
+{
+    UINT prev_bufs;
+    UINT i;
+
+    for (i = 0; i < samples * VNIF_INT_MOD_NEVENTS; i++) {
+        prev_bufs = sim->im.rx_bufs;
+        if (test_sim_drain(sim, model)) {
+            sim->changes++;
+            if (sim->im.rx_bufs == prev_bufs) {
+                sim->changes = ~0U;
+            }
+        } else if (sim->im.rx_bufs != prev_bufs) {
+            sim->changes = ~0U;
+        }
+        sim->visits[sim->im.profile]++;
+        if (sim->im.tune_state == VNIF_INT_MOD_PARKING_TIRED) {
+            sim->was_tired = TRUE;
+        }
+    }
+}
+
+static const test_model_t test_peak_2 = {{ 200, 300, 400, 300, 200 }};
+static const test_model_t test_rising = {{ 100, 200, 300, 400, 500 }};
+static const test_model_t test_flat = {{ 300, 300, 300, 300, 300 }};
+static const test_model_t test_trickle = {{ 10, 10, 10, 10, 10 }, 1};
+
+static void
+test_init_modes(void)
+{
+    vnif_int_mod_t im;
+
+    vnif_int_mod_init(&im, VNIF_INT_MOD_DISABLED);
+    CHECK(im.profile == 0 && im.rx_bufs == 1);
+    vnif_int_mod_init(&im, VNIF_INT_MOD_ENABLED);
+    CHECK(im.profile == VNIF_INT_MOD_DEFAULT_PROFILE && im.rx_bufs == 8);
+    vnif_int_mod_init(&im, VNIF_INT_MOD_ADAPTIVE);
+    CHECK(im.profile == 0 && im.rx_bufs == 1);
+    CHECK(im.tune_state == VNIF_INT_MOD_GOING_RIGHT);
+}
+
+/* The first drain starts the sample, the decision comes NEVENTS later. */
+static void
+test_sample_length(void)
+{
+    test_sim_t sim;
+    UINT i;
+
+    test_sim_init(&sim, VNIF_INT_MOD_ADAPTIVE);
+    CHECK(!test_sim_drain(&sim, &test_peak_2));
+    for (i = 1; i < VNIF_INT_MOD_NEVENTS; i++) {
+        CHECK(!test_sim_drain(&sim, &test_peak_2));
+    }
+    CHECK(sim.im.profile == 0);
+    CHECK(test_sim_drain(&sim, &test_peak_2));
+    CHECK(sim.im.profile == 1 && sim.im.rx_bufs == 4);
+}
+
+/* Drains that take no time give no rates and change nothing. */
+static void
+test_zero_delta(void)
+{
+    vnif_int_mod_t im;
+    UINT i;
+
+    vnif_int_mod_init(&im, VNIF_INT_MOD_ADAPTIVE);
+    for (i = 0; i < VNIF_INT_MOD_NEVENTS * 4; i++) {
+        CHECK(!vnif_int_mod_update(&im, 1000, 1, TEST_PKT_LEN));
+    }
+    CHECK(im.profile == 0 && im.rx_bufs == 1);
+}
+
+/* Climbs past the best profile, turns back once and parks on it. */
+static void
+test_settles_on_peak(void)
+{
+    static const UINT path[] = { 0, 1, 2, 3, 2, 2 };
+    test_sim_t sim;
+    UINT i;
+
+    test_sim_init(&sim, VNIF_INT_MOD_ADAPTIVE);
+    for (i = 0; i < sizeof(path) / sizeof(path[0]); i++) {
+        test_sim_run(&sim, &test_peak_2, 1);
+        CHECK(sim.im.profile == path[i]);
+    }
+    CHECK(sim.im.tune_state == VNIF_INT_MOD_PARKING_ON_TOP);
+
+    test_sim_run(&sim, &test_peak_2, TEST_SAMPLES);
+    CHECK(sim.changes != ~0U);
+    CHECK(sim.im.tune_state == VNIF_INT_MOD_PARKING_ON_TOP);
+    CHECK(sim.im.profile == 2);
+    CHECK(sim.visits[4] == 0);
+    CHECK(!sim.was_tired);
+}
+
+/* Keeps stepping right while it helps and parks on the edge. */
+static void
+test_rising_parks_on_edge(void)
+{
+    test_sim_t sim;
+
+    test_sim_init(&sim, VNIF_INT_MOD_ADAPTIVE);
+    test_sim_run(&sim, &test_rising, 8);
+    CHECK(sim.im.profile == VNIF_INT_MOD_NUM_PROFILES - 1);
+    CHECK(sim.im.rx_bufs == 32);
+    CHECK(sim.im.tune_state == VNIF_INT_MOD_PARKING_ON_TOP);
+
+    /* Stays parked while the traffic does not change. */
+    test_sim_run(&sim, &test_rising, TEST_SAMPLES);
+    CHECK(sim.im.profile == VNIF_INT_MOD_NUM_PROFILES - 1);
+    CHECK(sim.im.tune_state == VNIF_INT_MOD_PARKING_ON_TOP);
+}
+
+/* A parked path starts tuning again when the traffic changes. */
+static void
+test_unparks_on_change(void)
+{
+    static const UINT path[] = { 4, 3, 2, 1, 2, 2 };
+    test_sim_t sim;
+    UINT i;
+
+    test_sim_init(&sim, VNIF_INT_MOD_ADAPTIVE);
+    test_sim_run(&sim, &test_rising, 8);
+    CHECK(sim.im.tune_state == VNIF_INT_MOD_PARKING_ON_TOP);
+    CHECK(sim.im.profile == VNIF_INT_MOD_NUM_PROFILES - 1);
+
+    /* Down past the peak, back onto it and parked there. */
+    for (i = 0; i < sizeof(path) / sizeof(path[0]); i++) {
+        test_sim_run(&sim, &test_peak_2, 1);
+        CHECK(sim.im.profile == path[i]);
+    }
+    CHECK(sim.im.tune_state == VNIF_INT_MOD_PARKING_ON_TOP);
+
+    test_sim_run(&sim, &test_peak_2, TEST_SAMPLES);
+    CHECK(sim.changes != ~0U);
+    CHECK(sim.im.profile == 2);
+    CHECK(sim.im.tune_state == VNIF_INT_MOD_PARKING_ON_TOP);
+    CHECK(!sim.was_tired);
+}
+
+/*
+ * Light traffic comes in at the same rate whatever the threshold.  That
+ * is never better, so it keeps turning around near the start instead of
+ * holding packets for buffers that don't arrive, and eventually tires.
+ */
+static void
+test_trickle_stays_low(void)
+{
+    test_sim_t sim;
+
+    test_sim_init(&sim, VNIF_INT_MOD_ADAPTIVE);
+    test_sim_run(&sim, &test_trickle, TEST_SAMPLES);
+    CHECK(sim.changes != ~0U);
+    CHECK(sim.im.profile <= 1);
+    CHECK(sim.visits[2] == 0 && sim.visits[3] == 0 && sim.visits[4] == 0);
+    CHECK(sim.was_tired);
+}
+
+/* The same traffic in fewer drains is better, so it moves to the edge. */
+static void
+test_flat_fewer_drains(void)
+{
+    test_sim_t sim;
+
+    test_sim_init(&sim, VNIF_INT_MOD_ADAPTIVE);
+    test_sim_run(&sim, &test_flat, TEST_SAMPLES);
+    CHECK(sim.changes != ~0U);
+    CHECK(sim.im.profile == VNIF_INT_MOD_NUM_PROFILES - 1);
+    CHECK(sim.im.tune_state == VNIF_INT_MOD_PARKING_ON_TOP);
+}
+
+/*
+ * Traffic that falls off every sample is never better, so it turns around
+ * each time without settling.  It tires, parks for a while and then tunes
+ * again.
+ */
+static void
+test_fading_gets_tired(void)
+{
+    test_sim_t sim;
+    test_model_t model;
+    uint64_t ppms;
+    UINT tired_at;
+    UINT i;
+    UINT p;
+
+    test_sim_init(&sim, VNIF_INT_MOD_ADAPTIVE);
+    ppms = 2000;
+    tired_at = 0;
+    for (i = 1; i <= 20 && !sim.was_tired; i++) {
+        for (p = 0; p < VNIF_INT_MOD_NUM_PROFILES; p++) {
+            model.ppms[p] = ppms;
+        }
+        ppms = ppms * 4 / 5;
+        test_sim_run(&sim, &model, 1);
+        CHECK(sim.im.profile <= 1);
+        tired_at = i;
+    }
+    /* It only gives up after NUM_PROFILES * 2 steps. */
+    CHECK(sim.was_tired);
+    CHECK(tired_at > VNIF_INT_MOD_NUM_PROFILES * 2);
+
+    /* Parked for NUM_PROFILES samples whatever the traffic does. */
+    for (i = 1; i < VNIF_INT_MOD_NUM_PROFILES; i++) {
+        test_sim_run(&sim, &test_rising, 1);
+        CHECK(sim.im.tune_state == VNIF_INT_MOD_PARKING_TIRED);
+    }
+    test_sim_run(&sim, &test_rising, 1);
+    CHECK(sim.im.tune_state != VNIF_INT_MOD_PARKING_TIRED);
+}
+
+/*
+ * A tick with drains since the last one keeps the threshold, a quiet one
+ * idles the path at one buffer.  The first drain with packets puts the
+ * profile's threshold back and starts a new sample.
+ */
+static void
+test_idle_and_wake(void)
+{
+    test_sim_t sim;
+    UINT profile;
+    UINT i;
+
+    test_sim_init(&sim, VNIF_INT_MOD_ADAPTIVE);
+    test_sim_run(&sim, &test_rising, 8);
+    profile = sim.im.profile;
+    CHECK(sim.im.rx_bufs == 32);
+
+    CHECK(!vnif_int_mod_idle(&sim.im));
+    CHECK(sim.im.rx_bufs == 32);
+    CHECK(vnif_int_mod_idle(&sim.im));
+    CHECK(sim.im.idle && sim.im.rx_bufs == 1);
+
+    /* Drains without packets and a long gap don't wake or tune it. */
+    sim.now += 10000000;
+    for (i = 0; i < VNIF_INT_MOD_NEVENTS * 2; i++) {
+        CHECK(!vnif_int_mod_update(&sim.im, sim.now, 0, 0));
+    }
+    CHECK(sim.im.idle && sim.im.rx_bufs == 1);
+    CHECK(vnif_int_mod_idle(&sim.im));
+
+    CHECK(test_sim_drain(&sim, &test_rising));
+    CHECK(!sim.im.idle && sim.im.rx_bufs == 32);
+    CHECK(sim.im.profile == profile);
+    CHECK(sim.im.start.time == sim.now);
+
+    /* The gap is not part of the next sample, so it stays parked. */
+    test_sim_run(&sim, &test_rising, TEST_SAMPLES);
+    CHECK(sim.im.profile == profile);
+    CHECK(sim.im.tune_state == VNIF_INT_MOD_PARKING_ON_TOP);
+
+    /* Fixed moderation only counts the drains. */
+    vnif_int_mod_init(&sim.im, VNIF_INT_MOD_ENABLED);
+    CHECK(!vnif_int_mod_count(&sim.im, 1, TEST_PKT_LEN));
+    CHECK(!vnif_int_mod_idle(&sim.im));
+    CHECK(vnif_int_mod_idle(&sim.im));
+    CHECK(sim.im.rx_bufs == 1);
+    CHECK(!vnif_int_mod_count(&sim.im, 0, 0));
+    CHECK(sim.im.rx_bufs == 1);
+    CHECK(vnif_int_mod_count(&sim.im, 1, TEST_PKT_LEN));
+    CHECK(sim.im.rx_bufs == 8);
+}
+
+/* The same input gives the same decisions. */
+static void
+test_deterministic(void)
+{
+    test_sim_t a;
+    test_sim_t b;
+
+    test_sim_init(&a, VNIF_INT_MOD_ADAPTIVE);
+    test_sim_init(&b, VNIF_INT_MOD_ADAPTIVE);
+    test_sim_run(&a, &test_peak_2, TEST_SAMPLES);
+    test_sim_run(&b, &test_peak_2, TEST_SAMPLES);
+    CHECK(memcmp(&a, &b, sizeof(a)) == 0);
+}
+
+int
+main(void)
+{
+    test_init_modes();
+    test_sample_length();
+    test_zero_delta();
+    test_settles_on_peak();
+    test_rising_parks_on_edge();
+    test_unparks_on_change();
+    test_flat_fewer_drains();
+    test_trickle_stays_low();
+    test_fading_gets_tired();
+    test_idle_and_wake();
+    test_deterministic();
+
+    if (test_failures) {
+        printf("int_mod_test: %u failure(s)\n", test_failures);
+        return 1;
+    }
+    printf("int_mod_test: passed\n");
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Minimal stand-in for the WDK's ntddk.h so that the hardware independent
+ * parts of virtio_base can be built and exercised on a development host.
+ * Only what those sources and their headers use is provided.
+ */
+
+#ifndef _TEST_SHIM_NTDDK_H
+#define _TEST_SHIM_NTDDK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+#ifndef WINVER
+#define WINVER 0xA00
+#endif
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#define PAGE_SIZE 4096
+#define CACHE_LINE_SIZE 64
+#define PCI_TYPE0_ADDRESSES 6
+#define MAX_QUEUES_PER_DEVICE_DEFAULT 8
+
+typedef unsigned char BOOLEAN;
+typedef unsigned char UCHAR, *PUCHAR;
+typedef unsigned short USHORT;
+typedef unsigned int UINT;
+typedef unsigned int ULONG;
+typedef uintptr_t ULONG_PTR;
+typedef int NTSTATUS;
+typedef void *PVOID;
+typedef uintptr_t KSPIN_LOCK;
+typedef struct _DEVICE_OBJECT *PDEVICE_OBJECT;
+typedef struct _PCI_COMMON_HEADER *PPCI_COMMON_HEADER;
+
+typedef union _LARGE_INTEGER {
+    struct {
+        unsigned int LowPart;
+        int HighPart;
+    } u;
+    long long QuadPart;
+} LARGE_INTEGER, PHYSICAL_ADDRESS;
+
+#define KeMemoryBarrier() __sync_synchronize()
+
+typedef struct _LIST_ENTRY {
+    struct _LIST_ENTRY *Flink;
+    struct _LIST_ENTRY *Blink;
+} LIST_ENTRY, *PLIST_ENTRY;
+
+static inline void
+InitializeListHead(PLIST_ENTRY head)
+{
+    head->Flink = head;
+    head->Blink = head;
+}
+
+static inline BOOLEAN
+IsListEmpty(const LIST_ENTRY *head)
+{
+    return head->Flink == head;
+}
+
+static inline void
+InsertHeadList(PLIST_ENTRY head, PLIST_ENTRY entry)
+{
+    entry->Flink = head->Flink;
+    entry->Blink = head;
+    head->Flink->Blink = entry;
+    head->Flink = entry;
+}
+
+static inline void
+InsertTailList(PLIST_ENTRY head, PLIST_ENTRY entry)
+{
+    entry->Flink = head;
+    entry->Blink = head->Blink;
+    head->Blink->Flink = entry;
+    head->Blink = entry;
+}
+
+static inline PLIST_ENTRY
+RemoveHeadList(PLIST_ENTRY head)
+{
+    PLIST_ENTRY entry;
+
+    entry = head->Flink;
+    head->Flink = entry->Flink;
+    entry->Flink->Blink = head;
+    return entry;
+}
+
+#endif
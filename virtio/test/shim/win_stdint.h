@@ -0,0 +1,35 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host stand-in for include/win_stdint.h.  The host's <stdint.h> already
+ * has the fixed width types, so only the Windows and Linux style names are
+ * added on top.
+ */
+
+#ifndef _WINSTDINT_H
+#define _WINSTDINT_H
+
+#include <stdint.h>
+
+typedef int8_t      INT8;
+typedef int16_t     INT16;
+typedef int32_t     INT32;
+typedef int64_t     INT64;
+typedef uint8_t     UINT8;
+typedef uint16_t    UINT16;
+typedef uint32_t    UINT32;
+typedef uint64_t    UINT64;
+
+typedef INT8    s8;
+typedef UINT8   u8;
+typedef INT16   s16;
+typedef UINT16  u16;
+typedef INT32   s32;
+typedef UINT32  u32;
+typedef INT64   s64;
+typedef UINT64  u64;
+
+typedef intptr_t            xen_long_t;
+typedef uintptr_t           xen_ulong_t;
+
+#endif
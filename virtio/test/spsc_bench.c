@@ -0,0 +1,270 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host side comparison of the receive queue hand-off ring against the
+ * list and lock hand-off it replaced.  One thread produces in bursts, as a
+ * path's ring drain does, and another consumes, as the receive queue's DPC
+ * does.  The list side splices each burst onto the queue under the lock
+ * and the consumer drains it under the same lock, as the staged fallback
+ * in the driver does.  Both sides are limited to the ring's size in flight
+ * so the latencies are comparable.
+ *
+ * Throughput and per item hand-off latency are printed for each.  The
+ * numbers depend on the host so nothing is asserted about them, only that
+ * every item arrives once and in order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <ntddk.h>
+#include <win_stdint.h>
+#include <mp_rcv_xq.h>
+
+#define BENCH_ITEMS     1000000
+#define BENCH_BURST     32
+
+#define CHECK(_cond)                                                    \
+do {                                                                    \
+    if (!(_cond)) {                                                     \
+        printf("%s:%d: %s: CHECK(%s) failed\n",                         \
+               __FILE__, __LINE__, __func__, #_cond);                   \
+        test_failures++;                                                \
+        return;                                                         \
+    }                                                                   \
+} while (0)
+
+typedef struct _bench_item {
+    LIST_ENTRY          list;
+    ULONG               seq;
+    uint64_t            stamp;
+} bench_item_t;
+
+typedef struct _bench_result {
+    uint64_t            elapsed_ns;
+    uint64_t            lat_sum_ns;
+    uint64_t            lat_max_ns;
+    BOOLEAN             out_of_order;
+} bench_result_t;
+
+static unsigned int test_failures;
+
+static bench_item_t *bench_items;
+static bench_result_t bench_res;
+
+static rcv_xq_ring_t bench_xq;
+
+static LIST_ENTRY bench_list;
+static pthread_mutex_t bench_list_lock;
+static volatile ULONG bench_list_cons;
+
+static uint64_t
+bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+bench_consume(bench_item_t *item, ULONG expect, uint64_t now)
+{
+    uint64_t lat;
+
+    if (item->seq != expect) {
+        bench_res.out_of_order = TRUE;
+    }
+    lat = now - item->stamp;
+    bench_res.lat_sum_ns += lat;
+    if (lat > bench_res.lat_max_ns) {
+        bench_res.lat_max_ns = lat;
+    }
+}
+
+static void *
+bench_ring_producer(void *arg)
+{
+    ULONG seq;
+    UINT i;
+
+    seq = 0;
+    while (seq < BENCH_ITEMS) {
+        for (i = 0; i < BENCH_BURST && seq < BENCH_ITEMS; i++) {
+            bench_items[seq].stamp = bench_now();
+            if (!vnif_rcv_xq_put(&bench_xq,
+                                 (struct _RCB *)&bench_items[seq])) {
+                break;
+            }
+            seq++;
+        }
+        vnif_rcv_xq_publish(&bench_xq);
+        if (i < BENCH_BURST) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *
+bench_ring_consumer(void *arg)
+{
+    uint64_t now;
+    ULONG expect;
+    ULONG avail;
+    ULONG i;
+
+    expect = 0;
+    while (expect < BENCH_ITEMS) {
+        avail = vnif_rcv_xq_avail(&bench_xq);
+        if (avail == 0) {
+            sched_yield();
+            continue;
+        }
+        now = bench_now();
+        for (i = 0; i < avail; i++) {
+            bench_consume((bench_item_t *)vnif_rcv_xq_entry(&bench_xq, i),
+                          expect + i, now);
+        }
+        vnif_rcv_xq_release(&bench_xq, avail);
+        expect += avail;
+    }
+    return NULL;
+}
+
+static void *
+bench_list_producer(void *arg)
+{
+    LIST_ENTRY staged;
+    ULONG seq;
+    UINT i;
+
+    seq = 0;
+    while (seq < BENCH_ITEMS) {
+        InitializeListHead(&staged);
+        for (i = 0; i < BENCH_BURST && seq < BENCH_ITEMS; i++) {
+            if (seq - bench_list_cons >= VNIF_RCV_XQ_RING_SIZE) {
+                break;
+            }
+            bench_items[seq].stamp = bench_now();
+            InsertTailList(&staged, &bench_items[seq].list);
+            seq++;
+        }
+        if (!IsListEmpty(&staged)) {
+            /* Splice the staged list onto the tail, as the driver does. */
+            pthread_mutex_lock(&bench_list_lock);
+            staged.Flink->Blink = bench_list.Blink;
+            bench_list.Blink->Flink = staged.Flink;
+            staged.Blink->Flink = &bench_list;
+            bench_list.Blink = staged.Blink;
+            pthread_mutex_unlock(&bench_list_lock);
+        }
+        if (i < BENCH_BURST) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *
+bench_list_consumer(void *arg)
+{
+    bench_item_t *item;
+    uint64_t now;
+    ULONG expect;
+
+    expect = 0;
+    while (expect < BENCH_ITEMS) {
+        pthread_mutex_lock(&bench_list_lock);
+        if (IsListEmpty(&bench_list)) {
+            pthread_mutex_unlock(&bench_list_lock);
+            sched_yield();
+            continue;
+        }
+        now = bench_now();
+        while (!IsListEmpty(&bench_list)) {
+            item = (bench_item_t *)RemoveHeadList(&bench_list);
+            bench_consume(item, expect, now);
+            expect++;
+        }
+        bench_list_cons = expect;
+        pthread_mutex_unlock(&bench_list_lock);
+    }
+    return NULL;
+}
+
+static void
+bench_run(const char *name,
+          void *(*producer)(void *),
+          void *(*consumer)(void *))
+{
+    pthread_t prod;
+    pthread_t cons;
+    uint64_t start;
+
+    memset(&bench_res, 0, sizeof(bench_res));
+    start = bench_now();
+    CHECK(pthread_create(&cons, NULL, consumer, NULL) == 0);
+    CHECK(pthread_create(&prod, NULL, producer, NULL) == 0);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+    bench_res.elapsed_ns = bench_now() - start;
+
+    CHECK(!bench_res.out_of_order);
+    CHECK(bench_res.elapsed_ns != 0);
+
+    printf("spsc_bench: %-4s %u items, %.1f Mitems/s, "
+           "latency avg %llu ns max %llu ns\n",
+           name, BENCH_ITEMS,
+           (double)BENCH_ITEMS * 1000.0 / bench_res.elapsed_ns,
+           (unsigned long long)(bench_res.lat_sum_ns / BENCH_ITEMS),
+           (unsigned long long)bench_res.lat_max_ns);
+}
+
+static void
+bench_ring(void)
+{
+    memset(&bench_xq, 0, sizeof(bench_xq));
+    bench_run("ring", bench_ring_producer, bench_ring_consumer);
+    CHECK(bench_xq.cons == BENCH_ITEMS);
+}
+
+static void
+bench_lock_list(void)
+{
+    InitializeListHead(&bench_list);
+    pthread_mutex_init(&bench_list_lock, NULL);
+    bench_list_cons = 0;
+    bench_run("list", bench_list_producer, bench_list_consumer);
+    pthread_mutex_destroy(&bench_list_lock);
+    CHECK(IsListEmpty(&bench_list));
+    CHECK(bench_list_cons == BENCH_ITEMS);
+}
+
+int
+main(void)
+{
+    ULONG i;
+
+    bench_items = calloc(BENCH_ITEMS, sizeof(*bench_items));
+    if (bench_items == NULL) {
+        printf("spsc_bench: out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < BENCH_ITEMS; i++) {
+        bench_items[i].seq = i;
+    }
+
+    bench_ring();
+    bench_lock_list();
+    free(bench_items);
+
+    if (test_failures) {
+        printf("spsc_bench: %u failure(s)\n", test_failures);
+        return 1;
+    }
+    printf("spsc_bench: passed\n");
+    return 0;
+}
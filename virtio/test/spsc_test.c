@@ -0,0 +1,185 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host side test of the receive queue hand-off ring.  One thread produces
+ * in bursts and publishes them, as a path's ring drain does, while another
+ * drains, as the receive queue's DPC does.  Entries must arrive once each
+ * and in order, including across the wrap of the 32 bit indexes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <ntddk.h>
+#include <win_stdint.h>
+#include <mp_rcv_xq.h>
+
+#define TEST_ITEMS      2000000
+#define TEST_BURST_MAX  48
+
+#define CHECK(_cond)                                                    \
+do {                                                                    \
+    if (!(_cond)) {                                                     \
+        printf("%s:%d: %s: CHECK(%s) failed\n",                         \
+               __FILE__, __LINE__, __func__, #_cond);                   \
+        test_failures++;                                                \
+        return;                                                         \
+    }                                                                   \
+} while (0)
+
+#define TEST_ITEM(_seq) ((struct _RCB *)(uintptr_t)((_seq) + 1))
+#define TEST_SEQ(_rcb) ((ULONG)((uintptr_t)(_rcb) - 1))
+
+static unsigned int test_failures;
+
+static rcv_xq_ring_t test_xq;
+static volatile BOOLEAN test_consumer_failed;
+
+static uint32_t
+test_rand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+static void
+test_xq_init(ULONG start)
+{
+    memset(&test_xq, 0, sizeof(test_xq));
+    test_xq.prod_pvt = start;
+    test_xq.prod = start;
+    test_xq.cons = start;
+}
+
+/* Fill, publish and drain on one thread, across the index wrap. */
+static void
+test_single(void)
+{
+    ULONG seq;
+    ULONG i;
+
+    test_xq_init(0xffffffff - VNIF_RCV_XQ_RING_SIZE / 2);
+
+    for (i = 0; i < VNIF_RCV_XQ_RING_SIZE; i++) {
+        CHECK(vnif_rcv_xq_put(&test_xq, TEST_ITEM(i)));
+    }
+    CHECK(!vnif_rcv_xq_put(&test_xq, TEST_ITEM(i)));
+
+    /* Nothing is visible until it is published. */
+    CHECK(vnif_rcv_xq_avail(&test_xq) == 0);
+    CHECK(vnif_rcv_xq_publish(&test_xq) == VNIF_RCV_XQ_RING_SIZE);
+    CHECK(vnif_rcv_xq_publish(&test_xq) == 0);
+    CHECK(vnif_rcv_xq_avail(&test_xq) == VNIF_RCV_XQ_RING_SIZE);
+
+    for (i = 0; i < 10; i++) {
+        CHECK(TEST_SEQ(vnif_rcv_xq_entry(&test_xq, i)) == i);
+    }
+    vnif_rcv_xq_release(&test_xq, 10);
+    CHECK(vnif_rcv_xq_avail(&test_xq) == VNIF_RCV_XQ_RING_SIZE - 10);
+
+    /* The released slots are reusable, the rest still are not. */
+    for (seq = VNIF_RCV_XQ_RING_SIZE; seq < VNIF_RCV_XQ_RING_SIZE + 10; seq++) {
+        CHECK(vnif_rcv_xq_put(&test_xq, TEST_ITEM(seq)));
+    }
+    CHECK(!vnif_rcv_xq_put(&test_xq, TEST_ITEM(seq)));
+    CHECK(vnif_rcv_xq_publish(&test_xq) == 10);
+
+    for (seq = 10; seq < VNIF_RCV_XQ_RING_SIZE + 10; seq++) {
+        CHECK(vnif_rcv_xq_avail(&test_xq) != 0);
+        CHECK(TEST_SEQ(vnif_rcv_xq_entry(&test_xq, 0)) == seq);
+        vnif_rcv_xq_release(&test_xq, 1);
+    }
+    CHECK(vnif_rcv_xq_avail(&test_xq) == 0);
+    CHECK(test_xq.cons < VNIF_RCV_XQ_RING_SIZE);
+}
+
+static void *
+test_producer(void *arg)
+{
+    uint32_t seed;
+    ULONG seq;
+    UINT burst;
+    UINT i;
+
+    seed = 1;
+    seq = 0;
+    while (seq < TEST_ITEMS && !test_consumer_failed) {
+        burst = 1 + test_rand(&seed) % TEST_BURST_MAX;
+        for (i = 0; i < burst && seq < TEST_ITEMS; i++) {
+            if (!vnif_rcv_xq_put(&test_xq, TEST_ITEM(seq))) {
+                /* The driver stages these under the target's lock. */
+                break;
+            }
+            seq++;
+        }
+        vnif_rcv_xq_publish(&test_xq);
+        if (i < burst) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *
+test_consumer(void *arg)
+{
+    ULONG expect;
+    ULONG avail;
+    ULONG i;
+
+    expect = 0;
+    while (expect < TEST_ITEMS) {
+        avail = vnif_rcv_xq_avail(&test_xq);
+        if (avail == 0) {
+            sched_yield();
+            continue;
+        }
+        if (avail > VNIF_RCV_XQ_RING_SIZE) {
+            test_consumer_failed = TRUE;
+            break;
+        }
+        for (i = 0; i < avail; i++) {
+            if (TEST_SEQ(vnif_rcv_xq_entry(&test_xq, i)) != expect + i) {
+                test_consumer_failed = TRUE;
+                return NULL;
+            }
+        }
+        vnif_rcv_xq_release(&test_xq, avail);
+        expect += avail;
+    }
+    return NULL;
+}
+
+static void
+test_threads(void)
+{
+    pthread_t prod;
+    pthread_t cons;
+
+    /* Start close to the wrap so it is crossed early on. */
+    test_xq_init(0xffffffff - 1000);
+    test_consumer_failed = FALSE;
+    CHECK(pthread_create(&cons, NULL, test_consumer, NULL) == 0);
+    CHECK(pthread_create(&prod, NULL, test_producer, NULL) == 0);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+
+    CHECK(!test_consumer_failed);
+    CHECK(test_xq.prod == test_xq.cons);
+    CHECK(test_xq.prod == (ULONG)(0xffffffff - 1000 + TEST_ITEMS));
+}
+
+int
+main(void)
+{
+    test_single();
+    test_threads();
+
+    if (test_failures) {
+        printf("spsc_test: %u failure(s)\n", test_failures);
+        return 1;
+    }
+    printf("spsc_test: passed\n");
+    return 0;
+}
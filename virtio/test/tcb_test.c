@@ -0,0 +1,266 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host side test of the per path free TCB list.  Senders take chains of
+ * TCBs the way large sends do and a completion thread returns them, all
+ * under the path lock as in the driver, while tcb_free_cnt is checked
+ * against the list.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <ntddk.h>
+#include <win_stdint.h>
+#include <mp_tcb.h>
+
+#define TEST_NUM_TCB        256
+#define TEST_MAX_CHAIN      17      /* 64 KB send in 4 KB pages + header */
+#define TEST_SENDERS        4
+#define TEST_SENDS          50000
+
+#define CHECK(_cond)                                                    \
+do {                                                                    \
+    if (!(_cond)) {                                                     \
+        printf("%s:%d: %s: CHECK(%s) failed\n",                         \
+               __FILE__, __LINE__, __func__, #_cond);                   \
+        test_failures++;                                                \
+        return;                                                         \
+    }                                                                   \
+} while (0)
+
+typedef struct _TCB {
+    LIST_ENTRY list;
+    struct _TCB *next;
+} TCB;
+
+typedef struct test_path_s {
+    pthread_mutex_t tx_path_lock;
+    LIST_ENTRY tcb_free_list;
+    UINT tcb_free_cnt;
+    TCB *pending;               /* Sent chains waiting to complete. */
+    uint64_t sends;
+    uint64_t tcb_shortages;
+    BOOLEAN done;
+} test_path_t;
+
+static unsigned int test_failures;
+
+static TCB test_tcbs[TEST_NUM_TCB];
+
+static uint32_t
+test_rand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+static UINT
+test_list_len(LIST_ENTRY *head)
+{
+    LIST_ENTRY *e;
+    UINT n;
+
+    n = 0;
+    for (e = head->Flink; e != head; e = e->Flink) {
+        n++;
+    }
+    return n;
+}
+
+static void
+test_path_init(test_path_t *path)
+{
+    UINT i;
+
+    memset(path, 0, sizeof(*path));
+    pthread_mutex_init(&path->tx_path_lock, NULL);
+    InitializeListHead(&path->tcb_free_list);
+    for (i = 0; i < TEST_NUM_TCB; i++) {
+        test_tcbs[i].next = NULL;
+        VNIF_PUT_FREE_TCB(path, &test_tcbs[i]);
+    }
+}
+
+/* Return every chain on the pending list, as VNIFCheckSendCompletion does. */
+static void
+test_complete(test_path_t *path)
+{
+    TCB *chain;
+    TCB *tcb;
+
+    while (path->pending) {
+        chain = path->pending;
+        path->pending = chain->next;
+        while (chain) {
+            tcb = chain;
+            chain = (TCB *)tcb->list.Flink;
+            VNIF_PUT_FREE_TCB(path, tcb);
+        }
+    }
+}
+
+static void
+test_single(void)
+{
+    test_path_t path;
+    TCB *held[TEST_NUM_TCB];
+    TCB *tcb;
+    uint32_t seed;
+    UINT nheld;
+    UINT round;
+
+    test_path_init(&path);
+    CHECK(path.tcb_free_cnt == TEST_NUM_TCB);
+
+    seed = 1;
+    nheld = 0;
+    for (round = 0; round < 100000; round++) {
+        if (test_rand(&seed) & 1) {
+            VNIF_GET_FREE_TCB(&path, tcb);
+            if (nheld == TEST_NUM_TCB) {
+                CHECK(tcb == NULL);
+                CHECK(path.tcb_free_cnt == 0);
+            } else {
+                CHECK(tcb != NULL);
+                held[nheld++] = tcb;
+            }
+        } else if (nheld) {
+            VNIF_PUT_FREE_TCB(&path, held[--nheld]);
+        }
+        CHECK(path.tcb_free_cnt == TEST_NUM_TCB - nheld);
+    }
+    CHECK(test_list_len(&path.tcb_free_list) == path.tcb_free_cnt);
+    pthread_mutex_destroy(&path.tx_path_lock);
+}
+
+/*
+ * A large send checks tcb_free_cnt for the whole chain up front, as
+ * VNIFSendNetBufferList does, so taking the chain must never come up short.
+ */
+static void *
+test_sender(void *arg)
+{
+    test_path_t *path;
+    TCB *head;
+    TCB *tail;
+    TCB *tcb;
+    uint32_t seed;
+    UINT needed;
+    UINT sends;
+    UINT i;
+
+    path = arg;
+    seed = (uint32_t)(uintptr_t)&seed;
+    for (sends = 0; sends < TEST_SENDS; sends++) {
+        needed = 1 + test_rand(&seed) % TEST_MAX_CHAIN;
+        pthread_mutex_lock(&path->tx_path_lock);
+        while (needed > path->tcb_free_cnt) {
+            /* The driver queues the send until completions free TCBs. */
+            path->tcb_shortages++;
+            pthread_mutex_unlock(&path->tx_path_lock);
+            sched_yield();
+            pthread_mutex_lock(&path->tx_path_lock);
+        }
+        head = NULL;
+        tail = NULL;
+        for (i = 0; i < needed; i++) {
+            VNIF_GET_FREE_TCB(path, tcb);
+            if (tcb == NULL) {
+                break;
+            }
+            tcb->list.Flink = NULL;
+            if (tail) {
+                tail->list.Flink = &tcb->list;
+            } else {
+                head = tcb;
+            }
+            tail = tcb;
+        }
+        if (i == needed) {
+            head->next = path->pending;
+            path->pending = head;
+            path->sends++;
+        } else {
+            path->done = TRUE;      /* Flags the failure to the checker. */
+        }
+        pthread_mutex_unlock(&path->tx_path_lock);
+    }
+    return NULL;
+}
+
+static void *
+test_completer(void *arg)
+{
+    test_path_t *path;
+    BOOLEAN done;
+
+    path = arg;
+    do {
+        pthread_mutex_lock(&path->tx_path_lock);
+        test_complete(path);
+        done = path->done;
+        pthread_mutex_unlock(&path->tx_path_lock);
+        sched_yield();
+    } while (!done);
+    return NULL;
+}
+
+static void
+test_stress(void)
+{
+    test_path_t path;
+    pthread_t senders[TEST_SENDERS];
+    pthread_t completer;
+    struct timespec t0;
+    struct timespec t1;
+    BOOLEAN failed;
+    double ns;
+    UINT i;
+
+    test_path_init(&path);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    CHECK(pthread_create(&completer, NULL, test_completer, &path) == 0);
+    for (i = 0; i < TEST_SENDERS; i++) {
+        CHECK(pthread_create(&senders[i], NULL, test_sender, &path) == 0);
+    }
+    for (i = 0; i < TEST_SENDERS; i++) {
+        pthread_join(senders[i], NULL);
+    }
+
+    pthread_mutex_lock(&path.tx_path_lock);
+    failed = path.done;
+    path.done = TRUE;
+    pthread_mutex_unlock(&path.tx_path_lock);
+    pthread_join(completer, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    CHECK(!failed);
+    test_complete(&path);
+    CHECK(path.tcb_free_cnt == TEST_NUM_TCB);
+    CHECK(test_list_len(&path.tcb_free_list) == TEST_NUM_TCB);
+    CHECK(path.sends == (uint64_t)TEST_SENDERS * TEST_SENDS);
+
+    ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    printf("tcb_test: %d senders, %llu sends, %llu shortages, %.0f ns/send\n",
+           TEST_SENDERS, (unsigned long long)path.sends,
+           (unsigned long long)path.tcb_shortages,
+           ns / ((double)TEST_SENDERS * TEST_SENDS));
+    pthread_mutex_destroy(&path.tx_path_lock);
+}
+
+int
+main(void)
+{
+    test_single();
+    test_stress();
+
+    if (test_failures) {
+        printf("tcb_test: %u failure(s)\n", test_failures);
+        return 1;
+    }
+    printf("tcb_test: passed\n");
+    return 0;
+}
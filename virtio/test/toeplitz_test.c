@@ -0,0 +1,244 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host side test of the table driven Toeplitz hash used for RSS.  It is
+ * checked against the Microsoft RSS verification vectors and against a bit
+ * at a time reference for random keys and split inputs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ntddk.h>
+#include <win_stdint.h>
+#include <mp_toeplitz.h>
+
+#define TEST_KEY_MAX    40
+#define TEST_INPUT_MAX  36
+
+#define CHECK(_cond)                                                    \
+do {                                                                    \
+    if (!(_cond)) {                                                     \
+        printf("%s:%d: %s: CHECK(%s) failed\n",                         \
+               __FILE__, __LINE__, __func__, #_cond);                   \
+        test_failures++;                                                \
+        return;                                                         \
+    }                                                                   \
+} while (0)
+
+static unsigned int test_failures;
+
+static ULONG test_tbl[TEST_KEY_MAX - 4][256];
+
+/* Default key of the Microsoft RSS verification suite. */
+static const uint8_t test_ms_key[TEST_KEY_MAX] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+typedef struct test_ipv4_vector_s {
+    uint8_t dst[4];
+    uint16_t dst_port;
+    uint8_t src[4];
+    uint16_t src_port;
+    uint32_t hash_ip;
+    uint32_t hash_tcp;
+} test_ipv4_vector_t;
+
+typedef struct test_ipv6_vector_s {
+    uint8_t dst[16];
+    uint16_t dst_port;
+    uint8_t src[16];
+    uint16_t src_port;
+    uint32_t hash_ip;
+    uint32_t hash_tcp;
+} test_ipv6_vector_t;
+
+static const test_ipv4_vector_t test_ipv4_vectors[] = {
+    {{161, 142, 100, 80}, 1766, {66, 9, 149, 187}, 2794,
+     0x323e8fc2, 0x51ccc178},
+    {{65, 69, 140, 83}, 4739, {199, 92, 111, 2}, 14230,
+     0xd718262a, 0xc626b0ea},
+    {{12, 22, 207, 184}, 38024, {24, 19, 198, 95}, 12898,
+     0xd2d0a5de, 0x5c2b394a},
+    {{209, 142, 163, 6}, 2217, {38, 27, 205, 30}, 48228,
+     0x82989176, 0xafc7327f},
+    {{202, 188, 127, 2}, 1303, {153, 39, 163, 191}, 44251,
+     0x5d1809c5, 0x10e828a2},
+};
+
+static const test_ipv6_vector_t test_ipv6_vectors[] = {
+    /* 3ffe:2501:200:3::1 <- 3ffe:2501:200:1fff::7 */
+    {{0x3f, 0xfe, 0x25, 0x01, 0x02, 0x00, 0x00, 0x03,
+      0, 0, 0, 0, 0, 0, 0, 0x01}, 1766,
+     {0x3f, 0xfe, 0x25, 0x01, 0x02, 0x00, 0x1f, 0xff,
+      0, 0, 0, 0, 0, 0, 0, 0x07}, 2794,
+     0x2cc18cd5, 0x40207d3d},
+    /* ff02::1 <- 3ffe:501:8::260:97ff:fe40:efab */
+    {{0xff, 0x02, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0x01}, 4739,
+     {0x3f, 0xfe, 0x05, 0x01, 0x00, 0x08, 0x00, 0x00,
+      0x02, 0x60, 0x97, 0xff, 0xfe, 0x40, 0xef, 0xab}, 14230,
+     0x0f0c461c, 0xdde51bbf},
+    /* fe80::200:f8ff:fe21:67cf <- 3ffe:1900:4545:3:200:f8ff:fe21:67cf */
+    {{0xfe, 0x80, 0, 0, 0, 0, 0, 0,
+      0x02, 0x00, 0xf8, 0xff, 0xfe, 0x21, 0x67, 0xcf}, 38024,
+     {0x3f, 0xfe, 0x19, 0x00, 0x45, 0x45, 0x00, 0x03,
+      0x02, 0x00, 0xf8, 0xff, 0xfe, 0x21, 0x67, 0xcf}, 44251,
+     0x4b61e985, 0x02d1feef},
+};
+
+static uint32_t
+test_rand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+/* The per bit hash the table replaced. */
+static uint32_t
+test_ref_hash(const uint8_t *key, const uint8_t *data, UINT len)
+{
+    uint32_t key_word;
+    uint32_t res;
+    UINT byte;
+    UINT bit;
+
+    res = 0;
+    key_word = ((uint32_t)key[0] << 24) | ((uint32_t)key[1] << 16)
+        | ((uint32_t)key[2] << 8) | key[3];
+    for (byte = 0; byte < len; byte++) {
+        for (bit = 0; bit <= TOEPLITZ_MAX_BIT_NUM; bit++) {
+            if (data[byte] & (1 << (TOEPLITZ_MAX_BIT_NUM - bit))) {
+                res ^= key_word;
+            }
+            key_word = (key_word << 1)
+                | ((key[byte + 4] >> (TOEPLITZ_MAX_BIT_NUM - bit)) & 1);
+        }
+    }
+    return res;
+}
+
+/* Hash the input in pieces the way the sg list of a packet is hashed. */
+static uint32_t
+test_hash(UINT tbl_sz, const uint8_t *data, UINT len, UINT chunk)
+{
+    uint32_t res;
+    UINT pos;
+    UINT n;
+
+    res = 0;
+    for (pos = 0; pos < len; pos += n) {
+        n = len - pos < chunk ? len - pos : chunk;
+        res = vnif_toeplitz_hash(test_tbl, tbl_sz, pos, data + pos, n, res);
+    }
+    return res;
+}
+
+static UINT
+test_put(uint8_t *buf, UINT off, const void *data, UINT len)
+{
+    memcpy(buf + off, data, len);
+    return off + len;
+}
+
+static UINT
+test_put_port(uint8_t *buf, UINT off, uint16_t port)
+{
+    buf[off] = (uint8_t)(port >> 8);
+    buf[off + 1] = (uint8_t)port;
+    return off + 2;
+}
+
+static void
+test_ms_vectors(void)
+{
+    const test_ipv4_vector_t *v4;
+    const test_ipv6_vector_t *v6;
+    uint8_t in[TEST_INPUT_MAX];
+    UINT tbl_sz;
+    UINT off;
+    UINT i;
+
+    tbl_sz = vnif_toeplitz_build_tbl(test_ms_key, sizeof(test_ms_key),
+                                     test_tbl);
+    CHECK(tbl_sz == TEST_KEY_MAX - 4);
+
+    /* Input order is source address, destination address, ports. */
+    for (i = 0; i < sizeof(test_ipv4_vectors) / sizeof(*v4); i++) {
+        v4 = &test_ipv4_vectors[i];
+        off = test_put(in, 0, v4->src, 4);
+        off = test_put(in, off, v4->dst, 4);
+        CHECK(test_hash(tbl_sz, in, off, off) == v4->hash_ip);
+        off = test_put_port(in, off, v4->src_port);
+        off = test_put_port(in, off, v4->dst_port);
+        CHECK(test_hash(tbl_sz, in, off, off) == v4->hash_tcp);
+        CHECK(test_hash(tbl_sz, in, off, 4) == v4->hash_tcp);
+    }
+
+    for (i = 0; i < sizeof(test_ipv6_vectors) / sizeof(*v6); i++) {
+        v6 = &test_ipv6_vectors[i];
+        off = test_put(in, 0, v6->src, 16);
+        off = test_put(in, off, v6->dst, 16);
+        CHECK(test_hash(tbl_sz, in, off, off) == v6->hash_ip);
+        off = test_put_port(in, off, v6->src_port);
+        off = test_put_port(in, off, v6->dst_port);
+        CHECK(off == TEST_INPUT_MAX);
+        CHECK(test_hash(tbl_sz, in, off, off) == v6->hash_tcp);
+        CHECK(test_hash(tbl_sz, in, off, 16) == v6->hash_tcp);
+    }
+}
+
+static void
+test_random_keys(void)
+{
+    uint8_t key[TEST_KEY_MAX];
+    uint8_t in[TEST_KEY_MAX + 8];
+    uint32_t seed;
+    UINT key_sz;
+    UINT tbl_sz;
+    UINT len;
+    UINT round;
+    UINT i;
+
+    seed = 1;
+    for (round = 0; round < 2000; round++) {
+        key_sz = 5 + test_rand(&seed) % (TEST_KEY_MAX - 4);
+        for (i = 0; i < key_sz; i++) {
+            key[i] = (uint8_t)test_rand(&seed);
+        }
+        tbl_sz = vnif_toeplitz_build_tbl(key, key_sz, test_tbl);
+        CHECK(tbl_sz == key_sz - 4);
+
+        len = test_rand(&seed) % (tbl_sz + 1);
+        for (i = 0; i < sizeof(in); i++) {
+            in[i] = (uint8_t)test_rand(&seed);
+        }
+        CHECK(test_hash(tbl_sz, in, len, 1 + test_rand(&seed) % 8)
+              == test_ref_hash(key, in, len));
+
+        /* Input past the key does not contribute. */
+        CHECK(test_hash(tbl_sz, in, tbl_sz + 8, 3)
+              == test_ref_hash(key, in, tbl_sz));
+    }
+
+    CHECK(vnif_toeplitz_build_tbl(key, 4, test_tbl) == 0);
+    CHECK(test_hash(0, in, 8, 8) == 0);
+}
+
+int
+main(void)
+{
+    test_ms_vectors();
+    test_random_keys();
+
+    if (test_failures) {
+        printf("toeplitz_test: %u failure(s)\n", test_failures);
+        return 1;
+    }
+    printf("toeplitz_test: passed\n");
+    return 0;
+}
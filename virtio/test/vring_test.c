@@ -0,0 +1,756 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host side test of virtio_ring.c.  A simulated in-order device consumes
+ * what the driver side makes available, for both the split and the packed
+ * layouts, and the results of the two are compared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ntddk.h>
+#include <win_stdint.h>
+#include <virtio_dbg_print.h>
+#include <virtio_config.h>
+#include <virtio_pci.h>
+
+#define TEST_ALIGN          SMP_CACHE_BYTES
+#define TEST_INDIRECT_MAX   4
+#define TEST_SEQ_MAX        (1 << 20)
+
+#define CHECK(_cond)                                                    \
+do {                                                                    \
+    if (!(_cond)) {                                                     \
+        printf("%s:%d: %s: CHECK(%s) failed\n",                         \
+               __FILE__, __LINE__, __func__, #_cond);                   \
+        test_failures++;                                                \
+        return;                                                         \
+    }                                                                   \
+} while (0)
+
+unsigned int dbg_print_mask;
+static unsigned int test_failures;
+static unsigned int test_notifications;
+
+static void
+test_printk(char *_fmt, ...)
+{
+}
+
+void (*printk)(char *_fmt, ...) = test_printk;
+
+void
+virtio_iowrite16(ULONG_PTR ulRegister, uint16_t val)
+{
+    test_notifications++;
+}
+
+typedef struct test_queue_s {
+    virtio_queue_t *vq;
+    void *ring;
+    struct vring_desc (*indirect)[TEST_INDIRECT_MAX];
+
+    /* Simulated device state. */
+    uint16_t dev_avail;         /* Split: next avail ring entry to read. */
+    uint16_t dev_used;          /* Split: next used idx, packed: next desc. */
+    uint8_t dev_wrap;           /* Packed: device wrap counter. */
+    unsigned int interrupts;
+} test_queue_t;
+
+/* Same steps as the transports' queue setup. */
+static void
+test_queue_init(test_queue_t *tq, unsigned int num, BOOLEAN packed,
+    BOOLEAN use_event_idx)
+{
+    virtio_queue_t *vq;
+    unsigned int i;
+
+    memset(tq, 0, sizeof(*tq));
+    vq = calloc(1, virtio_queue_heap_size(num));
+    tq->ring = aligned_alloc(PAGE_SIZE,
+        (vring_size(num, TEST_ALIGN) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+    memset(tq->ring, 0, vring_size(num, TEST_ALIGN));
+    tq->indirect = calloc(num, sizeof(*tq->indirect));
+
+    vq->num_free = num;
+    vq->num_mask = (uint16_t)(num - 1);
+    vq->free_head = 0;
+    vq->use_event_idx = use_event_idx;
+    vq->notification_addr = tq;
+    if (packed) {
+        vring_packed_init_queue(vq, num, tq->ring, TEST_ALIGN);
+        tq->dev_wrap = 1;
+    } else {
+        vring_init(&vq->vring, num, tq->ring, TEST_ALIGN);
+        for (i = 0; i < num - 1; i++) {
+            vq->vring.desc[i].next = (uint16_t)(i + 1);
+        }
+    }
+    tq->vq = vq;
+}
+
+static void
+test_queue_free(test_queue_t *tq)
+{
+    free(tq->indirect);
+    free(tq->ring);
+    free(tq->vq);
+}
+
+/* Sum of the device writable lengths of a split chain. */
+static unsigned int
+dev_split_chain_len(virtio_queue_t *vq, uint16_t head)
+{
+    struct vring_desc *desc;
+    unsigned int i, len;
+
+    desc = vq->vring.desc;
+    len = 0;
+    if (desc[head].flags & VRING_DESC_F_INDIRECT) {
+        desc = (struct vring_desc *)(uintptr_t)vq->vring.desc[head].addr;
+        for (i = 0; i < vq->vring.desc[head].len / sizeof(*desc); i++) {
+            if (desc[i].flags & VRING_DESC_F_WRITE) {
+                len += desc[i].len;
+            }
+        }
+        return len;
+    }
+    for (i = head; ; i = desc[i].next) {
+        if (desc[i].flags & VRING_DESC_F_WRITE) {
+            len += desc[i].len;
+        }
+        if (!(desc[i].flags & VRING_DESC_F_NEXT)) {
+            break;
+        }
+    }
+    return len;
+}
+
+static unsigned int
+dev_consume_split(test_queue_t *tq, unsigned int max)
+{
+    virtio_queue_t *vq = tq->vq;
+    struct vring_used_elem *used;
+    uint16_t head, old;
+    unsigned int n;
+
+    for (n = 0; n < max && tq->dev_avail != vq->vring.avail->idx; n++) {
+        head = vq->vring.avail->ring[tq->dev_avail & vq->num_mask];
+        used = &vq->vring.used->ring[tq->dev_used & vq->num_mask];
+        used->id = head;
+        used->len = dev_split_chain_len(vq, head);
+        tq->dev_avail++;
+        tq->dev_used++;
+    }
+    if (vq->use_event_idx) {
+        vring_avail_event(&vq->vring) = tq->dev_avail;
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    old = vq->vring.used->idx;
+    vq->vring.used->idx = tq->dev_used;
+    if (vq->use_event_idx) {
+        if (vring_need_event(vring_used_event(&vq->vring), tq->dev_used, old)) {
+            tq->interrupts++;
+        }
+    } else if (!(vq->vring.avail->flags & VRING_AVAIL_F_NO_INTERRUPT)) {
+        tq->interrupts++;
+    }
+    return n;
+}
+
+/*
+ * Whether the driver wants an interrupt for the device's used index moving
+ * from old to its current position.  Packed ring positions are not free
+ * running, so this is asked for each used element rather than once for a
+ * batch that could span a whole lap.
+ */
+static BOOLEAN
+dev_packed_need_event(test_queue_t *tq, uint16_t old)
+{
+    virtio_queue_t *vq = tq->vq;
+    uint16_t off_wrap, event;
+
+    switch (vq->packed.driver->flags) {
+    case VRING_PACKED_EVENT_FLAG_ENABLE:
+        return TRUE;
+    case VRING_PACKED_EVENT_FLAG_DESC:
+        off_wrap = vq->packed.driver->off_wrap;
+        event = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+        if ((off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR) != tq->dev_wrap) {
+            event = (uint16_t)(event - vq->packed.num);
+        }
+        return vring_need_event(event, tq->dev_used, old);
+    default:
+        return FALSE;
+    }
+}
+
+static unsigned int
+dev_consume_packed(test_queue_t *tq, unsigned int max)
+{
+    virtio_queue_t *vq = tq->vq;
+    struct vring_packed_desc *desc, *table;
+    unsigned int n, i, chain, len;
+    uint16_t flags, old;
+    BOOLEAN notify;
+
+    desc = vq->packed.desc;
+    notify = FALSE;
+    for (n = 0; n < max; n++) {
+        flags = desc[tq->dev_used].flags;
+        if (!!(flags & (1 << VRING_PACKED_DESC_F_AVAIL)) != tq->dev_wrap
+                || !!(flags & (1 << VRING_PACKED_DESC_F_USED))
+                    == tq->dev_wrap) {
+            break;
+        }
+
+        len = 0;
+        chain = 1;
+        if (flags & VRING_DESC_F_INDIRECT) {
+            table = (struct vring_packed_desc *)(uintptr_t)
+                desc[tq->dev_used].addr;
+            for (i = 0; i < desc[tq->dev_used].len / sizeof(*table); i++) {
+                if (table[i].flags & VRING_DESC_F_WRITE) {
+                    len += table[i].len;
+                }
+            }
+        } else {
+            for (i = tq->dev_used; ; chain++) {
+                if (desc[i].flags & VRING_DESC_F_WRITE) {
+                    len += desc[i].len;
+                }
+                if (!(desc[i].flags & VRING_DESC_F_NEXT)) {
+                    break;
+                }
+                i = (i + 1) % vq->packed.num;
+            }
+        }
+
+        /* In order: the used element goes where the chain's head was. */
+        desc[tq->dev_used].len = len;
+        desc[tq->dev_used].flags = tq->dev_wrap
+            ? VRING_PACKED_DESC_F_AVAIL_USED : 0;
+
+        old = tq->dev_used;
+        tq->dev_used = (uint16_t)(tq->dev_used + chain);
+        if (tq->dev_used >= vq->packed.num) {
+            tq->dev_used -= (uint16_t)vq->packed.num;
+            tq->dev_wrap ^= 1;
+        }
+        if (dev_packed_need_event(tq, old)) {
+            notify = TRUE;
+        }
+    }
+    if (notify) {
+        tq->interrupts++;
+    }
+    return n;
+}
+
+static unsigned int
+dev_consume(test_queue_t *tq, unsigned int max)
+{
+    if (tq->vq->packed_ring) {
+        return dev_consume_packed(tq, max);
+    }
+    return dev_consume_split(tq, max);
+}
+
+static uint32_t
+test_rand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 16) & 0x7fff;
+}
+
+typedef struct test_log_s {
+    uint32_t *seq;
+    uint32_t *len;
+    unsigned int count;
+    uint32_t submitted;
+    uint32_t *expect_len;
+} test_log_t;
+
+static void
+test_log_init(test_log_t *log)
+{
+    log->seq = calloc(TEST_SEQ_MAX, sizeof(uint32_t));
+    log->len = calloc(TEST_SEQ_MAX, sizeof(uint32_t));
+    log->expect_len = calloc(TEST_SEQ_MAX, sizeof(uint32_t));
+    log->count = 0;
+    log->submitted = 0;
+}
+
+static void
+test_log_free(test_log_t *log)
+{
+    free(log->seq);
+    free(log->len);
+    free(log->expect_len);
+}
+
+/* Add one buffer of 0-1 out and 1-2 in segments, every 5th indirect. */
+static int
+test_add(test_queue_t *tq, test_log_t *log, uint32_t *seed, BOOLEAN batch)
+{
+    virtio_buffer_descriptor_t sg[TEST_INDIRECT_MAX];
+    struct vring_desc *table;
+    unsigned int out, in, i;
+    uint32_t seq, len;
+    int ret;
+
+    seq = log->submitted;
+    out = test_rand(seed) % 2;
+    in = 1 + test_rand(seed) % 2;
+    if (tq->vq->num_free < out + in) {
+        return -1;
+    }
+    for (i = 0, len = 0; i < out + in; i++) {
+        sg[i].phys_addr = 0x1000 * (seq + 1) + i;
+        sg[i].len = 64 + ((seq + i) % 1500);
+        if (i >= out) {
+            len += sg[i].len;
+        }
+    }
+    if (seq % 5 == 4) {
+        table = tq->indirect[seq % tq->vq->vring.num];
+        ret = batch
+            ? vring_add_buf_indirect_batch(tq->vq, sg, out, in,
+                (void *)(uintptr_t)(seq + 1), table, (uintptr_t)table)
+            : vring_add_buf_indirect(tq->vq, sg, out, in,
+                (void *)(uintptr_t)(seq + 1), table, (uintptr_t)table);
+    } else {
+        ret = batch
+            ? vring_add_buf_batch(tq->vq, sg, out, in,
+                (void *)(uintptr_t)(seq + 1))
+            : vring_add_buf(tq->vq, sg, out, in,
+                (void *)(uintptr_t)(seq + 1));
+    }
+    if (ret >= 0) {
+        log->expect_len[seq] = len;
+        log->submitted++;
+    }
+    return ret;
+}
+
+static unsigned int
+test_get_all(test_queue_t *tq, test_log_t *log)
+{
+    unsigned int len, n;
+    void *buf;
+
+    for (n = 0; (buf = vring_get_buf(tq->vq, &len)) != NULL; n++) {
+        log->seq[log->count] = (uint32_t)((uintptr_t)buf - 1);
+        log->len[log->count] = len;
+        log->count++;
+    }
+    return n;
+}
+
+/*
+ * Random adds, device consumption and completions, then a full drain.
+ * Returns with every submitted buffer completed and logged.
+ */
+static void
+test_workload(test_queue_t *tq, test_log_t *log, uint32_t seed,
+    unsigned int rounds, BOOLEAN batch)
+{
+    unsigned int r, k;
+
+    for (r = 0; r < rounds; r++) {
+        for (k = test_rand(&seed) % 4; k; k--) {
+            if (test_add(tq, log, &seed, batch) < 0) {
+                break;
+            }
+        }
+        vring_kick(tq->vq);
+        dev_consume(tq, test_rand(&seed) % 4);
+        test_get_all(tq, log);
+    }
+    while (dev_consume(tq, tq->vq->vring.num)) {
+        test_get_all(tq, log);
+    }
+}
+
+/* Every buffer comes back once, in order, with the device's length. */
+static void
+test_check_log(test_queue_t *tq, test_log_t *log)
+{
+    unsigned int i;
+
+    CHECK(log->count == log->submitted);
+    CHECK(tq->vq->num_free == tq->vq->vring.num);
+    for (i = 0; i < log->count; i++) {
+        CHECK(log->seq[i] == i);
+        CHECK(log->len[i] == log->expect_len[i]);
+    }
+}
+
+/*
+ * Drive the same workload through a split and a packed queue and require
+ * identical completions, over enough laps that the packed wrap counters
+ * flip many times.
+ */
+static void
+test_split_packed_equivalence(void)
+{
+    static const unsigned int sizes[] = {8, 16, 256};
+    test_queue_t split, packed;
+    test_log_t slog, plog;
+    unsigned int s, seed, event_idx;
+    unsigned int failures;
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (seed = 1; seed <= 3; seed++) {
+            for (event_idx = 0; event_idx < 2; event_idx++) {
+                failures = test_failures;
+                test_queue_init(&split, sizes[s], FALSE, (BOOLEAN)event_idx);
+                test_queue_init(&packed, sizes[s], TRUE, (BOOLEAN)event_idx);
+                test_log_init(&slog);
+                test_log_init(&plog);
+
+                test_workload(&split, &slog, seed, 20000, FALSE);
+                test_workload(&packed, &plog, seed, 20000, FALSE);
+                test_check_log(&split, &slog);
+                test_check_log(&packed, &plog);
+                if (test_failures == failures) {
+                    if (slog.count != plog.count
+                            || memcmp(slog.len, plog.len,
+                                slog.count * sizeof(uint32_t))) {
+                        printf("%s: num %u seed %u: split/packed differ\n",
+                               __func__, sizes[s], seed);
+                        test_failures++;
+                    }
+                }
+
+                test_log_free(&slog);
+                test_log_free(&plog);
+                test_queue_free(&split);
+                test_queue_free(&packed);
+            }
+        }
+    }
+}
+
+/*
+ * Staged buffers stay invisible to the device until published, a publish
+ * exposes the whole batch, and a batched workload completes the same as
+ * one that publishes every add.
+ */
+static void
+test_batch_publish(void)
+{
+    test_queue_t tq, ref;
+    test_log_t log, rlog;
+    uint32_t seed;
+    unsigned int packed, n, notified;
+
+    for (packed = 0; packed < 2; packed++) {
+        test_queue_init(&tq, 16, (BOOLEAN)packed, FALSE);
+        test_log_init(&log);
+
+        seed = 7;
+        for (n = 0; n < 5; n++) {
+            CHECK(test_add(&tq, &log, &seed, TRUE) >= 0);
+        }
+        CHECK(tq.vq->num_staged != 0);
+        CHECK(dev_consume(&tq, 16) == 0);
+
+        vring_publish_batch(tq.vq);
+        CHECK(tq.vq->num_staged == 0);
+        CHECK(dev_consume(&tq, 16) == 5);
+        CHECK(test_get_all(&tq, &log) == 5);
+
+        /* A kick publishes what is staged and notifies once. */
+        for (n = 0; n < 3; n++) {
+            CHECK(test_add(&tq, &log, &seed, TRUE) >= 0);
+        }
+        notified = test_notifications;
+        CHECK(vring_kick(tq.vq) == TRUE);
+        CHECK(test_notifications == notified + 1);
+        CHECK(dev_consume(&tq, 16) == 3);
+        CHECK(test_get_all(&tq, &log) == 3);
+        test_check_log(&tq, &log);
+
+        test_log_free(&log);
+        test_queue_free(&tq);
+
+        test_queue_init(&tq, 64, (BOOLEAN)packed, TRUE);
+        test_queue_init(&ref, 64, (BOOLEAN)packed, TRUE);
+        test_log_init(&log);
+        test_log_init(&rlog);
+        test_workload(&tq, &log, 11, 20000, TRUE);
+        test_workload(&ref, &rlog, 11, 20000, FALSE);
+        test_check_log(&tq, &log);
+        CHECK(log.count == rlog.count);
+        CHECK(memcmp(log.len, rlog.len, log.count * sizeof(uint32_t)) == 0);
+        test_log_free(&log);
+        test_log_free(&rlog);
+        test_queue_free(&tq);
+        test_queue_free(&ref);
+    }
+}
+
+/*
+ * The setup, producer and consumer parts of virtio_queue_t must not share
+ * a cache line, however the compiler packs the fields within each part.
+ */
+static void
+test_queue_layout(void)
+{
+    CHECK(offsetof(virtio_queue_t, num_free)
+        - offsetof(virtio_queue_t, packed_ring) >= VRING_CACHE_LINE_BYTES);
+    CHECK(offsetof(virtio_queue_t, last_used_idx)
+        - offsetof(virtio_queue_t, avail_wrap_counter)
+            >= VRING_CACHE_LINE_BYTES);
+    CHECK(offsetof(virtio_queue_t, data)
+        - offsetof(virtio_queue_t, used_wrap_counter)
+            >= VRING_CACHE_LINE_BYTES);
+}
+
+/* Run a small split ring until the 16 bit avail and used indexes wrap. */
+static void
+test_index_wrap(void)
+{
+    test_queue_t tq;
+    test_log_t log;
+    unsigned int event_idx;
+
+    for (event_idx = 0; event_idx < 2; event_idx++) {
+        test_queue_init(&tq, 8, FALSE, (BOOLEAN)event_idx);
+        test_log_init(&log);
+        test_workload(&tq, &log, 5, 100000, TRUE);
+        CHECK(log.submitted > 0x10000);
+        CHECK(tq.vq->vring.avail->idx == (uint16_t)log.submitted);
+        CHECK(tq.vq->last_used_idx == (uint16_t)log.submitted);
+        test_check_log(&tq, &log);
+        test_log_free(&log);
+        test_queue_free(&tq);
+    }
+}
+
+typedef BOOLEAN (*test_enable_fn)(virtio_queue_t *vq);
+
+/*
+ * Completions are only taken when the device interrupts or the last
+ * enable call said to poll.  Now and then the device completes everything
+ * outstanding, after which an interrupt must be pending if anything is
+ * left for the driver; otherwise it was lost.
+ */
+static void
+test_interrupt_driven(test_queue_t *tq, test_log_t *log, uint32_t seed,
+    unsigned int rounds, test_enable_fn enable)
+{
+    unsigned int r, k, seen;
+    BOOLEAN poll;
+
+    poll = !vring_enable_interrupt(tq->vq);
+    seen = tq->interrupts;
+    for (r = 0; r < rounds; r++) {
+        for (k = test_rand(&seed) % 4; k; k--) {
+            if (test_add(tq, log, &seed, TRUE) < 0) {
+                break;
+            }
+        }
+        vring_kick(tq->vq);
+
+        if (test_rand(&seed) % 8 == 0) {
+            while (dev_consume(tq, tq->vq->vring.num)) {
+                ;
+            }
+            CHECK(!VRING_HAS_UNCONSUMED_RESPONSES(tq->vq)
+                || tq->interrupts != seen || poll);
+        } else {
+            dev_consume(tq, test_rand(&seed) % 4);
+        }
+
+        if (tq->interrupts != seen || poll) {
+            seen = tq->interrupts;
+            vring_disable_interrupt(tq->vq);
+            test_get_all(tq, log);
+
+            /* The device keeps going while the driver re-arms. */
+            dev_consume(tq, test_rand(&seed) % 4);
+            poll = !enable(tq->vq);
+        }
+    }
+    while (dev_consume(tq, tq->vq->vring.num)) {
+        test_get_all(tq, log);
+    }
+    test_get_all(tq, log);
+}
+
+static BOOLEAN
+test_enable_delayed(virtio_queue_t *vq)
+{
+    return vring_enable_interrupt_delayed(vq);
+}
+
+/*
+ * With event indexes the used event belongs to the enable calls: taking
+ * completions must not move a delayed threshold, and whatever the device
+ * has done by the time it is armed, no interrupt may be lost.
+ */
+static void
+test_delayed_interrupt(void)
+{
+    test_queue_t tq;
+    test_log_t log;
+    uint32_t seed;
+    uint16_t event;
+    unsigned int packed, n, event_idx;
+
+    for (packed = 0; packed < 2; packed++) {
+        test_queue_init(&tq, 32, (BOOLEAN)packed, TRUE);
+        test_log_init(&log);
+        seed = 3;
+        for (n = 0; n < 16; n++) {
+            CHECK(test_add(&tq, &log, &seed, TRUE) >= 0);
+        }
+        vring_kick(tq.vq);
+        dev_consume(&tq, 2);
+        CHECK(test_get_all(&tq, &log) == 2);
+
+        CHECK(vring_enable_interrupt_delayed(tq.vq) == TRUE);
+        event = packed ? tq.vq->packed.driver->off_wrap
+            : vring_used_event(&tq.vq->vring);
+        dev_consume(&tq, 1);
+        CHECK(test_get_all(&tq, &log) == 1);
+        CHECK(event == (packed ? tq.vq->packed.driver->off_wrap
+            : vring_used_event(&tq.vq->vring)));
+
+        while (dev_consume(&tq, 32)) {
+            test_get_all(&tq, &log);
+        }
+        test_check_log(&tq, &log);
+        test_log_free(&log);
+        test_queue_free(&tq);
+
+        for (event_idx = 0; event_idx < 2; event_idx++) {
+            for (seed = 1; seed <= 8; seed++) {
+                test_queue_init(&tq, 16, (BOOLEAN)packed, (BOOLEAN)event_idx);
+                test_log_init(&log);
+                test_interrupt_driven(&tq, &log, seed, 20000,
+                                      test_enable_delayed);
+                test_check_log(&tq, &log);
+                test_log_free(&log);
+                test_queue_free(&tq);
+            }
+        }
+    }
+}
+
+static BOOLEAN
+test_enable_after_4(virtio_queue_t *vq)
+{
+    return vring_enable_interrupt_after(vq, 4);
+}
+
+static BOOLEAN
+test_enable_after_8(virtio_queue_t *vq)
+{
+    return vring_enable_interrupt_after(vq, 8);
+}
+
+/*
+ * Arm for a random number of buffers with the device idle, then have it
+ * use one buffer at a time.  The interrupt must come with the threshold'th
+ * buffer, or the last outstanding one if there are fewer, and not before.
+ * Completions taken on the way must not move the threshold.
+ */
+static void
+test_after_once(test_queue_t *tq, test_log_t *log, uint32_t *seed)
+{
+    unsigned int k, outstanding, bufs, expect, base, i;
+
+    for (k = test_rand(seed) % 7; k; k--) {
+        if (test_add(tq, log, seed, TRUE) < 0) {
+            break;
+        }
+    }
+    vring_kick(tq->vq);
+
+    vring_disable_interrupt(tq->vq);
+    test_get_all(tq, log);
+    outstanding = log->submitted - log->count;
+    bufs = 2 + test_rand(seed) % 8;
+    expect = bufs < outstanding ? bufs : outstanding;
+    CHECK(vring_enable_interrupt_after(tq->vq, (uint16_t)bufs) == TRUE);
+
+    base = tq->interrupts;
+    for (i = 1; i <= expect; i++) {
+        CHECK(dev_consume(tq, 1) == 1);
+        CHECK(tq->interrupts == base + (i == expect));
+        CHECK(test_get_all(tq, log) == 1);
+    }
+
+    /* Leave the device part way through the rest. */
+    dev_consume(tq, test_rand(seed) % 3);
+}
+
+/*
+ * vring_enable_interrupt_after() thresholds, on a packed ring across many
+ * laps and on a split ring across the 16 bit index wrap.  Then the same
+ * lost interrupt check as for the delayed enable.
+ */
+static void
+test_interrupt_after(void)
+{
+    test_queue_t tq;
+    test_log_t log;
+    uint32_t seed;
+    unsigned int packed, n, event_idx;
+
+    for (packed = 0; packed < 2; packed++) {
+        test_queue_init(&tq, 16, (BOOLEAN)packed, TRUE);
+        test_log_init(&log);
+        seed = 7;
+        for (n = 0; n < 30000; n++) {
+            test_after_once(&tq, &log, &seed);
+            if (test_failures) {
+                break;
+            }
+        }
+        while (dev_consume(&tq, 16)) {
+            test_get_all(&tq, &log);
+        }
+        test_get_all(&tq, &log);
+        CHECK(log.submitted > 0x10000);
+        test_check_log(&tq, &log);
+        test_log_free(&log);
+        test_queue_free(&tq);
+
+        for (event_idx = 0; event_idx < 2; event_idx++) {
+            for (seed = 1; seed <= 4; seed++) {
+                test_queue_init(&tq, 16, (BOOLEAN)packed, (BOOLEAN)event_idx);
+                test_log_init(&log);
+                test_interrupt_driven(&tq, &log, seed, 20000,
+                    seed & 1 ? test_enable_after_4 : test_enable_after_8);
+                test_check_log(&tq, &log);
+                test_log_free(&log);
+                test_queue_free(&tq);
+            }
+        }
+    }
+}
+
+int
+main(void)
+{
+    test_split_packed_equivalence();
+    test_batch_publish();
+    test_queue_layout();
+    test_index_wrap();
+    test_delayed_interrupt();
+    test_interrupt_after();
+
+    if (test_failures) {
+        printf("vring_test: %u failure(s)\n", test_failures);
+        return 1;
+    }
+    printf("vring_test: passed\n");
+    return 0;
+}
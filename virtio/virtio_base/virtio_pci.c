@@ -138,6 +138,19 @@ virtio_device_set_guest_feature_list(virtio_device_t *vdev, uint64_t list)
     return status;
 }
 
+/*
+ * Packed rings are opt-in.  A driver that wants them calls this after
+ * virtio_device_init() and before any queue is set up.
+ */
+void
+virtio_device_use_packed_ring(virtio_device_t *vdev, BOOLEAN enable)
+{
+    vdev->packed_ring = enable
+        && virtio_device_has_host_feature(vdev, VIRTIO_F_RING_PACKED);
+    RPRINTK(DPRTL_ON, ("%s %s: packed ring %d\n",
+                       vdev->drv_name, __func__, vdev->packed_ring));
+}
+
 void
 virtio_device_reset_features(virtio_device_t *vdev)
 {
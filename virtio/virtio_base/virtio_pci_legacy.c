@@ -239,6 +239,7 @@ virtio_dev_legacy_vq_setup(virtio_device_t *vdev, uint16_t qidx,
     vq->qidx = qidx;
     vq->port = (uint32_t)vdev->addr;
     vq->num_free = num;
+    vq->num_mask = (uint16_t)(num - 1);
     vq->free_head = 0;
     vq->use_event_idx = use_event_idx;
 
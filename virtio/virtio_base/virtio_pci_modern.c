@@ -257,6 +257,11 @@ virtio_dev_modern_set_features(virtio_device_t *vdev, u64 features)
     /* Give virtio_ring a chance to accept features. */
     vring_transport_features(&features);
 
+    /* The queue layout was chosen at init, keep the device in agreement. */
+    if (features && vdev->packed_ring) {
+        virtio_feature_enable(features, VIRTIO_F_RING_PACKED);
+    }
+
     if (features && !virtio_is_feature_enabled(features, VIRTIO_F_VERSION_1)) {
         PRINTK(("%s: modern interface missing VIRTIO_F_VERSION_1 %llx\n",
                 vdev->drv_name, features));
@@ -332,18 +337,47 @@ virtio_dev_modern_query_vq_alloc(virtio_device_t *vdev,
         *pring_size = vring_size(num, SMP_CACHE_BYTES);
     }
     if (pheap_size != NULL) {
-        *pheap_size = sizeof(void *) * num + sizeof(virtio_queue_t);
+        *pheap_size = virtio_queue_heap_size(num);
     }
 
     return STATUS_SUCCESS;
 }
 
+/*
+ * For a packed ring the avail and used addresses are the driver and device
+ * event suppression areas.
+ */
+static void
+virtio_dev_modern_write_vq_addrs(volatile virtio_pci_common_cfg_t *cfg,
+                                 virtio_queue_t *vq)
+{
+    PHYSICAL_ADDRESS pa;
+
+    RPRINTK(DPRTL_PCI, ("\twrite vring_mem\n"));
+    pa = MmGetPhysicalAddress(vq->packed_ring ?
+        (void *)vq->packed.desc : (void *)vq->vring.desc);
+    VIRTIO_IOWRITE64_LOHI(pa.QuadPart,
+                          &cfg->queue_desc_lo,
+                          &cfg->queue_desc_hi);
+    RPRINTK(DPRTL_PCI, ("\twrite avail\n"));
+    pa = MmGetPhysicalAddress(vq->packed_ring ?
+        (void *)vq->packed.driver : (void *)vq->vring.avail);
+    VIRTIO_IOWRITE64_LOHI(pa.QuadPart,
+                          &cfg->queue_avail_lo,
+                          &cfg->queue_avail_hi);
+    RPRINTK(DPRTL_PCI, ("\twrite used\n"));
+    pa = MmGetPhysicalAddress(vq->packed_ring ?
+        (void *)vq->packed.device : (void *)vq->vring.used);
+    VIRTIO_IOWRITE64_LOHI(pa.QuadPart,
+                          &cfg->queue_used_lo,
+                          &cfg->queue_used_hi);
+}
+
 static NTSTATUS
 virtio_dev_modern_vq_activate(virtio_device_t *vdev,
                               virtio_queue_t *vq,
                               uint16_t msi_vector)
 {
-    PHYSICAL_ADDRESS pa;
     volatile virtio_pci_common_cfg_t *cfg;
     uint16_t num;
 
@@ -355,21 +389,7 @@ virtio_dev_modern_vq_activate(virtio_device_t *vdev,
                         cfg->queue_size, num));
     virtio_iowrite16((ULONG_PTR)&cfg->queue_size, num);
 
-    RPRINTK(DPRTL_PCI, ("\twrite vring_mem\n"));
-    pa = MmGetPhysicalAddress(vq->vring.desc);
-    VIRTIO_IOWRITE64_LOHI(pa.QuadPart,
-                          &cfg->queue_desc_lo,
-                          &cfg->queue_desc_hi);
-    RPRINTK(DPRTL_PCI, ("\twrite avail\n"));
-    pa = MmGetPhysicalAddress(vq->vring.avail);
-    VIRTIO_IOWRITE64_LOHI(pa.QuadPart,
-                          &cfg->queue_avail_lo,
-                          &cfg->queue_avail_hi);
-    RPRINTK(DPRTL_PCI, ("\twrite used\n"));
-    pa = MmGetPhysicalAddress(vq->vring.used);
-    VIRTIO_IOWRITE64_LOHI(pa.QuadPart,
-                          &cfg->queue_used_lo,
-                          &cfg->queue_used_hi);
+    virtio_dev_modern_write_vq_addrs(cfg, vq);
 
     if (msi_vector != VIRTIO_MSI_NO_VECTOR) {
         RPRINTK(DPRTL_PCI, ("\tvirtio_dev_modern_set_queue_vector %d\n",
@@ -399,10 +419,10 @@ virtio_dev_modern_vq_setup(virtio_device_t *vdev,
                            uint16_t msi_vector,
                            BOOLEAN use_event_idx)
 {
-    PHYSICAL_ADDRESS pa;
     volatile virtio_pci_common_cfg_t *cfg = vdev->common;
     void *vq_addr;
     NTSTATUS status;
+    uint16_t max_num;
     uint16_t off;
     uint16_t i;
     BOOLEAN alloced_mem;
@@ -414,11 +434,20 @@ virtio_dev_modern_vq_setup(virtio_device_t *vdev,
     alloced_mem = FALSE;
     if (vq == NULL) {
         RPRINTK(DPRTL_PCI, ("\tneed to alloc\n"));
-        status = virtio_dev_modern_query_vq_alloc(vdev, qidx, &num, NULL, NULL);
+        status = virtio_dev_modern_query_vq_alloc(vdev, qidx, &max_num,
+                                                  NULL, NULL);
         if (!NT_SUCCESS(status)) {
             return NULL;
         }
-        vq = VIRTIO_ALLOC(sizeof(virtio_queue_t) + (sizeof(void *) * num));
+
+        /*
+         * The driver may ask for a smaller queue than the device offers.
+         * Anything else gets the device's size.
+         */
+        if (num == 0 || num > max_num || (num & (num - 1))) {
+            num = max_num;
+        }
+        vq = VIRTIO_ALLOC(virtio_queue_heap_size(num));
         if (vq == NULL) {
             return NULL;
         }
@@ -433,23 +462,29 @@ virtio_dev_modern_vq_setup(virtio_device_t *vdev,
     }
 
     RPRINTK(DPRTL_PCI, ("\tzero out vq for bytes %d\n",
-            sizeof(virtio_queue_t) + (sizeof(void *) * num)));
-    memset(vq, 0, sizeof(virtio_queue_t) + (sizeof(void *) * num));
+            virtio_queue_heap_size(num)));
+    memset(vq, 0, virtio_queue_heap_size(num));
     memset(vring_mem, 0, vring_size(num, SMP_CACHE_BYTES));
 
-    RPRINTK(DPRTL_PCI, ("\tvring_init\n"));
-    vring_init(&vq->vring, num, vring_mem, SMP_CACHE_BYTES);
-
     vq->vdev = vdev;
     vq->qidx = qidx;
     vq->port = (uint32_t)vdev->addr;
     vq->num_free = num;
+    vq->num_mask = (uint16_t)(num - 1);
     vq->free_head = 0;
     vq->use_event_idx = use_event_idx;
 
-    RPRINTK(DPRTL_PCI, ("\tinit descriptors\n"));
-    for (i = 0; i < num - 1; i++) {
-        vq->vring.desc[i].next = i + 1;
+    if (vdev->packed_ring) {
+        RPRINTK(DPRTL_PCI, ("\tvring_packed_init_queue\n"));
+        vring_packed_init_queue(vq, num, vring_mem, SMP_CACHE_BYTES);
+    } else {
+        RPRINTK(DPRTL_PCI, ("\tvring_init\n"));
+        vring_init(&vq->vring, num, vring_mem, SMP_CACHE_BYTES);
+
+        RPRINTK(DPRTL_PCI, ("\tinit descriptors\n"));
+        for (i = 0; i < num - 1; i++) {
+            vq->vring.desc[i].next = i + 1;
+        }
     }
 
     /* activate the queue */
@@ -457,21 +492,7 @@ virtio_dev_modern_vq_setup(virtio_device_t *vdev,
                         cfg->queue_size, num));
     virtio_iowrite16((ULONG_PTR)&cfg->queue_size, num);
 
-    RPRINTK(DPRTL_PCI, ("\twrite vring_mem\n"));
-    pa = MmGetPhysicalAddress(vring_mem);
-    VIRTIO_IOWRITE64_LOHI(pa.QuadPart,
-                          &cfg->queue_desc_lo,
-                          &cfg->queue_desc_hi);
-    RPRINTK(DPRTL_PCI, ("\twrite avail\n"));
-    pa = MmGetPhysicalAddress(vq->vring.avail);
-    VIRTIO_IOWRITE64_LOHI(pa.QuadPart,
-                          &cfg->queue_avail_lo,
-                          &cfg->queue_avail_hi);
-    RPRINTK(DPRTL_PCI, ("\twrite used\n"));
-    pa = MmGetPhysicalAddress(vq->vring.used);
-    VIRTIO_IOWRITE64_LOHI(pa.QuadPart,
-                          &cfg->queue_used_lo,
-                          &cfg->queue_used_hi);
+    virtio_dev_modern_write_vq_addrs(cfg, vq);
 
     do {
         RPRINTK(DPRTL_PCI, ("\tread notify offset\n"));
@@ -551,7 +572,9 @@ static void virtio_dev_modern_vq_delete(virtio_queue_t *vq, uint32_t free_mem)
     }
 
     if (free_mem && vq) {
-        if (vq->vring.desc) {
+        if (vq->packed_ring && vq->packed.desc) {
+            VIRTIO_FREE_CONTIGUOUS(vq->packed.desc);
+        } else if (vq->vring.desc) {
             VIRTIO_FREE_CONTIGUOUS(vq->vring.desc);
         }
         VIRTIO_FREE(vq);
@@ -41,8 +41,95 @@
 
 static void vring_queue_notify(virtio_queue_t *vq);
 
+static __inline void
+vring_packed_advance(virtio_queue_t *vq, uint16_t *idx, uint16_t *flags)
+{
+    if (++(*idx) >= vq->packed.num) {
+        *idx = 0;
+        *flags ^= VRING_PACKED_DESC_F_AVAIL_USED;
+        vq->avail_wrap_counter ^= 1;
+    }
+}
+
+/*
+ * The device stops at the first head it doesn't see as avail, so only the
+ * first head of a batch has its flags held back until vring_publish_batch().
+ */
+static __inline void
+vring_packed_stage_head(virtio_queue_t *vq,
+    uint16_t head,
+    uint16_t head_flags,
+    unsigned int total)
+{
+    if (vq->num_staged == 0) {
+        vq->staged_head = head;
+        vq->staged_head_flags = head_flags;
+    } else {
+        vq->packed.desc[head].flags = head_flags;
+    }
+    vq->num_staged += (uint16_t)total;
+}
+
+static int
+vring_add_buf_packed(virtio_queue_t *vq,
+    virtio_buffer_descriptor_t *sg,
+    unsigned int out,
+    unsigned int in,
+    void *data)
+{
+    struct vring_packed_desc *desc;
+    unsigned int n, total;
+    uint16_t head, i, id, flags, head_flags, avail_used_flags;
+
+    desc = vq->packed.desc;
+    total = out + in;
+    head = vq->next_avail_idx;
+    id = (uint16_t)vq->free_head;
+    avail_used_flags = vq->avail_used_flags;
+    head_flags = 0;
+
+    for (i = head, n = 0; n < total; n++, sg++) {
+        flags = avail_used_flags;
+        if (n >= out) {
+            flags |= VRING_DESC_F_WRITE;
+        }
+        if (n + 1 < total) {
+            flags |= VRING_DESC_F_NEXT;
+        }
+        desc[i].addr = sg->phys_addr;
+        desc[i].len = sg->len;
+        desc[i].id = id;
+
+        /* The head is made available last, after the whole chain is set. */
+        if (i == head) {
+            head_flags = flags;
+        } else {
+            desc[i].flags = flags;
+        }
+        vring_packed_advance(vq, &i, &avail_used_flags);
+    }
+
+    vq->num_free -= total;
+    vq->next_avail_idx = i;
+    vq->avail_used_flags = avail_used_flags;
+    vq->free_head = vq->desc_state[id].next;
+    vq->desc_state[id].num = (uint16_t)total;
+    vq->data[id] = data;
+
+    DPRINTK(DPRTL_RING, ("%s>>> ring %d, head %d, id %d, last_used %d\n",
+        __func__, vq->qidx, head, id, vq->last_used_idx));
+
+    vring_packed_stage_head(vq, head, head_flags, total);
+    return vq->num_free;
+}
+
+/*
+ * Stage a buffer without exposing it to the host.  Staged buffers are
+ * made available by vring_publish_batch(), vring_kick() or
+ * vring_kick_always() with one barrier for the whole batch.
+ */
 int
-vring_add_buf(virtio_queue_t *vq,
+vring_add_buf_batch(virtio_queue_t *vq,
     virtio_buffer_descriptor_t *sg,
     unsigned int out,
     unsigned int in,
@@ -75,11 +162,16 @@ vring_add_buf(virtio_queue_t *vq,
          * descriptors in tx ring
          */
         if (out) {
+            vring_publish_batch(vq);
             vring_queue_notify(vq);
         }
         return -1;
     }
 
+    if (vq->packed_ring) {
+        return vring_add_buf_packed(vq, sg, out, in, data);
+    }
+
     /* We're about to use some buffers from the free list. */
     vq->num_free -= out + in;
 
@@ -112,27 +204,81 @@ vring_add_buf(virtio_queue_t *vq,
     vq->data[head] = data;
 
     /*
-     * Put entry in available array (but don't update avail->idx until they
-     * do sync).  FIXME: avoid modulus here?
+     * Put entry in available array (but don't update avail->idx until the
+     * batch is published).
      */
-    avail = vq->vring.avail->idx % vq->vring.num;
+    avail = (vq->vring.avail->idx + vq->num_staged) & vq->num_mask;
     vq->vring.avail->ring[avail] = (uint16_t)head;
+    vq->num_staged++;
 
     DPRINTK(DPRTL_RING, ("%s >>> avail %d vq->vring.avail->idx = %d,\n",
         __func__, avail, vq->vring.avail->idx));
-    DPRINTK(DPRTL_RING, ("\tvq->num_added = %d vq->vring.num = %d\n",
-        vq->num_added, vq->vring.num));
+    DPRINTK(DPRTL_RING, ("\tvq->num_staged = %d vq->vring.num = %d\n",
+        vq->num_staged, vq->vring.num));
     DPRINTK(DPRTL_RING, ("%s>>> ring %d, head %d, last_used %d, used %d\n",
         __func__, vq->qidx, head, vq->last_used_idx, vq->vring.used->idx));
 
-    mb();
-    vq->vring.avail->idx++;
-    vq->num_added++;
     return vq->num_free;
 }
 
 int
-vring_add_buf_indirect(virtio_queue_t *vq,
+vring_add_buf(virtio_queue_t *vq,
+    virtio_buffer_descriptor_t *sg,
+    unsigned int out,
+    unsigned int in,
+    void *data)
+{
+    int num_free;
+
+    num_free = vring_add_buf_batch(vq, sg, out, in, data);
+    vring_publish_batch(vq);
+    return num_free;
+}
+
+static int
+vring_add_buf_indirect_packed(virtio_queue_t *vq,
+    virtio_buffer_descriptor_t *sg,
+    unsigned int out,
+    unsigned int in,
+    void *data,
+    struct vring_packed_desc *vr_desc,
+    uint64_t pa)
+{
+    unsigned int i;
+    uint16_t head, id, head_flags;
+
+    if (vq->num_free < 1) {
+        return -1;
+    }
+
+    /* Indirect tables of a packed ring are consumed in order, no next. */
+    for (i = 0; i < out + in; i++, sg++) {
+        vr_desc[i].addr = sg->phys_addr;
+        vr_desc[i].len = sg->len;
+        vr_desc[i].id = 0;
+        vr_desc[i].flags = i < out ? 0 : VRING_DESC_F_WRITE;
+    }
+
+    head = vq->next_avail_idx;
+    id = (uint16_t)vq->free_head;
+    head_flags = VRING_DESC_F_INDIRECT | vq->avail_used_flags;
+
+    vq->packed.desc[head].addr = pa;
+    vq->packed.desc[head].len = i * sizeof(struct vring_packed_desc);
+    vq->packed.desc[head].id = id;
+
+    vq->num_free--;
+    vring_packed_advance(vq, &vq->next_avail_idx, &vq->avail_used_flags);
+    vq->free_head = vq->desc_state[id].next;
+    vq->desc_state[id].num = 1;
+    vq->data[id] = data;
+
+    vring_packed_stage_head(vq, head, head_flags, 1);
+    return vq->num_free;
+}
+
+int
+vring_add_buf_indirect_batch(virtio_queue_t *vq,
     virtio_buffer_descriptor_t *sg,
     unsigned int out,
     unsigned int in,
@@ -147,6 +293,10 @@ vring_add_buf_indirect(virtio_queue_t *vq,
     if (!pa) {
         return -1;
     }
+    if (vq->packed_ring) {
+        return vring_add_buf_indirect_packed(vq, sg, out, in, data,
+            (struct vring_packed_desc *)vr_desc, pa);
+    }
     /* Transfer entries from the sg list into the indirect page */
     for (i = 0; i < out; i++) {
         vr_desc[i].addr = sg->phys_addr;
@@ -184,25 +334,62 @@ vring_add_buf_indirect(virtio_queue_t *vq,
     vq->data[head] = data;
 
     /*
-     * Put entry in available array (but don't update avail->idx until they
-     * do sync).  FIXME: avoid modulus here?
+     * Put entry in available array (but don't update avail->idx until the
+     * batch is published).
      */
-    avail = vq->vring.avail->idx % vq->vring.num;
+    avail = (vq->vring.avail->idx + vq->num_staged) & vq->num_mask;
     vq->vring.avail->ring[avail] = (uint16_t)head;
+    vq->num_staged++;
 
     DPRINTK(DPRTL_RING, ("%s >>> avail %d vq->vring.avail->idx = %d,\n",
         __func__, avail, vq->vring.avail->idx));
-    DPRINTK(DPRTL_RING, ("\tvq->num_added = %d vq->vring.num = %d\n",
-        vq->num_added, vq->vring.num));
+    DPRINTK(DPRTL_RING, ("\tvq->num_staged = %d vq->vring.num = %d\n",
+        vq->num_staged, vq->vring.num));
     DPRINTK(DPRTL_RING, ("%s>>> ring %d, head %d, last_used %d, used %d\n",
         __func__, vq->qidx, head, vq->last_used_idx, vq->vring.used->idx));
 
-    mb();
-    vq->vring.avail->idx++;
-    vq->num_added++;
     return vq->num_free;
 }
 
+int
+vring_add_buf_indirect(virtio_queue_t *vq,
+    virtio_buffer_descriptor_t *sg,
+    unsigned int out,
+    unsigned int in,
+    void *data,
+    struct vring_desc *vr_desc,
+    uint64_t pa)
+{
+    int num_free;
+
+    num_free = vring_add_buf_indirect_batch(vq, sg, out, in, data,
+                                            vr_desc, pa);
+    vring_publish_batch(vq);
+    return num_free;
+}
+
+/*
+ * Expose every buffer staged since the last publish to the host with a
+ * single barrier and a single avail index (or packed head flags) store.
+ */
+void
+vring_publish_batch(virtio_queue_t *vq)
+{
+    if (vq->num_staged == 0) {
+        return;
+    }
+
+    /* Descriptors and avail entries need to be set before exposing them. */
+    wmb();
+    if (vq->packed_ring) {
+        vq->packed.desc[vq->staged_head].flags = vq->staged_head_flags;
+    } else {
+        vq->vring.avail->idx += vq->num_staged;
+    }
+    vq->num_added += vq->num_staged;
+    vq->num_staged = 0;
+}
+
 static void
 detach_buf(virtio_queue_t *vq, unsigned int head)
 {
@@ -224,12 +411,68 @@ detach_buf(virtio_queue_t *vq, unsigned int head)
     vq->num_free++;
 }
 
+static void
+detach_buf_packed(virtio_queue_t *vq, unsigned int id)
+{
+    vq->data[id] = NULL;
+    vq->num_free += vq->desc_state[id].num;
+    vq->desc_state[id].next = (uint16_t)vq->free_head;
+    vq->free_head = id;
+}
+
+static void *
+vring_get_buf_packed(virtio_queue_t *vq, unsigned int *len)
+{
+    void *buf;
+    unsigned int id;
+    uint16_t last_used;
+
+    if (!vring_packed_more_used(vq)) {
+        return NULL;
+    }
+
+    /* Only read the descriptor after the device has marked it used. */
+    rmb();
+
+    last_used = vq->last_used_idx;
+    id = vq->packed.desc[last_used].id;
+    *len = vq->packed.desc[last_used].len;
+
+    DPRINTK(DPRTL_RING, ("%s>>> ring %d, id %d, len %d, last_used %d\n",
+        __func__, vq->qidx, id, *len, last_used));
+
+    if (id >= vq->packed.num) {
+        PRINTK(("id %u out of range\n", id));
+        return NULL;
+    }
+    if (!vq->data[id]) {
+        PRINTK(("id %u is not a head!\n", id));
+        return NULL;
+    }
+
+    buf = vq->data[id];
+    last_used += vq->desc_state[id].num;
+    if (last_used >= vq->packed.num) {
+        last_used -= (uint16_t)vq->packed.num;
+        vq->used_wrap_counter ^= 1;
+    }
+    vq->last_used_idx = last_used;
+    detach_buf_packed(vq, id);
+
+    /* The event offset is only moved by the vring_enable_interrupt*() calls. */
+    return buf;
+}
+
 void *
 vring_get_buf(virtio_queue_t *vq, unsigned int *len)
 {
     void *buf;
     unsigned int i;
 
+    if (vq->packed_ring) {
+        return vring_get_buf_packed(vq, len);
+    }
+
     if (!VRING_HAS_UNCONSUMED_RESPONSES(vq)) {
         return NULL;
     }
@@ -237,8 +480,8 @@ vring_get_buf(virtio_queue_t *vq, unsigned int *len)
     /* Only get used array entries after they have been exposed by host. */
     rmb();
 
-    i = vq->vring.used->ring[vq->last_used_idx % vq->vring.num].id;
-    *len = vq->vring.used->ring[vq->last_used_idx % vq->vring.num].len;
+    i = vq->vring.used->ring[vq->last_used_idx & vq->num_mask].id;
+    *len = vq->vring.used->ring[vq->last_used_idx & vq->num_mask].len;
 
     DPRINTK(DPRTL_RING,
             ("%s>>> ring %d, id %d, len %d, last_used %d, used %d\n",
@@ -262,9 +505,12 @@ vring_get_buf(virtio_queue_t *vq, unsigned int *len)
     /*
      * If we expect an interrupt for the next entry, tell host
      * by writing event index and flush out the write before
-     * the read in the next get_buf call.
+     * the read in the next get_buf call.  Queues using event indexes
+     * set it from vring_enable_interrupt*() only, so that a delayed
+     * threshold isn't pulled back to the next entry here.
      */
-    if (!(vq->vring.avail->flags & VRING_AVAIL_F_NO_INTERRUPT)) {
+    if (!vq->use_event_idx
+            && !(vq->vring.avail->flags & VRING_AVAIL_F_NO_INTERRUPT)) {
         vring_used_event(&vq->vring) = vq->last_used_idx;
         mb();
     }
@@ -283,19 +529,54 @@ vring_detach_unused_buf(virtio_queue_t *vq)
             continue;
         }
         buf = vq->data[i];
-        detach_buf(vq, i);
-        vq->vring.avail->idx--;
+        if (vq->packed_ring) {
+            detach_buf_packed(vq, i);
+        } else {
+            detach_buf(vq, i);
+            vq->vring.avail->idx--;
+        }
         return buf;
     }
     return NULL;
 }
 
+static BOOLEAN
+vring_kick_prepare_packed(virtio_queue_t *vq)
+{
+    uint16_t new, old, off_wrap, flags, event_idx;
+
+    /* Expose the new descriptors before checking the device event. */
+    mb();
+
+    old = (uint16_t)(vq->next_avail_idx - vq->num_added);
+    new = vq->next_avail_idx;
+    vq->num_added = 0;
+
+    flags = vq->packed.device->flags;
+    if (flags != VRING_PACKED_EVENT_FLAG_DESC) {
+        return flags != VRING_PACKED_EVENT_FLAG_DISABLE;
+    }
+
+    off_wrap = vq->packed.device->off_wrap;
+    event_idx = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+    if ((off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR)
+            != vq->avail_wrap_counter) {
+        event_idx -= (uint16_t)vq->packed.num;
+    }
+    return vring_need_event(event_idx, new, old);
+}
+
 static BOOLEAN
 vring_kick_prepare(virtio_queue_t *vq)
 {
     uint16_t new, old;
     BOOLEAN needs_kick;
 
+    vring_publish_batch(vq);
+    if (vq->packed_ring) {
+        return vring_kick_prepare_packed(vq);
+    }
+
     /*We need to expose available array entries before checking avail event. */
     mb();
 
@@ -326,6 +607,7 @@ vring_queue_notify(virtio_queue_t *vq)
 void
 vring_kick_always(virtio_queue_t *vq)
 {
+    vring_publish_batch(vq);
 
     /*
      * Descriptors and available array need to be set before we expose the
@@ -333,8 +615,7 @@ vring_kick_always(virtio_queue_t *vq)
      */
     wmb();
 
-    DPRINTK(DPRTL_RING, ("%s>>> vq->vring.avail->idx %d\n",
-        __func__, vq->vring.avail->idx));
+    DPRINTK(DPRTL_RING, ("%s>>> ring %d\n", __func__, vq->qidx));
     vq->num_added = 0;
 
     /* Need to update avail index before checking if we should notify */
@@ -343,21 +624,32 @@ vring_kick_always(virtio_queue_t *vq)
     vring_queue_notify(vq);
 }
 
-void
+/* Returns TRUE if the host needed and was sent a notification. */
+BOOLEAN
 vring_kick(virtio_queue_t *vq)
 {
     if (vring_kick_prepare(vq)) {
         vring_queue_notify(vq);
+        return TRUE;
     }
+    return FALSE;
 }
 
 void
 vring_disable_interrupt(virtio_queue_t *vq)
 {
-    vq->vring.avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+    if (vq->packed_ring) {
+        vq->packed.driver->flags = VRING_PACKED_EVENT_FLAG_DISABLE;
+    } else {
+        vq->vring.avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+    }
     mb();
 }
 
+/*
+ * Returns FALSE if buffers were used while interrupts were off.  The device
+ * may not interrupt for those, so the caller must poll the queue.
+ */
 BOOLEAN
 vring_enable_interrupt(virtio_queue_t *vq)
 {
@@ -365,9 +657,179 @@ vring_enable_interrupt(virtio_queue_t *vq)
      * We optimistically turn back on interrupts, then check if there was
      * more to do.
      */
+    if (vq->packed_ring) {
+        if (vq->use_event_idx) {
+            vq->packed.driver->off_wrap = vq->last_used_idx
+                | (vq->used_wrap_counter << VRING_PACKED_EVENT_F_WRAP_CTR);
+            wmb();
+            vq->packed.driver->flags = VRING_PACKED_EVENT_FLAG_DESC;
+        } else {
+            vq->packed.driver->flags = VRING_PACKED_EVENT_FLAG_ENABLE;
+        }
+    } else {
+        if (vq->use_event_idx) {
+            vring_used_event(&vq->vring) = vq->last_used_idx;
+        }
+        vq->vring.avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+    }
+    mb();
+    return !VRING_HAS_UNCONSUMED_RESPONSES(vq);
+}
+
+/*
+ * Descriptors past last_used_idx that the device has already used.  Used
+ * elements are only written at chain heads, so walk them head to head.
+ * The walk stops once it gets past limit.
+ */
+static uint16_t
+vring_packed_used_dist(virtio_queue_t *vq, uint16_t limit)
+{
+    uint16_t outstanding, dist, idx, id, flags;
+    uint8_t wrap;
+
+    outstanding = (uint16_t)(vq->packed.num - vq->num_free);
+    idx = vq->last_used_idx;
+    wrap = vq->used_wrap_counter;
+    for (dist = 0; dist <= limit && dist < outstanding; ) {
+        flags = ((volatile struct vring_packed_desc *)
+            &vq->packed.desc[idx])->flags;
+        if (!!(flags & (1 << VRING_PACKED_DESC_F_AVAIL)) != wrap
+                || !!(flags & (1 << VRING_PACKED_DESC_F_USED)) != wrap) {
+            break;
+        }
+        rmb();
+        id = vq->packed.desc[idx].id;
+        if (id >= vq->packed.num || vq->desc_state[id].num == 0) {
+            break;
+        }
+        dist += vq->desc_state[id].num;
+        idx += vq->desc_state[id].num;
+        if (idx >= vq->packed.num) {
+            idx -= (uint16_t)vq->packed.num;
+            wrap ^= 1;
+        }
+    }
+    return dist;
+}
+
+/*
+ * Descriptors from last_used_idx to the head of the buffer bufs buffers on,
+ * or to the head of the last outstanding buffer if there are fewer.  Every
+ * descriptor of a chain carries the buffer id, and a used element carries
+ * the id of the chain it completes, so each head gives its chain's length
+ * whether it has been used or not.
+ */
+static uint16_t
+vring_packed_bufs_dist(virtio_queue_t *vq, uint16_t bufs)
+{
+    uint16_t outstanding, dist, idx, id, num;
+
+    outstanding = (uint16_t)(vq->packed.num - vq->num_free);
+    idx = vq->last_used_idx;
+    for (dist = 0; bufs; bufs--) {
+        id = vq->packed.desc[idx].id;
+        num = id < vq->packed.num ? vq->desc_state[id].num : 0;
+        if (num == 0) {
+            num = 1;
+        }
+        if (dist + num >= outstanding) {
+            break;
+        }
+        dist += num;
+        idx += num;
+        if (idx >= vq->packed.num) {
+            idx -= (uint16_t)vq->packed.num;
+        }
+    }
+    return dist;
+}
+
+/*
+ * Ask for an interrupt once the device's used index moves past dist
+ * descriptors beyond last_used_idx.  Returns FALSE if it already has.
+ */
+static BOOLEAN
+vring_packed_enable_interrupt_at(virtio_queue_t *vq, uint16_t dist)
+{
+    uint16_t used_idx;
+    uint8_t wrap;
+
+    used_idx = vq->last_used_idx + dist;
+    wrap = vq->used_wrap_counter;
+    if (used_idx >= vq->packed.num) {
+        used_idx -= (uint16_t)vq->packed.num;
+        wrap ^= 1;
+    }
+    vq->packed.driver->off_wrap = used_idx
+        | (wrap << VRING_PACKED_EVENT_F_WRAP_CTR);
+    wmb();
+    vq->packed.driver->flags = VRING_PACKED_EVENT_FLAG_DESC;
+    mb();
+
+    /*
+     * The device may already be past the event.  The descriptor at the
+     * event offset can be mid-chain and never marked used, so count what
+     * the device has used instead of reading it.
+     */
+    return vring_packed_used_dist(vq, dist) <= dist;
+}
+
+/*
+ * Like vring_enable_interrupt() but, when event indexes are in use, ask the
+ * host to hold off the interrupt until about 3/4 of the outstanding buffers
+ * have been used.  Returns FALSE if that many have already been used, in
+ * which case no interrupt may come and the caller must poll the queue.
+ */
+BOOLEAN
+vring_enable_interrupt_delayed(virtio_queue_t *vq)
+{
+    uint16_t bufs;
+
+    if (!vq->use_event_idx) {
+        return vring_enable_interrupt(vq);
+    }
+
+    if (vq->packed_ring) {
+        bufs = (uint16_t)((vq->packed.num - vq->num_free) * 3 / 4);
+        return vring_packed_enable_interrupt_at(vq, bufs);
+    }
+
+    bufs = (uint16_t)((vq->vring.avail->idx - vq->last_used_idx) * 3 / 4);
+    vring_used_event(&vq->vring) = vq->last_used_idx + bufs;
     vq->vring.avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
     mb();
-    return TRUE;
+    return (uint16_t)(vq->vring.used->idx - vq->last_used_idx) <= bufs;
+}
+
+/*
+ * Like vring_enable_interrupt() but, when event indexes are in use, ask the
+ * host to hold off the interrupt until bufs more buffers have been used, or
+ * all that are outstanding if fewer.  Returns FALSE if they have already
+ * been used, in which case no interrupt may come and the caller must poll.
+ */
+BOOLEAN
+vring_enable_interrupt_after(virtio_queue_t *vq, uint16_t bufs)
+{
+    uint16_t outstanding;
+
+    if (!vq->use_event_idx || bufs <= 1) {
+        return vring_enable_interrupt(vq);
+    }
+
+    if (vq->packed_ring) {
+        /* The event goes on the head of the bufs'th buffer. */
+        return vring_packed_enable_interrupt_at(vq,
+            vring_packed_bufs_dist(vq, bufs - 1));
+    }
+
+    outstanding = (uint16_t)(vq->vring.avail->idx - vq->last_used_idx);
+    if (outstanding < bufs) {
+        bufs = outstanding ? outstanding : 1;
+    }
+    vring_used_event(&vq->vring) = vq->last_used_idx + bufs - 1;
+    vq->vring.avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+    mb();
+    return (uint16_t)(vq->vring.used->idx - vq->last_used_idx) < bufs;
 }
 
 void
@@ -387,6 +849,32 @@ vring_stop_interrupts(virtio_queue_t *vq)
     }
 }
 
+/* Lay out the packed ring and reset the queue's packed ring state. */
+void
+vring_packed_init_queue(virtio_queue_t *vq,
+    unsigned int num,
+    void *p,
+    unsigned long align)
+{
+    unsigned int i;
+
+    vring_packed_init(&vq->packed, num, p, align);
+    vq->vring.num = num;
+    vq->desc_state = (vring_packed_desc_state_t *)&vq->data[num];
+    vq->packed_ring = TRUE;
+    vq->next_avail_idx = 0;
+    vq->last_used_idx = 0;
+    vq->avail_wrap_counter = 1;
+    vq->used_wrap_counter = 1;
+    vq->num_staged = 0;
+    vq->avail_used_flags = 1 << VRING_PACKED_DESC_F_AVAIL;
+    vq->free_head = 0;
+    for (i = 0; i < num; i++) {
+        vq->desc_state[i].next = (uint16_t)(i + 1);
+        vq->desc_state[i].num = 0;
+    }
+}
+
 /* Negotiates virtio transport features */
 void
 vring_transport_features(uint64_t *features)
@@ -107,6 +107,15 @@ sp_start_io(virtio_sp_dev_ext_t *dev_ext, PSCSI_REQUEST_BLOCK Srb)
                     &((PREAD_CAPACITY_DATA_EX)
                         Srb->DataBuffer)->BytesPerBlock,
                     &info->blk_size);
+
+                /* Advertise thin provisioning so UNMAP is issued. */
+                if (Srb->DataTransferLength > 14) {
+                    ((uint8_t *)Srb->DataBuffer)[14] =
+                        (IS_BIT_SET(dev_ext->features, VIRTIO_BLK_F_DISCARD)
+                         || IS_BIT_SET(dev_ext->features,
+                                       VIRTIO_BLK_F_WRITE_ZEROES)) ?
+                            VBIF_READ_CAP16_LBPME : 0;
+                }
             }
 
             RPRINTK(DPRTL_TRC,
@@ -125,6 +134,13 @@ sp_start_io(virtio_sp_dev_ext_t *dev_ext, PSCSI_REQUEST_BLOCK Srb)
             break;
         }
 
+        case SCSIOP_UNMAP:
+        case SCSIOP_WRITE_SAME16:
+            if (Srb->SrbStatus != SRB_STATUS_PENDING) {
+                /* sp_build_io could not translate the request. */
+                break;
+            }
+            /* Fall through to queue the request sp_build_io built. */
         case SCSIOP_READ:
         case SCSIOP_WRITE:
         case SCSIOP_READ16:
@@ -259,7 +275,7 @@ sp_start_io(virtio_sp_dev_ext_t *dev_ext, PSCSI_REQUEST_BLOCK Srb)
                 VIRTIO_SP_DRIVER_NAME,
                 Srb->Function, dev_ext->op_mode, dev_ext->state,
                 dev_ext->vq[0]->last_used_idx,
-                dev_ext->vq[0]->vring.used->idx));
+                VRING_HAS_UNCONSUMED_RESPONSES(dev_ext->vq[0])));
 
         if ((dev_ext->op_mode & OP_MODE_SHUTTING_DOWN)) {
             dev_ext->op_mode &= OP_MODE_SHUTTING_DOWN;
@@ -420,6 +436,10 @@ sp_build_io(virtio_sp_dev_ext_t *dev_ext, PSCSI_REQUEST_BLOCK srb)
         srb_ext->sg[el].phys_addr = pa.QuadPart;
         srb_ext->sg[el].len = sizeof(srb_ext->vbr.status);
         break;
+    case SCSIOP_UNMAP:
+    case SCSIOP_WRITE_SAME16:
+        srb->SrbStatus = virtio_blk_build_discard(dev_ext, srb);
+        break;
     default:
         srb->SrbStatus = SRB_STATUS_SUCCESS;
         break;
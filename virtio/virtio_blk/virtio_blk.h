@@ -67,6 +67,8 @@
 #define VIRTIO_BLK_F_TOPOLOGY   10      /* Topology information is available */
 #define VIRTIO_BLK_F_CONFIG_WCE 11      /* Writeback mode available in config */
 #define VIRTIO_BLK_F_MQ         12      /* support more than one vq */
+#define VIRTIO_BLK_F_DISCARD    13      /* DISCARD is supported */
+#define VIRTIO_BLK_F_WRITE_ZEROES 14    /* WRITE ZEROES is supported */
 
 /* These two define direction. */
 #define VIRTIO_BLK_T_IN         0
@@ -75,6 +77,11 @@
 #define VIRTIO_BLK_T_SCSI_CMD   2
 #define VIRTIO_BLK_T_FLUSH      4
 #define VIRTIO_BLK_T_GET_ID     8
+#define VIRTIO_BLK_T_DISCARD    11
+#define VIRTIO_BLK_T_WRITE_ZEROES 13
+
+/* Flag for a WRITE_ZEROES segment that the device may unmap. */
+#define VIRTIO_BLK_WRITE_ZEROES_FLAG_UNMAP  0x1
 
 #define VIRTIO_BLK_S_OK         0
 #define VIRTIO_BLK_S_IOERR      1
@@ -82,6 +89,15 @@
 
 #define SECTOR_SIZE             512
 
+/* Most DISCARD/WRITE_ZEROES segments carried by one request. */
+#define VBIF_MAX_DISCARD_SEGS   16
+
+/* UNMAP bit in byte 1 of the WRITE SAME(16) CDB. */
+#define VBIF_WRITE_SAME_UNMAP   0x08
+
+/* LBPME bit in byte 14 of the READ CAPACITY(16) data. */
+#define VBIF_READ_CAP16_LBPME   0x80
+
 #define MAX_PHYS_SEGMENTS       64
 #define VIRTIO_MAX_SG           (3 + MAX_PHYS_SEGMENTS)
 
@@ -184,8 +200,26 @@ typedef struct vbif_info_ex_s {
     uint8_t wce;                    /* (if VIRTIO_BLK_F_CONFIG_WCE) */
     uint8_t unused;
     u16 num_queues;                 /* only when VIRTIO_BLK_F_MQ is set */
+    uint32_t max_discard_sectors;   /* (if VIRTIO_BLK_F_DISCARD) */
+    uint32_t max_discard_seg;
+    uint32_t discard_sector_alignment;
+    uint32_t max_write_zeroes_sectors; /* (if VIRTIO_BLK_F_WRITE_ZEROES) */
+    uint32_t max_write_zeroes_seg;
+    uint8_t write_zeroes_may_unmap;
+    uint8_t unused1[3];
 } vbif_info_ex_t;
 
+/* The DISCARD/WRITE_ZEROES tail of vbif_info_ex_t. */
+typedef struct vbif_discard_info_s {
+    uint32_t max_discard_sectors;
+    uint32_t max_discard_seg;
+    uint32_t discard_sector_alignment;
+    uint32_t max_write_zeroes_sectors;
+    uint32_t max_write_zeroes_seg;
+    uint8_t write_zeroes_may_unmap;
+    uint8_t unused1[3];
+} vbif_discard_info_t;
+
 #pragma pack()
 
 typedef struct virtio_blk_outhdr_s {
@@ -194,6 +228,12 @@ typedef struct virtio_blk_outhdr_s {
     uint64_t sector;    /* sector offset of request */
 } virtio_blk_outhdr_t;
 
+typedef struct virtio_blk_discard_write_zeroes_s {
+    uint64_t sector;
+    uint32_t num_sectors;
+    uint32_t flags;
+} virtio_blk_discard_write_zeroes_t;
+
 typedef struct virtio_blk_req_s {
     LIST_ENTRY list_entry;
     virtio_blk_outhdr_t out_hdr;
@@ -207,6 +247,7 @@ typedef struct _vbif_srb_extension {
     ULONG            in;
     virtio_buffer_descriptor_t sg[VIRTIO_MAX_SG];
     struct vring_desc vr_desc[VIRTIO_MAX_SG];
+    virtio_blk_discard_write_zeroes_t dwz[VBIF_MAX_DISCARD_SEGS];
 #ifndef IS_STORPORT
     BOOLEAN         notify_next;
 #endif
@@ -247,6 +288,7 @@ typedef struct _virtio_sp_dev_ext {
 #endif
 
     vbif_info_t     info;
+    vbif_discard_info_t discard;
 } virtio_sp_dev_ext_t;
 
 #include <virtio_sp_common.h>
@@ -302,5 +344,7 @@ uint64_t virtio_blk_get_lba(virtio_sp_dev_ext_t *dev_ext,
     PSCSI_REQUEST_BLOCK srb);
 BOOLEAN virtio_blk_do_flush(virtio_sp_dev_ext_t *dev_ext,
     SCSI_REQUEST_BLOCK *srb);
+UCHAR virtio_blk_build_discard(virtio_sp_dev_ext_t *dev_ext,
+    PSCSI_REQUEST_BLOCK srb);
 
 #endif  /* _VIRTIO_BLK_H_ */
@@ -54,6 +54,33 @@ virtio_sp_get_device_config(virtio_sp_dev_ext_t *dev_ext)
         dev_ext->info.min_io_size = 0;
         dev_ext->info.opt_io_size = 0;
     }
+
+    memset(&dev_ext->discard, 0, sizeof(vbif_discard_info_t));
+    if (IS_BIT_SET(dev_ext->features, VIRTIO_BLK_F_DISCARD)
+            || IS_BIT_SET(dev_ext->features, VIRTIO_BLK_F_WRITE_ZEROES)) {
+        VIRTIO_DEVICE_GET_CONFIG(&dev_ext->vdev,
+            FIELD_OFFSET(vbif_info_ex_t, max_discard_sectors),
+            &dev_ext->discard, sizeof(vbif_discard_info_t));
+    }
+    if (!IS_BIT_SET(dev_ext->features, VIRTIO_BLK_F_DISCARD)) {
+        dev_ext->discard.max_discard_sectors = 0;
+        dev_ext->discard.max_discard_seg = 0;
+        dev_ext->discard.discard_sector_alignment = 0;
+    } else {
+        if (dev_ext->discard.max_discard_sectors == 0) {
+            dev_ext->discard.max_discard_sectors = 0xffffffff;
+        }
+        if (dev_ext->discard.max_discard_seg == 0) {
+            dev_ext->discard.max_discard_seg = 1;
+        }
+    }
+    if (!IS_BIT_SET(dev_ext->features, VIRTIO_BLK_F_WRITE_ZEROES)) {
+        dev_ext->discard.max_write_zeroes_sectors = 0;
+        dev_ext->discard.max_write_zeroes_seg = 0;
+        dev_ext->discard.write_zeroes_may_unmap = 0;
+    } else if (dev_ext->discard.max_write_zeroes_sectors == 0) {
+        dev_ext->discard.max_write_zeroes_sectors = 0xffffffff;
+    }
 }
 
 void
@@ -87,6 +114,19 @@ virtio_sp_dump_device_config_info(virtio_sp_dev_ext_t *dev_ext,
         dev_ext->info.alignment_offset));
     PRINTK(("\tmin_io_size: %d\n", dev_ext->info.min_io_size));
     PRINTK(("\topt_io_size: %d\n", dev_ext->info.opt_io_size));
+    if (IS_BIT_SET(dev_ext->features, VIRTIO_BLK_F_DISCARD)) {
+        PRINTK(("\tVIRTIO_BLK_F_DISCARD: max sectors %u, segs %u, align %u\n",
+            dev_ext->discard.max_discard_sectors,
+            dev_ext->discard.max_discard_seg,
+            dev_ext->discard.discard_sector_alignment));
+    }
+    if (IS_BIT_SET(dev_ext->features, VIRTIO_BLK_F_WRITE_ZEROES)) {
+        PRINTK(("\tVIRTIO_BLK_F_WRITE_ZEROES: max sectors %u, segs %u, "
+            "may unmap %d\n",
+            dev_ext->discard.max_write_zeroes_sectors,
+            dev_ext->discard.max_write_zeroes_seg,
+            dev_ext->discard.write_zeroes_may_unmap));
+    }
 }
 
 void
@@ -102,6 +142,13 @@ virtio_sp_initialize(virtio_sp_dev_ext_t *dev_ext)
     if (virtio_is_feature_enabled(dev_ext->features, VIRTIO_F_VERSION_1)) {
         virtio_feature_enable(guest_features, VIRTIO_F_VERSION_1);
     }
+    if (virtio_is_feature_enabled(dev_ext->features, VIRTIO_BLK_F_DISCARD)) {
+        virtio_feature_enable(guest_features, VIRTIO_BLK_F_DISCARD);
+    }
+    if (virtio_is_feature_enabled(dev_ext->features,
+                                  VIRTIO_BLK_F_WRITE_ZEROES)) {
+        virtio_feature_enable(guest_features, VIRTIO_BLK_F_WRITE_ZEROES);
+    }
     PRINTK(("%s: setting guest features 0x%llx\n",
             VIRTIO_SP_DRIVER_NAME, guest_features));
     virtio_device_set_guest_feature_list(&dev_ext->vdev, guest_features);
@@ -118,6 +165,8 @@ void
 virtio_blk_inquery_data(virtio_sp_dev_ext_t *dev_ext, PSCSI_REQUEST_BLOCK srb)
 {
     PINQUIRYDATA inquiryData;
+    uint32_t blocks;
+    uint32_t spb;
     unsigned int i;
 
     RPRINTK(DPRTL_CONFIG,
@@ -196,6 +245,93 @@ virtio_blk_inquery_data(virtio_sp_dev_ext_t *dev_ext, PSCSI_REQUEST_BLOCK srb)
             spage->SupportedPageList[0] = VPD_SUPPORTED_PAGES;
             spage->SupportedPageList[1] = VPD_SERIAL_NUMBER;
             spage->SupportedPageList[2] = VPD_DEVICE_IDENTIFIERS;
+            if (IS_BIT_SET(dev_ext->features, VIRTIO_BLK_F_DISCARD)
+                    || IS_BIT_SET(dev_ext->features,
+                                  VIRTIO_BLK_F_WRITE_ZEROES)) {
+                spage->PageLength = 5;
+                spage->SupportedPageList[3] = VPD_BLOCK_LIMITS;
+                spage->SupportedPageList[4] = VPD_LOGICAL_BLOCK_PROVISIONING;
+            }
+            break;
+        }
+        case VPD_BLOCK_LIMITS: {
+            PVPD_BLOCK_LIMITS_PAGE lpage;
+
+            if (!IS_BIT_SET(dev_ext->features, VIRTIO_BLK_F_DISCARD)
+                    && !IS_BIT_SET(dev_ext->features,
+                                   VIRTIO_BLK_F_WRITE_ZEROES)) {
+                srb->SrbStatus = SRB_STATUS_INVALID_REQUEST;
+                break;
+            }
+            if (srb->DataTransferLength < sizeof(VPD_BLOCK_LIMITS_PAGE)) {
+                srb->SrbStatus = SRB_STATUS_DATA_OVERRUN;
+                break;
+            }
+
+            RPRINTK(DPRTL_CONFIG,
+                    ("%x: SCSIOP_INQUIRY page b0.\n",
+                     srb->TargetId));
+            lpage = (PVPD_BLOCK_LIMITS_PAGE)srb->DataBuffer;
+            memset(lpage, 0, sizeof(VPD_BLOCK_LIMITS_PAGE));
+            lpage->DeviceType = DIRECT_ACCESS_DEVICE;
+            lpage->DeviceTypeQualifier = DEVICE_CONNECTED;
+            lpage->PageCode = VPD_BLOCK_LIMITS;
+            lpage->PageLength[1] = 0x3c;
+
+            /* The host reports 512 byte sectors, SCSI wants blocks. */
+            spb = dev_ext->info.blk_size / SECTOR_SIZE;
+            if (IS_BIT_SET(dev_ext->features, VIRTIO_BLK_F_DISCARD)) {
+                blocks = dev_ext->discard.max_discard_sectors / spb;
+                REVERSE_BYTES(lpage->MaximumUnmapLBACount, &blocks);
+                blocks = min(dev_ext->discard.max_discard_seg,
+                             VBIF_MAX_DISCARD_SEGS);
+                REVERSE_BYTES(lpage->MaximumUnmapBlockDescriptorCount,
+                              &blocks);
+                blocks = dev_ext->discard.discard_sector_alignment / spb;
+                if (blocks == 0) {
+                    blocks = 1;
+                }
+                REVERSE_BYTES(lpage->OptimalUnmapGranularity, &blocks);
+            }
+            if (IS_BIT_SET(dev_ext->features, VIRTIO_BLK_F_WRITE_ZEROES)) {
+                blocks = dev_ext->discard.max_write_zeroes_sectors / spb;
+                REVERSE_BYTES(&lpage->MaxWriteSameLength[4], &blocks);
+            }
+            srb->DataTransferLength = sizeof(VPD_BLOCK_LIMITS_PAGE);
+            break;
+        }
+        case VPD_LOGICAL_BLOCK_PROVISIONING: {
+            PVPD_LOGICAL_BLOCK_PROVISIONING_PAGE ppage;
+
+            if (!IS_BIT_SET(dev_ext->features, VIRTIO_BLK_F_DISCARD)
+                    && !IS_BIT_SET(dev_ext->features,
+                                   VIRTIO_BLK_F_WRITE_ZEROES)) {
+                srb->SrbStatus = SRB_STATUS_INVALID_REQUEST;
+                break;
+            }
+            if (srb->DataTransferLength <
+                    sizeof(VPD_LOGICAL_BLOCK_PROVISIONING_PAGE)) {
+                srb->SrbStatus = SRB_STATUS_DATA_OVERRUN;
+                break;
+            }
+
+            RPRINTK(DPRTL_CONFIG,
+                    ("%x: SCSIOP_INQUIRY page b2.\n",
+                     srb->TargetId));
+            ppage = (PVPD_LOGICAL_BLOCK_PROVISIONING_PAGE)srb->DataBuffer;
+            memset(ppage, 0, sizeof(VPD_LOGICAL_BLOCK_PROVISIONING_PAGE));
+            ppage->DeviceType = DIRECT_ACCESS_DEVICE;
+            ppage->DeviceTypeQualifier = DEVICE_CONNECTED;
+            ppage->PageCode = VPD_LOGICAL_BLOCK_PROVISIONING;
+            ppage->PageLength[1] = 4;
+            ppage->ProvisioningType = PROVISIONING_TYPE_THIN;
+            ppage->LBPU =
+                IS_BIT_SET(dev_ext->features, VIRTIO_BLK_F_DISCARD) ? 1 : 0;
+            ppage->LBPWS =
+                IS_BIT_SET(dev_ext->features, VIRTIO_BLK_F_WRITE_ZEROES) ?
+                    1 : 0;
+            srb->DataTransferLength =
+                sizeof(VPD_LOGICAL_BLOCK_PROVISIONING_PAGE);
             break;
         }
         case VPD_DEVICE_IDENTIFIERS: {
@@ -411,7 +547,7 @@ virtio_blk_do_flush(virtio_sp_dev_ext_t *dev_ext, SCSI_REQUEST_BLOCK *srb)
     dev_ext->op_mode |= OP_MODE_FLUSH;
     if (dev_ext->indirect) {
         pa = SP_GET_PHYSICAL_ADDRESS(dev_ext, NULL, srb_ext->vr_desc, &len);
-        num_free = vring_add_buf_indirect(dev_ext->vq[qidx],
+        num_free = vring_add_buf_indirect_batch(dev_ext->vq[qidx],
             &srb_ext->sg[0],
             srb_ext->out,
             srb_ext->in,
@@ -419,7 +555,7 @@ virtio_blk_do_flush(virtio_sp_dev_ext_t *dev_ext, SCSI_REQUEST_BLOCK *srb)
             srb_ext->vr_desc,
             pa.QuadPart);
     } else {
-        num_free = vring_add_buf(dev_ext->vq[qidx],
+        num_free = vring_add_buf_batch(dev_ext->vq[qidx],
             &srb_ext->sg[0],
             srb_ext->out,
             srb_ext->in,
@@ -451,6 +587,135 @@ virtio_blk_do_flush(virtio_sp_dev_ext_t *dev_ext, SCSI_REQUEST_BLOCK *srb)
     return FALSE;
 }
 
+/*
+ * Translate UNMAP and WRITE SAME(16) into a DISCARD or WRITE_ZEROES
+ * request.  The segments live in the srb extension.  Returns
+ * SRB_STATUS_PENDING when the request is ready to be queued.
+ */
+UCHAR
+virtio_blk_build_discard(virtio_sp_dev_ext_t *dev_ext, PSCSI_REQUEST_BLOCK srb)
+{
+    PHYSICAL_ADDRESS pa;
+    vbif_srb_ext_t *srb_ext;
+    virtio_blk_discard_write_zeroes_t *seg;
+    PUNMAP_LIST_HEADER hdr;
+    PCDB cdb;
+    uint8_t *buf;
+    uint64_t lba;
+    uint64_t max_sectors;
+    uint32_t blocks;
+    uint32_t num_segs;
+    uint32_t max_segs;
+    uint32_t spb;
+    uint32_t type;
+    uint32_t i;
+    uint16_t desc_len;
+    ULONG seg_len;
+    ULONG len;
+    ULONG el;
+
+    srb_ext = (vbif_srb_ext_t *)srb->SrbExtension;
+    seg = srb_ext->dwz;
+    spb = dev_ext->info.blk_size / SECTOR_SIZE;
+
+    if (srb->Cdb[0] == SCSIOP_UNMAP) {
+        if (!IS_BIT_SET(dev_ext->features, VIRTIO_BLK_F_DISCARD)
+                || srb->DataTransferLength < sizeof(UNMAP_LIST_HEADER)) {
+            return SRB_STATUS_INVALID_REQUEST;
+        }
+        hdr = (PUNMAP_LIST_HEADER)srb->DataBuffer;
+        REVERSE_BYTES_SHORT(&desc_len, hdr->BlockDescrDataLength);
+        if (sizeof(UNMAP_LIST_HEADER) + desc_len > srb->DataTransferLength) {
+            return SRB_STATUS_INVALID_REQUEST;
+        }
+        num_segs = desc_len / sizeof(UNMAP_BLOCK_DESCRIPTOR);
+        if (num_segs == 0) {
+            return SRB_STATUS_SUCCESS;
+        }
+        max_segs = min(dev_ext->discard.max_discard_seg,
+                       VBIF_MAX_DISCARD_SEGS);
+        if (num_segs > max_segs) {
+            PRINTK(("%s %s: %d unmap descriptors, max %d\n",
+                    VIRTIO_SP_DRIVER_NAME, __func__, num_segs, max_segs));
+            return SRB_STATUS_INVALID_REQUEST;
+        }
+        max_sectors = dev_ext->discard.max_discard_sectors;
+        for (i = 0; i < num_segs; i++) {
+            REVERSE_BYTES_QUAD(&lba, hdr->Descriptors[i].StartingLba);
+            REVERSE_BYTES(&blocks, hdr->Descriptors[i].LbaCount);
+            if ((uint64_t)blocks * spb > max_sectors) {
+                return SRB_STATUS_INVALID_REQUEST;
+            }
+            seg[i].sector = lba * spb;
+            seg[i].num_sectors = blocks * spb;
+            seg[i].flags = 0;
+        }
+        type = VIRTIO_BLK_T_DISCARD;
+    } else {
+        /* Only a zero pattern can be turned into WRITE_ZEROES. */
+        if (!IS_BIT_SET(dev_ext->features, VIRTIO_BLK_F_WRITE_ZEROES)
+                || srb->DataBuffer == NULL) {
+            return SRB_STATUS_INVALID_REQUEST;
+        }
+        buf = (uint8_t *)srb->DataBuffer;
+        len = min(srb->DataTransferLength, dev_ext->info.blk_size);
+        for (i = 0; i < len; i++) {
+            if (buf[i] != 0) {
+                return SRB_STATUS_INVALID_REQUEST;
+            }
+        }
+        cdb = (PCDB)srb->Cdb;
+        REVERSE_BYTES_QUAD(&lba, cdb->CDB16.LogicalBlock);
+        REVERSE_BYTES(&blocks, cdb->CDB16.TransferLength);
+        max_sectors = dev_ext->discard.max_write_zeroes_sectors;
+        if (blocks == 0 || (uint64_t)blocks * spb > max_sectors) {
+            return SRB_STATUS_INVALID_REQUEST;
+        }
+        seg[0].sector = lba * spb;
+        seg[0].num_sectors = blocks * spb;
+        seg[0].flags = (srb->Cdb[1] & VBIF_WRITE_SAME_UNMAP) ?
+            VIRTIO_BLK_WRITE_ZEROES_FLAG_UNMAP : 0;
+        num_segs = 1;
+        type = VIRTIO_BLK_T_WRITE_ZEROES;
+    }
+
+    srb_ext->vbr.out_hdr.sector = 0;
+    srb_ext->vbr.out_hdr.ioprio = 0;
+    srb_ext->vbr.out_hdr.type   = type;
+    srb_ext->vbr.req            = srb;
+
+    pa = SP_GET_PHYSICAL_ADDRESS(
+        dev_ext, NULL, &srb_ext->vbr.out_hdr, &len);
+    srb_ext->sg[0].phys_addr = pa.QuadPart;
+    srb_ext->sg[0].len   = sizeof(srb_ext->vbr.out_hdr);
+
+    /* The segment array may straddle a page in the srb extension. */
+    buf = (uint8_t *)seg;
+    seg_len = num_segs * sizeof(virtio_blk_discard_write_zeroes_t);
+    for (el = 1; seg_len; el++) {
+        pa = SP_GET_PHYSICAL_ADDRESS(dev_ext, NULL, buf, &len);
+        if (len == 0 || len > seg_len) {
+            len = seg_len;
+        }
+        srb_ext->sg[el].phys_addr = pa.QuadPart;
+        srb_ext->sg[el].len = len;
+        buf += len;
+        seg_len -= len;
+    }
+    srb_ext->out = el;
+    srb_ext->in = 1;
+
+    pa = SP_GET_PHYSICAL_ADDRESS(
+        dev_ext, NULL, &srb_ext->vbr.status, &len);
+    srb_ext->sg[el].phys_addr = pa.QuadPart;
+    srb_ext->sg[el].len = sizeof(srb_ext->vbr.status);
+
+    DPRINTK(DPRTL_TRC, ("%s %s: type %d, segs %d, sector %llx, num %x\n",
+        VIRTIO_SP_DRIVER_NAME, __func__, type, num_segs,
+        seg[0].sector, seg[0].num_sectors));
+    return SRB_STATUS_PENDING;
+}
+
 #ifdef IS_STORPORT
 BOOLEAN
 virtio_blk_stor_do_flush(virtio_sp_dev_ext_t *dev_ext, SCSI_REQUEST_BLOCK *srb)
@@ -52,6 +52,10 @@ static NDIS_STRING reg_rx_sg_name =
     NDIS_STRING_CONST("FragmentedReceives");
 static NDIS_STRING reg_numrfd_name =
     NDIS_STRING_CONST("NumRcb");
+static NDIS_STRING reg_rx_queue_size_name =
+    NDIS_STRING_CONST("RxQueueSize");
+static NDIS_STRING reg_tx_queue_size_name =
+    NDIS_STRING_CONST("TxQueueSize");
 static NDIS_STRING reg_rcv_limit_name =
     NDIS_STRING_CONST("RcvLimit");
 static NDIS_STRING reg_resource_timeout_name =
@@ -102,8 +106,18 @@ static NDIS_STRING reg_split_evtchn = NDIS_STRING_CONST("SplitEvtchn");
 
 static NDIS_STRING reg_indirect_desc = NDIS_STRING_CONST("IndirectDescriptors");
 
+static NDIS_STRING reg_packed_ring = NDIS_STRING_CONST("PackedRing");
+
 static NDIS_STRING reg_tx_sg_cnt = NDIS_STRING_CONST("TxSgCnt");
 
+#ifdef NDIS60_MINIPORT
+static NDIS_STRING reg_int_mod = NDIS_STRING_CONST("*InterruptModeration");
+static NDIS_STRING reg_busy_poll_usecs = NDIS_STRING_CONST("BusyPollUsecs");
+static NDIS_STRING reg_busy_poll_pkts = NDIS_STRING_CONST("BusyPollPkts");
+static NDIS_STRING reg_tx_cpus_per_queue = NDIS_STRING_CONST("TxCpusPerQueue");
+static NDIS_STRING reg_tx_bql = NDIS_STRING_CONST("TxByteQueueLimits");
+#endif
+
 static NDIS_STATUS
 VNIFSetupNdisAdapterTx(PVNIF_ADAPTER adapter)
 {
@@ -310,6 +324,20 @@ vnif_free_path_info(PVNIF_ADAPTER adapter)
     UINT i;
     UINT r;
 
+    if (adapter->rcv_xq != NULL) {
+        NdisFreeMemory(adapter->rcv_xq,
+                       sizeof(rcv_xq_ring_t) * adapter->num_rcv_queues
+                       * adapter->num_paths,
+                       0);
+        adapter->rcv_xq = NULL;
+    }
+    if (adapter->tx_cpu_map != NULL) {
+        NdisFreeMemory(adapter->tx_cpu_map,
+                       sizeof(USHORT) * adapter->tx_cpu_map_sz,
+                       0);
+        adapter->tx_cpu_map = NULL;
+        adapter->tx_cpu_map_sz = 0;
+    }
     if (adapter->path != NULL) {
         for (i = 0; i < adapter->num_paths; ++i) {
             NdisFreeSpinLock(&adapter->path[i].rx_path_lock);
@@ -380,6 +408,51 @@ vnif_set_num_paths(PVNIF_ADAPTER adapter)
     RPRINTK(DPRTL_INIT, ("[%s] num paths %u\n", __func__, num_paths));
 }
 
+/*
+ * Give each processor its own tx path so sends from different processors
+ * don't contend for the same tx_path_lock.  Runs of tx_cpus_per_queue
+ * adjacent processors share a path, wrapping around the paths.  Path i's
+ * DPC runs on processor i, so with one processor per queue a send is
+ * completed on the processor that made it.
+ *
+ * A flow whose sender moves to a processor on another path can have its
+ * packets put on the wire out of order while the old path still holds
+ * some of them.  So this is off by default and sends follow the RSS hash.
+ */
+static void
+vnif_setup_tx_cpu_map(PVNIF_ADAPTER adapter)
+{
+    UINT i;
+
+    if (adapter->num_paths <= 1 || adapter->tx_cpus_per_queue == 0) {
+        return;
+    }
+
+#if NDIS620_MINIPORT_SUPPORT
+    adapter->tx_cpu_map_sz =
+        KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS);
+#else
+    adapter->tx_cpu_map_sz = VNFI_GET_PROCESSOR_COUNT & 0xFFFF;
+#endif
+    VNIF_ALLOCATE_MEMORY(
+        adapter->tx_cpu_map,
+        sizeof(USHORT) * adapter->tx_cpu_map_sz,
+        VNIF_POOL_TAG,
+        NdisMiniportDriverHandle,
+        NormalPoolPriority);
+    if (adapter->tx_cpu_map == NULL) {
+        PRINTK(("[%s] no memory for tx cpu map, steer by hash\n", __func__));
+        adapter->tx_cpu_map_sz = 0;
+        return;
+    }
+    for (i = 0; i < adapter->tx_cpu_map_sz; i++) {
+        adapter->tx_cpu_map[i] = (USHORT)
+            ((i / adapter->tx_cpus_per_queue) % adapter->num_paths);
+        RPRINTK(DPRTL_INIT, ("[%s] cpu %d uses tx path %d\n",
+                             __func__, i, adapter->tx_cpu_map[i]));
+    }
+}
+
 static NDIS_STATUS
 vnif_setup_path_info(PVNIF_ADAPTER adapter)
 {
@@ -421,6 +494,32 @@ vnif_setup_path_info(PVNIF_ADAPTER adapter)
         NdisInitializeListHead(&adapter->rcv_q[i].rcv_to_process);
         adapter->rcv_q[i].n_busy_rcv = 0;
     }
+
+    /*
+     * The hand-off rings are only used when RSS redirects receives to
+     * another queue.  Without them the RCBs are spliced under the target
+     * queue's lock.
+     */
+    if (adapter->num_rcv_queues > 1) {
+        VNIF_ALLOCATE_MEMORY(
+            adapter->rcv_xq,
+            sizeof(rcv_xq_ring_t) * adapter->num_rcv_queues
+                * adapter->num_paths,
+            VNIF_POOL_TAG,
+            NdisMiniportDriverHandle,
+            NormalPoolPriority);
+        if (adapter->rcv_xq != NULL) {
+            NdisZeroMemory(adapter->rcv_xq, sizeof(rcv_xq_ring_t)
+                           * adapter->num_rcv_queues * adapter->num_paths);
+            for (i = 0; i < adapter->num_rcv_queues; ++i) {
+                adapter->rcv_q[i].xq =
+                    &adapter->rcv_xq[i * adapter->num_paths];
+            }
+        } else {
+            PRINTK(("[%s] no memory for rcv hand-off rings\n", __func__));
+        }
+    }
+
     for (i = 0; i < adapter->num_paths; ++i) {
         NdisAllocateSpinLock(&adapter->path[i].rx_path_lock);
         NdisAllocateSpinLock(&adapter->path[i].tx_path_lock);
@@ -429,12 +528,16 @@ vnif_setup_path_info(PVNIF_ADAPTER adapter)
         InitializeQueueHeader(&adapter->path[i].send_wait_queue);
 #endif
 
+        vnif_int_mod_init(&adapter->path[i].rx_mod, adapter->int_mod);
+
         status = vnif_rss_setup_queue_dpc_path(adapter, i);
         if (status != NDIS_STATUS_SUCCESS) {
             return status;
         }
     }
 
+    vnif_setup_tx_cpu_map(adapter);
+
     status = VNIF_SETUP_PATH_INFO_EX(adapter);
 
     return NDIS_STATUS_SUCCESS;
@@ -606,6 +709,42 @@ VNIFReadPrintMaskRegParameter(PVNIF_ADAPTER adapter)
     return status;
 }
 
+/*
+ * A requested virtio queue size.  0 keeps the size the device offers,
+ * otherwise the value is clamped and rounded down to a power of 2.
+ */
+static uint32_t
+vnif_read_queue_size(NDIS_HANDLE config_handle, NDIS_STRING *name)
+{
+    NDIS_STATUS status;
+    PNDIS_CONFIGURATION_PARAMETER returned_value;
+    uint32_t size;
+    uint32_t pow2;
+
+    NdisReadConfiguration(
+        &status,
+        &returned_value,
+        config_handle,
+        name,
+        NdisParameterInteger);
+    if (status != NDIS_STATUS_SUCCESS
+            || returned_value->ParameterData.IntegerData == 0) {
+        return 0;
+    }
+
+    size = returned_value->ParameterData.IntegerData;
+    if (size < VNIF_MIN_QUEUE_SIZE) {
+        size = VNIF_MIN_QUEUE_SIZE;
+    } else if (size > VNIF_MAX_QUEUE_SIZE) {
+        size = VNIF_MAX_QUEUE_SIZE;
+    }
+    for (pow2 = VNIF_MIN_QUEUE_SIZE; (pow2 << 1) <= size; pow2 <<= 1) {
+        ;
+    }
+    RPRINTK(DPRTL_INIT, ("VNIF: %ws %d\n", name->Buffer, pow2));
+    return pow2;
+}
+
 NDIS_STATUS
 VNIFReadRegParameters(PVNIF_ADAPTER adapter)
 {
@@ -886,6 +1025,11 @@ VNIFReadRegParameters(PVNIF_ADAPTER adapter)
          __func__, status, adapter->hw_tasks,
          returned_value->ParameterData.IntegerData));
 
+    adapter->rx_queue_size = vnif_read_queue_size(config_handle,
+                                                  &reg_rx_queue_size_name);
+    adapter->tx_queue_size = vnif_read_queue_size(config_handle,
+                                                  &reg_tx_queue_size_name);
+
     NdisReadConfiguration(
         &status,
         &returned_value,
@@ -901,6 +1045,10 @@ VNIFReadRegParameters(PVNIF_ADAPTER adapter)
         } else if (adapter->num_rcb == 0) {
             adapter->num_rcb = NET_RX_RING_SIZE;
         }
+    } else if (adapter->rx_queue_size) {
+        /* Fill the whole of a requested rx queue by default. */
+        adapter->num_rcb = adapter->rx_queue_size;
+        status = NDIS_STATUS_SUCCESS;
     } else {
         adapter->num_rcb = NET_RX_RING_SIZE;
         status = NDIS_STATUS_SUCCESS;
@@ -944,6 +1092,85 @@ VNIFReadRegParameters(PVNIF_ADAPTER adapter)
         status = NDIS_STATUS_SUCCESS;
     }
 
+#ifdef NDIS60_MINIPORT
+    NdisReadConfiguration(
+        &status,
+        &returned_value,
+        config_handle,
+        &reg_int_mod,
+        NdisParameterInteger);
+    if (status == NDIS_STATUS_SUCCESS) {
+        adapter->int_mod = returned_value->ParameterData.IntegerData;
+        if (adapter->int_mod > VNIF_INT_MOD_ADAPTIVE) {
+            adapter->int_mod = VNIF_INT_MOD_DISABLED;
+        }
+    } else {
+        adapter->int_mod = VNIF_INT_MOD_DISABLED;
+        status = NDIS_STATUS_SUCCESS;
+    }
+
+    NdisReadConfiguration(
+        &status,
+        &returned_value,
+        config_handle,
+        &reg_busy_poll_usecs,
+        NdisParameterInteger);
+    if (status == NDIS_STATUS_SUCCESS) {
+        adapter->busy_poll_usecs = min(
+            returned_value->ParameterData.IntegerData,
+            VNIF_BUSY_POLL_MAX_USECS);
+    } else {
+        adapter->busy_poll_usecs = 0;
+        status = NDIS_STATUS_SUCCESS;
+    }
+
+    NdisReadConfiguration(
+        &status,
+        &returned_value,
+        config_handle,
+        &reg_busy_poll_pkts,
+        NdisParameterInteger);
+    if (status == NDIS_STATUS_SUCCESS) {
+        adapter->busy_poll_pkts = returned_value->ParameterData.IntegerData;
+        if (adapter->busy_poll_pkts > VNIF_BUSY_POLL_MAX_PKTS) {
+            adapter->busy_poll_pkts = VNIF_BUSY_POLL_MAX_PKTS;
+        } else if (adapter->busy_poll_pkts < 1) {
+            adapter->busy_poll_pkts = 1;
+        }
+    } else {
+        adapter->busy_poll_pkts = VNIF_BUSY_POLL_DEF_PKTS;
+        status = NDIS_STATUS_SUCCESS;
+    }
+
+    NdisReadConfiguration(
+        &status,
+        &returned_value,
+        config_handle,
+        &reg_tx_cpus_per_queue,
+        NdisParameterInteger);
+    if (status == NDIS_STATUS_SUCCESS) {
+        adapter->tx_cpus_per_queue = min(
+            returned_value->ParameterData.IntegerData,
+            VNIF_MAX_TX_CPUS_PER_QUEUE);
+    } else {
+        adapter->tx_cpus_per_queue = VNIF_DEF_TX_CPUS_PER_QUEUE;
+        status = NDIS_STATUS_SUCCESS;
+    }
+
+    NdisReadConfiguration(
+        &status,
+        &returned_value,
+        config_handle,
+        &reg_tx_bql,
+        NdisParameterInteger);
+    if (status == NDIS_STATUS_SUCCESS) {
+        adapter->tx_bql_enabled = !!returned_value->ParameterData.IntegerData;
+    } else {
+        adapter->tx_bql_enabled = 1;
+        status = NDIS_STATUS_SUCCESS;
+    }
+#endif
+
     NdisReadConfiguration(
         &status,
         &returned_value,
@@ -1013,9 +1240,14 @@ VNIFReadRegParameters(PVNIF_ADAPTER adapter)
     adapter->max_frame_sz = adapter->mtu + ETH_HEADER_SIZE;
     status = NDIS_STATUS_SUCCESS;
 
-    adapter->rx_alloc_buffer_size = g_running_hypervisor == HYPERVISOR_KVM ?
-        (((adapter->max_frame_sz + adapter->buffer_offset - 1)
-          >> PAGE_SHIFT) + 1) * PAGE_SIZE :
+    /*
+     * With mergeable rx buffers (buffer_offset is only set then) the host
+     * spreads larger frames over num_buffers page sized buffers, so they
+     * don't have to be sized for the MTU.
+     */
+    adapter->rx_alloc_buffer_size = g_running_hypervisor == HYPERVISOR_KVM
+            && adapter->buffer_offset == 0 ?
+        (((adapter->max_frame_sz - 1) >> PAGE_SHIFT) + 1) * PAGE_SIZE :
         PAGE_SIZE;
 
     RPRINTK(DPRTL_INIT, ("VNIF: mtu %d mfz %d bfz 0x%x\n",
@@ -1319,6 +1551,23 @@ VNIFReadRegParameters(PVNIF_ADAPTER adapter)
         }
     }
 
+    /* Packed rings are only used when explicitly turned on. */
+    if (adapter->b_packed_ring == TRUE) {
+        NdisReadConfiguration(
+            &status,
+            &returned_value,
+            config_handle,
+            &reg_packed_ring,
+            NdisParameterInteger);
+        if (status != NDIS_STATUS_SUCCESS
+                || returned_value->ParameterData.IntegerData != 1) {
+            adapter->b_packed_ring = FALSE;
+        }
+        RPRINTK(DPRTL_INIT, ("VNIF: NdisReadConfiguration PackedRing %d\n",
+                             adapter->b_packed_ring));
+        status = NDIS_STATUS_SUCCESS;
+    }
+
     if (g_running_hypervisor == HYPERVISOR_XEN) {
         adapter->max_sg_el = VNIF_XEN_MAX_TX_SG_ELEMENTS;
     } else {
@@ -1371,6 +1620,17 @@ VNIFDumpSettings(PVNIF_ADAPTER adapter)
     PRINTK(("\tduplex state = %d\n", adapter->duplex_state));
     PRINTK(("\tLSO size %d\n", adapter->lso_data_size));
     PRINTK(("\trcbs = %d\n", adapter->num_rcb));
+    PRINTK(("\trx queue size = %d, requested %d\n",
+            VNIF_RX_RING_SIZE(adapter), adapter->rx_queue_size));
+    PRINTK(("\ttx queue size = %d, requested %d\n",
+            VNIF_TX_RING_SIZE(adapter), adapter->tx_queue_size));
+
+    /* Each rcb holds an rx buffer and each tx slot a page for copies. */
+    PRINTK(("\trx buffer memory = %d KB, tx buffer memory = %d KB\n",
+            (uint32_t)(((uint64_t)adapter->num_paths * adapter->num_rcb
+                * adapter->rx_alloc_buffer_size) >> 10),
+            (uint32_t)(((uint64_t)adapter->num_paths
+                * VNIF_TX_RING_SIZE(adapter) * PAGE_SIZE) >> 10)));
     PRINTK(("\trcv limit = %d\n", adapter->rcv_limit));
     PRINTK(("\tresource timeout = %d\n", adapter->resource_timeout));
     if (adapter->pv_stats) {
@@ -1393,6 +1653,13 @@ VNIFDumpSettings(PVNIF_ADAPTER adapter)
 #endif
     PRINTK(("\tnum hw queues = %d\n", adapter->num_hw_queues));
     PRINTK(("\tnum paths = %d\n", adapter->num_paths));
+    PRINTK(("\tinterrupt moderation = %d\n", adapter->int_mod));
+    PRINTK(("\tbusy poll usecs = %d, pkts = %d\n",
+            adapter->busy_poll_usecs, adapter->busy_poll_pkts));
+    PRINTK(("\ttx cpus per queue = %d, map %s\n",
+            adapter->tx_cpus_per_queue,
+            adapter->tx_cpu_map != NULL ? "in use" : "not used"));
+    PRINTK(("\ttx byte queue limits = %d\n", adapter->tx_bql_enabled));
 #ifdef NDIS620_MINIPORT
     PRINTK(("\tmulti-queue supported = %d\n", adapter->b_multi_queue));
     PRINTK(("\trss supported = %d\n", adapter->b_rss_supported));
@@ -37,6 +37,8 @@
 #include <ntstrsafe.h>
 #include <mp_packet.h>
 #include <mp_rss.h>
+#include <mp_csum.h>
+#include <mp_int_mod.h>
 #include <mp_nif.h>
 #include <win_cmp_strtol.h>
 #include <asm/win_cpuid.h>
@@ -61,6 +63,43 @@
 
 #define MIN_FREE_CP_TX_SLOTS 2
 
+/*
+ * Sends at least VNIF_TX_COPY_BREAK long only have their first
+ * VNIF_TX_HDR_COPY_LEN bytes copied, the rest goes out from the NB's pages.
+ */
+#define VNIF_TX_COPY_BREAK      512
+#define VNIF_TX_HDR_COPY_LEN    128
+
+/*
+ * Packets left below the rx interrupt moderation threshold are picked up
+ * by a VNIF_INT_MOD_TIMER_MS timer.  NDIS timers fire on the system clock
+ * tick, 15.6ms unless something has raised the clock rate, so 1 means the
+ * next tick.  That is the worst case added latency for a moderated packet.
+ */
+#define VNIF_INT_MOD_TIMER_MS           1
+
+/*
+ * Busy poll: an rx interrupt DPC keeps draining its ring with the interrupt
+ * still disabled until it has received busy_poll_pkts or the ring has
+ * stayed empty for busy_poll_usecs.
+ */
+#define VNIF_BUSY_POLL_MAX_USECS        1000
+#define VNIF_BUSY_POLL_DEF_PKTS         256
+#define VNIF_BUSY_POLL_MAX_PKTS         4096
+#define VNIF_BUSY_POLL_HIST_SZ          8
+
+#define VNIF_MAX_NUMA_NODES             64  /* Counted, the last has the rest */
+
+#define VNIF_DEF_TX_CPUS_PER_QUEUE      0   /* 0 steers sends by RSS hash */
+#define VNIF_MAX_TX_CPUS_PER_QUEUE      64
+
+#define VNIF_BQL_MIN_LIMIT              ETH_MAX_PACKET_SIZE
+#define VNIF_BQL_MAX_LIMIT              (1 << 24)
+#define VNIF_BQL_SLACK_HOLD_TIME        10000000    /* 1 second in 100ns */
+
+/* Query only: the tx queue used by each processor index, as USHORTs. */
+#define OID_VNIF_TX_QUEUE_MAP           0xFF564E01
+
 #define VNIF_XEN_MAX_TX_SG_ELEMENTS 19
 #define VNIF_VIRTIO_MIN_TX_SG_ELEMENTS 20
 #define VNIF_VIRTIO_DEF_TX_SG_ELEMENTS 25
@@ -117,6 +156,8 @@
 #define VNIF_MAX_LINK_SPEED   (VNIF_BASE_LINK_SPEED * VNIF_MAX_REG_LINK_SPEED)
 
 #define VNIF_MAX_NUM_RCBS           4096
+#define VNIF_MIN_QUEUE_SIZE         256         /* Requested virtio queues */
+#define VNIF_MAX_QUEUE_SIZE         4096
 #define VNIF_MIN_RCV_LIMIT          20
 
 #define VNIF_RECEIVE_DISCARD        0
@@ -148,6 +189,13 @@
                                 + IP_HEADER_SIZE_VAL                        \
                                 + TCP_HEADER_SIZE)
 
+/*
+ * Bytes pulled into the first rx buffer when a packet's headers are split
+ * across buffers.  Covers IPv6 and TCP with options.  The rest of the
+ * packet stays in the following buffers and is never touched.
+ */
+#define VNIF_RX_HDR_LEN         128
+
 #define VNIF_CHECKSUM_OFFLOAD_INFO_BITS 0x1c
                                         /*
                                          * Bit possition of:
@@ -686,8 +734,18 @@ typedef struct vnif_pv_stats_s {
     uint64_t        spkt_cnt;
     uint64_t        rpkt_cnt;
     uint64_t        tx_pkt_cnt;
+    uint64_t        tx_ints_avoided;    /* Completions without their own int */
+    uint64_t        tx_copy_octets;     /* Tx bytes copied into TCBs */
+    uint64_t        tx_zero_copy_octets; /* Tx bytes sent from NB pages */
+    uint64_t        rx_rss_passes;      /* Ring drains that redirected RCBs */
+    uint64_t        rx_rss_lock_cnt;    /* Other rcv_q locks taken for them */
+    uint64_t        rx_rss_xq_cnt;      /* RCBs handed off through a ring */
+    uint64_t        rx_hdr_copy_octets; /* Rx header bytes pulled up */
+    uint64_t        rx_frag_octets;     /* Rx bytes passed in later buffers */
     uint32_t        interval;
     int32_t         rx_to_process_cnt;
+    int32_t         kicks;              /* Notifications sent to the host */
+    int32_t         kicks_avoided;      /* Suppressed by the host's event idx */
     uint32_t        rx_ring_empty_nbusy;
     uint32_t        rx_ring_empty_calc;
 #ifdef DBG
@@ -701,6 +759,41 @@ typedef struct vnif_pv_stats_s {
 #endif
 } vnif_pv_stats_t;
 
+/*
+ * Byte queue limit for a tx path.  The counters are running byte totals
+ * that are allowed to wrap; only their differences matter.  Sending stops
+ * once the bytes in flight reach the limit.  The limit grows when the ring
+ * runs dry while limited and shrinks when it never does over the hold time.
+ */
+typedef struct vnif_bql_s {
+    uint32_t            num_queued;     /* Bytes put on the ring */
+    uint32_t            adj_limit;      /* limit + num_completed */
+    uint32_t            last_obj_cnt;   /* Bytes of the last send */
+    uint32_t            limit;
+    uint32_t            num_completed;  /* Bytes completed by the backend */
+    uint32_t            prev_ovlimit;
+    uint32_t            prev_num_queued;
+    uint32_t            prev_last_obj_cnt;
+    uint32_t            lowest_slack;
+    uint32_t            inflight_hwm;   /* Most bytes in flight, per stat */
+    uint64_t            slack_start_time;
+    uint64_t            stalls;         /* Sends held back by the limit */
+} vnif_bql_t;
+
+#define vnif_bql_avail(_bql)                                            \
+    ((int32_t)((_bql)->adj_limit - (_bql)->num_queued))
+
+#define vnif_bql_queued(_bql, _bytes)                                   \
+{                                                                       \
+    (_bql)->last_obj_cnt = (_bytes);                                    \
+    (_bql)->num_queued += (_bytes);                                     \
+    if ((_bql)->num_queued - (_bql)->num_completed                      \
+            > (_bql)->inflight_hwm) {                                   \
+        (_bql)->inflight_hwm = (_bql)->num_queued                       \
+            - (_bql)->num_completed;                                    \
+    }                                                                   \
+}
+
 typedef struct vnif_path_s {
     union {
         vnif_xq_path_t  xq;
@@ -712,6 +805,7 @@ typedef struct vnif_path_s {
     NDIS_SPIN_LOCK      tx_path_lock;
     rcb_ring_pool_t     rcb_rp;
     LIST_ENTRY          tcb_free_list;
+    UINT                tcb_free_cnt;   /* Entries on tcb_free_list */
     struct vring_desc   *tx_desc;
 #ifdef NDIS60_MINIPORT
     QUEUE_HEADER        send_wait_queue;
@@ -719,12 +813,20 @@ typedef struct vnif_path_s {
 #endif
     ULONG               Flags;
     UINT                cpu_idx;
+    USHORT              numa_node;      /* Node its RCBs were allocated on */
+    uint64_t            tcb_shortages;  /* Sends deferred for lack of TCBs */
+    uint64_t            tx_nbls;        /* NBLs queued to this path */
+    uint64_t            tx_nbs;
+    vnif_bql_t          tx_bql;
+    vnif_int_mod_t      rx_mod;
+    UINT                rx_drain_pkts;  /* Packets in the last drain */
+    uint64_t            bp_occupancy[VNIF_BUSY_POLL_HIST_SZ]; /* 1/7 steps */
+    uint64_t            bp_pkts[VNIF_BUSY_POLL_HIST_SZ];      /* log2 */
 #if NDIS620_MINIPORT_SUPPORT
     GROUP_AFFINITY      dpc_affinity;
 #else
     KAFFINITY           dpc_target_proc;
 #endif
-    UINT                rx_should_notify;
 } vnif_path_t;
 
 /***************************************************************************/
@@ -738,6 +840,7 @@ typedef struct _VNIF_ADAPTER {
     vnif_path_t         *path;
     UINT                num_paths;
     rcv_to_process_q_t  *rcv_q;
+    rcv_xq_ring_t       *rcv_xq;        /* num_rcv_queues * num_paths */
     UINT                num_rcv_queues; /* registry */
 #if NDIS620_MINIPORT_SUPPORT
     vnif_rss_t          rss;
@@ -764,7 +867,17 @@ typedef struct _VNIF_ADAPTER {
     uint32_t            cur_tx_tasks;
     uint32_t            cur_rx_tasks;
     uint32_t            num_rcb;
+    uint32_t            rx_queue_size;  /* Requested, 0 for the device's */
+    uint32_t            tx_queue_size;
+    uint32_t            rx_node_bufs[VNIF_MAX_NUMA_NODES];
     int32_t             rcv_limit;
+    uint32_t            int_mod;        /* VNIF_INT_MOD_* */
+    uint32_t            busy_poll_usecs;
+    uint32_t            busy_poll_pkts;
+    uint32_t            tx_cpus_per_queue;
+    uint32_t            tx_bql_enabled;
+    USHORT              *tx_cpu_map;    /* Processor index to tx path */
+    uint32_t            tx_cpu_map_sz;
     uint32_t            resource_timeout;
     uint32_t            rx_alloc_buffer_size;
     uint32_t            buffer_offset;
@@ -778,6 +891,8 @@ typedef struct _VNIF_ADAPTER {
     NDIS_HANDLE         rcv_timer;
     NDIS_HANDLE         poll_timer;
     KDPC                poll_dpc;
+    NDIS_HANDLE         int_mod_timer;
+    LONG                int_mod_timer_set;
     LONG                nWaitSend;
 #else
     NDIS_HANDLE         WrapperContext;
@@ -865,6 +980,7 @@ typedef struct _VNIF_ADAPTER {
     BOOLEAN             b_rss_supported;
     BOOLEAN             b_use_split_evtchn;
     BOOLEAN             b_indirect;
+    BOOLEAN             b_packed_ring;  /* Offered, then opted in by reg */
 
 #ifdef DBG
     uint32_t            dbg_print_cnt;
@@ -1022,6 +1138,7 @@ void
 VNIFIndicateOffload(PVNIF_ADAPTER adapter);
 
 NDIS_TIMER_FUNCTION VNIFPollTimerDpc;
+NDIS_TIMER_FUNCTION VNIFIntModTimerDpc;
 KDEFERRED_ROUTINE vnif_poll_dpc;
 
 NDIS_STATUS
@@ -1225,12 +1342,18 @@ void vnif_txrx_interrupt_dpc(PVNIF_ADAPTER adapter, ULONG txrx_ind,
 void vnif_call_txrx_interrupt_dpc(PVNIF_ADAPTER adapter);
 KDEFERRED_ROUTINE vnif_rx_path_dpc;
 NDIS_STATUS vnif_setup_rx_path_dpc(PVNIF_ADAPTER adapter);
+UINT vnif_rcv_xq_drain(PVNIF_ADAPTER adapter, UINT rcv_qidx);
+BOOLEAN vnif_rcv_q_pending(PVNIF_ADAPTER adapter, UINT rcv_qidx);
+void vnif_int_mod_set_mode(PVNIF_ADAPTER adapter, uint32_t mode);
+void vnif_bql_init(vnif_bql_t *bql);
+void vnif_bql_completed(vnif_bql_t *bql, uint32_t bytes, uint64_t now);
 UINT vnif_collapse_rx(PVNIF_ADAPTER adapter, RCB *rcb);
 uint32_t vnif_should_complete_packet(PVNIF_ADAPTER adapter, PUCHAR dest,
     UINT len);
 
 UINT vnif_add_rcb_to_ring_from_list(struct _VNIF_ADAPTER *adapter,
                                     UINT path_id);
+void vnif_stage_rcb(PVNIF_ADAPTER Adapter, RCB *rcb);
 void vnif_return_rcb(PVNIF_ADAPTER Adapter, RCB *rcb);
 void vnif_drop_rcb(PVNIF_ADAPTER adapter, RCB *rcb, int status);
 void vnif_send_arp(PVNIF_ADAPTER adapter);
@@ -0,0 +1,101 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright 2026 SUSE LLC
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _MP_CSUM_H
+#define _MP_CSUM_H
+
+/*
+ * Software checksum helpers for when the backend does not offload.  They
+ * only use fixed width types so the host tests in virtio/test can build
+ * them.
+ */
+
+/*
+ * One's complement sum of a buffer.  Sixteen bytes are summed per pass as
+ * 32 bit words into a 64 bit accumulator, which cannot overflow for any
+ * buffer a packet can hold.  Pass a previous partial sum in to continue it.
+ */
+static __inline uint64_t
+vnif_csum_partial(void *buffer, uint32_t len, uint64_t sum)
+{
+    uint32_t *dw;
+    uint8_t *b;
+
+    dw = (uint32_t *)buffer;
+    while (len >= 16) {
+        sum += dw[0];
+        sum += dw[1];
+        sum += dw[2];
+        sum += dw[3];
+        dw += 4;
+        len -= 16;
+    }
+    while (len >= 4) {
+        sum += *dw++;
+        len -= 4;
+    }
+    b = (uint8_t *)dw;
+    if (len >= 2) {
+        sum += *(uint16_t *)b;
+        b += 2;
+        len -= 2;
+    }
+    if (len) {
+        sum += *b;
+    }
+    return sum;
+}
+
+/* Fold a partial sum down to 16 bits without taking the complement. */
+static __inline uint16_t
+vnif_csum_fold(uint64_t sum)
+{
+    sum = (sum >> 32) + (sum & 0xffffffff);
+    sum = (sum >> 32) + (sum & 0xffffffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    return (uint16_t)sum;
+}
+
+/*
+ * Folded sum of one fragment of a chained packet.  A fragment that starts
+ * at an odd offset into the packet has its bytes paired the other way
+ * round, so its sum is byte swapped.
+ */
+static __inline uint16_t
+vnif_csum_frag(void *buffer, uint32_t len, uint32_t pkt_offset)
+{
+    uint16_t sum;
+
+    sum = vnif_csum_fold(vnif_csum_partial(buffer, len, 0));
+    if (pkt_offset & 1) {
+        sum = (uint16_t)((sum << 8) | (sum >> 8));
+    }
+    return sum;
+}
+
+#endif
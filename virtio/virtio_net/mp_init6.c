@@ -614,6 +614,7 @@ VNIFSetupNdisAdapterEx(PVNIF_ADAPTER adapter)
     do {
         adapter->ResetTimer = NULL;
         adapter->rcv_timer = NULL;
+        adapter->int_mod_timer = NULL;
 #if defined NDIS60_MINIPORT
         if (g_running_hypervisor == HYPERVISOR_KVM) {
             adapter->poll_timer = NULL;
@@ -661,6 +662,17 @@ VNIFSetupNdisAdapterEx(PVNIF_ADAPTER adapter)
         }
 #endif
 
+        Timer.TimerFunction = VNIFIntModTimerDpc;
+        Timer.FunctionContext = adapter;
+        status = NdisAllocateTimerObject(
+            adapter->AdapterHandle,
+            &Timer,
+            &adapter->int_mod_timer);
+        if (status != NDIS_STATUS_SUCCESS) {
+            adapter->int_mod_timer = NULL;
+            break;
+        }
+
         if (adapter->pv_stats) {
             Timer.TimerFunction = VNIFPvStatTimerDpc;
             Timer.FunctionContext = adapter;
@@ -684,6 +696,10 @@ VNIFSetupNdisAdapterEx(PVNIF_ADAPTER adapter)
             NdisFreeTimerObject(adapter->rcv_timer);
             adapter->rcv_timer = NULL;
         }
+        if (adapter->int_mod_timer) {
+            NdisFreeTimerObject(adapter->int_mod_timer);
+            adapter->int_mod_timer = NULL;
+        }
 #if defined NDIS60_MINIPORT
         if (g_running_hypervisor == HYPERVISOR_KVM) {
             if (adapter->poll_timer) {
@@ -702,6 +718,31 @@ VNIFSetupNdisAdapterEx(PVNIF_ADAPTER adapter)
     return status;
 }
 
+#if NDIS620_MINIPORT_SUPPORT
+/*
+ * Run on the path's processor while its RCBs are allocated so that pool
+ * and shared memory come from that processor's NUMA node.  The path's
+ * ring is drained and refilled on that processor.
+ */
+static BOOLEAN
+vnif_rx_pool_set_affinity(PVNIF_ADAPTER adapter,
+                          UINT path_id,
+                          GROUP_AFFINITY *old_affinity)
+{
+    BOOLEAN set;
+
+    set = FALSE;
+    if (adapter->path[path_id].dpc_affinity.Mask != 0
+            && KeGetCurrentIrql() == PASSIVE_LEVEL) {
+        KeSetSystemGroupAffinityThread(&adapter->path[path_id].dpc_affinity,
+                                       old_affinity);
+        set = TRUE;
+    }
+    adapter->path[path_id].numa_node = KeGetCurrentNodeNumber();
+    return set;
+}
+#endif
+
 NDIS_STATUS
 VNIFSetupNdisAdapterRx(PVNIF_ADAPTER adapter)
 {
@@ -712,10 +753,15 @@ VNIFSetupNdisAdapterRx(PVNIF_ADAPTER adapter)
     void *ptr;
     PNET_BUFFER nb;
     NDIS_STATUS status = NDIS_STATUS_SUCCESS;
+#if NDIS620_MINIPORT_SUPPORT
+    GROUP_AFFINITY old_affinity;
+    BOOLEAN affinity_set;
+#endif
     uint32_t i;
     uint32_t p;
 
     RPRINTK(DPRTL_ON, ("VNIF: VNIFSetupNdisAdapterRx - IN\n"));
+    NdisZeroMemory(adapter->rx_node_bufs, sizeof(adapter->rx_node_bufs));
     do {
 
         /* Pre-allocate packet pool and buffer pool for recveive. */
@@ -758,6 +804,9 @@ VNIFSetupNdisAdapterRx(PVNIF_ADAPTER adapter)
 
 
         for (p = 0; p < adapter->num_paths; p++) {
+#if NDIS620_MINIPORT_SUPPORT
+            affinity_set = vnif_rx_pool_set_affinity(adapter, p, &old_affinity);
+#endif
             VNIF_ALLOCATE_MEMORY(
                 adapter->path[p].rcb_rp.rcb_array,
                 sizeof(RCB *) * adapter->num_rcb,
@@ -766,6 +815,11 @@ VNIFSetupNdisAdapterRx(PVNIF_ADAPTER adapter)
                 NormalPoolPriority);
             if (adapter->path[p].rcb_rp.rcb_array == NULL) {
                 status = STATUS_NO_MEMORY;
+#if NDIS620_MINIPORT_SUPPORT
+                if (affinity_set) {
+                    KeRevertToUserGroupAffinityThread(&old_affinity);
+                }
+#endif
                 break;
             }
             NdisZeroMemory(adapter->path[p].rcb_rp.rcb_array,
@@ -820,7 +874,9 @@ VNIFSetupNdisAdapterRx(PVNIF_ADAPTER adapter)
 
                 rcb->mdl = NdisAllocateMdl(adapter->AdapterHandle,
                     rcb->page + adapter->buffer_offset,
-                    min(adapter->max_frame_sz, adapter->rx_alloc_buffer_size));
+                    min(adapter->max_frame_sz,
+                        adapter->rx_alloc_buffer_size
+                            - adapter->buffer_offset));
 
                 if (rcb->mdl == NULL) {
                     PRINTK(("VNIF: NdisAllocateMdl failed.\n"));
@@ -851,6 +907,17 @@ VNIFSetupNdisAdapterRx(PVNIF_ADAPTER adapter)
                 nb_list->Status = NDIS_STATUS_SUCCESS;
                 VNIF_PUSH_PCB(adapter->path[p].rcb_rp.rcb_nbl, nb_list);
             }
+#if NDIS620_MINIPORT_SUPPORT
+            if (affinity_set) {
+                KeRevertToUserGroupAffinityThread(&old_affinity);
+            }
+#endif
+            if (status != NDIS_STATUS_SUCCESS) {
+                break;
+            }
+            adapter->rx_node_bufs[min(adapter->path[p].numa_node,
+                                      VNIF_MAX_NUMA_NODES - 1)] +=
+                adapter->num_rcb;
         }
 
         if (status != NDIS_STATUS_SUCCESS) {
@@ -978,6 +1045,16 @@ VNIFFreeAdapterEx(PVNIF_ADAPTER adapter)
         NdisFreeTimerObject(adapter->rcv_timer);
         adapter->rcv_timer = NULL;
     }
+    if (adapter->int_mod_timer) {
+        /* Keep the timer from being set again while it is freed. */
+        InterlockedExchange(&adapter->int_mod_timer_set, 1);
+        VNIF_CANCEL_TIMER(adapter->int_mod_timer, &cancelled);
+
+        NdisAcquireSpinLock(&adapter->adapter_flag_lock);
+        NdisFreeTimerObject(adapter->int_mod_timer);
+        adapter->int_mod_timer = NULL;
+        NdisReleaseSpinLock(&adapter->adapter_flag_lock);
+    }
 #if defined NDIS60_MINIPORT
     if (g_running_hypervisor == HYPERVISOR_KVM) {
         if (adapter->poll_timer) {
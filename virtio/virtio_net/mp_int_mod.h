@@ -0,0 +1,347 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright 2026 SUSE LLC
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _MP_INT_MOD_H
+#define _MP_INT_MOD_H
+
+/*
+ * Rx interrupt moderation, the *InterruptModeration keyword.  A profile is
+ * the number of received buffers the host collects before interrupting.
+ * Adaptive moderation picks the profile from the per path packet, byte and
+ * ring drain rates every VNIF_INT_MOD_NEVENTS drains.  A path that sees no
+ * drains for a whole moderation timer period goes idle at one buffer per
+ * interrupt until traffic comes back.  The engine lives in this header so
+ * the host tests in virtio/test can build it.
+ */
+#define VNIF_INT_MOD_DISABLED           0
+#define VNIF_INT_MOD_ENABLED            1   /* Fixed default profile */
+#define VNIF_INT_MOD_ADAPTIVE           2
+#define VNIF_INT_MOD_NUM_PROFILES       5
+#define VNIF_INT_MOD_DEFAULT_PROFILE    2
+#define VNIF_INT_MOD_NEVENTS            64
+
+typedef struct vnif_int_mod_sample_s {
+    uint64_t            time;           /* 100ns units */
+    uint64_t            pkts;
+    uint64_t            bytes;
+    uint32_t            events;
+} vnif_int_mod_sample_t;
+
+typedef struct vnif_int_mod_s {
+    vnif_int_mod_sample_t cur;
+    vnif_int_mod_sample_t start;        /* cur when the sample began */
+    uint64_t            prev_ppms;      /* Rates of the last sample */
+    uint64_t            prev_bpms;
+    uint64_t            prev_epms;
+    UINT                profile;
+    UINT                tune_state;
+    UINT                steps_right;
+    UINT                steps_left;
+    UINT                tired;
+    UINT                rx_bufs;        /* Buffers per rx interrupt */
+    uint32_t            tick_events;    /* cur.events at the last tick */
+    BOOLEAN             idle;
+} vnif_int_mod_t;
+
+/*
+ * Adaptive rx interrupt moderation.  Each sample of VNIF_INT_MOD_NEVENTS
+ * ring drains is compared with the previous one.  While the byte, packet
+ * or drain rate keeps getting better the profile keeps stepping in the same
+ * direction, otherwise it turns around.  When it has settled between two
+ * profiles it parks until the traffic changes, or for a while if it could
+ * not settle at all.
+ */
+#define VNIF_INT_MOD_PARKING_ON_TOP     0
+#define VNIF_INT_MOD_PARKING_TIRED      1
+#define VNIF_INT_MOD_GOING_RIGHT        2
+#define VNIF_INT_MOD_GOING_LEFT         3
+
+#define VNIF_INT_MOD_STATS_WORSE        0
+#define VNIF_INT_MOD_STATS_SAME         1
+#define VNIF_INT_MOD_STATS_BETTER       2
+
+#define VNIF_INT_MOD_STEPPED            0
+#define VNIF_INT_MOD_TOO_TIRED          1
+#define VNIF_INT_MOD_ON_EDGE            2
+
+/* A difference of more than 10% is significant. */
+#define VNIF_INT_MOD_SIGNIFICANT(_cur, _prev)                           \
+    ((_cur) > (_prev) ? ((_cur) - (_prev)) * 10 > (_prev)               \
+                      : ((_prev) - (_cur)) * 10 > (_prev))
+
+static const UINT vnif_int_mod_rx_bufs[VNIF_INT_MOD_NUM_PROFILES] = {
+    1, 4, 8, 16, 32
+};
+
+static __inline UINT
+vnif_int_mod_compare(vnif_int_mod_t *im,
+                     uint64_t ppms,
+                     uint64_t bpms,
+                     uint64_t epms)
+{
+    if (im->prev_bpms == 0) {
+        return bpms ? VNIF_INT_MOD_STATS_BETTER : VNIF_INT_MOD_STATS_SAME;
+    }
+    if (VNIF_INT_MOD_SIGNIFICANT(bpms, im->prev_bpms)) {
+        return bpms > im->prev_bpms ? VNIF_INT_MOD_STATS_BETTER
+                                    : VNIF_INT_MOD_STATS_WORSE;
+    }
+
+    if (im->prev_ppms == 0) {
+        return ppms ? VNIF_INT_MOD_STATS_BETTER : VNIF_INT_MOD_STATS_SAME;
+    }
+    if (VNIF_INT_MOD_SIGNIFICANT(ppms, im->prev_ppms)) {
+        return ppms > im->prev_ppms ? VNIF_INT_MOD_STATS_BETTER
+                                    : VNIF_INT_MOD_STATS_WORSE;
+    }
+
+    /* Same traffic, fewer drains is better. */
+    if (im->prev_epms == 0) {
+        return VNIF_INT_MOD_STATS_SAME;
+    }
+    if (VNIF_INT_MOD_SIGNIFICANT(epms, im->prev_epms)) {
+        return epms < im->prev_epms ? VNIF_INT_MOD_STATS_BETTER
+                                    : VNIF_INT_MOD_STATS_WORSE;
+    }
+    return VNIF_INT_MOD_STATS_SAME;
+}
+
+static __inline UINT
+vnif_int_mod_step(vnif_int_mod_t *im)
+{
+    if (im->tired == VNIF_INT_MOD_NUM_PROFILES * 2) {
+        return VNIF_INT_MOD_TOO_TIRED;
+    }
+    im->tired++;
+
+    if (im->tune_state == VNIF_INT_MOD_GOING_RIGHT) {
+        if (im->profile == VNIF_INT_MOD_NUM_PROFILES - 1) {
+            return VNIF_INT_MOD_ON_EDGE;
+        }
+        im->profile++;
+        im->steps_right++;
+    } else if (im->tune_state == VNIF_INT_MOD_GOING_LEFT) {
+        if (im->profile == 0) {
+            return VNIF_INT_MOD_ON_EDGE;
+        }
+        im->profile--;
+        im->steps_left++;
+    }
+    return VNIF_INT_MOD_STEPPED;
+}
+
+static __inline void
+vnif_int_mod_park(vnif_int_mod_t *im, UINT state)
+{
+    im->tune_state = state;
+    im->steps_right = 0;
+    im->steps_left = 0;
+    im->tired = state == VNIF_INT_MOD_PARKING_TIRED
+        ? VNIF_INT_MOD_NUM_PROFILES : 0;
+}
+
+static __inline void
+vnif_int_mod_exit_parking(vnif_int_mod_t *im)
+{
+    im->tune_state = im->profile ? VNIF_INT_MOD_GOING_LEFT
+                                 : VNIF_INT_MOD_GOING_RIGHT;
+    vnif_int_mod_step(im);
+}
+
+static __inline void
+vnif_int_mod_decide(vnif_int_mod_t *im,
+                    uint64_t ppms,
+                    uint64_t bpms,
+                    uint64_t epms)
+{
+    UINT prev_state;
+    BOOLEAN on_top;
+
+    prev_state = im->tune_state;
+
+    switch (im->tune_state) {
+    case VNIF_INT_MOD_PARKING_ON_TOP:
+        if (vnif_int_mod_compare(im, ppms, bpms, epms)
+                != VNIF_INT_MOD_STATS_SAME) {
+            vnif_int_mod_exit_parking(im);
+        }
+        break;
+
+    case VNIF_INT_MOD_PARKING_TIRED:
+        im->tired--;
+        if (im->tired == 0) {
+            vnif_int_mod_exit_parking(im);
+        }
+        break;
+
+    default:
+        if (vnif_int_mod_compare(im, ppms, bpms, epms)
+                != VNIF_INT_MOD_STATS_BETTER) {
+            if (im->tune_state == VNIF_INT_MOD_GOING_RIGHT) {
+                im->tune_state = VNIF_INT_MOD_GOING_LEFT;
+                im->steps_left = 0;
+            } else {
+                im->tune_state = VNIF_INT_MOD_GOING_RIGHT;
+                im->steps_right = 0;
+            }
+        }
+
+        /* Back where the last turn started, between two profiles. */
+        if (im->tune_state == VNIF_INT_MOD_GOING_RIGHT) {
+            on_top = im->steps_left > 1 && im->steps_right == 1;
+        } else {
+            on_top = im->steps_right > 1 && im->steps_left == 1;
+        }
+        if (on_top) {
+            vnif_int_mod_park(im, VNIF_INT_MOD_PARKING_ON_TOP);
+            break;
+        }
+
+        switch (vnif_int_mod_step(im)) {
+        case VNIF_INT_MOD_ON_EDGE:
+            vnif_int_mod_park(im, VNIF_INT_MOD_PARKING_ON_TOP);
+            break;
+        case VNIF_INT_MOD_TOO_TIRED:
+            vnif_int_mod_park(im, VNIF_INT_MOD_PARKING_TIRED);
+            break;
+        }
+        break;
+    }
+
+    if (prev_state != VNIF_INT_MOD_PARKING_ON_TOP
+            || im->tune_state != VNIF_INT_MOD_PARKING_ON_TOP) {
+        im->prev_ppms = ppms;
+        im->prev_bpms = bpms;
+        im->prev_epms = epms;
+    }
+}
+
+static __inline void
+vnif_int_mod_init(vnif_int_mod_t *im, uint32_t mode)
+{
+    NdisZeroMemory(im, sizeof(vnif_int_mod_t));
+    if (mode == VNIF_INT_MOD_ENABLED) {
+        im->profile = VNIF_INT_MOD_DEFAULT_PROFILE;
+    }
+    im->tune_state = VNIF_INT_MOD_GOING_RIGHT;
+    im->rx_bufs = vnif_int_mod_rx_bufs[im->profile];
+}
+
+/*
+ * Called from the moderation timer when the path has nothing waiting.  If
+ * there has been no drain since the last tick the path has gone quiet, so
+ * drop to one buffer per interrupt.  Returns TRUE if it went idle.
+ */
+static __inline BOOLEAN
+vnif_int_mod_idle(vnif_int_mod_t *im)
+{
+    if (im->cur.events != im->tick_events) {
+        im->tick_events = im->cur.events;
+        return FALSE;
+    }
+    im->idle = TRUE;
+    im->rx_bufs = 1;
+    return TRUE;
+}
+
+/*
+ * Count one ring drain.  Empty drains of an idle path are not counted.  The
+ * first one with packets puts rx_bufs back for the profile and restarts the
+ * sample, the idle time says nothing about the profile.  Returns TRUE if
+ * rx_bufs changed.
+ */
+static __inline BOOLEAN
+vnif_int_mod_count(vnif_int_mod_t *im, UINT pkts, UINT bytes)
+{
+    BOOLEAN woke;
+
+    woke = FALSE;
+    if (im->idle) {
+        if (pkts == 0) {
+            return FALSE;
+        }
+        im->idle = FALSE;
+        im->rx_bufs = vnif_int_mod_rx_bufs[im->profile];
+        im->start.time = 0;
+        woke = im->rx_bufs > 1;
+    }
+    im->cur.pkts += pkts;
+    im->cur.bytes += bytes;
+    im->cur.events++;
+    return woke;
+}
+
+/*
+ * Account one ring drain for adaptive moderation.  The caller holds the
+ * path's rx_path_lock and passes the current interrupt time.  Returns TRUE
+ * if rx_bufs changed.
+ */
+static __inline BOOLEAN
+vnif_int_mod_update(vnif_int_mod_t *im, uint64_t now, UINT pkts, UINT bytes)
+{
+    uint64_t delta;
+    uint64_t ppms;
+    uint64_t bpms;
+    uint64_t epms;
+    UINT prev_profile;
+    BOOLEAN woke;
+
+    woke = vnif_int_mod_count(im, pkts, bytes);
+    if (im->idle) {
+        return FALSE;
+    }
+    if (im->start.time == 0) {
+        im->cur.time = now;
+        im->start = im->cur;
+        return woke;
+    }
+    if (im->cur.events - im->start.events < VNIF_INT_MOD_NEVENTS) {
+        return FALSE;
+    }
+
+    /* Rates per ms, the interrupt time is in 100ns units. */
+    delta = now - im->start.time;
+    if (delta == 0) {
+        return FALSE;
+    }
+    ppms = (im->cur.pkts - im->start.pkts) * 10000 / delta;
+    bpms = (im->cur.bytes - im->start.bytes) * 10000 / delta;
+    epms = (uint64_t)(im->cur.events - im->start.events) * 10000 / delta;
+
+    prev_profile = im->profile;
+    vnif_int_mod_decide(im, ppms, bpms, epms);
+
+    im->cur.time = now;
+    im->start = im->cur;
+
+    if (im->profile == prev_profile) {
+        return FALSE;
+    }
+    im->rx_bufs = vnif_int_mod_rx_bufs[im->profile];
+    return TRUE;
+}
+
+#endif
@@ -199,6 +199,23 @@ vnif_build_ip_chksum_hdr(TCB *tcb, PUCHAR virtual_addr, UINT cur_len, UINT i,
     }
 }
 
+/* Out of TCBs part way through a packet, give back the ones chained so far. */
+static void
+vnif_build_sg_ex_fail(PVNIF_ADAPTER adapter, TCB *tcb)
+{
+    TCB *next_tcb;
+
+    PRINTK(("vnif_build_sg_ex: out of TCBs.\n"));
+    adapter->path[0].tcb_shortages++;
+    while (tcb->next) {
+        next_tcb = tcb->next;
+        tcb->next = next_tcb->next;
+        next_tcb->next = NULL;
+        VNIF_PUT_FREE_TCB(&adapter->path[0], next_tcb);
+    }
+    tcb->sg_cnt = 0;
+}
+
 static UINT
 vnif_build_sg_ex(PVNIF_ADAPTER adapter, TCB *tcb, PNDIS_BUFFER current_buffer,
     UINT data_len)
@@ -279,8 +296,11 @@ vnif_build_sg_ex(PVNIF_ADAPTER adapter, TCB *tcb, PNDIS_BUFFER current_buffer,
                     sg_idx++;
 
                     if (cur_len) {
-                        cur_tcb = (TCB *)
-                            RemoveHeadList(&adapter->path[0].tcb_free_list);
+                        VNIF_GET_FREE_TCB(&adapter->path[0], cur_tcb);
+                        if (cur_tcb == NULL) {
+                            vnif_build_sg_ex_fail(adapter, tcb);
+                            return 0;
+                        }
                         cur_tcb->next = NULL;
                         pDest = cur_tcb->data;
                         dest_len = 0;
@@ -480,7 +500,7 @@ MPSendPackets(
                 }
             }
 
-            tcb = (TCB *) RemoveHeadList(&adapter->path[0].tcb_free_list);
+            VNIF_GET_FREE_TCB(&adapter->path[0], tcb);
             tcb->orig_send_packet = packet;
 
             NdisQueryPacketLength(packet, &packet_len);
@@ -492,12 +512,12 @@ MPSendPackets(
                 DPRINTK(DPRTL_ON, ("vnif_build_sg: len %d, physfrags %d.\n",
                     len, buffer_cnt));
                 if (buffer_cnt < adapter->max_sg_el) {
-                    vnif_build_sg(adapter, tcb, nbuf, len);
+                    len = vnif_build_sg(adapter, tcb, nbuf, len);
                 } else if (len < PAGE_SIZE - adapter->buffer_offset) {
                     len = VNIFCopyPacket(tcb, nbuf, len,
                                          adapter->buffer_offset);
                 } else{
-                    vnif_build_sg_ex(adapter, tcb, nbuf, len);
+                    len = vnif_build_sg_ex(adapter, tcb, nbuf, len);
                 }
 
                 if (adapter->cur_tx_tasks & VNIF_CHKSUM_IPV4_TCP) {
@@ -522,7 +542,7 @@ MPSendPackets(
                         packet,
                         NDIS_STATUS_BUFFER_OVERFLOW);
                 }
-                InsertHeadList(&adapter->path[0].tcb_free_list, &tcb->list);
+                VNIF_PUT_FREE_TCB(&adapter->path[0], tcb);
                 continue;
             }
 
@@ -636,8 +656,7 @@ VNIFCheckSendCompletion(PVNIF_ADAPTER adapter, UINT path_id)
                 return_tcb = tcb;
                 tcb = tcb->next;
                 return_tcb->next = NULL;
-                InsertHeadList(&adapter->path[0].tcb_free_list,
-                               &return_tcb->list);
+                VNIF_PUT_FREE_TCB(&adapter->path[0], return_tcb);
             }
         }
         VNIF_SET_TX_RSP_CONS(adapter, path_id, prod);
@@ -937,6 +956,7 @@ VNIFReceivePackets(IN PVNIF_ADAPTER adapter, UINT path_id, UINT nbls)
             }
         }
         DPRINTK(DPRTL_TRC, ("VNIF: VNIF Received Packets = %d.\n", cnt));
+        VNIF_RX_RING_PUBLISH(adapter, path_id);
         VNIF_RING_FINAL_CHECK_FOR_RESPONSES(adapter->path[0].rx, &more_to_do);
     } while (more_to_do && cnt < ring_size);
 
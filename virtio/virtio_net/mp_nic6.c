@@ -232,21 +232,6 @@ VNIFCopyNetBuffer(PNET_BUFFER nb, TCB *tcb, uint32_t adjust)
     return bytes_copied;
 }
 
-static __inline UINT
-vnif_num_in_list(LIST_ENTRY *list_head, UINT needed)
-{
-    LIST_ENTRY *list;
-    UINT n;
-
-    n = 0;
-    list = list_head->Flink;
-    while (list != list_head && n < needed) {
-        n++;
-        list = list->Flink;
-    }
-    return n;
-}
-
 static __inline UINT
 vnif_get_mdl_sg_cnt(PMDL mdl)
 {
@@ -285,8 +270,7 @@ vnif_collapse_tx(PVNIF_ADAPTER adapter, TCB *tcb,
 #ifdef DBG
     UINT        avail_tcbs;
 
-    avail_tcbs = vnif_num_in_list(&adapter->path[path_id].tcb_free_list,
-                                  adapter->max_sg_el);
+    avail_tcbs = adapter->path[path_id].tcb_free_cnt;
 #endif
     NdisQueryMdl(mdl, &pSrc, &mdl_len, NormalPagePriority);
     if (pSrc == NULL) {
@@ -363,10 +347,8 @@ vnif_collapse_tx(PVNIF_ADAPTER adapter, TCB *tcb,
                     sg_idx++;
 
                     if (mdl_len) {
-                        if (!IsListEmpty(
-                                &adapter->path[path_id].tcb_free_list)) {
-                            cur_tcb = (TCB *)RemoveHeadList(
-                                &adapter->path[path_id].tcb_free_list);
+                        VNIF_GET_FREE_TCB(&adapter->path[path_id], cur_tcb);
+                        if (cur_tcb != NULL) {
                             cur_tcb->next = NULL;
                             pDest = cur_tcb->data;
                             bytes_in_page = PAGE_SIZE;
@@ -531,11 +513,11 @@ vnif_build_sg(PVNIF_ADAPTER adapter, UINT path_id, TCB *tcb,
 
     if (sg_cnt >= adapter->max_sg_el) {
         DPRINTK(DPRTL_UNEXPDTX,
-            ("%s: need to do vnif_collapse_tx: len %d sg_cnt = %d needed %d.\n",
+            ("%s: need to do vnif_collapse_tx: len %d sg_cnt %d free %d.\n",
              __func__,
              data_len,
              sg_cnt,
-             vnif_num_in_list(&adapter->path[path_id].tcb_free_list, sg_cnt)));
+             adapter->path[path_id].tcb_free_cnt));
         bytes_copied = vnif_collapse_tx(adapter, tcb, mdl, mdl_offset,
                                         data_len, path_id);
         return bytes_copied;
@@ -630,10 +612,10 @@ vnif_build_sg(PVNIF_ADAPTER adapter, UINT path_id, TCB *tcb,
         PRINTK(("******** sg_idx %d sg_cnt %d data_len %d %d **************\n",
                 sg_idx, vnif_get_mdl_sg_cnt(org_mdl), org_data_len, data_len));
         PRINTK(
-            ("Need to do vnif_collapse_tx: len %d sg_idx = %d needed %d.\n",
+            ("Need to do vnif_collapse_tx: len %d sg_idx = %d free %d.\n",
              org_data_len,
              sg_idx,
-             vnif_num_in_list(&adapter->path[path_id].tcb_free_list, sg_idx)));
+             adapter->path[path_id].tcb_free_cnt));
     }
 #endif
 
@@ -641,6 +623,107 @@ vnif_build_sg(PVNIF_ADAPTER adapter, UINT path_id, TCB *tcb,
     return bytes_copied;
 }
 
+/*
+ * Copy only the first VNIF_TX_HDR_COPY_LEN bytes of the NET_BUFFER into the
+ * TCB so the headers can be parsed and updated, then point the remaining
+ * sg elements straight at the NET_BUFFER's pages.  Returns 0 if the payload
+ * doesn't fit in the sg elements so the caller can fall back to copying.
+ */
+static UINT
+vnif_build_hdr_sg(PVNIF_ADAPTER adapter, TCB *tcb, PNET_BUFFER nb)
+{
+    PPFN_NUMBER pfn_list;
+    PUCHAR      pSrc;
+    PUCHAR      pDest;
+    PMDL        mdl;
+    ULONG       mdl_offset;
+    ULONG       mdl_len;
+    ULONG       data_len;
+    ULONG       hdr_len;
+    ULONG       cp_len;
+    ULONG       len_inc;
+    ULONG       pos;
+    UINT        sg_idx;
+
+    mdl = NET_BUFFER_FIRST_MDL(nb);
+    mdl_offset = NET_BUFFER_DATA_OFFSET(nb);
+    data_len = NET_BUFFER_DATA_LENGTH(nb);
+    pDest = tcb->data + adapter->buffer_offset;
+
+    hdr_len = 0;
+    while (mdl != NULL && hdr_len < VNIF_TX_HDR_COPY_LEN) {
+        NdisQueryMdl(mdl, &pSrc, &mdl_len, NormalPagePriority);
+        if (pSrc == NULL) {
+            return 0;
+        }
+        if (mdl_offset < mdl_len) {
+            cp_len = mdl_len - mdl_offset;
+            if (cp_len > VNIF_TX_HDR_COPY_LEN - hdr_len) {
+                cp_len = VNIF_TX_HDR_COPY_LEN - hdr_len;
+            }
+            NdisMoveMemory(pDest + hdr_len, pSrc + mdl_offset, cp_len);
+            hdr_len += cp_len;
+            mdl_offset += cp_len;
+        }
+        if (mdl_offset >= mdl_len) {
+            mdl_offset -= mdl_len;
+            NdisGetNextMdl(mdl, &mdl);
+        }
+    }
+
+    tcb->sg[0].phys_addr = tcb->data_pa.QuadPart + adapter->buffer_offset;
+    tcb->sg[0].len = hdr_len;
+    tcb->sg[0].offset = (ULONG)BYTE_OFFSET(pDest);
+    tcb->sg[0].pfn = phys_to_mfn(tcb->data_pa.QuadPart);
+    sg_idx = 1;
+
+    data_len -= hdr_len;
+    while (mdl != NULL && data_len > 0) {
+        mdl_len = MmGetMdlByteCount(mdl);
+        if (mdl_offset < mdl_len) {
+            mdl_len -= mdl_offset;
+            if (mdl_len > data_len) {
+                mdl_len = data_len;
+            }
+            data_len -= mdl_len;
+
+            /* pos is relative to the start of the MDL's first page. */
+            pfn_list = MmGetMdlPfnArray(mdl);
+            pos = MmGetMdlByteOffset(mdl) + mdl_offset;
+            while (mdl_len > 0) {
+                if (sg_idx >= adapter->max_sg_el) {
+                    return 0;
+                }
+                len_inc = PAGE_SIZE - (pos & (PAGE_SIZE - 1));
+                if (len_inc > mdl_len) {
+                    len_inc = mdl_len;
+                }
+                tcb->sg[sg_idx].pfn = (ULONG)pfn_list[pos >> PAGE_SHIFT];
+                tcb->sg[sg_idx].offset = pos & (PAGE_SIZE - 1);
+                tcb->sg[sg_idx].phys_addr =
+                    ((uint64_t)pfn_list[pos >> PAGE_SHIFT] << PAGE_SHIFT)
+                    + tcb->sg[sg_idx].offset;
+                tcb->sg[sg_idx].len = len_inc;
+                sg_idx++;
+                pos += len_inc;
+                mdl_len -= len_inc;
+            }
+            mdl_offset = 0;
+        } else {
+            mdl_offset -= mdl_len;
+        }
+        NdisGetNextMdl(mdl, &mdl);
+    }
+
+    if (data_len != 0) {
+        return 0;
+    }
+
+    tcb->sg_cnt = sg_idx;
+    tcb->flags = VNIF_TCB_HDR_COPIED;
+    return NET_BUFFER_DATA_LENGTH(nb);
+}
+
 NDIS_STATUS
 VNIFSendNetBufferList(PVNIF_ADAPTER adapter,
     PNET_BUFFER_LIST nb_list,
@@ -656,6 +739,7 @@ VNIFSendNetBufferList(PVNIF_ADAPTER adapter,
     PNET_BUFFER     nb_to_send;
     PNET_BUFFER     nb;
     uint32_t        len;
+    uint32_t        copied;
     int             notify;
     UINT            i;
     UINT            sg_cnt;
@@ -687,6 +771,13 @@ VNIFSendNetBufferList(PVNIF_ADAPTER adapter,
 
         nb_len = NET_BUFFER_DATA_LENGTH(nb_to_send);
 
+        if (adapter->tx_bql_enabled
+                && vnif_bql_avail(&adapter->path[path_id].tx_bql) < 0) {
+            adapter->path[path_id].tx_bql.stalls++;
+            status = NDIS_STATUS_RESOURCES;
+            break;
+        }
+
         if (VRING_CAN_ADD_TX(
                 adapter,
                 path_id,
@@ -706,26 +797,23 @@ VNIFSendNetBufferList(PVNIF_ADAPTER adapter,
             if (sg_cnt > adapter->max_sg_el) {
                 needed_tcbs = (nb_len / (PAGE_SIZE - adapter->buffer_offset))
                               + 1;
-                avail_tcbs =
-                    vnif_num_in_list(&adapter->path[path_id].tcb_free_list,
-                                     needed_tcbs);
+                avail_tcbs = adapter->path[path_id].tcb_free_cnt;
                 if (needed_tcbs > avail_tcbs) {
                     DPRINTK(DPRTL_UNEXPD, ("%s: nl_len %d sg_cnt %d ",
                             __func__, nb_len, sg_cnt));
                     DPRINTK(DPRTL_UNEXPD, ("avail tcbs %d needed tcbs %d\n",
                             avail_tcbs, needed_tcbs));
+                    adapter->path[path_id].tcb_shortages++;
                     status = NDIS_STATUS_RESOURCES;
                     break;
                 }
             }
         }
 
-        if (!IsListEmpty(&adapter->path[path_id].tcb_free_list)) {
-            tcb = (TCB *)RemoveHeadList(&adapter->path[path_id].tcb_free_list);
-        }
-
+        VNIF_GET_FREE_TCB(&adapter->path[path_id], tcb);
         if (tcb == NULL) {
             DPRINTK(DPRTL_UNEXPD, ("** Ran out of tcbs.\n"));
+            adapter->path[path_id].tcb_shortages++;
             status = NDIS_STATUS_RESOURCES;
             break;
         }
@@ -734,14 +822,40 @@ VNIFSendNetBufferList(PVNIF_ADAPTER adapter,
         tcb->adapter = adapter;
         tcb->nb = nb_to_send;
         tcb->nb_list = nb_list;
+        tcb->flags = 0;
 
         VNIFInterlockedIncrement(adapter->nBusySend);
         VNIFIncStat(adapter->pv_stats->tx_pkt_cnt);
 
-        if (nb_len <= ETH_MAX_PACKET_SIZE
+        len = 0;
+        copied = 0;
+        if (nb_len >= VNIF_TX_COPY_BREAK
+                && nb_len <= ETH_MAX_PACKET_SIZE
+                && sg_cnt < adapter->max_sg_el
+                && NET_BUFFER_LIST_INFO(nb_list,
+                                        Ieee8021QNetBufferListInfo) == NULL
+                && NET_BUFFER_LIST_INFO(nb_list,
+                                        TcpLargeSendNetBufferListInfo) == NULL
+                && (adapter->b_indirect
+                    || VRING_CAN_ADD_TX(adapter, path_id,
+                                        sg_cnt + MIN_FREE_CP_TX_SLOTS))) {
+            /*
+             * Priority tagged sends still take the full copy below since
+             * neither ring has a way to carry the tag outside the frame.
+             * LSO sends keep their existing paths.
+             */
+            len = vnif_build_hdr_sg(adapter, tcb, nb_to_send);
+            copied = tcb->sg[0].len;
+        }
+        if (len) {
+            VNIFIncrementStat(adapter->pv_stats->tx_zero_copy_octets,
+                              len - copied);
+            VNIFIncrementStat(adapter->pv_stats->tx_copy_octets, copied);
+        } else if (nb_len <= ETH_MAX_PACKET_SIZE
                 || (sg_cnt > adapter->max_sg_el
                     && nb_len < (PAGE_SIZE - adapter->buffer_offset))) {
             len = VNIFCopyNetBuffer(nb_to_send, tcb, adapter->buffer_offset);
+            VNIFIncrementStat(adapter->pv_stats->tx_copy_octets, len);
         } else {
             len = vnif_build_sg(adapter,
                                 path_id,
@@ -750,6 +864,11 @@ VNIFSendNetBufferList(PVNIF_ADAPTER adapter,
                                 NET_BUFFER_DATA_OFFSET(tcb->nb),
                                 NET_BUFFER_DATA_LENGTH(tcb->nb),
                                 sg_cnt);
+            if (sg_cnt >= adapter->max_sg_el) {
+                VNIFIncrementStat(adapter->pv_stats->tx_copy_octets, len);
+            } else {
+                VNIFIncrementStat(adapter->pv_stats->tx_zero_copy_octets, len);
+            }
             if (adapter->cur_tx_tasks & (VNIF_CHKSUM_IPV4_TCP
                                          | VNIF_CHKSUM_IPV6_TCP)) {
                 flags |= NETTXF_data_validated | NETTXF_csum_blank;
@@ -783,6 +902,7 @@ VNIFSendNetBufferList(PVNIF_ADAPTER adapter,
                         flags,
                         &i);
             VNIF_SET_TX_REQ_PROD_PVT(adapter, path_id, i);
+            vnif_bql_queued(&adapter->path[path_id].tx_bql, nb_len);
 
             tcb = NULL;
         } else {
@@ -800,7 +920,7 @@ VNIFSendNetBufferList(PVNIF_ADAPTER adapter,
         ftcb = tcb;
         tcb = tcb->next;
         ftcb->next = NULL;
-        InsertHeadList(&adapter->path[path_id].tcb_free_list, &ftcb->list);
+        VNIF_PUT_FREE_TCB(&adapter->path[path_id], ftcb);
         VNIFInterlockedDecrement(adapter->nBusySend);
     }
 
@@ -922,8 +1042,7 @@ vnif_free_send_tcbs(PVNIF_ADAPTER adapter, TCB *tcb, UINT path_id)
             return_tcb = ftcb;
             ftcb = ftcb->next;
             return_tcb->next = NULL;
-            InsertHeadList(&adapter->path[path_id].tcb_free_list,
-                           &return_tcb->list);
+            VNIF_PUT_FREE_TCB(&adapter->path[path_id], return_tcb);
         }
     }
 }
@@ -978,12 +1097,14 @@ VNIFCheckSendCompletion(PVNIF_ADAPTER adapter, UINT path_id)
     UINT len;
     UINT cnt;
     UINT txstatus;
+    uint32_t bytes;
 
     DPRINTK(DPRTL_TX, ("---> VNIFCheckSendCompletion\n"));
     NdisDprAcquireSpinLock(&adapter->path[path_id].tx_path_lock);
 
     cnt = 0;
     prod = 0;
+    bytes = 0;
     tcb_to_free = NULL;
 
     /* Any packets being sent? Any packet waiting in the send queue? */
@@ -1013,6 +1134,7 @@ VNIFCheckSendCompletion(PVNIF_ADAPTER adapter, UINT path_id)
             /* nb and nb_list will be NULL for a gratuitous ARP packet. */
             if (tcb->nb) {
                 vnif_send_status(adapter, tcb->nb, (int16_t)txstatus);
+                bytes += NET_BUFFER_DATA_LENGTH(tcb->nb);
             }
 
             if (tcb_to_free == NULL) {
@@ -1055,6 +1177,12 @@ VNIFCheckSendCompletion(PVNIF_ADAPTER adapter, UINT path_id)
 
     vnif_free_send_tcbs(adapter, tcb_to_free, path_id);
 
+    if (bytes) {
+        vnif_bql_completed(&adapter->path[path_id].tx_bql,
+                           bytes,
+                           KeQueryInterruptTime());
+    }
+
     /* If we queued any transmits because we didn't have any TCBs earlier,
      * dequeue and send those packets now, as long as we have free TCBs.
      */
@@ -1124,6 +1252,8 @@ MPSendNetBufferLists(
     UINT nb_cnt = 0;
     UINT path_id;
     UINT old_path_id;
+    UINT cpu_path_id;
+    ULONG cpu;
     PNET_BUFFER nb;
     PNET_BUFFER_LIST cur_nb_list;
     PNET_BUFFER_LIST next_nb_list;
@@ -1167,12 +1297,29 @@ MPSendNetBufferLists(
          * Adapter is ready, send this net buffer list, in this case,
          * we always return pending
          */
+        /*
+         * With a tx cpu map, the whole chain goes to the sending
+         * processor's path.  Otherwise each NBL follows its RSS hash.
+         */
+        cpu_path_id = (UINT)-1;
+        if (adapter->tx_cpu_map != NULL) {
+            cpu = vnif_get_current_processor(NULL);
+            if (cpu >= adapter->tx_cpu_map_sz) {
+                cpu %= adapter->tx_cpu_map_sz;
+            }
+            cpu_path_id = adapter->tx_cpu_map[cpu];
+        }
+
         old_path_id = (UINT)-1;
         for (cur_nb_list = nb_list;
                 cur_nb_list != NULL;
                 cur_nb_list = next_nb_list) {
 
-            VNIF_RSS_2_QUEUE_MAP(adapter, cur_nb_list, path_id);
+            if (cpu_path_id != (UINT)-1) {
+                path_id = cpu_path_id;
+            } else {
+                VNIF_RSS_2_QUEUE_MAP(adapter, cur_nb_list, path_id);
+            }
 
             if (old_path_id != path_id) {
                 if (old_path_id != (UINT)-1) {
@@ -1195,6 +1342,8 @@ MPSendNetBufferLists(
             }
             ASSERT(nb_cnt > 0);
             VNIF_GET_NET_BUFFER_LIST_REF_COUNT(cur_nb_list) = nb_cnt;
+            adapter->path[path_id].tx_nbls++;
+            adapter->path[path_id].tx_nbs += nb_cnt;
             /*
              * Queue is not empty or tcb is not available, or another
              * thread is sending a NetBufferList.
@@ -1550,6 +1699,115 @@ vnif_queue_rcv_dpc_if_needed(PVNIF_ADAPTER adapter,
     }
 }
 
+/*
+ * Try to hand a redirected RCB to its target receive queue through the
+ * path's lock-free ring.  The caller holds the path's rx_path_lock, which
+ * makes it the ring's only producer.  The entry is not visible to the
+ * consumer until vnif_rx_flush_staged publishes it.
+ */
+static __inline BOOLEAN
+vnif_rx_xq_put(rcv_to_process_q_t *target_q, UINT path_id, RCB *rcb)
+{
+    if (target_q->xq == NULL) {
+        return FALSE;
+    }
+    return vnif_rcv_xq_put(&target_q->xq[path_id], rcb);
+}
+
+/*
+ * Hand the RCBs redirected to other receive queues during a ring drain over
+ * to those queues.  Ring entries are published without taking any lock.
+ * RCBs that did not fit in a ring were staged and are spliced onto the
+ * target, taking each target's lock once.  The caller's rcv_q lock is
+ * dropped while doing so, the same as when RCBs were moved one at a time.
+ */
+static void
+vnif_rx_flush_staged(PVNIF_ADAPTER adapter,
+                     rcv_to_process_q_t *rcv_q,
+                     UINT path_id,
+                     LIST_ENTRY *staged,
+                     uint32_t staged_mask,
+                     uint32_t xq_mask)
+{
+    rcv_to_process_q_t *target_q;
+    LIST_ENTRY *tail;
+    UINT qidx;
+    UINT lock_cnt;
+    UINT xq_cnt;
+
+    xq_cnt = 0;
+    for (qidx = 0; xq_mask != 0; qidx++, xq_mask >>= 1) {
+        if (!(xq_mask & 1)) {
+            continue;
+        }
+        target_q = &adapter->rcv_q[qidx];
+        xq_cnt += vnif_rcv_xq_publish(&target_q->xq[path_id]);
+        target_q->rcv_should_queue_dpc = TRUE;
+    }
+
+    lock_cnt = 0;
+    if (staged_mask) {
+        NdisDprReleaseSpinLock(&rcv_q->rcv_to_process_lock);
+        for (qidx = 0; staged_mask != 0; qidx++, staged_mask >>= 1) {
+            if (!(staged_mask & 1)) {
+                continue;
+            }
+            target_q = &adapter->rcv_q[qidx];
+            NdisDprAcquireSpinLock(&target_q->rcv_to_process_lock);
+
+            /* Anything already in the rings goes ahead of the staged RCBs. */
+            vnif_rcv_xq_drain(adapter, qidx);
+
+            /* Splice the staged list onto the tail of rcv_to_process. */
+            tail = target_q->rcv_to_process.Blink;
+            tail->Flink = staged[qidx].Flink;
+            staged[qidx].Flink->Blink = tail;
+            staged[qidx].Blink->Flink = &target_q->rcv_to_process;
+            target_q->rcv_to_process.Blink = staged[qidx].Blink;
+
+            target_q->rcv_should_queue_dpc = TRUE;
+            NdisDprReleaseSpinLock(&target_q->rcv_to_process_lock);
+            lock_cnt++;
+        }
+        NdisDprAcquireSpinLock(&rcv_q->rcv_to_process_lock);
+    }
+
+    VNIFIncStat(adapter->pv_stats->rx_rss_passes);
+    VNIFIncrementStat(adapter->pv_stats->rx_rss_lock_cnt, lock_cnt);
+    VNIFIncrementStat(adapter->pv_stats->rx_rss_xq_cnt, xq_cnt);
+}
+
+/*
+ * Feed the drain into the path's moderation and make sure the timer is
+ * running while its rx interrupts are moderated.  The caller holds the
+ * path's rx_path_lock.
+ */
+static __inline void
+vnif_rx_int_mod_update(PVNIF_ADAPTER adapter,
+                       UINT path_id,
+                       UINT pkts,
+                       UINT bytes)
+{
+    vnif_int_mod_t *im;
+    BOOLEAN changed;
+
+    im = &adapter->path[path_id].rx_mod;
+    if (adapter->int_mod == VNIF_INT_MOD_ADAPTIVE) {
+        changed = vnif_int_mod_update(im, KeQueryInterruptTime(),
+                                      pkts, bytes);
+    } else {
+        changed = vnif_int_mod_count(im, pkts, bytes);
+    }
+    if (changed) {
+        DPRINTK(DPRTL_DPC, ("%s: path_id %d rx_bufs %d\n",
+                            __func__, path_id, im->rx_bufs));
+    }
+    if (im->rx_bufs > 1
+            && InterlockedExchange(&adapter->int_mod_timer_set, 1) == 0) {
+        VNIF_SET_TIMER(adapter->int_mod_timer, VNIF_INT_MOD_TIMER_MS);
+    }
+}
+
 /*
  * VNIFReceivePackets does the following:
  * 1. update rx_ring consumer pointer.
@@ -1566,6 +1824,7 @@ VNIFReceivePackets(PVNIF_ADAPTER adapter,
                    UINT max_nbls_to_indicate)
 {
     PROCESSOR_NUMBER target_processor = {0};
+    LIST_ENTRY staged[VNIF_MAX_RCV_QUEUES];
     PNET_BUFFER nb;
     PNET_BUFFER_LIST nb_list;
     PNET_BUFFER_LIST cur_nbl;
@@ -1582,7 +1841,14 @@ VNIFReceivePackets(PVNIF_ADAPTER adapter,
     UINT rcv_target_qidx;
     int more_to_do;
     uint32_t ring_size;
+    uint32_t ring_slots;
+    uint32_t staged_mask;
+    uint32_t xq_mask;
     uint32_t i;
+    UINT rx_pkts;
+    UINT rx_bytes;
+    UINT rx_hdr_copied;
+    UINT rx_frag_bytes;
     uint64_t st;
     BOOLEAN needs_dpc;
 #ifdef RSS_DEBUG
@@ -1616,7 +1882,8 @@ VNIFReceivePackets(PVNIF_ADAPTER adapter,
                        vnif_get_current_processor(NULL),
                        rcv_qidx));
 
-    ring_size = min(max_nbls_to_indicate, VNIF_RX_RING_SIZE(adapter));
+    ring_slots = VNIF_RX_RING_SIZE(adapter);
+    ring_size = min(max_nbls_to_indicate, ring_slots);
     rcv_q = &adapter->rcv_q[rcv_qidx];
     rcv_q->rcv_should_queue_dpc = FALSE;
     rp = 0;
@@ -1626,6 +1893,12 @@ VNIFReceivePackets(PVNIF_ADAPTER adapter,
     rcb_added_to_ring = 0;
     more_to_do = 0;
     needs_dpc = FALSE;
+    staged_mask = 0;
+    xq_mask = 0;
+    rx_pkts = 0;
+    rx_bytes = 0;
+    rx_hdr_copied = 0;
+    rx_frag_bytes = 0;
 
     if (path_id < adapter->num_paths) {
         NdisDprAcquireSpinLock(&adapter->path[path_id].rx_path_lock);
@@ -1659,8 +1932,10 @@ VNIFReceivePackets(PVNIF_ADAPTER adapter,
                     continue;
                 }
 
-                if (rcb->len < VNIF_TCPIP_HEADER_LEN) {
+                if (rcb->next != NULL && rcb->len < VNIF_RX_HDR_LEN) {
+                    rx_hdr_copied -= rcb->len;
                     rcb_added_to_ring += vnif_collapse_rx(adapter, rcb);
+                    rx_hdr_copied += rcb->len;
                 }
 
                 if (len < ETH_MIN_PACKET_SIZE) {
@@ -1670,6 +1945,10 @@ VNIFReceivePackets(PVNIF_ADAPTER adapter,
                         ETH_MIN_PACKET_SIZE - (uintptr_t)len);
                 }
 
+                rx_pkts++;
+                rx_bytes += len;
+                rx_frag_bytes += len - rcb->len;
+
                 rcv_target_qidx = rcv_qidx;
                 vnif_get_rcb_pkt_info(adapter,
                                       rcb,
@@ -1677,12 +1956,23 @@ VNIFReceivePackets(PVNIF_ADAPTER adapter,
                                       &rcv_target_qidx,
                                       len);
                 if (rcv_target_qidx != rcv_qidx) {
-                    NdisDprReleaseSpinLock(&rcv_q->rcv_to_process_lock);
-                    NdisDprAcquireSpinLock(
-                        &adapter->rcv_q[rcv_target_qidx].rcv_to_process_lock);
-                    InsertTailList(
-                        &adapter->rcv_q[rcv_target_qidx].rcv_to_process,
-                        &rcb->list);
+                    /*
+                     * Redirected RCBs are handed over once the drain is done.
+                     * Once one has been staged, the rest for that queue are
+                     * staged too so they stay in order.
+                     */
+                    if ((staged_mask & (1 << rcv_target_qidx))
+                            || !vnif_rx_xq_put(&adapter->rcv_q[rcv_target_qidx],
+                                               path_id,
+                                               rcb)) {
+                        if (!(staged_mask & (1 << rcv_target_qidx))) {
+                            staged_mask |= 1 << rcv_target_qidx;
+                            InitializeListHead(&staged[rcv_target_qidx]);
+                        }
+                        InsertTailList(&staged[rcv_target_qidx], &rcb->list);
+                    } else {
+                        xq_mask |= 1 << rcv_target_qidx;
+                    }
 
 #ifdef DBG
                     if (adapter->rcv_q[rcv_target_qidx].rcv_processor.Number
@@ -1695,10 +1985,6 @@ VNIFReceivePackets(PVNIF_ADAPTER adapter,
                             target_processor;
                     }
 #endif
-                    adapter->rcv_q[rcv_target_qidx].rcv_should_queue_dpc = TRUE;
-                    NdisDprReleaseSpinLock(
-                        &adapter->rcv_q[rcv_target_qidx].rcv_to_process_lock);
-                    NdisDprAcquireSpinLock(&rcv_q->rcv_to_process_lock);
 
                     /* Setup DPC */
                     DPRINTK(DPRTL_RSS,
@@ -1733,7 +2019,7 @@ VNIFReceivePackets(PVNIF_ADAPTER adapter,
                                      rcv_qidx);
                 }
 
-                if (adapter->num_rcb > NET_RX_RING_SIZE) {
+                if (adapter->num_rcb > ring_slots) {
                     rcb_added_to_ring += vnif_add_rcb_to_ring_from_list(
                         adapter,
                         path_id);
@@ -1743,8 +2029,19 @@ VNIFReceivePackets(PVNIF_ADAPTER adapter,
             }
 
             VNIF_SET_RX_RSP_CONS(adapter, path_id, rp);
+            VNIF_RX_RING_PUBLISH(adapter, path_id);
+
+            if (staged_mask || xq_mask) {
+                vnif_rx_flush_staged(adapter, rcv_q, path_id,
+                                     staged, staged_mask, xq_mask);
+                staged_mask = 0;
+                xq_mask = 0;
+            }
         } /* Pull packets off the ring. */
 
+        /* Pick up what other paths have handed to this queue. */
+        vnif_rcv_xq_drain(adapter, rcv_qidx);
+
 
         VNIFStatQueryInterruptTime(st);
 
@@ -1812,6 +2109,19 @@ VNIFReceivePackets(PVNIF_ADAPTER adapter,
         }
     } while (more_to_do && nb_list_cnt < ring_size);
 
+    if (path_id < adapter->num_paths) {
+        adapter->path[path_id].rx_drain_pkts = rx_pkts;
+        if (rx_pkts) {
+            VNIFIncrementStat(adapter->pv_stats->rx_hdr_copy_octets,
+                              rx_hdr_copied);
+            VNIFIncrementStat(adapter->pv_stats->rx_frag_octets,
+                              rx_frag_bytes);
+        }
+        if (adapter->int_mod) {
+            vnif_rx_int_mod_update(adapter, path_id, rx_pkts, rx_bytes);
+        }
+    }
+
     rcv_flags = NDIS_RECEIVE_FLAGS_DISPATCH_LEVEL |
         NDIS_RECEIVE_FLAGS_PERFECT_FILTERED;
 
@@ -1822,7 +2132,7 @@ VNIFReceivePackets(PVNIF_ADAPTER adapter,
         rcv_flags |= NDIS_RECEIVE_FLAGS_RESOURCES;
     }
 
-    if (!IsListEmpty(&rcv_q->rcv_to_process)) {
+    if (vnif_rcv_q_pending(adapter, rcv_qidx)) {
         DPRINTK(DPRTL_DPC,
             ("%s: RecvToProcess not empty, schedule dpc, nbls %d ind %d\n",
             __func__,
@@ -1883,6 +2193,8 @@ MPReturnNetBufferLists(NDIS_HANDLE MiniportAdapterContext,
     UINT old_path_id;
     UINT cur_path_id;
     UINT cur_rcv_qidx;
+    UINT rcb_added_to_ring;
+    UINT old;
 #ifdef DBG
     UINT acq = 0;
 #endif
@@ -1897,6 +2209,8 @@ MPReturnNetBufferLists(NDIS_HANDLE MiniportAdapterContext,
     dispatch_level = NDIS_TEST_RETURN_AT_DISPATCH_LEVEL(ReturnFlags);
 
     old_path_id = (UINT)-1;
+    rcb_added_to_ring = 0;
+    old = 0;
     for (nb_list = NetBufferLists; nb_list != NULL; nb_list = next_nb_list) {
         next_nb_list = NET_BUFFER_LIST_NEXT_NBL(nb_list);
         NET_BUFFER_LIST_NEXT_NBL(nb_list) = NULL;
@@ -1913,13 +2227,16 @@ MPReturnNetBufferLists(NDIS_HANDLE MiniportAdapterContext,
 
         if (old_path_id != cur_path_id) {
             if (old_path_id != (UINT)-1) {
+                VNIF_RX_RING_PUBLISH(adapter, old_path_id);
+                VNIF_RX_NOTIFY(adapter, old_path_id, rcb_added_to_ring, old);
                 VNIF_RELEASE_SPIN_LOCK(&adapter->path[old_path_id].rx_path_lock,
                                        dispatch_level);
             }
             old_path_id = cur_path_id;
             VNIF_ACQUIRE_SPIN_LOCK(&adapter->path[cur_path_id].rx_path_lock,
                                    dispatch_level);
-            adapter->path[cur_path_id].rx_should_notify++;
+            VNIF_GET_RX_REQ_PROD(adapter, cur_path_id, &old);
+            rcb_added_to_ring = 0;
 #ifdef DBG
             acq++;
 #endif
@@ -1932,22 +2249,18 @@ MPReturnNetBufferLists(NDIS_HANDLE MiniportAdapterContext,
         VNIF_PUSH_PCB(adapter->path[cur_path_id].rcb_rp.rcb_nbl, nb_list);
 
         VNIFReturnRcbStats(adapter, rcb);
-        vnif_return_rcb(adapter, rcb);
+        vnif_stage_rcb(adapter, rcb);
+        rcb_added_to_ring++;
 
         VNIFInterlockedDecrement(adapter->nBusyRecv);
         VNIFInterlockedDecrement(adapter->rcv_q[cur_rcv_qidx].n_busy_rcv);
     }
     if (old_path_id != (UINT)-1) {
+        VNIF_RX_RING_PUBLISH(adapter, old_path_id);
+        VNIF_RX_NOTIFY(adapter, old_path_id, rcb_added_to_ring, old);
         VNIF_RELEASE_SPIN_LOCK(&adapter->path[old_path_id].rx_path_lock,
                                dispatch_level);
     }
-
-    for (cur_path_id = 0; cur_path_id < adapter->num_paths; cur_path_id++) {
-        if (adapter->path[cur_path_id].rx_should_notify != 0) {
-            VNIF_RX_RING_KICK_ALWAYS(&adapter->path[cur_path_id]);
-            adapter->path[cur_path_id].rx_should_notify = 0;
-        }
-    }
 #ifdef DBG
     if (acq != 1) {
         PRINTK(("** acq = %d\n", acq));
@@ -2126,6 +2439,84 @@ VNIFPollTimerDpc(void *s1, void *context, void *s2, void *s3)
     DPRINTK(DPRTL_ON, ("%s: out\n", __func__));
 }
 
+/*
+ * Returns TRUE if the path went idle: it had nothing waiting and no drains
+ * since the last tick.  Its ring is then re-armed to interrupt on the next
+ * buffer so it no longer needs the timer.
+ */
+static BOOLEAN
+vnif_int_mod_path_idle(PVNIF_ADAPTER adapter, UINT path_id)
+{
+    BOOLEAN idle;
+
+    NdisDprAcquireSpinLock(&adapter->path[path_id].rx_path_lock);
+    idle = vnif_int_mod_idle(&adapter->path[path_id].rx_mod);
+    if (idle) {
+        VNIF_RX_RING_REARM(adapter, path_id);
+    }
+    NdisDprReleaseSpinLock(&adapter->path[path_id].rx_path_lock);
+    return idle;
+}
+
+/*
+ * Pick up received packets that are waiting for a moderated rx interrupt
+ * which may not come until more arrive.  The timer only has the system
+ * clock's resolution, 15.6ms by default, so a VNIF_INT_MOD_TIMER_MS period
+ * bounds the wait to about one clock tick.  A path that stays quiet for a
+ * whole tick drops to one buffer per interrupt, and the timer stops once
+ * no path is moderated.
+ */
+void
+VNIFIntModTimerDpc(void *s1, void *context, void *s2, void *s3)
+{
+    PVNIF_ADAPTER adapter = (PVNIF_ADAPTER)context;
+    BOOLEAN moderated;
+    UINT i;
+
+    moderated = FALSE;
+    if (VNIF_IS_READY(adapter)) {
+        for (i = 0; i < adapter->num_paths; i++) {
+            if (adapter->path[i].rx_mod.rx_bufs <= 1) {
+                continue;
+            }
+            if (!VNIF_RING_HAS_UNCONSUMED_RESPONSES(adapter->path[i].rx)
+                    && vnif_int_mod_path_idle(adapter, i)
+                    && !VNIF_RING_HAS_UNCONSUMED_RESPONSES(
+                        adapter->path[i].rx)) {
+                continue;
+            }
+            /* A buffer that slipped in before the re-arm is drained here. */
+            moderated = TRUE;
+            if (VNIF_RING_HAS_UNCONSUMED_RESPONSES(adapter->path[i].rx)) {
+                vnif_txrx_interrupt_dpc(adapter,
+                                        VNF_ADAPTER_RX_DPC_IN_PROGRESS,
+                                        i,
+                                        NDIS_INDICATE_ALL_NBLS);
+            }
+        }
+    }
+
+    NdisAcquireSpinLock(&adapter->adapter_flag_lock);
+    if (moderated && VNIF_IS_READY(adapter) && adapter->int_mod_timer) {
+        VNIF_SET_TIMER(adapter->int_mod_timer, VNIF_INT_MOD_TIMER_MS);
+    } else {
+        InterlockedExchange(&adapter->int_mod_timer_set, 0);
+
+        /* A path woken after it was looked at saw the timer still set. */
+        for (i = 0; i < adapter->num_paths
+                && VNIF_IS_READY(adapter) && adapter->int_mod_timer; i++) {
+            if (adapter->path[i].rx_mod.rx_bufs > 1
+                    && InterlockedExchange(&adapter->int_mod_timer_set, 1)
+                        == 0) {
+                VNIF_SET_TIMER(adapter->int_mod_timer,
+                               VNIF_INT_MOD_TIMER_MS);
+                break;
+            }
+        }
+    }
+    NdisReleaseSpinLock(&adapter->adapter_flag_lock);
+}
+
 void
 vnif_poll_dpc(PKDPC dpc, void *ctx, void *s1, void *s2)
 {
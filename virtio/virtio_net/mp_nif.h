@@ -109,6 +109,10 @@ typedef struct _vnif_xen_s {
 
 #define VNIF_ADD_RCB_TO_RING VNIFV_ADD_RCB_TO_RING
 
+#define VNIF_RX_RING_PUBLISH VNIFV_RX_RING_PUBLISH
+
+#define VNIF_RX_RING_REARM VNIFV_RX_RING_REARM
+
 #define MP_RING_FULL MPV_RING_FULL
 
 #define MP_RING_EMPTY MPV_RING_EMPTY
@@ -153,6 +157,7 @@ typedef struct _vnif_xen_s {
 
 #define VNIF_SETUP_PATH_INFO_EX vnifv_setup_path_info_ex
 
+
 #ifdef DBG
 #define VNIF_DUMP VNIFV_DUMP
 #define vnif_rcv_stats_dump vnifv_rcv_stats_dump
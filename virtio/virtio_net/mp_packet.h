@@ -29,6 +29,8 @@
 
 #define __XEN_INTERFACE_VERSION__ 0x00030202
 #include <asm/win_compat.h>
+#include <mp_tcb.h>
+#include <mp_rcv_xq.h>
 
 #if defined XENNET || defined PVVXNET
 #include <xen/public/win_xen.h>
@@ -58,6 +60,9 @@ typedef struct vnif_buffer_descriptor_s {
     ULONG offset;
 } vnif_buffer_descriptor_t;
 
+/* TCB flags */
+#define VNIF_TCB_HDR_COPIED     0x1     /* sg[0] is the copied header */
+
 /* TCB (Transmit Control Block) */
 typedef struct _TCB {
     LIST_ENTRY              list;
@@ -127,6 +132,7 @@ typedef struct _RCB {
 #endif
     INT                     total_len;
     uint32_t                len;
+    uint32_t                data_off;   /* Data start past page */
     uint32_t                flags;
     uint64_t                st;
     UINT                    path_id;
@@ -152,6 +158,7 @@ typedef struct _rcb_ring_pool {
 
 typedef struct _rcv_to_process_q {
     LIST_ENTRY          rcv_to_process;
+    rcv_xq_ring_t       *xq;            /* Indexed by producer path_id */
     NDIS_SPIN_LOCK      rcv_to_process_lock;
     KDPC                rcv_q_dpc;
     LONG                n_busy_rcv;
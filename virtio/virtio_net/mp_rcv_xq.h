@@ -0,0 +1,101 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright 2026 SUSE LLC
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _MP_RCV_XQ_H
+#define _MP_RCV_XQ_H
+
+#define VNIF_RCV_XQ_RING_SIZE   128
+#define VNIF_CACHE_LINE_BYTES   64
+
+/*
+ * Hand-off of RCBs from one path's ring drain to another receive queue.
+ * There is one ring per (path, receive queue) pair.  The producer holds the
+ * path's rx_path_lock and the consumer the receive queue's
+ * rcv_to_process_lock, so neither side needs the other's lock.
+ */
+typedef struct _rcv_xq_ring {
+    ULONG               prod_pvt;       /* Producer only */
+    volatile ULONG      prod;
+    uint8_t             pad_prod[VNIF_CACHE_LINE_BYTES];
+    volatile ULONG      cons;
+    uint8_t             pad_cons[VNIF_CACHE_LINE_BYTES];
+    struct _RCB         *ring[VNIF_RCV_XQ_RING_SIZE];
+} rcv_xq_ring_t;
+
+/* Producer: queue an entry, it is not visible until published. */
+static __inline BOOLEAN
+vnif_rcv_xq_put(rcv_xq_ring_t *xq, struct _RCB *rcb)
+{
+    if (xq->prod_pvt - xq->cons >= VNIF_RCV_XQ_RING_SIZE) {
+        return FALSE;
+    }
+    xq->ring[xq->prod_pvt & (VNIF_RCV_XQ_RING_SIZE - 1)] = rcb;
+    xq->prod_pvt++;
+    return TRUE;
+}
+
+/* Producer: make the queued entries visible and return how many there were. */
+static __inline ULONG
+vnif_rcv_xq_publish(rcv_xq_ring_t *xq)
+{
+    ULONG cnt;
+
+    cnt = xq->prod_pvt - xq->prod;
+    if (cnt) {
+        KeMemoryBarrier();
+        xq->prod = xq->prod_pvt;
+    }
+    return cnt;
+}
+
+/* Consumer: number of published entries, readable once this returns. */
+static __inline ULONG
+vnif_rcv_xq_avail(rcv_xq_ring_t *xq)
+{
+    ULONG cnt;
+
+    cnt = xq->prod - xq->cons;
+    if (cnt) {
+        KeMemoryBarrier();
+    }
+    return cnt;
+}
+
+static __inline struct _RCB *
+vnif_rcv_xq_entry(rcv_xq_ring_t *xq, ULONG i)
+{
+    return xq->ring[(xq->cons + i) & (VNIF_RCV_XQ_RING_SIZE - 1)];
+}
+
+/* Consumer: hand the first cnt entries' slots back to the producer. */
+static __inline void
+vnif_rcv_xq_release(rcv_xq_ring_t *xq, ULONG cnt)
+{
+    KeMemoryBarrier();
+    xq->cons += cnt;
+}
+
+#endif
@@ -382,8 +382,10 @@ vnif_rss_move_rx(PVNIF_ADAPTER adapter)
     }
     no_q_idx = adapter->num_rcv_queues - 1;
     NdisAcquireSpinLock(&adapter->rcv_q[no_q_idx].rcv_to_process_lock);
+    vnif_rcv_xq_drain(adapter, no_q_idx);
     for (i = 0; i < no_q_idx; i++) {
         NdisAcquireSpinLock(&adapter->rcv_q[i].rcv_to_process_lock);
+        vnif_rcv_xq_drain(adapter, i);
         j = 0;
         while (!IsListEmpty(&adapter->rcv_q[i].rcv_to_process)) {
             RPRINTK(DPRTL_RSS, ("%s[%d]: %d ==> 0\n", __func__, i, j++));
@@ -541,6 +543,10 @@ vnif_rss_oid_gen_receive_scale_params(PVNIF_ADAPTER adapter,
         NdisMoveMemory(adapter->rss.hash_secret_key,
                        (char *)rss_params + rss_params->HashSecretKeyOffset,
                        rss_params->HashSecretKeySize);
+        adapter->rss.hash_key_tbl_sz = (USHORT)vnif_toeplitz_build_tbl(
+            (uint8_t *)adapter->rss.hash_secret_key,
+            adapter->rss.hash_secret_key_sz,
+            adapter->rss.hash_key_tbl);
 
         RPRINTK(DPRTL_RSS, ("Hash Secret Key: sz %d mask %x info %x\n",
                 adapter->rss.hash_secret_key_sz,
@@ -625,36 +631,26 @@ vnif_rss_get_rcv_qidx_for_cur_processor(PVNIF_ADAPTER adapter)
 static uint32_t
 vnif_rss_toeplitz_hash(hash_sg_entry_t *sg_buf,
                        int sg_entries,
-                       uint8_t *full_key)
+                       vnif_rss_t *rss)
 {
-
-    uint32_t first_key_word;
     uint32_t res;
-    UINT byte;
-    UINT bit;
+    UINT pos;
     hash_sg_entry_t *sg_entry;
-    uint8_t *next_key_byte;
 
     res = 0;
-    next_key_byte = full_key + sizeof(first_key_word);
-    first_key_word = RtlUlongByteSwap(*(uint32_t *)full_key);
-
+    pos = 0;
     for (sg_entry = sg_buf; sg_entry < sg_buf + sg_entries; ++sg_entry) {
-        for (byte = 0; byte < sg_entry->chunkLen; ++byte) {
-            for (bit = 0; bit <= TOEPLITZ_MAX_BIT_NUM; ++bit) {
-                if (TOEPLITZ_BYTE_HAS_BIT(sg_entry->chunkPtr[byte], bit)) {
-                    res ^= first_key_word;
-                }
-                first_key_word = (first_key_word << 1)
-                    | TOEPLITZ_BYTE_BIT_STATE(*next_key_byte, bit);
-            }
-            ++next_key_byte;
-        }
+        res = vnif_toeplitz_hash(rss->hash_key_tbl,
+                                 rss->hash_key_tbl_sz,
+                                 pos,
+                                 (uint8_t *)sg_entry->chunkPtr,
+                                 sg_entry->chunkLen,
+                                 res);
+        pos += sg_entry->chunkLen;
     }
     return res;
 }
 
-
 static void
 vnif_rss_get_hash_info(PVNIF_ADAPTER adapter,
                        RCB *rcb,
@@ -739,9 +735,7 @@ vnif_rss_get_hash_info(PVNIF_ADAPTER adapter,
     }
 
     if (sg_cnt != 0) {
-        *hash_value = vnif_rss_toeplitz_hash(sg_buf,
-                                             sg_cnt,
-                                             adapter->rss.hash_secret_key);
+        *hash_value = vnif_rss_toeplitz_hash(sg_buf, sg_cnt, &adapter->rss);
         rcb->pkt_info.hash_type = *hash_type;
         rcb->pkt_info.hash_value = *hash_value;
         rcb->pkt_info.hash_function = NdisHashFunctionToeplitz;
@@ -1155,7 +1149,7 @@ vnif_rss_dbg_dump_map(PVNIF_ADAPTER adapter)
     }
     PRINTK(("\n"));
     for (i = 0; i < adapter->num_rcv_queues; i++) {
-        if (!IsListEmpty(&adapter->rcv_q[i].rcv_to_process)) {
+        if (vnif_rcv_q_pending(adapter, i)) {
             PRINTK(("Maybe need DPC for rcv q %d on processor %d\n", i,
                     adapter->rcv_q[i].rcv_processor.Number));
             maybe++;
@@ -27,6 +27,8 @@
 #ifndef _MP_RSS_H
 #define _MP_RSS_H
 
+#include <mp_toeplitz.h>
+
 #define VNIF_NO_RECEIVE_QUEUE (-2)
 
 typedef enum VNIF_RSS_MODE_s {
@@ -41,6 +43,7 @@ typedef enum VNIF_RSS_MODE_s {
 #define VNIF_RECEIVE_UNCLASSIFIED_PACKET (-1)
 #define VNIF_INVALID_INDIRECTION_INDEX (-1)
 #define VNIF_MAX_NUM_RSS_QUEUES 16
+#define VNIF_MAX_RCV_QUEUES (VNIF_MAX_NUM_RSS_QUEUES + 1) /* + no rcv queue */
 #define VNIF_DEFAULT_NUM_RSS_QUEUES 8
 
 #define IS_POWER_OF_TWO(_num) (((_num) != 0) && (((_num) & ((_num) - 1)) == 0))
@@ -53,12 +56,6 @@ typedef enum VNIF_RSS_MODE_s {
 
 #define vnif_get_current_processor(_null) KeGetCurrentProcessorNumberEx(NULL)
 
-#define TOEPLITZ_MAX_BIT_NUM (7)
-#define TOEPLITZ_BYTE_HAS_BIT(byte, bit)                                    \
-    ((byte) & (1 << (TOEPLITZ_MAX_BIT_NUM - (bit))))
-#define TOEPLITZ_BYTE_BIT_STATE(byte, bit)                                  \
-    (((byte) >> (TOEPLITZ_MAX_BIT_NUM - (bit))) & 1)
-
 #define VNIF_GET_RSS_MODE(_adapter) (_adapter)->rss.rss_mode
 
 #define VNIF_RSS_MAX_INDRECTION_TBL_SIZE    \
@@ -66,6 +63,10 @@ typedef enum VNIF_RSS_MODE_s {
 #define VNIF_RSS_HASH_SECRET_KEY_MAX_SIZE_REVISION                          \
     NDIS_RSS_HASH_SECRET_KEY_MAX_SIZE_REVISION_2
 
+/* Each input byte consumes one key byte, the last 4 only seed the window. */
+#define VNIF_RSS_HASH_KEY_TBL_SIZE                                          \
+    (VNIF_RSS_HASH_SECRET_KEY_MAX_SIZE_REVISION - 4)
+
 #define VNIF_RSS_2_QUEUE_MAP(_adapter, _nb_list, _path_id)                  \
 {                                                                           \
     ULONG           rss_hash_val;                                           \
@@ -100,6 +101,8 @@ typedef struct _vnif_rss_s {
     PROCESSOR_NUMBER indirection_tbl[VNIF_RSS_MAX_INDRECTION_TBL_SIZE];
     CCHAR q_indirection_tbl[VNIF_RSS_MAX_INDRECTION_TBL_SIZE];
     CCHAR hash_secret_key[VNIF_RSS_HASH_SECRET_KEY_MAX_SIZE_REVISION];
+    /* Per input byte position, the hash contribution of each byte value. */
+    ULONG hash_key_tbl[VNIF_RSS_HASH_KEY_TBL_SIZE][256];
     PCHAR           cpu_idx_mapping;
     USHORT          *rss2_queue_map;
     ULONG           cpu_idx_mapping_sz;
@@ -110,6 +113,7 @@ typedef struct _vnif_rss_s {
     UINT            rss2_queue_len;
     USHORT          indirection_tbl_sz;
     USHORT          hash_secret_key_sz;
+    USHORT          hash_key_tbl_sz;
 
 } vnif_rss_t;
 
@@ -160,6 +164,7 @@ vnif_rss_get_rcb_target_info(struct _VNIF_ADAPTER *adapter,
 void vnif_rss_free_info(struct _VNIF_ADAPTER *adapter);
 
 #else
+#define VNIF_MAX_RCV_QUEUES 1
 #define vnif_rss_set_generall_attributes(_adapter_, _rss_caps_) NULL
 #define vnif_rss_setup_queue_dpc_path(_adapter_, _path_id) NDIS_STATUS_SUCCESS
 #define vnif_rss_set_rcv_q_targets(_adapter)
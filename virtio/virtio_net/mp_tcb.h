@@ -0,0 +1,52 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright 2026 SUSE LLC
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _MP_TCB_H
+#define _MP_TCB_H
+
+/*
+ * Per path free TCB list.  tcb_free_cnt lets the send path check for the
+ * TCBs a large send needs without walking the list.  The path's
+ * tx_path_lock is held for both.  Only list operations are used so the
+ * host tests in virtio/test can build them.
+ */
+#define VNIF_PUT_FREE_TCB(_path, _tcb)                                  \
+{                                                                       \
+    InsertHeadList(&(_path)->tcb_free_list, &(_tcb)->list);             \
+    (_path)->tcb_free_cnt++;                                            \
+}
+
+#define VNIF_GET_FREE_TCB(_path, _tcb)                                  \
+{                                                                       \
+    if (!IsListEmpty(&(_path)->tcb_free_list)) {                        \
+        (_tcb) = (TCB *)RemoveHeadList(&(_path)->tcb_free_list);        \
+        (_path)->tcb_free_cnt--;                                        \
+    } else {                                                            \
+        (_tcb) = NULL;                                                  \
+    }                                                                   \
+}
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright 2026 SUSE LLC
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _MP_TOEPLITZ_H
+#define _MP_TOEPLITZ_H
+
+/*
+ * Table driven Toeplitz hash.  Kept free of NDIS types beyond ULONG and
+ * UINT so the host tests in virtio/test can build it.
+ */
+
+#define TOEPLITZ_MAX_BIT_NUM (7)
+
+/*
+ * Build the lookup table for a secret key and return the number of input
+ * bytes it covers.  For input byte position i, bit j selects the 32 bit key
+ * window starting at key bit 8 * i + j.  The hash of a byte value is the xor
+ * of the windows selected by its set bits, so hashing becomes one lookup
+ * per input byte.
+ */
+static __inline UINT
+vnif_toeplitz_build_tbl(const uint8_t *key, UINT key_sz, ULONG (*tbl)[256])
+{
+    uint64_t key_bits;
+    ULONG window[TOEPLITZ_MAX_BIT_NUM + 1];
+    UINT tbl_sz;
+    UINT pos;
+    UINT bit;
+    UINT mask;
+    UINT val;
+
+    tbl_sz = key_sz > 4 ? key_sz - 4 : 0;
+    for (pos = 0; pos < tbl_sz; pos++) {
+        key_bits = ((uint64_t)key[pos] << 32)
+            | ((uint64_t)key[pos + 1] << 24)
+            | ((uint64_t)key[pos + 2] << 16)
+            | ((uint64_t)key[pos + 3] << 8)
+            | key[pos + 4];
+        for (bit = 0; bit <= TOEPLITZ_MAX_BIT_NUM; bit++) {
+            window[bit] = (ULONG)(key_bits >> (TOEPLITZ_MAX_BIT_NUM + 1 - bit));
+        }
+
+        /* Each new high bit extends the entries already built below it. */
+        tbl[pos][0] = 0;
+        for (bit = TOEPLITZ_MAX_BIT_NUM + 1, mask = 1; bit-- > 0; mask <<= 1) {
+            for (val = 0; val < mask; val++) {
+                tbl[pos][mask | val] = tbl[pos][val] ^ window[bit];
+            }
+        }
+    }
+    return tbl_sz;
+}
+
+/*
+ * Hash len bytes of input starting at input position pos into res.  Input
+ * past the end of the table is ignored.
+ */
+static __inline uint32_t
+vnif_toeplitz_hash(ULONG (*tbl)[256], UINT tbl_sz, UINT pos,
+                   const uint8_t *data, UINT len, uint32_t res)
+{
+    UINT i;
+
+    for (i = 0; i < len && pos + i < tbl_sz; i++) {
+        res ^= tbl[pos + i][data[i]];
+    }
+    return res;
+}
+
+#endif
@@ -56,6 +56,62 @@ vnif_should_exit_txrx_dpc(PVNIF_ADAPTER adapter, ULONG txrx_ind, UINT path_id)
     return FALSE;
 }
 
+#ifdef NDIS60_MINIPORT
+/*
+ * Keep draining the path's rx ring while its interrupt is still disabled.
+ * Returns once busy_poll_pkts have been received or the ring has stayed
+ * empty for busy_poll_usecs, after which the caller re-arms the interrupt.
+ */
+static void
+vnif_busy_poll_rx(PVNIF_ADAPTER adapter,
+                  UINT path_id,
+                  UINT max_nbls_to_indicate)
+{
+    vnif_path_t *path;
+    LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    LONGLONG budget;
+    LONGLONG idle_start;
+    UINT pkts;
+    UINT polls;
+    UINT busy_polls;
+    UINT bucket;
+
+    path = &adapter->path[path_id];
+    now = KeQueryPerformanceCounter(&freq);
+    budget = freq.QuadPart * adapter->busy_poll_usecs / 1000000;
+    idle_start = now.QuadPart;
+    pkts = path->rx_drain_pkts;
+    polls = 0;
+    busy_polls = 0;
+
+    while (pkts < adapter->busy_poll_pkts
+           && now.QuadPart - idle_start < budget
+           && VNIF_IS_READY(adapter)) {
+        polls++;
+        if (VNIF_RING_HAS_UNCONSUMED_RESPONSES(path->rx)) {
+            VNIFReceivePackets(adapter, path_id, max_nbls_to_indicate);
+            pkts += path->rx_drain_pkts;
+            busy_polls++;
+            now = KeQueryPerformanceCounter(NULL);
+            idle_start = now.QuadPart;
+        } else {
+            YieldProcessor();
+            now = KeQueryPerformanceCounter(NULL);
+        }
+    }
+
+    if (polls) {
+        path->bp_occupancy[busy_polls * (VNIF_BUSY_POLL_HIST_SZ - 1)
+                           / polls]++;
+    }
+    for (bucket = 0; pkts && bucket < VNIF_BUSY_POLL_HIST_SZ - 1; bucket++) {
+        pkts >>= 1;
+    }
+    path->bp_pkts[bucket]++;
+}
+#endif
+
 void
 vnif_txrx_interrupt_dpc(PVNIF_ADAPTER adapter,
                         ULONG txrx_ind,
@@ -100,6 +156,11 @@ vnif_txrx_interrupt_dpc(PVNIF_ADAPTER adapter,
                 adapter->path[path_id].tx);
         } else {
             VNIFReceivePackets(adapter, path_id, max_nbls_to_indicate);
+#ifdef NDIS60_MINIPORT
+            if (adapter->busy_poll_usecs) {
+                vnif_busy_poll_rx(adapter, path_id, max_nbls_to_indicate);
+            }
+#endif
 
             if (g_running_hypervisor == HYPERVISOR_XEN) {
                 more_to_do = VNIF_RING_HAS_UNCONSUMED_RESPONSES(
@@ -116,6 +177,10 @@ vnif_txrx_interrupt_dpc(PVNIF_ADAPTER adapter,
 
     } while (more_to_do);
 
+    if (txrx_ind == VNF_ADAPTER_TX_DPC_IN_PROGRESS && did_work > 1) {
+        VNIFIncrementStat(adapter->pv_stats->tx_ints_avoided, did_work - 1);
+    }
+
 #if defined NDIS60_MINIPORT
     if (g_running_hypervisor == HYPERVISOR_KVM) {
         if (did_work) {
@@ -247,6 +312,164 @@ vnif_setup_rx_path_dpc(VNIF_ADAPTER *adapter)
     return NDIS_STATUS_SUCCESS;
 }
 
+/*
+ * Move the RCBs other paths have handed to this receive queue onto its
+ * rcv_to_process list.  The caller holds the queue's rcv_to_process_lock,
+ * which makes it the rings' only consumer.
+ */
+UINT
+vnif_rcv_xq_drain(PVNIF_ADAPTER adapter, UINT rcv_qidx)
+{
+    rcv_to_process_q_t *rcv_q;
+    rcv_xq_ring_t *xq;
+    RCB *rcb;
+    ULONG avail;
+    ULONG i;
+    UINT cnt;
+    UINT p;
+
+    rcv_q = &adapter->rcv_q[rcv_qidx];
+    if (rcv_q->xq == NULL) {
+        return 0;
+    }
+    cnt = 0;
+    for (p = 0; p < adapter->num_paths; p++) {
+        xq = &rcv_q->xq[p];
+        avail = vnif_rcv_xq_avail(xq);
+        if (avail == 0) {
+            continue;
+        }
+        for (i = 0; i < avail; i++) {
+            rcb = vnif_rcv_xq_entry(xq, i);
+            InsertTailList(&rcv_q->rcv_to_process, &rcb->list);
+        }
+        vnif_rcv_xq_release(xq, avail);
+        cnt += avail;
+    }
+    return cnt;
+}
+
+BOOLEAN
+vnif_rcv_q_pending(PVNIF_ADAPTER adapter, UINT rcv_qidx)
+{
+    rcv_to_process_q_t *rcv_q;
+    UINT p;
+
+    rcv_q = &adapter->rcv_q[rcv_qidx];
+    if (!IsListEmpty(&rcv_q->rcv_to_process)) {
+        return TRUE;
+    }
+    if (rcv_q->xq != NULL) {
+        for (p = 0; p < adapter->num_paths; p++) {
+            if (rcv_q->xq[p].prod != rcv_q->xq[p].cons) {
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+void
+vnif_int_mod_set_mode(PVNIF_ADAPTER adapter, uint32_t mode)
+{
+    UINT i;
+
+    for (i = 0; i < adapter->num_paths; i++) {
+        NdisAcquireSpinLock(&adapter->path[i].rx_path_lock);
+        vnif_int_mod_init(&adapter->path[i].rx_mod, mode);
+        NdisReleaseSpinLock(&adapter->path[i].rx_path_lock);
+    }
+    adapter->int_mod = mode;
+}
+
+void
+vnif_bql_init(vnif_bql_t *bql)
+{
+    NdisZeroMemory(bql, sizeof(vnif_bql_t));
+    bql->limit = VNIF_BQL_MIN_LIMIT;
+    bql->adj_limit = VNIF_BQL_MIN_LIMIT;
+    bql->lowest_slack = (uint32_t)-1;
+    bql->slack_start_time = KeQueryInterruptTime();
+}
+
+#define VNIF_BQL_POSDIFF(_a, _b) \
+    ((int32_t)((_a) - (_b)) > 0 ? (_a) - (_b) : 0)
+
+/*
+ * Account bytes the backend has completed and recompute the limit.  The
+ * caller holds the path's tx_path_lock and passes the interrupt time.
+ */
+void
+vnif_bql_completed(vnif_bql_t *bql, uint32_t bytes, uint64_t now)
+{
+    uint32_t completed;
+    uint32_t limit;
+    uint32_t ovlimit;
+    uint32_t inprogress;
+    uint32_t prev_inprogress;
+    uint32_t slack;
+    uint32_t slack_last_objs;
+    BOOLEAN all_prev_completed;
+
+    completed = bql->num_completed + bytes;
+    limit = bql->limit;
+
+    /* Bytes over the limit before this completion, in flight still. */
+    ovlimit = VNIF_BQL_POSDIFF(bql->num_queued - bql->num_completed, limit);
+    inprogress = bql->num_queued - completed;
+    prev_inprogress = bql->prev_num_queued - bql->num_completed;
+    all_prev_completed =
+        (int32_t)(completed - bql->prev_num_queued) >= 0;
+
+    if ((ovlimit && !inprogress)
+            || (bql->prev_ovlimit && all_prev_completed)) {
+        /*
+         * The ring drained while sends were held back: the limit is too
+         * low.  Grow it by what was queued since the last completion
+         * plus what was over the limit then.
+         */
+        limit += VNIF_BQL_POSDIFF(completed, bql->prev_num_queued)
+            + bql->prev_ovlimit;
+        bql->slack_start_time = now;
+        bql->lowest_slack = (uint32_t)-1;
+    } else if (inprogress && prev_inprogress && !all_prev_completed) {
+        /*
+         * The ring never ran dry.  Track the smallest excess over the hold
+         * time and take it off the limit once the time is up.
+         */
+        slack = VNIF_BQL_POSDIFF(limit + bql->prev_ovlimit,
+                                 2 * (completed - bql->num_completed));
+        slack_last_objs = bql->prev_ovlimit
+            ? VNIF_BQL_POSDIFF(bql->prev_last_obj_cnt, bql->prev_ovlimit)
+            : 0;
+        slack = max(slack, slack_last_objs);
+        if (slack < bql->lowest_slack) {
+            bql->lowest_slack = slack;
+        }
+        if (now - bql->slack_start_time > VNIF_BQL_SLACK_HOLD_TIME) {
+            limit = VNIF_BQL_POSDIFF(limit, bql->lowest_slack);
+            bql->slack_start_time = now;
+            bql->lowest_slack = (uint32_t)-1;
+        }
+    }
+
+    if (limit < VNIF_BQL_MIN_LIMIT) {
+        limit = VNIF_BQL_MIN_LIMIT;
+    } else if (limit > VNIF_BQL_MAX_LIMIT) {
+        limit = VNIF_BQL_MAX_LIMIT;
+    }
+    if (limit != bql->limit) {
+        bql->limit = limit;
+        ovlimit = 0;
+    }
+
+    bql->adj_limit = limit + completed;
+    bql->prev_ovlimit = ovlimit;
+    bql->prev_last_obj_cnt = bql->last_obj_cnt;
+    bql->num_completed = completed;
+    bql->prev_num_queued = bql->num_queued;
+}
+
 BOOLEAN
 calculate_rx_checksum(RCB *rcb,
                       uint8_t *pkt_buf,
@@ -260,12 +483,12 @@ calculate_rx_checksum(RCB *rcb,
     uint16_t *buff;
     uint16_t *src_addr;
     uint16_t *dest_addr;
-    uint16_t *w;
+    uint8_t *w;
     uint32_t len;
     uint32_t cur_len;
     uint32_t sum;
     uint32_t chksum_offset;
-    uint16_t odd;
+    uint32_t offset;
     uint16_t orig_chksum;
     BOOLEAN chksum_valid;
 
@@ -305,51 +528,25 @@ calculate_rx_checksum(RCB *rcb,
         protocol, buff[chksum_offset]));
 
     buff[chksum_offset] = 0;
-    w = buff;
+    w = (uint8_t *)buff;
 
-    /* Calculate the checksum for the header and payload. */
+    /* Calculate the checksum for the header and payload per fragment. */
     cur_len = rcb->len - (ETH_HEADER_SIZE + ip_hdr_len);
-    if (cur_len > len) {
-        cur_len = len;
-    }
-    while (len > 1 && rcb) {
-        while (cur_len > 1) {
-            cur_len -= 2;
-            sum += *w++;
-            len -= 2;
+    offset = 0;
+    while (len > 0 && rcb) {
+        if (cur_len > len) {
+            cur_len = len;
         }
+        sum += vnif_csum_frag(w, cur_len, offset);
+        offset += cur_len;
+        len -= cur_len;
         rcb = rcb->next;
         if (rcb) {
-            if (cur_len == 0) {
-                cur_len = rcb->len;
-                w = (uint16_t *)rcb->page;
-            } else {
-                /*
-                 * We have one byte left in the current page and more data
-                 * in another fragment. Take the current byte and one from
-                 * the next fragment. Due to the byte swapping, put the last
-                 * byte in the lower portion on the uint16 and the first byte
-                 * of the next fragment in the upper portion of the uint16.
-                 */
-                odd = *w & 0xFF;
-                odd |= ((uint16_t)(rcb->page[0]) << 8);
-                sum += odd;
-                len -= 2;
-                cur_len = rcb->len - 1;
-                w = (uint16_t *)(rcb->page + 1);
-            }
-
+            cur_len = rcb->len;
+            w = rcb->page + rcb->data_off;
         }
     }
 
-    /*
-     * If len is 1 there ist still on byte left. We add a padding
-     * byte (0xFF) to build a 16 bit word.
-     */
-    if (len > 0) {
-        sum += *w & 0xFF;
-    }
-
     /*
      * Keep only the last 16 bits of the 32 bit calculated sum and
      * add the carries.
@@ -380,17 +577,7 @@ calculate_rx_checksum(RCB *rcb,
 static UINT32
 raw_checksum_calculator(PVOID buffer, ULONG len)
 {
-    uint32_t val = 0;
-    PUSHORT pus = (PUSHORT)buffer;
-    ULONG count = len >> 1;
-
-    while (count--) {
-        val += *pus++;
-    }
-    if (len & 1) {
-        val += (USHORT)*(PUCHAR)pus;
-    }
-    return val;
+    return vnif_csum_fold(vnif_csum_partial(buffer, len, 0));
 }
 
 static __inline USHORT
@@ -577,39 +764,14 @@ uint16_t
 calculate_ip_checksum(uint8_t *pkt_buf)
 {
     uint16_t *buff;
-    uint16_t *w;
     uint32_t ip_hdr_sz;
-    uint32_t i;
     uint32_t sum;
 
     ip_hdr_sz = IP_INPLACE_HEADER_SIZE(pkt_buf);
     buff = (uint16_t *)pkt_buf;
-    w = buff;
     buff[5] = 0;
 
-    /*
-     * Make 16 bit words out of every two adjacent 8 bit words in the packet
-     * and add them up
-     */
-    sum = 0;
-    while (ip_hdr_sz > 1) {
-        sum += *w++;
-        ip_hdr_sz -= 2;
-    }
-    /*
-     * If len is 1 there ist still on byte left. We add a padding
-     * byte (0xFF) to build a 16 bit word.
-     */
-    if (ip_hdr_sz > 0) {
-        sum += *w & 0xFF;
-    }
-
-    /*
-     * Keep only the last 16 bits of the 32 bit calculated sum and
-     * add the carries.
-     */
-    sum = (sum >> 16) + (sum & 0xFFFF);
-    sum += (sum >> 16);
+    sum = vnif_csum_fold(vnif_csum_partial(buff, ip_hdr_sz, 0));
 
     /* Take the one's complement of sum. */
     sum = ~sum;
@@ -704,17 +866,41 @@ vnif_collapse_rx(PVNIF_ADAPTER adapter, RCB *rcb)
     PUCHAR dest;
     UINT rcb_added_to_ring;
     UINT target_len;
+#ifdef NDIS60_MINIPORT
+    UINT len;
+#endif
 
     dest = rcb->page + rcb->len + adapter->buffer_offset;
     cur_rcb = rcb->next;
     rcb_added_to_ring = 0;
     if (rcb->total_len > ETH_MIN_PACKET_SIZE) {
-        target_len = VNIF_TCPIP_HEADER_LEN;
+        target_len = VNIF_RX_HDR_LEN;
     } else {
         target_len = ETH_MIN_PACKET_SIZE;
     }
-    while (cur_rcb && rcb->len <= target_len) {
-        NdisMoveMemory(dest, cur_rcb->page, cur_rcb->len);
+    while (cur_rcb && rcb->len < target_len) {
+#ifdef NDIS60_MINIPORT
+        /*
+         * Only pull up the headers.  The payload stays where it is and the
+         * buffer's mdl and data_off are moved past the bytes taken.  Both
+         * are put back when the rcb is returned to the ring.
+         */
+        len = target_len - rcb->len;
+        if (cur_rcb->len > len) {
+            NdisMoveMemory(dest, cur_rcb->mdl->MappedSystemVa, len);
+            rcb->len += len;
+            cur_rcb->len -= len;
+            (uint8_t *)cur_rcb->mdl->MappedSystemVa += len;
+            (uint8_t *)cur_rcb->mdl->StartVa += len;
+            cur_rcb->data_off += len;
+            DPRINTK(DPRTL_TRC,
+                ("Pulling up: %p len is %d of %d\n", rcb, len, rcb->len));
+            break;
+        }
+        NdisMoveMemory(dest, cur_rcb->mdl->MappedSystemVa, cur_rcb->len);
+#else
+        NdisMoveMemory(dest, cur_rcb->page + cur_rcb->data_off, cur_rcb->len);
+#endif
         dest += cur_rcb->len;
         rcb->len += cur_rcb->len;
 #ifdef NDIS60_MINIPORT
@@ -876,6 +1062,7 @@ vnif_add_rcb_to_ring(PVNIF_ADAPTER adapter, RCB *rcb)
         cur_rcb->next = NULL;
         cur_rcb->len = 0;
         cur_rcb->total_len = 0;
+        cur_rcb->data_off = 0;
 
         /* In case of priority packet, put things back the way it was.*/
 #ifdef NDIS60_MINIPORT
@@ -915,17 +1102,21 @@ vnif_add_rcb_to_ring_from_list(PVNIF_ADAPTER adapter, UINT path_id)
     return 1;
 }
 
+/*
+ * Put the rcb back on the ring without exposing it to the backend.  The
+ * caller must VNIF_RX_RING_PUBLISH before dropping rx_path_lock.
+ */
 /* Assumes Adapter->RecvLock is held. */
 /* Assumes Adapter->vq[rcb->path_id].rx_path_lock is held. */
 void
-vnif_return_rcb(PVNIF_ADAPTER adapter, RCB *rcb)
+vnif_stage_rcb(PVNIF_ADAPTER adapter, RCB *rcb)
 {
     UINT path_id;
 
     path_id = rcb->path_id;
     DPRINTK(DPRTL_TRC, ("%s: index %x path_id %d.\n",
                         __func__, rcb->index, path_id));
-    if (adapter->num_rcb <= NET_RX_RING_SIZE) {
+    if (adapter->num_rcb <= VNIF_RX_RING_SIZE(adapter)) {
         vnif_add_rcb_to_ring(adapter, rcb);
     } else {
         DPRINTK(DPRTL_TRC, ("%s: vnif_add_rcb_to_ring.\n", __func__));
@@ -936,6 +1127,18 @@ vnif_return_rcb(PVNIF_ADAPTER adapter, RCB *rcb)
     vnif_return_rcb_verify(adapter, rcb);
 }
 
+/* Assumes Adapter->RecvLock is held. */
+/* Assumes Adapter->vq[rcb->path_id].rx_path_lock is held. */
+void
+vnif_return_rcb(PVNIF_ADAPTER adapter, RCB *rcb)
+{
+    UINT path_id;
+
+    path_id = rcb->path_id;
+    vnif_stage_rcb(adapter, rcb);
+    VNIF_RX_RING_PUBLISH(adapter, path_id);
+}
+
 void
 vnif_drop_rcb(PVNIF_ADAPTER adapter, RCB *rcb, int status)
 {
@@ -982,7 +1185,7 @@ VNIFReceiveTimerDpc(
     NdisReleaseSpinLock(&adapter->adapter_flag_lock);
 
     for (i = 0; i < adapter->num_rcv_queues; ++i) {
-        if (!IsListEmpty(&adapter->rcv_q[i].rcv_to_process)) {
+        if (vnif_rcv_q_pending(adapter, i)) {
             if (adapter->pv_stats) {
                 RPRINTK(DPRTL_ON,
                    ("%s: %s rx_cnt %d nBusyRecvs %d, irql %d cpu %d.\n",
@@ -1224,7 +1427,7 @@ vnif_send_private_buffer(
 
         VNIF_GET_TX_REQ_PROD_PVT(adapter, 0, &i);
 
-        tcb = (TCB *) RemoveHeadList(&adapter->path[0].tcb_free_list);
+        VNIF_GET_FREE_TCB(&adapter->path[0], tcb);
 
         if (tcb == NULL) {
             PRINTK(("%s: no tcbs available.\n", __func__));
@@ -1522,6 +1725,99 @@ VNIFPvStatTimerDpc(
         adapter->ifOutErrors + adapter->ifOutDiscards));
 #endif
 
+    RPRINTK(DPRTL_ON,
+           ("    Kicks %d, avoided %d, Tx ints avoided %lld\n",
+        adapter->pv_stats->kicks,
+        adapter->pv_stats->kicks_avoided,
+        adapter->pv_stats->tx_ints_avoided));
+    RPRINTK(DPRTL_ON,
+           ("    Tx bytes: Copied %lld, Zero copy %lld\n",
+        adapter->pv_stats->tx_copy_octets,
+        adapter->pv_stats->tx_zero_copy_octets));
+    RPRINTK(DPRTL_ON,
+           ("    Rx bytes: Headers copied %lld, In later buffers %lld\n",
+        adapter->pv_stats->rx_hdr_copy_octets,
+        adapter->pv_stats->rx_frag_octets));
+    if (adapter->pv_stats->rx_rss_passes) {
+        RPRINTK(DPRTL_ON,
+               ("    Rx RSS redirect: passes %lld, locks %lld, per pass %lld\n",
+            adapter->pv_stats->rx_rss_passes,
+            adapter->pv_stats->rx_rss_lock_cnt,
+            adapter->pv_stats->rx_rss_lock_cnt
+                / adapter->pv_stats->rx_rss_passes));
+        RPRINTK(DPRTL_ON,
+               ("    Rx RSS redirect: hand-off ring %lld\n",
+            adapter->pv_stats->rx_rss_xq_cnt));
+    }
+
+#ifdef NDIS60_MINIPORT
+    for (i = 0; i < adapter->num_paths; i++) {
+        RPRINTK(DPRTL_ON, ("    Tx[%d]: NBLs %lld, NBs %lld\n",
+            i,
+            adapter->path[i].tx_nbls,
+            adapter->path[i].tx_nbs));
+        RPRINTK(DPRTL_ON,
+            ("    Tx[%d]: byte limit %d, in flight high %d, stalls %lld\n",
+            i,
+            adapter->path[i].tx_bql.limit,
+            adapter->path[i].tx_bql.inflight_hwm,
+            adapter->path[i].tx_bql.stalls));
+        adapter->path[i].tx_bql.inflight_hwm = 0;
+        if (adapter->path[i].tcb_shortages) {
+            RPRINTK(DPRTL_ON, ("    Tx[%d]: TCB shortages %lld, free %d\n",
+                i,
+                adapter->path[i].tcb_shortages,
+                adapter->path[i].tcb_free_cnt));
+        }
+        RPRINTK(DPRTL_ON,
+            ("    Rx[%d]: buffer memory %d KB, %d of %d, cpu %d node %d\n",
+            i,
+            (adapter->num_rcb * adapter->rx_alloc_buffer_size) >> 10,
+            adapter->num_rcb,
+            adapter->rx_alloc_buffer_size,
+            adapter->path[i].cpu_idx,
+            adapter->path[i].numa_node));
+        if (adapter->busy_poll_usecs) {
+            RPRINTK(DPRTL_ON,
+                ("    Rx[%d]: busy poll occupancy "
+                 "%lld %lld %lld %lld %lld %lld %lld %lld\n",
+                i,
+                adapter->path[i].bp_occupancy[0],
+                adapter->path[i].bp_occupancy[1],
+                adapter->path[i].bp_occupancy[2],
+                adapter->path[i].bp_occupancy[3],
+                adapter->path[i].bp_occupancy[4],
+                adapter->path[i].bp_occupancy[5],
+                adapter->path[i].bp_occupancy[6],
+                adapter->path[i].bp_occupancy[7]));
+            RPRINTK(DPRTL_ON,
+                ("    Rx[%d]: busy poll pkts "
+                 "%lld %lld %lld %lld %lld %lld %lld %lld\n",
+                i,
+                adapter->path[i].bp_pkts[0],
+                adapter->path[i].bp_pkts[1],
+                adapter->path[i].bp_pkts[2],
+                adapter->path[i].bp_pkts[3],
+                adapter->path[i].bp_pkts[4],
+                adapter->path[i].bp_pkts[5],
+                adapter->path[i].bp_pkts[6],
+                adapter->path[i].bp_pkts[7]));
+        }
+        if (adapter->int_mod) {
+            RPRINTK(DPRTL_ON, ("    Rx[%d]: moderation bufs %d, pkts %lld\n",
+                i,
+                adapter->path[i].rx_mod.rx_bufs,
+                adapter->path[i].rx_mod.cur.pkts));
+        }
+    }
+    for (i = 0; i < VNIF_MAX_NUMA_NODES; i++) {
+        if (adapter->rx_node_bufs[i]) {
+            RPRINTK(DPRTL_ON, ("    Rx node %d: buffers %d\n",
+                i, adapter->rx_node_bufs[i]));
+        }
+    }
+#endif
+
     RPRINTK(DPRTL_ON,
            ("    Rx: Good %lld, Normal %lld, Resource %lld, Discarded %lld\n",
         adapter->pv_stats->rx_pkt_cnt,
@@ -1598,7 +1894,7 @@ VNIFPvStatTimerDpc(
     }
 
     for (i = 0; i < adapter->num_rcv_queues; ++i) {
-        if (!IsListEmpty(&adapter->rcv_q[i].rcv_to_process)) {
+        if (vnif_rcv_q_pending(adapter, i)) {
             PRINTK(("    [%d] rcv_to_process not empty: cnt %d nBusyRecvs %d\n",
                   i, adapter->pv_stats->rx_to_process_cnt, adapter->nBusyRecv));
 #ifdef DBG
@@ -1617,10 +1913,10 @@ VNIFPvStatTimerDpc(
 #ifndef XENNET
             if (g_running_hypervisor == HYPERVISOR_KVM) {
                 PRINTK(
-                    ("    [%d] last_used_idx %d used->idx %d free %d head %d\n",
+                    ("    [%d] last_used_idx %d packed %d free %d head %d\n",
                     i,
                     adapter->path[i].u.vq.rx->last_used_idx,
-                    adapter->path[i].u.vq.rx->vring.used->idx,
+                    adapter->path[i].u.vq.rx->packed_ring,
                     adapter->path[i].u.vq.rx->num_free,
                     adapter->path[i].u.vq.rx->free_head));
             }
@@ -284,6 +284,11 @@ VNIFV_FindAdapter(PVNIF_ADAPTER adapter)
                                  adapter->b_indirect));
         }
 
+        if (virtio_is_feature_enabled(adapter->u.v.features,
+                                      VIRTIO_F_RING_PACKED)) {
+            adapter->b_packed_ring = TRUE;
+        }
+
         /* MAC */
         status = VNIFSetupPermanentAddress(adapter);
         if (status != NDIS_STATUS_SUCCESS) {
@@ -316,12 +321,17 @@ vnif_init_rcb_pool(PVNIF_ADAPTER adapter)
         vnif_init_rcb_free_list(adapter, path_id);
 
         sg.len = adapter->rx_alloc_buffer_size;
-        for (i = 0; i < adapter->path[path_id].u.vq.rx->vring.num; i++) {
+        for (i = 0;
+                i < adapter->path[path_id].u.vq.rx->vring.num
+                && !IsListEmpty(&adapter->path[path_id].rcb_rp.rcb_free_list);
+                i++) {
             rcb = (RCB *)RemoveHeadList(
                 &adapter->path[path_id].rcb_rp.rcb_free_list);
             sg.phys_addr = rcb->page_pa.QuadPart;
-            vring_add_buf(adapter->path[path_id].u.vq.rx, &sg, 0, 1, rcb);
+            vring_add_buf_batch(adapter->path[path_id].u.vq.rx,
+                                &sg, 0, 1, rcb);
         }
+        vring_publish_batch(adapter->path[path_id].u.vq.rx);
 
         NdisReleaseSpinLock(&adapter->path[path_id].rx_path_lock);
 
@@ -360,6 +370,8 @@ vnif_init_tx(PVNIF_ADAPTER adapter)
                 &tcb->list,
                 &adapter->path[p].tx_path_lock);
         }
+        adapter->path[p].tcb_free_cnt = num_ring_desc;
+        vnif_bql_init(&adapter->path[p].tx_bql);
     }
     return NDIS_STATUS_SUCCESS;
 }
@@ -381,6 +393,13 @@ vnif_set_guest_features(PVNIF_ADAPTER adapter)
         virtio_feature_enable(guest_features, VIRTIO_RING_F_INDIRECT_DESC);
     }
 
+    adapter->u.v.b_event_idx = FALSE;
+    if (virtio_is_feature_enabled(adapter->u.v.features,
+                                  VIRTIO_RING_F_EVENT_IDX)) {
+        virtio_feature_enable(guest_features, VIRTIO_RING_F_EVENT_IDX);
+        adapter->u.v.b_event_idx = TRUE;
+    }
+
     if ((adapter->cur_rx_tasks & (VNIF_CHKSUM_IPV4_TCP
                                   | VNIF_CHKSUM_IPV4_UDP
                                   | VNIF_CHKSUM_IPV6_TCP
@@ -430,9 +449,9 @@ vnif_setup_queues(PVNIF_ADAPTER adapter)
             i * 2,
             NULL,
             NULL,
-            0,
+            (uint16_t)adapter->rx_queue_size,
             adapter->path[i].u.vq.rx_msg,
-            FALSE);
+            adapter->u.v.b_event_idx);
         if (adapter->path[i].u.vq.rx == NULL) {
             PRINTK(("Failed to setup rx queue for path %d msg %d\n",
                     i, adapter->path[i].u.vq.rx_msg));
@@ -446,9 +465,9 @@ vnif_setup_queues(PVNIF_ADAPTER adapter)
             (i * 2) + 1,
             NULL,
             NULL,
-            0,
+            (uint16_t)adapter->tx_queue_size,
             adapter->path[i].u.vq.tx_msg,
-            FALSE);
+            adapter->u.v.b_event_idx);
         if (adapter->path[i].u.vq.tx == NULL) {
             PRINTK(("Failed to setup tx queue for path %d msg %d\n",
                     i, adapter->path[i].u.vq.tx_msg));
@@ -479,7 +498,7 @@ vnif_setup_queues(PVNIF_ADAPTER adapter)
                     NULL,
                     0,
                     adapter->u.v.ctrl_msg,
-                    FALSE);
+                    adapter->u.v.b_event_idx);
                 if (adapter->u.v.ctrl_q == NULL) {
                     PRINTK(("Failed to setup ctrl queu\n"));
                     status = NDIS_ERROR_CODE_OUT_OF_RESOURCES;
@@ -611,6 +630,7 @@ VNIFV_SetupAdapterInterface(PVNIF_ADAPTER adapter)
         adapter->lso_data_size = VIRTIO_LSO_MAX_DATA_SIZE;
     }
 
+    virtio_device_use_packed_ring(&adapter->u.v.vdev, adapter->b_packed_ring);
     vnif_set_guest_features(adapter);
 
     status = vnif_setup_queues(adapter);
@@ -48,17 +48,30 @@ vnif_disable_interrupt_from_status(PVNIF_ADAPTER adapter,
     }
 }
 
-static VOID
+/*
+ * TX completions are not latency sensitive, so their interrupt is delayed
+ * until most of the outstanding sends are done.  Returns FALSE if the TX
+ * ring already needs servicing and no interrupt may arrive for it.
+ */
+static BOOLEAN
 vnif_enable_interrupt_from_status(PVNIF_ADAPTER adapter,
                                    UINT path_id,
                                    LONG int_status)
 {
+    BOOLEAN tx_idle;
+
+    tx_idle = TRUE;
     if (int_status & VNIF_RX_INT) {
-        vring_enable_interrupt(adapter->path[path_id].u.vq.rx);
+        /* Anything already past the threshold is seen by the caller. */
+        vring_enable_interrupt_after(
+            adapter->path[path_id].u.vq.rx,
+            (uint16_t)adapter->path[path_id].rx_mod.rx_bufs);
     }
     if (int_status & VNIF_TX_INT) {
-        vring_enable_interrupt(adapter->path[path_id].u.vq.tx);
+        tx_idle = vring_enable_interrupt_delayed(
+            adapter->path[path_id].u.vq.tx);
     }
+    return tx_idle;
 }
 
 static VOID
@@ -108,10 +121,9 @@ MPEnableMSIInterrupt(
 static BOOLEAN
 sync_q_enable(sync_ctx_t *sync)
 {
-    vnif_enable_interrupt_from_status(sync->adapter,
-                                      sync->path_id,
-                                      sync->int_status);
-    return TRUE;
+    return vnif_enable_interrupt_from_status(sync->adapter,
+                                             sync->path_id,
+                                             sync->int_status);
 }
 
 static void
@@ -202,12 +214,19 @@ vnif_miniport_interrupt_dpc(
     } while (more_to_do);
 
     if (path_id < adapter->num_paths && int_status != 0) {
-        NdisMSynchronizeWithInterruptEx(adapter->u.v.interrupt_handle,
-                                        msg_id, sync_q_enable, &sync);
+        more_to_do = 0;
+        if (!NdisMSynchronizeWithInterruptEx(adapter->u.v.interrupt_handle,
+                                             msg_id, sync_q_enable, &sync)) {
+            /* Let the queued dpc pick up the tx work as well as any rx. */
+            more_to_do = VNIF_TX_INT | (int_status & VNIF_RX_INT);
+            InterlockedOr(&adapter->path[path_id].u.vq.interrupt_status,
+                          (LONG)more_to_do);
+        }
 
-        if ((int_status & VNIF_RX_INT)
-                && VNIF_RING_HAS_UNCONSUMED_RESPONSES(
-                        adapter->path[path_id].u.vq.rx)) {
+        if (more_to_do
+                || ((int_status & VNIF_RX_INT)
+                    && VNIF_RING_HAS_UNCONSUMED_RESPONSES(
+                        adapter->path[path_id].u.vq.rx))) {
 
 #if NDIS_SUPPORT_NDIS620
             KeGetCurrentProcessorNumberEx(&processor_number);
@@ -88,6 +88,7 @@ typedef struct _vnif_virtio_s {
     NDIS_SPIN_LOCK      ctrl_lock;
     uint16_t            ctrl_msg;
     BOOLEAN             b_control_queue;
+    BOOLEAN             b_event_idx;        /* VIRTIO_RING_F_EVENT_IDX */
     BOOLEAN             cached;             /* are alloc bufferes cached */
 } vnif_virtio_t;
 
@@ -158,6 +159,8 @@ void VNIFV_FREE_SHARED_MEMORY(struct _VNIF_ADAPTER *adapter, void *va,
     PHYSICAL_ADDRESS pa, uint32_t len, NDIS_HANDLE hndl);
 
 void VNIFV_ADD_RCB_TO_RING(struct _VNIF_ADAPTER *adapter, struct _RCB *rcb);
+void VNIFV_RX_RING_PUBLISH(struct _VNIF_ADAPTER *adapter, UINT path_id);
+void VNIFV_RX_RING_REARM(struct _VNIF_ADAPTER *adapter, UINT path_id);
 ULONG VNIFV_RX_RING_SIZE(struct _VNIF_ADAPTER *adapter);
 ULONG VNIFV_TX_RING_SIZE(struct _VNIF_ADAPTER *adapter);
 void VNIFV_GET_TX_REQ_PROD_PVT(struct _VNIF_ADAPTER *adapter, UINT path_id,
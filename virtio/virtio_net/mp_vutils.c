@@ -116,6 +116,7 @@ vnifv_add_tx(PVNIF_ADAPTER adapter, UINT path_id, TCB *tcb,
     uint8_t *ip_hdr;
     ULONG gso_mss;
     UINT sg_cnt;
+    UINT copy_len;
     uint16_t ip_hdr_len;
     uint8_t protocol;
 #ifdef DBG
@@ -139,7 +140,18 @@ vnifv_add_tx(PVNIF_ADAPTER adapter, UINT path_id, TCB *tcb,
         sg[1].phys_addr = tcb->data_pa.QuadPart + adapter->buffer_offset;
         sg[1].len = send_len;
         sg_cnt = 2;
+        copy_len = send_len;
+    } else {
+        for (sg_cnt = 0; sg_cnt < tcb->sg_cnt; sg_cnt++) {
+            sg[sg_cnt + 1].phys_addr = tcb->sg[sg_cnt].phys_addr;
+            sg[sg_cnt + 1].len = tcb->sg[sg_cnt].len;
+        }
+        sg_cnt++; /* Add one for the header. */
+        copy_len = tcb->sg[0].len;
+    }
 
+    /* Only look at the headers when they have been copied into the tcb. */
+    if (tcb->sg_cnt == 0 || (tcb->flags & VNIF_TCB_HDR_COPIED)) {
         ip_hdr = tcb->data + adapter->buffer_offset + ETH_HEADER_SIZE;
 
         if (IP_INPLACE_HEADER_VERSION(ip_hdr) == IPV4) {
@@ -147,7 +159,7 @@ vnifv_add_tx(PVNIF_ADAPTER adapter, UINT path_id, TCB *tcb,
             protocol = ip_hdr[IP_HDR_TCP_UDP_OFFSET];
         } else {
             get_ipv6_hdr_len_and_protocol((ipv6_header_t *)ip_hdr,
-                                          send_len - ETH_HEADER_SIZE,
+                                          copy_len - ETH_HEADER_SIZE,
                                           &ip_hdr_len,
                                           &protocol);
         }
@@ -179,12 +191,6 @@ vnifv_add_tx(PVNIF_ADAPTER adapter, UINT path_id, TCB *tcb,
                                 ip_hdr_len,
                                 send_len);
         }
-    } else {
-        for (sg_cnt = 0; sg_cnt < tcb->sg_cnt; sg_cnt++) {
-            sg[sg_cnt + 1].phys_addr = tcb->sg[sg_cnt].phys_addr;
-            sg[sg_cnt + 1].len = tcb->sg[sg_cnt].len;
-        }
-        sg_cnt++; /* Add one for the header. */
     }
 
     if (gso_mss) {
@@ -263,21 +269,39 @@ vnifv_add_tx(PVNIF_ADAPTER adapter, UINT path_id, TCB *tcb,
 #endif
 
     if (adapter->b_indirect) {
-        vring_add_buf_indirect(adapter->path[path_id].tx,
-                               sg,
-                               sg_cnt,
-                               0,
-                               tcb,
-                               (struct vring_desc *)tcb->vr_desc,
-                               tcb->vr_desc_pa.QuadPart);
+        vring_add_buf_indirect_batch(adapter->path[path_id].tx,
+                                     sg,
+                                     sg_cnt,
+                                     0,
+                                     tcb,
+                                     (struct vring_desc *)tcb->vr_desc,
+                                     tcb->vr_desc_pa.QuadPart);
+    } else {
+        vring_add_buf_batch(adapter->path[path_id].tx, sg, sg_cnt, 0, tcb);
+    }
+}
+
+/*
+ * With event indexes the host tells us which avail index it wants to hear
+ * about, so only kick when that index has been crossed.
+ */
+static void
+vnifv_kick(PVNIF_ADAPTER adapter, virtio_queue_t *vq)
+{
+    if (vring_kick(vq)) {
+        VNIFInterlockedIncrementStat(adapter->pv_stats->kicks);
     } else {
-        vring_add_buf(adapter->path[path_id].tx, sg, sg_cnt, 0, tcb);
+        VNIFInterlockedIncrementStat(adapter->pv_stats->kicks_avoided);
     }
 }
 
 void
 vnifv_notify_always_tx(PVNIF_ADAPTER adapter, UINT path_id)
 {
+    if (adapter->u.v.b_event_idx) {
+        vnifv_kick(adapter, adapter->path[path_id].u.vq.tx);
+        return;
+    }
     vring_kick_always(adapter->path[path_id].tx);
 }
 
@@ -289,9 +313,75 @@ vnifv_get_tx(PVNIF_ADAPTER adapter, UINT path_id, UINT *cons, UINT prod,
     return vring_get_buf(adapter->path[path_id].tx, len);
 }
 
+/*
+ * With mergeable rx buffers a frame is spread over num_buffers rx buffers.
+ * Only the first one carries the virtio header, the data of the rest
+ * starts at the beginning of the page.
+ */
+static void
+vnifv_get_rx_merged(PVNIF_ADAPTER adapter, UINT path_id, RCB *head,
+    uint16_t nbuffers)
+{
+    RCB *tail;
+    RCB *rcb;
+    UINT len;
+
+    tail = head;
+    while (--nbuffers) {
+        rcb = vring_get_buf(adapter->path[path_id].u.vq.rx, &len);
+        if (rcb == NULL) {
+            PRINTK(("%s: missing %d rx buffers, total_len %d\n",
+                    __func__, nbuffers, head->total_len));
+            break;
+        }
+        rcb->len = len;
+        rcb->next = NULL;
+#ifdef NDIS60_MINIPORT
+        (uint8_t *)rcb->mdl->MappedSystemVa -= adapter->buffer_offset;
+        (uint8_t *)rcb->mdl->StartVa -= adapter->buffer_offset;
+#endif
+        tail->next = rcb;
+        tail = rcb;
+        head->total_len += len;
+    }
+}
+
+RCB *
+vnifv_get_rx(PVNIF_ADAPTER adapter, UINT path_id, UINT rp, UINT *i, INT *len)
+{
+    virtio_net_hdr_mrg_t *hdr;
+    RCB *rcb;
+
+    rcb = vring_get_buf(adapter->path[path_id].u.vq.rx, len);
+    if (rcb) {
+        rcb->len = *len - adapter->buffer_offset;
+        rcb->total_len = rcb->len;
+        rcb->next = NULL;
+        if (adapter->buffer_offset) {
+            hdr = (virtio_net_hdr_mrg_t *)rcb->page;
+            if (hdr->nbuffers > 1) {
+                vnifv_get_rx_merged(adapter, path_id, rcb, hdr->nbuffers);
+            }
+        }
+        *len = rcb->total_len;
+    }
+    return rcb;
+}
+
+#ifdef NDIS60_MINIPORT
+        (uint8_t *)rcb->mdl->MappedSystemVa -= adapter->buffer_offset;
+        (uint8_t *)rcb->mdl->StartVa -= adapter->buffer_offset;
+#endif
+        tail->next = rcb;
+        tail = rcb;
+        head->total_len += len;
+    }
+}
+
 RCB *
 vnifv_get_rx(PVNIF_ADAPTER adapter, UINT path_id, UINT rp, UINT *i, INT *len)
 {
+    virtio_net_hdr_mrg_t *hdr;
     RCB *rcb;
 
     rcb = vring_get_buf(adapter->path[path_id].u.vq.rx, len);
@@ -299,6 +389,17 @@ vnifv_get_rx(PVNIF_ADAPTER adapter, UINT path_id, UINT rp, UINT *i, INT *len)
         rcb->len = *len - adapter->buffer_offset;
         rcb->total_len = rcb->len;
         rcb->next = NULL;
+        rcb->gso_size = 0;
+        if (adapter->buffer_offset) {
+            hdr = (virtio_net_hdr_mrg_t *)rcb->page;
+            if (hdr->hdr.gso_type != VIRTIO_NET_HDR_GSO_NONE) {
+                rcb->gso_size = hdr->hdr.gso_size;
+            }
+            if (hdr->nbuffers > 1) {
+                vnifv_get_rx_merged(adapter, path_id, rcb, hdr->nbuffers);
+            }
+        }
+        *len = rcb->total_len;
     }
     return rcb;
 }
@@ -363,7 +464,20 @@ VNIFV_ADD_RCB_TO_RING(VNIF_ADAPTER *adapter, RCB *rcb)
 
     sg.phys_addr = rcb->page_pa.QuadPart;
     sg.len = adapter->rx_alloc_buffer_size;
-    vring_add_buf(adapter->path[rcb->path_id].u.vq.rx, &sg, 0, 1, rcb);
+    vring_add_buf_batch(adapter->path[rcb->path_id].u.vq.rx, &sg, 0, 1, rcb);
+}
+
+void
+VNIFV_RX_RING_PUBLISH(VNIF_ADAPTER *adapter, UINT path_id)
+{
+    vring_publish_batch(adapter->path[path_id].u.vq.rx);
+}
+
+/* Interrupt on the next received buffer instead of the moderated count. */
+void
+VNIFV_RX_RING_REARM(VNIF_ADAPTER *adapter, UINT path_id)
+{
+    vring_enable_interrupt(adapter->path[path_id].u.vq.rx);
 }
 
 ULONG
@@ -451,7 +565,11 @@ VNIFV_RX_NOTIFY(VNIF_ADAPTER *adapter, UINT path_id,
                 UINT rcb_added_to_ring, UINT old)
 {
     if (rcb_added_to_ring) {
-        vring_kick_always(adapter->path[path_id].rx);
+        if (adapter->u.v.b_event_idx) {
+            vnifv_kick(adapter, adapter->path[path_id].u.vq.rx);
+        } else {
+            vring_kick_always(adapter->path[path_id].rx);
+        }
     }
 }
 
@@ -470,8 +588,7 @@ VNIFV_RING_FREE_REQUESTS(VNIF_ADAPTER *adapter, UINT path_id)
 UINT
 VNIFV_HAS_UNCONSUMED_RESPONSES(void *vq, UINT cons, UINT prod)
 {
-    return ((virtio_queue_t *)vq)->last_used_idx !=
-        ((virtio_queue_t *)vq)->vring.used->idx;
+    return VRING_HAS_UNCONSUMED_RESPONSES((virtio_queue_t *)vq);
 }
 
 UINT
@@ -82,6 +82,7 @@ NDIS_OID VNIFSupportedOids[] = {
 #ifdef NDIS60_MINIPORT
     OID_GEN_STATISTICS,
     OID_GEN_INTERRUPT_MODERATION,
+    OID_VNIF_TX_QUEUE_MAP,
 #else
     OID_802_3_MAC_OPTIONS,
 #endif
@@ -479,18 +480,24 @@ MPQueryInformation(
         break;
 
     case OID_GEN_INTERRUPT_MODERATION:
-        /* This driver does not support interrupt moderation at this time */
         int_mod.Header.Type = NDIS_OBJECT_TYPE_DEFAULT;
         int_mod.Header.Revision =
             NDIS_INTERRUPT_MODERATION_PARAMETERS_REVISION_1;
         int_mod.Header.Size =
             NDIS_SIZEOF_INTERRUPT_MODERATION_PARAMETERS_REVISION_1;
         int_mod.Flags = 0;
-        int_mod.InterruptModeration = NdisInterruptModerationNotSupported;
+        int_mod.InterruptModeration = adapter->int_mod
+            ? NdisInterruptModerationEnabled
+            : NdisInterruptModerationDisabled;
         ulBytesAvailable = infolen =
             sizeof(NDIS_INTERRUPT_MODERATION_PARAMETERS);
         infoptr = (PVOID) &int_mod;
         break;
+
+    case OID_VNIF_TX_QUEUE_MAP:
+        ulBytesAvailable = infolen = sizeof(USHORT) * adapter->tx_cpu_map_sz;
+        infoptr = (PVOID) adapter->tx_cpu_map;
+        break;
 #else
     case OID_802_3_MAC_OPTIONS:
         info = 0;
@@ -740,6 +747,7 @@ MPSetInformation(
 #ifdef NDIS60_MINIPORT
     PNDIS_OFFLOAD_ENCAPSULATION encapsulation;
     PNDIS_OFFLOAD_PARAMETERS offload_parms;
+    PNDIS_INTERRUPT_MODERATION_PARAMETERS int_mod;
     uint32_t offload_changed;
     uint32_t lso_enabled;
     USHORT offload_params_size;
@@ -812,8 +820,32 @@ MPSetInformation(
 
 #ifdef NDIS60_MINIPORT
     case OID_GEN_INTERRUPT_MODERATION:
-        /* This driver does not support interrupt moderation at this time */
-        status = NDIS_STATUS_INVALID_DATA;
+        if (InformationBufferLength
+                < NDIS_SIZEOF_INTERRUPT_MODERATION_PARAMETERS_REVISION_1) {
+            *BytesNeeded =
+                NDIS_SIZEOF_INTERRUPT_MODERATION_PARAMETERS_REVISION_1;
+            status = NDIS_STATUS_INVALID_LENGTH;
+            break;
+        }
+        int_mod = (PNDIS_INTERRUPT_MODERATION_PARAMETERS)InformationBuffer;
+        status = NDIS_STATUS_SUCCESS;
+        if (int_mod->InterruptModeration == NdisInterruptModerationDisabled) {
+            vnif_int_mod_set_mode(adapter, VNIF_INT_MOD_DISABLED);
+        } else if (int_mod->InterruptModeration
+                   == NdisInterruptModerationEnabled) {
+            if (adapter->int_mod == VNIF_INT_MOD_DISABLED) {
+                vnif_int_mod_set_mode(adapter, VNIF_INT_MOD_ADAPTIVE);
+            }
+        } else {
+            status = NDIS_STATUS_INVALID_DATA;
+        }
+        if (status == NDIS_STATUS_SUCCESS) {
+            *BytesRead =
+                NDIS_SIZEOF_INTERRUPT_MODERATION_PARAMETERS_REVISION_1;
+        }
+        RPRINTK(DPRTL_CONFIG, ("OID_GEN_INTERRUPT_MODERATION %d: %d\n",
+                               int_mod->InterruptModeration,
+                               adapter->int_mod));
         break;
 
     case OID_OFFLOAD_ENCAPSULATION:
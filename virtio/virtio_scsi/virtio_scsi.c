@@ -128,7 +128,8 @@ sp_start_io(virtio_sp_dev_ext_t *dev_ext, PSCSI_REQUEST_BLOCK Srb)
                 VIRTIO_SP_DRIVER_NAME, Srb->Function,
                 dev_ext->op_mode, dev_ext->state,
                 dev_ext->vq[VIRTIO_SCSI_QUEUE_REQUEST]->last_used_idx,
-                dev_ext->vq[VIRTIO_SCSI_QUEUE_REQUEST]->vring.used->idx));
+                VRING_HAS_UNCONSUMED_RESPONSES(
+                    dev_ext->vq[VIRTIO_SCSI_QUEUE_REQUEST])));
 
         if ((dev_ext->op_mode & OP_MODE_SHUTTING_DOWN)) {
             RPRINTK(DPRTL_ON, ("  anding in OP_MODE_SHUTTING_DOWN\n"));
@@ -139,8 +140,8 @@ sp_start_io(virtio_sp_dev_ext_t *dev_ext, PSCSI_REQUEST_BLOCK Srb)
         dev_ext->op_mode |= OP_MODE_RESET;
         RPRINTK(DPRTL_ON, ("  new op_mode %x\n", dev_ext->op_mode));
 
-        if (dev_ext->vq[VIRTIO_SCSI_QUEUE_REQUEST]->last_used_idx
-                != dev_ext->vq[VIRTIO_SCSI_QUEUE_REQUEST]->vring.used->idx) {
+        if (VRING_HAS_UNCONSUMED_RESPONSES(
+                dev_ext->vq[VIRTIO_SCSI_QUEUE_REQUEST])) {
             /* Try to clean up any outstanding requests. */
             dev_ext->op_mode |= OP_MODE_POLLING;
             virtio_sp_poll(dev_ext);
@@ -361,7 +362,8 @@ sp_reset_bus(virtio_sp_dev_ext_t *dev_ext, ULONG PathId)
     PRINTK(("%s %s: op = %x, st = %x, %x %x\n",
         VIRTIO_SP_DRIVER_NAME, __func__, dev_ext->op_mode, dev_ext->state,
         dev_ext->vq[VIRTIO_SCSI_QUEUE_REQUEST]->last_used_idx,
-        dev_ext->vq[VIRTIO_SCSI_QUEUE_REQUEST]->vring.used->idx));
+        VRING_HAS_UNCONSUMED_RESPONSES(
+            dev_ext->vq[VIRTIO_SCSI_QUEUE_REQUEST])));
     return TRUE;
 }
 
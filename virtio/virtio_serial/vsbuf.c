@@ -130,8 +130,9 @@ vserial_send_buffers(PPDO_DEVICE_EXTENSION port,
     return length;
 }
 
-NTSTATUS
-vserial_add_in_buf(IN virtio_queue_t *vq, IN port_buffer_t *buf)
+/* Stage the buffer on the ring, it is exposed to the host by vring_kick. */
+static NTSTATUS
+vserial_stage_in_buf(IN virtio_queue_t *vq, IN port_buffer_t *buf)
 {
     NTSTATUS  status = STATUS_SUCCESS;
     virtio_buffer_descriptor_t sg;
@@ -147,15 +148,26 @@ vserial_add_in_buf(IN virtio_queue_t *vq, IN port_buffer_t *buf)
     sg.phys_addr = buf->pa_buf.QuadPart;
     sg.len = buf->size;
 
-    if (vring_add_buf(vq, &sg, 0, 1, buf) < 0) {
+    if (vring_add_buf_batch(vq, &sg, 0, 1, buf) < 0) {
         status = STATUS_INSUFFICIENT_RESOURCES;
     }
 
-    vring_kick(vq);
     DPRINTK(DPRTL_TRC, ("<-- %s\n", __func__));
     return status;
 }
 
+NTSTATUS
+vserial_add_in_buf(IN virtio_queue_t *vq, IN port_buffer_t *buf)
+{
+    NTSTATUS  status;
+
+    status = vserial_stage_in_buf(vq, buf);
+    if (vq != NULL) {
+        vring_kick(vq);
+    }
+    return status;
+}
+
 port_buffer_t *
 vserial_get_inf_buf(PPDO_DEVICE_EXTENSION port)
 {
@@ -189,20 +201,29 @@ vserial_fill_queue(IN virtio_queue_t *vq, IN KSPIN_LOCK *lock)
     for (;;) {
         buf = vserial_alloc_buffer(PAGE_SIZE);
         if (buf == NULL) {
-            return STATUS_INSUFFICIENT_RESOURCES;
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
         }
 
         KeAcquireInStackQueuedSpinLock(lock, &lh);
-        status = vserial_add_in_buf(vq, buf);
+        status = vserial_stage_in_buf(vq, buf);
         if (!NT_SUCCESS(status)) {
             vserial_free_buffer(buf);
             KeReleaseInStackQueuedSpinLock(&lh);
+            status = STATUS_SUCCESS;
             break;
         }
         KeReleaseInStackQueuedSpinLock(&lh);
     }
+
+    /* Publish everything staged above and notify the host once. */
+    if (vq != NULL) {
+        KeAcquireInStackQueuedSpinLock(lock, &lh);
+        vring_kick(vq);
+        KeReleaseInStackQueuedSpinLock(&lh);
+    }
     DPRINTK(DPRTL_TRC, ("<-- %s\n", __func__));
-    return STATUS_SUCCESS;
+    return status;
 }
 
 void
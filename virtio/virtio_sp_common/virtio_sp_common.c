@@ -430,7 +430,7 @@ virtio_scsi_do_cmd(virtio_sp_dev_ext_t *dev_ext, SCSI_REQUEST_BLOCK *srb)
 
     if (dev_ext->indirect) {
         pa = SP_GET_PHYSICAL_ADDRESS(dev_ext, NULL, srb_ext->vr_desc, &len);
-        num_free = vring_add_buf_indirect(dev_ext->vq[qidx],
+        num_free = vring_add_buf_indirect_batch(dev_ext->vq[qidx],
             &srb_ext->sg[0],
             srb_ext->out,
             srb_ext->in,
@@ -438,7 +438,7 @@ virtio_scsi_do_cmd(virtio_sp_dev_ext_t *dev_ext, SCSI_REQUEST_BLOCK *srb)
             srb_ext->vr_desc,
             pa.QuadPart);
     } else {
-        num_free = vring_add_buf(dev_ext->vq[qidx],
+        num_free = vring_add_buf_batch(dev_ext->vq[qidx],
             &srb_ext->sg[0],
             srb_ext->out,
             srb_ext->in,
@@ -578,7 +578,9 @@ virtio_sp_virtio_dev_init(virtio_sp_dev_ext_t *dev_ext,
     virtio_bar_t bar[PCI_TYPE0_ADDRESSES];
     NTSTATUS status;
     ULONG pci_cfg_len;
+    ULONG len;
     ULONG i;
+    uint32_t packed_ring;
     UCHAR CapOffset;
     int iBar;
 
@@ -672,6 +674,17 @@ virtio_sp_virtio_dev_init(virtio_sp_dev_ext_t *dev_ext,
                                 pci_cfg_buf,
                                 VIRTIO_SP_DRIVER_NAME,
                                 dev_ext->msi_enabled);
+    if (NT_SUCCESS(status)) {
+        /* Packed rings stay off unless asked for, and never for dumps. */
+        packed_ring = 0;
+        if (dev_ext->op_mode == OP_MODE_NORMAL) {
+            len = sizeof(uint32_t);
+            sp_registry_read(dev_ext, PVCTRL_PACKED_RING_STR, REG_DWORD,
+                             &packed_ring, &len);
+        }
+        virtio_device_use_packed_ring(&dev_ext->vdev,
+                                      packed_ring ? TRUE : FALSE);
+    }
     return status;
 }
 
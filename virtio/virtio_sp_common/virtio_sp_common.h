@@ -35,6 +35,7 @@
 #endif
 
 #define PVCTRL_QDEPTH_STR "qdepth"
+#define PVCTRL_PACKED_RING_STR "packed_ring"
 
 #define SP_NUMBER_OF_ACCESS_RANGES PCI_TYPE0_ADDRESSES
 #define SP_BUS_INTERFACE_TYPE PCIBus
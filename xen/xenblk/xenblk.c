@@ -90,6 +90,14 @@ XenBlkIoctl(XENBLK_DEVICE_EXTENSION *dev_ext, pv_ioctl_t data);
 static uint32_t g_interrupt_count;
 uint32_t g_max_segs_per_req = XENBLK_DEFAULT_MAX_SEGS;
 
+/* Data pages are (1 << order) + PAGE_ROUND_UP for each bounce class. */
+static const uint8_t xenblk_bounce_order[XENBLK_BOUNCE_CLASSES] = {
+    2, 4, 6, 8
+};
+static const uint16_t xenblk_bounce_depth[XENBLK_BOUNCE_CLASSES] = {
+    32, 16, 8, 4
+};
+
 
 /*
  * Routine Description:
@@ -171,6 +179,105 @@ XenDriverEntry(IN PVOID DriverObject, IN PVOID RegistryPath)
     return status;
 }
 
+static void
+xenblk_bounce_init(XENBLK_DEVICE_EXTENSION *dev_ext)
+{
+    struct xenblk_bounce_class *bc;
+    uint32_t pages;
+    uint32_t c;
+
+    dev_ext->bounce = ExAllocatePoolWithTag(NonPagedPoolNx,
+        XENBLK_BOUNCE_CLASSES * sizeof(struct xenblk_bounce_class),
+        XENBLK_TAG_GENERAL);
+    if (dev_ext->bounce == NULL) {
+        PRINTK(("XenBlk: failed to alloc bounce buffer classes.\n"));
+        return;
+    }
+    for (c = 0; c < XENBLK_BOUNCE_CLASSES; c++) {
+        bc = &dev_ext->bounce[c];
+        InitializeSListHead(&bc->free);
+
+        /* Room for the data plus the sa array and working sgl. */
+        pages = (1 << xenblk_bounce_order[c]) + PAGE_ROUND_UP;
+        bc->size = (pages << PAGE_SHIFT)
+            + (uint32_t)(sizeof(void *) * (pages + 1))
+            + (uint32_t)sizeof(STOR_SCATTER_GATHER_LIST)
+            + (uint32_t)(sizeof(STOR_SCATTER_GATHER_ELEMENT) * pages);
+        bc->max_free = xenblk_bounce_depth[c];
+    }
+}
+
+/*
+ * Buffers are only ever pushed whole onto their class's free list, so
+ * the list entry lives in the first bytes of the free buffer itself.
+ */
+static uint8_t *
+xenblk_bounce_get(XENBLK_DEVICE_EXTENSION *dev_ext, size_t size,
+    uint8_t *cls)
+{
+    struct xenblk_bounce_class *bc;
+    uint8_t *va;
+    uint8_t c;
+
+    *cls = XENBLK_BOUNCE_NONE;
+    if (dev_ext->bounce != NULL) {
+        for (c = 0; c < XENBLK_BOUNCE_CLASSES; c++) {
+            bc = &dev_ext->bounce[c];
+            if (size <= bc->size) {
+                va = (uint8_t *)InterlockedPopEntrySList(&bc->free);
+                if (va != NULL) {
+                    *cls = c;
+                    return va;
+                }
+                va = ExAllocatePoolWithTag(NonPagedPoolNx, bc->size,
+                                           XENBLK_TAG_GENERAL);
+                if (va != NULL) {
+                    *cls = c;
+                    InterlockedIncrement(&dev_ext->bounce_allocs);
+                }
+                return va;
+            }
+        }
+    }
+    InterlockedIncrement(&dev_ext->bounce_allocs);
+    return ExAllocatePoolWithTag(NonPagedPoolNx, size, XENBLK_TAG_GENERAL);
+}
+
+void
+xenblk_bounce_put(XENBLK_DEVICE_EXTENSION *dev_ext, void *va, uint8_t cls)
+{
+    struct xenblk_bounce_class *bc;
+
+    if (cls < XENBLK_BOUNCE_CLASSES && dev_ext->bounce != NULL) {
+        bc = &dev_ext->bounce[cls];
+        if (QueryDepthSList(&bc->free) < bc->max_free) {
+            InterlockedPushEntrySList(&bc->free, (PSLIST_ENTRY)va);
+            return;
+        }
+    }
+    ExFreePool(va);
+}
+
+void
+xenblk_bounce_free(XENBLK_DEVICE_EXTENSION *dev_ext)
+{
+    struct xenblk_bounce_class *bounce;
+    PSLIST_ENTRY entry;
+    uint32_t c;
+
+    bounce = dev_ext->bounce;
+    if (bounce == NULL) {
+        return;
+    }
+    dev_ext->bounce = NULL;
+    for (c = 0; c < XENBLK_BOUNCE_CLASSES; c++) {
+        while ((entry = InterlockedPopEntrySList(&bounce[c].free)) != NULL) {
+            ExFreePool(entry);
+        }
+    }
+    ExFreePool(bounce);
+}
+
 static NTSTATUS
 XenBlkInitDevExt(
     XENBLK_DEVICE_EXTENSION *dev_ext,
@@ -256,6 +363,14 @@ XenBlkInitDevExt(
     XENBLK_ZERO_VALUE(dev_ext->alloc_cnt_s);
     XENBLK_ZERO_VALUE(dev_ext->alloc_cnt_v);
 
+    dev_ext->bounce = NULL;
+    dev_ext->bounce_ios = 0;
+    dev_ext->bounce_bytes = 0;
+    dev_ext->bounce_allocs = 0;
+    if (irql <= DISPATCH_LEVEL) {
+        xenblk_bounce_init(dev_ext);
+    }
+
     XENBLK_CLEAR_FLAG(dev_ext->xenblk_locks, 0xffffffff);
     XENBLK_CLEAR_FLAG(dev_ext->cpu_locks, 0xffffffff);
 
@@ -351,11 +466,11 @@ XenBlkFindAdapter(
         /* If just one controller, all infos will be the same. */
         /* If each has their own contrller, there will only be one info. */
         if (dev_ext->info != NULL && dev_ext->info[0] != NULL) {
-            q_depth = RING_SIZE(&dev_ext->info[0]->ring) /
+            q_depth = RING_SIZE(&dev_ext->info[0]->rinfo[0].ring) /
             ((XENBLK_MAX_SGL_ELEMENTS /
               BLKIF_MAX_SEGMENTS_PER_REQUEST) + 1) > PVCTRL_MAX_BLK_QDEPTH ?
                 PVCTRL_MAX_BLK_QDEPTH :
-                RING_SIZE(&dev_ext->info[0]->ring) /
+                RING_SIZE(&dev_ext->info[0]->rinfo[0].ring) /
                     ((XENBLK_MAX_SGL_ELEMENTS /
                       BLKIF_MAX_SEGMENTS_PER_REQUEST) + 1);
             if (dev_ext->qdepth > q_depth) {
@@ -429,6 +544,36 @@ XenBlkFindAdapter(
     return SP_RETURN_FOUND;
 }
 
+#if defined XENBLK_STORPORT && (NTDDI_VERSION >= NTDDI_WIN7)
+/*
+ * Have StorPort complete each request on the processor that issued it.
+ * Together with xenblk_select_ring() this keeps a ring's completions on
+ * the processors that feed it.
+ */
+static void
+xenblk_init_perf_opts(XENBLK_DEVICE_EXTENSION *dev_ext)
+{
+    PERF_CONFIGURATION_DATA perf;
+    ULONG status;
+
+    memset(&perf, 0, sizeof(perf));
+    perf.Version = STOR_PERF_VERSION;
+    perf.Size = sizeof(perf);
+    status = StorPortInitializePerfOpts(dev_ext, TRUE, &perf);
+    if (status != STOR_STATUS_SUCCESS
+            || !(perf.Flags & STOR_PERF_DPC_REDIRECTION)) {
+        RPRINTK(DPRTL_INIT, ("XenBlk: no DPC redirection: %x, flags %x\n",
+                             status, perf.Flags));
+        return;
+    }
+    perf.Flags = STOR_PERF_DPC_REDIRECTION;
+    status = StorPortInitializePerfOpts(dev_ext, FALSE, &perf);
+    RPRINTK(DPRTL_INIT, ("XenBlk: DPC redirection status %x\n", status));
+}
+#else
+#define xenblk_init_perf_opts(_dev_ext)
+#endif
+
 static BOOLEAN
 XenBlkInitialize(XENBLK_DEVICE_EXTENSION *dev_ext)
 {
@@ -446,7 +591,7 @@ XenBlkInitialize(XENBLK_DEVICE_EXTENSION *dev_ext)
     if (dev_ext->state == REMOVED) {
         for (i = 0; i < dev_ext->max_targets; i++) {
             if (dev_ext->info[i]) {
-                unmask_evtchn(dev_ext->info[i]->evtchn);
+                xenblk_unmask_evtchns(dev_ext->info[i]);
             }
         }
         dev_ext->state = WORKING;
@@ -458,6 +603,10 @@ XenBlkInitialize(XENBLK_DEVICE_EXTENSION *dev_ext)
         return TRUE;
     }
 
+    if (dev_ext->op_mode == OP_MODE_NORMAL) {
+        xenblk_init_perf_opts(dev_ext);
+    }
+
     XENBLK_CLEAR_FLAG(dev_ext->xenblk_locks, (BLK_IZE_L | BLK_INT_L));
     XENBLK_CLEAR_FLAG(dev_ext->cpu_locks, (1 << KeGetCurrentProcessorNumber()));
 
@@ -576,6 +725,9 @@ XenBlkClaim(XENBLK_DEVICE_EXTENSION *dev_ext)
     struct blkfront_info *info;
     NTSTATUS status;
     uint32_t i;
+#ifdef XENBLK_STORPORT
+    uint32_t r;
+#endif
 
     /*
      * The info array of pointers comes form xenbus and all pointers
@@ -659,9 +811,12 @@ XenBlkClaim(XENBLK_DEVICE_EXTENSION *dev_ext)
         RPRINTK(DPRTL_INIT,
                 ("Xenblk: XenBlkClaim - blkfront_probe complete.\n"));
 #ifdef XENBLK_STORPORT
-        StorPortInitializeDpc(dev_ext,
-            &info->dpc,
-            (PHW_DPC_ROUTINE)blkif_int_dpc);
+        /* All of them, the ring count can change on a reconnect. */
+        for (r = 0; r < XENBLK_MAX_RINGS; r++) {
+            StorPortInitializeDpc(dev_ext,
+                &info->rinfo[r].dpc,
+                (PHW_DPC_ROUTINE)blkif_int_dpc);
+        }
 #endif
         dev_ext->info[i] = info;
         PRINTK(("Xenblk: initialization complete for %s.\n", info->nodename));
@@ -674,6 +829,7 @@ XenBlkInitHiberCrashInfo(XENBLK_DEVICE_EXTENSION *dev_ext,
     struct blkfront_info *info)
 {
     uint32_t j;
+    uint32_t r;
 
     /*
      * The info array of pointers comes form xenbus and all pointers
@@ -683,12 +839,17 @@ XenBlkInitHiberCrashInfo(XENBLK_DEVICE_EXTENSION *dev_ext,
     if (info != NULL) {
         RPRINTK(DPRTL_INIT, ("\thibernate or crash dump\n");
         xenblk_print_save_req(&info->xbdev->req);
-        mask_evtchn(info->evtchn));
+        xenblk_mask_evtchns(info));
 
         /* Clear out any grants that may still be around. */
         RPRINTK(DPRTL_INIT, ("\tdoing shadow completion\n"));
-        for (j = 0; j < BLK_RING_SIZE; j++) {
-            info->shadow[j].req.nr_segments = 0;
+        for (r = 0; r < info->nr_rings; r++) {
+            if (info->rinfo[r].shadow == NULL) {
+                continue;
+            }
+            for (j = 0; j < BLK_RING_SIZE; j++) {
+                info->rinfo[r].shadow[j].req.nr_segments = 0;
+            }
         }
 
         /*
@@ -974,6 +1135,13 @@ XenBlkStartIo(XENBLK_DEVICE_EXTENSION *dev_ext, PSCSI_REQUEST_BLOCK Srb)
                     Srb->DataBuffer)->LogicalBlockAddress,
                 &last_sector);
 
+            /* Advertise thin provisioning so UNMAP is issued. */
+            if (Srb->DataTransferLength > 14) {
+                ((uint8_t *)Srb->DataBuffer)[14] =
+                    (info->flags & BLKIF_DISCARD_F) ?
+                        XENBLK_READ_CAP16_LBPME : 0;
+            }
+
             RPRINTK(DPRTL_ON,
                     ("16 %x: sectors 0x%llx sector-sz %u last sector 0x%llx\n",
                      Srb->TargetId,
@@ -1026,6 +1194,23 @@ XenBlkStartIo(XENBLK_DEVICE_EXTENSION *dev_ext, PSCSI_REQUEST_BLOCK Srb)
             break;
         }
 
+        case SCSIOP_UNMAP:
+            DPRINTK(DPRTL_TRC, ("%x: SCSIOP_UNMAP, dev=%x,srb=%x\n",
+                                Srb->TargetId, dev_ext, Srb));
+            Srb->SrbStatus = do_blkif_discard(info, Srb);
+            if (Srb->SrbStatus == SRB_STATUS_PENDING) {
+                xenblk_next_request(NextRequest, dev_ext);
+                XENBLK_CLEAR_FLAG(dev_ext->xenblk_locks,
+                                  (BLK_STI_L | BLK_SIO_L));
+                return TRUE;
+            }
+            if (Srb->SrbStatus == SRB_STATUS_BUSY) {
+                StorPortBusy(dev_ext, 2);
+                RPRINTK(DPRTL_UNEXPD, ("Xenblk %x: unmap SRB_STATUS_BUSY\n",
+                                       Srb->TargetId));
+            }
+            break;
+
         case SCSIOP_INQUIRY: {
             PINQUIRYDATA inquiryData;
             uint8_t *rbuf;
@@ -1119,6 +1304,91 @@ XenBlkStartIo(XENBLK_DEVICE_EXTENSION *dev_ext, PSCSI_REQUEST_BLOCK Srb)
                     rbuf->SupportedPageList[0] = VPD_SUPPORTED_PAGES;
                     rbuf->SupportedPageList[1] = VPD_SERIAL_NUMBER;
                     rbuf->SupportedPageList[2] = VPD_DEVICE_IDENTIFIERS;
+                    if (info->flags & BLKIF_DISCARD_F) {
+                        rbuf->PageLength = 5;
+                        rbuf->SupportedPageList[3] = VPD_BLOCK_LIMITS;
+                        rbuf->SupportedPageList[4] =
+                            VPD_LOGICAL_BLOCK_PROVISIONING;
+                    }
+                    break;
+                }
+                case VPD_BLOCK_LIMITS: {
+                    PVPD_BLOCK_LIMITS_PAGE rbuf;
+                    uint32_t blocks;
+                    uint32_t spb;
+
+                    if (!(info->flags & BLKIF_DISCARD_F)) {
+                        Srb->SrbStatus = SRB_STATUS_INVALID_REQUEST;
+                        break;
+                    }
+                    if (Srb->DataTransferLength <
+                            sizeof(VPD_BLOCK_LIMITS_PAGE)) {
+                        Srb->SrbStatus = SRB_STATUS_DATA_OVERRUN;
+                        break;
+                    }
+
+                    RPRINTK(DPRTL_ON, ("%x: SCSIOP_INQUIRY page b0.\n",
+                                       Srb->TargetId));
+                    rbuf = (PVPD_BLOCK_LIMITS_PAGE)Srb->DataBuffer;
+                    memset(rbuf, 0, sizeof(VPD_BLOCK_LIMITS_PAGE));
+                    rbuf->DeviceType = DIRECT_ACCESS_DEVICE;
+                    rbuf->DeviceTypeQualifier = DEVICE_CONNECTED;
+                    rbuf->PageCode = VPD_BLOCK_LIMITS;
+                    rbuf->PageLength[1] = 0x3c;
+
+                    blocks = 0xffffffff;
+                    REVERSE_BYTES(rbuf->MaximumUnmapLBACount, &blocks);
+                    blocks = XENBLK_MAX_DISCARD_REQS;
+                    REVERSE_BYTES(rbuf->MaximumUnmapBlockDescriptorCount,
+                                  &blocks);
+
+                    /*
+                     * The discard extent is kept in 512 byte sectors, the
+                     * page reports it in logical blocks.
+                     */
+                    spb = (uint32_t)(info->sector_size >> 9);
+                    if (spb == 0) {
+                        spb = 1;
+                    }
+                    blocks = info->discard_granularity / spb;
+                    if (blocks == 0) {
+                        blocks = 1;
+                    }
+                    REVERSE_BYTES(rbuf->OptimalUnmapGranularity, &blocks);
+                    blocks = info->discard_alignment / spb;
+                    REVERSE_BYTES(rbuf->UnmapGranularityAlignment, &blocks);
+                    /* UGAVALID */
+                    rbuf->UnmapGranularityAlignment[0] |= 0x80;
+                    Srb->DataTransferLength = sizeof(VPD_BLOCK_LIMITS_PAGE);
+                    break;
+                }
+                case VPD_LOGICAL_BLOCK_PROVISIONING: {
+                    PVPD_LOGICAL_BLOCK_PROVISIONING_PAGE rbuf;
+
+                    if (!(info->flags & BLKIF_DISCARD_F)) {
+                        Srb->SrbStatus = SRB_STATUS_INVALID_REQUEST;
+                        break;
+                    }
+                    if (Srb->DataTransferLength <
+                            sizeof(VPD_LOGICAL_BLOCK_PROVISIONING_PAGE)) {
+                        Srb->SrbStatus = SRB_STATUS_DATA_OVERRUN;
+                        break;
+                    }
+
+                    RPRINTK(DPRTL_ON, ("%x: SCSIOP_INQUIRY page b2.\n",
+                                       Srb->TargetId));
+                    rbuf = (PVPD_LOGICAL_BLOCK_PROVISIONING_PAGE)
+                        Srb->DataBuffer;
+                    memset(rbuf, 0,
+                           sizeof(VPD_LOGICAL_BLOCK_PROVISIONING_PAGE));
+                    rbuf->DeviceType = DIRECT_ACCESS_DEVICE;
+                    rbuf->DeviceTypeQualifier = DEVICE_CONNECTED;
+                    rbuf->PageCode = VPD_LOGICAL_BLOCK_PROVISIONING;
+                    rbuf->PageLength[1] = 4;
+                    rbuf->ProvisioningType = PROVISIONING_TYPE_THIN;
+                    rbuf->LBPU = 1;
+                    Srb->DataTransferLength =
+                        sizeof(VPD_LOGICAL_BLOCK_PROVISIONING_PAGE);
                     break;
                 }
                 case VPD_DEVICE_IDENTIFIERS: {
@@ -1480,11 +1750,18 @@ XenBlkStartReadWrite(XENBLK_DEVICE_EXTENSION *dev_ext,
             working_sgl_size = sizeof(STOR_SCATTER_GATHER_LIST)
                 + (sizeof(STOR_SCATTER_GATHER_ELEMENT) *
                     (va_size >> PAGE_SHIFT));
-            srb_ext->va = ExAllocatePoolWithTag(NonPagedPoolNx,
+            srb_ext->va = xenblk_bounce_get(dev_ext,
                 (size_t)va_size + (size_t)sa_size + (size_t)working_sgl_size,
-                XENBLK_TAG_GENERAL);
+                &srb_ext->bounce_cls);
             if (srb_ext->va) {
                 XENBLK_INC(dev_ext->alloc_cnt_v);
+                if (InterlockedIncrement64(&dev_ext->bounce_ios) == 1) {
+                    PRINTK(("XenBlk: %x double buffering unaligned I/O, "
+                            "paddr %llx, len %d\n",
+                            Srb->TargetId,
+                            srb_ext->sys_sgl->List[0].PhysicalAddress.QuadPart,
+                            Srb->DataTransferLength));
+                }
                 srb_ext->pa.QuadPart = __pa(srb_ext->va);
 
                 srb_ext->sa = (void **)(srb_ext->va + va_size);
@@ -1508,6 +1785,8 @@ XenBlkStartReadWrite(XENBLK_DEVICE_EXTENSION *dev_ext,
                     DPRINTK(DPRTL_MM, ("  Doing a write, do memcpy.\n"));
                     xenblk_cp_from_sa(srb_ext->sa, srb_ext->sys_sgl,
                         srb_ext->va);
+                    InterlockedExchangeAdd64(&dev_ext->bounce_bytes,
+                                             Srb->DataTransferLength);
                     xenblk_unmap_system_address(srb_ext->sa, srb_ext->sys_sgl);
                 }
 #ifdef XENBLK_REQUEST_VERIFIER
@@ -1525,6 +1804,7 @@ XenBlkStartReadWrite(XENBLK_DEVICE_EXTENSION *dev_ext,
                      Srb, srb_ext, srb_ext->va, srb_ext->sa));
         } else {
             srb_ext->va = NULL;
+            srb_ext->bounce_cls = XENBLK_BOUNCE_NONE;
             srb_ext->sgl = srb_ext->sys_sgl;
 #ifdef XENBLK_DBG_MAP_SGL_ONLY
             if (Srb->Cdb[0] == SCSIOP_READ || Srb->Cdb[0] == SCSIOP_READ16) {
@@ -1653,7 +1933,9 @@ static BOOLEAN
 XenBlkInterruptPoll(XENBLK_DEVICE_EXTENSION *dev_ext)
 {
     struct blkfront_info *info;
+    struct blkfront_ring_info *rinfo;
     uint32_t i;
+    uint32_t r;
     BOOLEAN claimed;
 
     DPRINTK(DPRTL_TRC, ("==> XenBlkInterruptPoll: cpu %d irql = %x\n",
@@ -1671,9 +1953,12 @@ XenBlkInterruptPoll(XENBLK_DEVICE_EXTENSION *dev_ext)
         for (i = 0; i < dev_ext->max_targets; i++) {
             info = dev_ext->info[i];
             if (info) {
-                if (RING_HAS_UNCONSUMED_RESPONSES(&info->ring)) {
-                    blkif_complete_int(info);
-                    claimed = TRUE;
+                for (r = 0; r < info->nr_rings; r++) {
+                    rinfo = &info->rinfo[r];
+                    if (RING_HAS_UNCONSUMED_RESPONSES(&rinfo->ring)) {
+                        blkif_complete_int(rinfo);
+                        claimed = TRUE;
+                    }
                 }
             }
         }
@@ -1828,7 +2113,7 @@ XenBlkAdapterControl (
                  * Can't quiesce at this time because the irql
                  * may be too high so just mask.
                  */
-                mask_evtchn(dev_ext->info[i]->evtchn);
+                xenblk_mask_evtchns(dev_ext->info[i]);
             }
         }
         XENBLK_CLEAR_FLAG(dev_ext->xenblk_locks, (BLK_ACTR_L | BLK_INT_L));
@@ -1842,7 +2127,7 @@ XenBlkAdapterControl (
             RPRINTK(DPRTL_ON, ("  ScsiRestartAdapter - just unmask.\n"));
             for (i = 0; i < dev_ext->max_targets; i++) {
                 if (dev_ext->info[i]) {
-                    unmask_evtchn(dev_ext->info[i]->evtchn);
+                    xenblk_unmask_evtchns(dev_ext->info[i]);
                 }
             }
             dev_ext->state = WORKING;
@@ -1880,6 +2165,7 @@ XenBlkFreeResource(struct blkfront_info *info, uint32_t info_idx,
 {
     xenbus_release_device_t release_data;
     uint32_t i;
+    uint32_t r;
 
     release_data.action = action;
     release_data.type = vbd;
@@ -1894,7 +2180,9 @@ XenBlkFreeResource(struct blkfront_info *info, uint32_t info_idx,
         if (info_idx != XENBLK_MAXIMUM_TARGETS) {
             info->xbdev->info[info_idx] = NULL;
         }
-        xenblk_unmap_system_addresses(info);
+        for (r = 0; r < info->nr_rings; r++) {
+            xenblk_unmap_system_addresses(&info->rinfo[r]);
+        }
         xenbus_release_device(info, info->xbdev, release_data);
         blkif_free(info, 0);
         if (action == RELEASE_REMOVE) {
@@ -2016,7 +2304,14 @@ XenBlkIoctl(XENBLK_DEVICE_EXTENSION *dev_ext, pv_ioctl_t data)
 void
 XenBlkDebugDump(XENBLK_DEVICE_EXTENSION *dev_ext)
 {
+    struct blkfront_ring_info *rinfo;
     uint32_t i;
+    uint32_t r;
+
+    /* The bounce buffers are shared by all of the adapter's disks. */
+    PRINTK(("*** XenBlk bounce ios %lld, bytes copied %lld, allocs %d\n",
+        dev_ext->bounce_ios, dev_ext->bounce_bytes,
+        dev_ext->bounce_allocs));
 
     for (i = 0; i < dev_ext->max_targets; i++) {
         if (dev_ext->info[i]) {
@@ -2025,17 +2320,37 @@ XenBlkDebugDump(XENBLK_DEVICE_EXTENSION *dev_ext)
                 dev_ext->state, dev_ext->info[i]->connected,
                 KeGetCurrentIrql(), KeGetCurrentProcessorNumber()));
 
-            PRINTK(("\tsring: req_prod %x, rsp_prod %x\n",
-                dev_ext->info[i]->ring.sring->req_prod,
-                dev_ext->info[i]->ring.sring->rsp_prod));
-
-            PRINTK(("\tsring: req_event %x, rsp_event %x\n",
-                dev_ext->info[i]->ring.sring->req_event,
-                dev_ext->info[i]->ring.sring->rsp_event));
-            PRINTK(("\tring: req_prod_pvt %x, rsp_cons %x\n",
-                dev_ext->info[i]->ring.req_prod_pvt,
-                dev_ext->info[i]->ring.rsp_cons));
             PRINTK(("\tglobal interrupt count: %d.\n", g_interrupt_count));
+            PRINTK(("\trings %u, cpus per ring %u, persistent grants %s\n",
+                dev_ext->info[i]->nr_rings,
+                dev_ext->info[i]->cpus_per_ring,
+                (dev_ext->info[i]->flags & BLKIF_PERSISTENT_F) ?
+                    "on" : "off"));
+            if (dev_ext->info[i]->flags & BLKIF_DISCARD_F) {
+                PRINTK(("\tdiscard granularity %u, alignment %u\n",
+                    dev_ext->info[i]->discard_granularity,
+                    dev_ext->info[i]->discard_alignment));
+            }
+            for (r = 0; r < dev_ext->info[i]->nr_rings; r++) {
+                rinfo = &dev_ext->info[i]->rinfo[r];
+                if (rinfo->ring.sring == NULL) {
+                    continue;
+                }
+                PRINTK(("\tring %u: evtchn %u\n", r, rinfo->evtchn));
+                PRINTK(("\tsring: req_prod %x, rsp_prod %x\n",
+                    rinfo->ring.sring->req_prod,
+                    rinfo->ring.sring->rsp_prod));
+                PRINTK(("\tsring: req_event %x, rsp_event %x\n",
+                    rinfo->ring.sring->req_event,
+                    rinfo->ring.sring->rsp_event));
+                PRINTK(("\tring: req_prod_pvt %x, rsp_cons %x\n",
+                    rinfo->ring.req_prod_pvt,
+                    rinfo->ring.rsp_cons));
+                PRINTK(("\tpersist pages %u, hits %llu, transient %llu\n",
+                    rinfo->persist_cnt,
+                    rinfo->persist_hits,
+                    rinfo->transient_grants));
+            }
 #ifdef DBG
             PRINTK(("\tsrbs_seen %x, ret %x, io_srbs_seen %x ret %x\n",
                 srbs_seen, srbs_returned, io_srbs_seen, io_srbs_returned));
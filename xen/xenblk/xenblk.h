@@ -91,6 +91,21 @@
 
 /* BLKIF flags */
 #define BLKIF_READ_ONLY_F       0x01
+#define BLKIF_PERSISTENT_F      0x02
+#define BLKIF_DISCARD_F         0x04
+
+/* Most UNMAP block descriptors turned into discard ring requests at once. */
+#define XENBLK_MAX_DISCARD_REQS 16
+
+/* LBPME bit in byte 14 of the READ CAPACITY(16) data. */
+#define XENBLK_READ_CAP16_LBPME 0x80
+
+/*
+ * Most data pages a ring's persistent pool may grow to.  feature-persistent
+ * is only offered when a full ring of the largest requests fits.
+ */
+#define BLK_PERSIST_MAX_PAGES   8192
+#define BLK_PERSIST_NONE        0xffff
 
 #define WORKING                 0x0001
 #define PENDINGSTOP             0x0002
@@ -192,6 +207,8 @@ DPR_SRB(char *where)
 
 #define BLK_MAX_RING_PAGE_ORDER 4U
 #define BLK_MAX_RING_PAGES (1U << BLK_MAX_RING_PAGE_ORDER)
+#define XENBLK_MAX_RINGS 8
+#define XENBLK_MAX_NODE_NAME_LEN 64
 #define BLK_MAX_RING_SIZE __CONST_RING_SIZE(blkif, \
                                             BLK_MAX_RING_PAGES * PAGE_SIZE)
 
@@ -235,11 +252,18 @@ typedef struct _xenblk_srb_extension {
     SCSI_REQUEST_BLOCK *srb;
     uint32_t use_cnt;
     uint16_t status;
+    uint8_t bounce_cls;
 #ifdef DBG
     void *dev_ext;
 #endif
 } xenblk_srb_extension;
 
+struct blk_persist_page {
+    void *va;
+    grant_ref_t gref;
+    uint16_t next;
+};
+
 struct blk_shadow {
     union {
         blkif_request_t req;
@@ -248,6 +272,9 @@ struct blk_shadow {
     void *request;
     unsigned long *frame;
     uint32_t num_ind;
+    uint16_t num_persist;
+    uint16_t *persist;              /* Sized like frame */
+    uint8_t **persist_va;
     xenblk_srb_extension *srb_ext;
 #ifdef DBG
     uint32_t seq;
@@ -273,6 +300,7 @@ struct blk_req_ring {
 
 struct blk_mm_ring_el {
     void *vaddr;
+    uint8_t bounce_cls;
 #ifdef XENBLK_STORPORT
     uint32_t mapped_elements;
     void **mapped_addr;
@@ -286,6 +314,20 @@ struct blk_mm_ring {
     unsigned long prod;
 };
 
+/*
+ * Unaligned requests are double buffered.  The buffers come from per
+ * adapter free lists in a few size classes so that a workload which is
+ * always unaligned does not hit the pool allocator on every I/O.
+ */
+#define XENBLK_BOUNCE_CLASSES       4
+#define XENBLK_BOUNCE_NONE          0xff
+
+struct xenblk_bounce_class {
+    SLIST_HEADER free;
+    uint32_t size;
+    uint16_t max_free;
+};
+
 typedef struct _XENBLK_DEVICE_EXTENSION {
     struct blkfront_info **info;        /* xenbus has the array */
     uint64_t        mmio;
@@ -300,6 +342,10 @@ typedef struct _XENBLK_DEVICE_EXTENSION {
     uint32_t        max_targets;
     uint32_t        pvctrl_flags;
     uint32_t        qdepth;
+    struct xenblk_bounce_class *bounce;
+    LONG64          bounce_ios;
+    LONG64          bounce_bytes;
+    LONG            bounce_allocs;
 #ifndef XENBLK_STORPORT
     KSPIN_LOCK      dev_lock;
     KDPC            rwdpc;
@@ -316,55 +362,81 @@ typedef struct _XENBLK_DEVICE_EXTENSION {
 #endif
 } XENBLK_DEVICE_EXTENSION, *PXENBLK_DEVICE_EXTENSION;
 
-/*
- * We have one of these per vbd, whether ide, scsi or 'other'.  They
- * hang in private_data off the gendisk structure. We may end up
- * putting all kinds of interesting stuff here :-)
- */
-struct blkfront_info {
-    XENBLK_DEVICE_EXTENSION *xbdev;
-    blkif_vdev_t handle;
-    int connected;
-    unsigned int ring_size;
+void xenblk_bounce_put(XENBLK_DEVICE_EXTENSION *dev_ext, void *va,
+    uint8_t cls);
+void xenblk_bounce_free(XENBLK_DEVICE_EXTENSION *dev_ext);
+
+/* Per ring state.  A vbd has one of these per negotiated queue. */
+struct blkfront_ring_info {
+    struct blkfront_info *info;
+    unsigned int ring_idx;
     blkif_front_ring_t ring;
     struct blkif_request_segment **indirect_segs;
-    unsigned int max_segs_per_req;
     unsigned int evtchn;
-    LIST_ENTRY rq;
     KSPIN_LOCK lock;
 #if defined XENBLK_STORPORT
     STOR_DPC dpc;
 #endif
-    struct xenbus_watch watch;
     struct gnttab_free_callback callback;
     struct blk_shadow *shadow;
     grant_ref_t ring_refs[BLK_MAX_RING_PAGES];
     void *ring_pages[BLK_MAX_RING_PAGES];
     uint32_t id[BLK_RING_SIZE];
     unsigned long shadow_free;
-    unsigned long sector_size;
-    uint64_t sectors;
-    char *nodename;
-    char *otherend;
-    domid_t otherend_id;
     uint32_t has_interrupt;
     struct blk_mm_ring mm;
     xenblk_srb_extension *hsrb_ext;
     xenblk_srb_extension *tsrb_ext;
-    uint32_t flags;
+    struct blk_persist_page *persist;
+    grant_ref_t *indirect_grefs;    /* Persistent grants of indirect_segs */
+    uint32_t nr_indirect_grefs;
+    uint32_t persist_max;
+    uint32_t persist_cnt;
+    uint16_t persist_free;
+    uint64_t persist_hits;          /* Pages reused from the free list */
+    uint64_t transient_grants;
 
 #ifdef DBG
     uint32_t depth;
     uint32_t max_depth;
     uint32_t queued_srb_ext;
-    uint32_t xenblk_locks;
-    uint32_t cpu_locks;
     uint32_t req;
     uint32_t seq;
     uint32_t cseq;
 #endif
 };
 
+/*
+ * We have one of these per vbd, whether ide, scsi or 'other'.  They
+ * hang in private_data off the gendisk structure. We may end up
+ * putting all kinds of interesting stuff here :-)
+ */
+struct blkfront_info {
+    XENBLK_DEVICE_EXTENSION *xbdev;
+    blkif_vdev_t handle;
+    int connected;
+    unsigned int ring_size;
+    unsigned int max_segs_per_req;
+    unsigned int nr_rings;
+    unsigned int cpus_per_ring;
+    struct blkfront_ring_info rinfo[XENBLK_MAX_RINGS];
+    LIST_ENTRY rq;
+    struct xenbus_watch watch;
+    unsigned long sector_size;
+    uint64_t sectors;
+    char *nodename;
+    char *otherend;
+    domid_t otherend_id;
+    uint32_t flags;
+    uint32_t discard_granularity;   /* in 512 byte sectors */
+    uint32_t discard_alignment;     /* in 512 byte sectors */
+
+#ifdef DBG
+    uint32_t xenblk_locks;
+    uint32_t cpu_locks;
+#endif
+};
+
 ULONG XenDriverEntry(IN PVOID DriverObject, IN PVOID RegistryPath);
 
 #define srb_pages_in_req(_srb_ext, _np)                                     \
@@ -423,14 +495,39 @@ ULONG XenDriverEntry(IN PVOID DriverObject, IN PVOID RegistryPath);
     }                                                                       \
 }
 static inline void
-xenblk_add_tail(struct blkfront_info *info, xenblk_srb_extension *srb_ext)
+xenblk_add_tail(struct blkfront_ring_info *rinfo,
+    xenblk_srb_extension *srb_ext)
 {
-    if (info->hsrb_ext == NULL) {
-        info->hsrb_ext = srb_ext;
-        info->tsrb_ext = srb_ext;
+    if (rinfo->hsrb_ext == NULL) {
+        rinfo->hsrb_ext = srb_ext;
+        rinfo->tsrb_ext = srb_ext;
     } else {
-        info->tsrb_ext->next = srb_ext;
-        info->tsrb_ext = srb_ext;
+        rinfo->tsrb_ext->next = srb_ext;
+        rinfo->tsrb_ext = srb_ext;
+    }
+}
+
+static inline void
+xenblk_mask_evtchns(struct blkfront_info *info)
+{
+    uint32_t r;
+
+    for (r = 0; r < info->nr_rings; r++) {
+        if (info->rinfo[r].evtchn) {
+            mask_evtchn(info->rinfo[r].evtchn);
+        }
+    }
+}
+
+static inline void
+xenblk_unmask_evtchns(struct blkfront_info *info)
+{
+    uint32_t r;
+
+    for (r = 0; r < info->nr_rings; r++) {
+        if (info->rinfo[r].evtchn) {
+            unmask_evtchn(info->rinfo[r].evtchn);
+        }
     }
 }
 
@@ -675,7 +772,7 @@ xenblk_unmap_system_address(void *sa[], STOR_SCATTER_GATHER_LIST *sys_sgl)
 }
 
 static inline void
-xenblk_unmap_system_addresses(struct blkfront_info *info)
+xenblk_unmap_system_addresses(struct blkfront_ring_info *rinfo)
 {
     struct blk_mm_ring *mm;
     unsigned long idx;
@@ -690,7 +787,7 @@ xenblk_unmap_system_addresses(struct blkfront_info *info)
                 ("*** xenblk_unmap_system_addresses at irql %d ***\n", irql));
     }
 #endif
-    mm = &info->mm;
+    mm = &rinfo->mm;
     while (mm->cons != mm->prod) {
         idx = mm->cons & (BLK_RING_SIZE - 1);
         DPRINTK(DPRTL_MM, ("mm umap: va %p irql %d\n",
@@ -706,10 +803,11 @@ xenblk_unmap_system_addresses(struct blkfront_info *info)
                 mm->ring[idx].mapped_addr[i] = NULL;
             }
         }
-        DPRINTK(DPRTL_MM, ("mm ExFreePool addr %p\n", mm->ring[idx].vaddr));
+        DPRINTK(DPRTL_MM, ("mm bounce put addr %p\n", mm->ring[idx].vaddr));
         if (mm->ring[idx].vaddr) {
-            ExFreePool(mm->ring[idx].vaddr);
-            XENBLK_DEC(info->xbdev->alloc_cnt_v);
+            xenblk_bounce_put(rinfo->info->xbdev, mm->ring[idx].vaddr,
+                              mm->ring[idx].bounce_cls);
+            XENBLK_DEC(rinfo->info->xbdev->alloc_cnt_v);
             mm->ring[idx].vaddr = NULL;
         }
         mm->cons++;
@@ -717,14 +815,14 @@ xenblk_unmap_system_addresses(struct blkfront_info *info)
 }
 
 static inline void
-xenblk_save_system_address(struct blkfront_info *info,
+xenblk_save_system_address(struct blkfront_ring_info *rinfo,
     xenblk_srb_extension *srb_ext)
 {
     struct blk_mm_ring *mm;
     unsigned long idx;
     uint32_t i;
 
-    mm = &info->mm;
+    mm = &rinfo->mm;
     idx = mm->prod & (BLK_RING_SIZE - 1);
 #ifdef DBG
     if (mm->ring[idx].vaddr != NULL) {
@@ -733,6 +831,7 @@ xenblk_save_system_address(struct blkfront_info *info,
     }
 #endif
     mm->ring[idx].vaddr = srb_ext->va;
+    mm->ring[idx].bounce_cls = srb_ext->bounce_cls;
     mm->ring[idx].mapped_elements = srb_ext->sys_sgl->NumberOfElements;
     for (i = 0; i < srb_ext->sys_sgl->NumberOfElements; i++) {
         mm->ring[idx].mapped_addr[i] = srb_ext->sa[i];
@@ -785,6 +884,22 @@ xenblk_buffer_mfn(XENBLK_DEVICE_EXTENSION *dev_ext, SCSI_REQUEST_BLOCK *srb,
     return pfn_to_mfn((unsigned long)(addr >> PAGE_SHIFT));
 }
 
+/* System address of the data the srb's sgl describes, or NULL. */
+static inline uint8_t *
+xenblk_get_srb_va(XENBLK_DEVICE_EXTENSION *dev_ext, SCSI_REQUEST_BLOCK *srb,
+    xenblk_srb_extension *srb_ext)
+{
+    void *va;
+
+    if (srb_ext->va != NULL) {
+        return srb_ext->va;
+    }
+    if (StorPortGetSystemAddress(dev_ext, srb, &va) != STOR_STATUS_SUCCESS) {
+        return NULL;
+    }
+    return va;
+}
+
 #else
 /***************************** SCSI MINIPORT *******************************/
 typedef uintptr_t xenblk_addr_t;
@@ -829,26 +944,32 @@ typedef uintptr_t xenblk_addr_t;
 #define storport_release_spinlock(_dext, _lhndl)
 
 static inline void
-xenblk_unmap_system_addresses(struct blkfront_info *info)
+xenblk_unmap_system_addresses(struct blkfront_ring_info *rinfo)
 {
     struct blk_mm_ring *mm;
+    unsigned long idx;
 
-    mm = &info->mm;
+    mm = &rinfo->mm;
     while (mm->cons != mm->prod) {
-        ExFreePool(mm->ring[mm->cons & (BLK_RING_SIZE - 1)].vaddr);
-        XENBLK_DEC(info->xbdev->alloc_cnt_v);
+        idx = mm->cons & (BLK_RING_SIZE - 1);
+        xenblk_bounce_put(rinfo->info->xbdev, mm->ring[idx].vaddr,
+                          mm->ring[idx].bounce_cls);
+        XENBLK_DEC(rinfo->info->xbdev->alloc_cnt_v);
         mm->cons++;
     }
 }
 
 static inline void
-xenblk_save_system_address(struct blkfront_info *info,
+xenblk_save_system_address(struct blkfront_ring_info *rinfo,
     xenblk_srb_extension *srb_ext)
 {
     struct blk_mm_ring *mm;
+    unsigned long idx;
 
-    mm = &info->mm;
-    mm->ring[mm->prod & (BLK_RING_SIZE - 1)].vaddr = srb_ext->va;
+    mm = &rinfo->mm;
+    idx = mm->prod & (BLK_RING_SIZE - 1);
+    mm->ring[idx].vaddr = srb_ext->va;
+    mm->ring[idx].bounce_cls = srb_ext->bounce_cls;
     mm->prod++;
 }
 
@@ -940,6 +1061,9 @@ xenblk_buffer_mfn(XENBLK_DEVICE_EXTENSION *dev_ext, SCSI_REQUEST_BLOCK *srb,
     return buffer_mfn;
 }
 
+#define xenblk_get_srb_va(_dev_ext, _srb, _srb_ext)                     \
+    ((_srb_ext)->va != NULL ? (uint8_t *)(_srb_ext)->va                 \
+        : (uint8_t *)(_srb)->DataBuffer)
 
 #endif
 
@@ -950,7 +1074,8 @@ void XenBlkFreeAllResources(XENBLK_DEVICE_EXTENSION *dev_ext,
     XENBUS_RELEASE_ACTION action);
 NTSTATUS blkfront_probe(struct blkfront_info *info);
 NTSTATUS do_blkif_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb);
-uint32_t blkif_complete_int(struct blkfront_info *info);
+UCHAR do_blkif_discard(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb);
+uint32_t blkif_complete_int(struct blkfront_ring_info *rinfo);
 #ifdef XENBLK_STORPORT
 KDEFERRED_ROUTINE blkif_int_dpc;
 KDEFERRED_ROUTINE blkif_int;
@@ -41,12 +41,13 @@ static void connect(struct blkfront_info *);
 static void blkfront_closing(struct blkfront_info *info);
 static int blkfront_remove(XENBLK_DEVICE_EXTENSION *);
 static int talk_to_backend(struct blkfront_info *);
-static int setup_blkring(struct blkfront_info *info,
+static int setup_blkring(struct blkfront_ring_info *rinfo,
                          unsigned int old_ring_size);
+static BOOLEAN xenblk_alloc_persist(struct blkfront_info *info);
+static void xenblk_free_persist(struct blkfront_ring_info *rinfo);
 
-static void kick_pending_request_queues(struct blkfront_info *);
-static void blkif_restart_queue(IN PDEVICE_OBJECT DevObject, IN PVOID Context);
-static void blkif_completion(struct blkfront_info *info, unsigned long id);
+static void blkif_completion(struct blkfront_ring_info *rinfo,
+                             unsigned long id);
 
 /*
  * Entry point to this code when a new device is created.  Allocate the basic
@@ -59,6 +60,7 @@ blkfront_probe(struct blkfront_info *info)
 {
     char *buf;
     enum xenbus_state backend_state;
+    unsigned int r;
     int err, i;
 
     RPRINTK(DPRTL_INIT, ("blkfront_probe: "));
@@ -75,8 +77,13 @@ blkfront_probe(struct blkfront_info *info)
     info->sector_size = 0;
     info->sectors = 0;
     InitializeListHead(&info->rq);
-    KeInitializeSpinLock(&info->lock);
-
+    for (i = 0; i < XENBLK_MAX_RINGS; i++) {
+        info->rinfo[i].info = info;
+        info->rinfo[i].ring_idx = i;
+        KeInitializeSpinLock(&info->rinfo[i].lock);
+        info->rinfo[i].mm.cons = 0;
+        info->rinfo[i].mm.prod = 0;
+    }
 
     info->handle = (uint16_t)cmp_strtou64(
         strrchr(info->nodename, '/') + 1, NULL, 10);
@@ -86,8 +93,6 @@ blkfront_probe(struct blkfront_info *info)
     info->watch.node = info->otherend;
     info->watch.flags = XBWF_new_thread;
     info->watch.context = info;
-    info->mm.cons = 0;
-    info->mm.prod = 0;
 
     RPRINTK(DPRTL_FRNT, ("XenBlk:    blkfront_probe - talk_to_backend.\n"));
     err = talk_to_backend(info);
@@ -95,17 +100,19 @@ blkfront_probe(struct blkfront_info *info)
         return err;
     }
 
-    RPRINTK(DPRTL_FRNT, ("Alloc %d * %d * %d + %d * %d = %d\n",
-                         BLK_RING_SIZE,
+    RPRINTK(DPRTL_FRNT, ("Alloc %d * %d * (%d * %d + %d * %d) = %d\n",
+                         info->nr_rings, BLK_RING_SIZE,
                          sizeof(void *), info->max_segs_per_req,
                          sizeof(unsigned long),
                          info->max_segs_per_req,
-                         BLK_RING_SIZE * ((sizeof(void *)
+                         info->nr_rings * BLK_RING_SIZE * ((sizeof(void *)
                              * info->max_segs_per_req) +
                              (sizeof(unsigned long)
                              * info->max_segs_per_req))));
+    /* All of the rings' mm buffers come from one chunk owned by ring 0. */
     buf = ExAllocatePoolWithTag(NonPagedPoolNx,
-        BLK_RING_SIZE * ((sizeof(void *) * info->max_segs_per_req) +
+        info->nr_rings * BLK_RING_SIZE *
+            ((sizeof(void *) * info->max_segs_per_req) +
             (sizeof(unsigned long) * info->max_segs_per_req)),
         XENBLK_TAG_GENERAL);
     if (buf == NULL) {
@@ -113,11 +120,13 @@ blkfront_probe(struct blkfront_info *info)
         blkif_free(info, 0);
         return  STATUS_NO_MEMORY;
     }
-    for (i = 0; i < BLK_RING_SIZE; i++) {
-        info->mm.ring[i].mapped_addr = (void **)buf;
-        buf += sizeof(void *) * info->max_segs_per_req;
-        info->mm.ring[i].mapped_len = (unsigned long *)buf;
-        buf += sizeof(unsigned long) * info->max_segs_per_req;
+    for (r = 0; r < info->nr_rings; r++) {
+        for (i = 0; i < BLK_RING_SIZE; i++) {
+            info->rinfo[r].mm.ring[i].mapped_addr = (void **)buf;
+            buf += sizeof(void *) * info->max_segs_per_req;
+            info->rinfo[r].mm.ring[i].mapped_len = (unsigned long *)buf;
+            buf += sizeof(unsigned long) * info->max_segs_per_req;
+        }
     }
 
     RPRINTK(DPRTL_FRNT,
@@ -280,17 +289,121 @@ xenblk_get_xenstore_max_segs(struct blkfront_info *info)
                        (unsigned int)BLK_MAX_RING_SIZE));
 }
 
+/*
+ * Use one ring per group of vCPUs, bounded by what the backend offers in
+ * multi-queue-max-queues.  This is read again on every talk_to_backend as
+ * a different backend may offer a different number.  Only rinfo[] is
+ * fixed at XENBLK_MAX_RINGS.
+ */
+static void
+xenblk_get_num_rings(struct blkfront_info *info)
+{
+    char *buf;
+    unsigned int max_queues;
+    unsigned int num_cpus;
+
+#if (NTDDI_VERSION >= NTDDI_WIN7)
+    num_cpus = KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS);
+#else
+    num_cpus = KeQueryActiveProcessorCount(NULL);
+#endif
+    max_queues = 1;
+    buf = xenbus_read(XBT_NIL, info->otherend, "multi-queue-max-queues",
+                      NULL);
+    if (buf != NULL) {
+        max_queues = (unsigned int)cmp_strtou64(buf, NULL, 10);
+        xenbus_free_string(buf);
+    }
+
+    info->nr_rings = max_queues < num_cpus ? max_queues : num_cpus;
+    if (info->nr_rings > XENBLK_MAX_RINGS) {
+        info->nr_rings = XENBLK_MAX_RINGS;
+    }
+    if (info->nr_rings == 0) {
+        info->nr_rings = 1;
+    }
+    info->cpus_per_ring = (num_cpus + info->nr_rings - 1) / info->nr_rings;
+    RPRINTK(DPRTL_ON, ("blkfront: %s: max queues %u, cpus %u, rings %u\n",
+                       info->nodename, max_queues, num_cpus, info->nr_rings));
+}
+
+static int
+xenblk_write_ring_keys(struct blkfront_info *info,
+                       struct xenbus_transaction xbt,
+                       const char **message)
+{
+    struct blkfront_ring_info *rinfo;
+    char xs_path_buf[XENBLK_MAX_NODE_NAME_LEN];
+    char *xs_path;
+    char tbuf[12];
+    unsigned int r;
+    unsigned int i;
+    int err;
+
+    err = 0;
+    for (r = 0; r < info->nr_rings; r++) {
+        rinfo = &info->rinfo[r];
+        if (info->nr_rings > 1) {
+            xs_path = xs_path_buf;
+            if (RtlStringCbPrintfA(xs_path, sizeof(xs_path_buf),
+                                   "%s/queue-%u", info->nodename, r)
+                    != STATUS_SUCCESS) {
+                *message = "formatting queue path";
+                return -EINVAL;
+            }
+        } else {
+            xs_path = info->nodename;
+        }
+
+        if (info->ring_size == 1) {
+            RPRINTK(DPRTL_ON, ("talk_to_backend %s: ring-ref %u\n",
+                               xs_path, rinfo->ring_refs[0]));
+            err = xenbus_printf(xbt, xs_path, "ring-ref", "%u",
+                                rinfo->ring_refs[0]);
+            if (err) {
+                *message = "writing ring-ref";
+                return err;
+            }
+        } else {
+            for (i = 0; i < info->ring_size; i++) {
+                if (RtlStringCbPrintfA(tbuf, sizeof(tbuf), "ring-ref%u", i)
+                        != STATUS_SUCCESS) {
+                    *message = "formatting ring-ref";
+                    return -EINVAL;
+                }
+                RPRINTK(DPRTL_ON, ("talk_to_backend %s: %s %u\n",
+                                   xs_path, tbuf, rinfo->ring_refs[i]));
+                err = xenbus_printf(xbt, xs_path, tbuf, "%u",
+                                    rinfo->ring_refs[i]);
+                if (err) {
+                    *message = "writing ring-ref";
+                    return err;
+                }
+            }
+        }
+
+        RPRINTK(DPRTL_ON, ("talk_to_backend %s: evtchn %u\n",
+                           xs_path, rinfo->evtchn));
+        err = xenbus_printf(xbt, xs_path, "event-channel", "%u",
+            rinfo->evtchn);
+        if (err) {
+            *message = "writing event-channel";
+            return err;
+        }
+    }
+    return err;
+}
+
 /* Common code used when first setting up, and when resuming. */
 static int
 talk_to_backend(struct blkfront_info *info)
 {
     const char *message = NULL;
     struct xenbus_transaction xbt;
-    char tbuf[12];
     int err;
     unsigned int ring_order;
-    unsigned int i;
-    unsigned int old_ring_size = RING_SIZE(&info->ring);
+    unsigned int r;
+    BOOLEAN persist;
 
     if (info->xbdev->pvctrl_flags & XENBUS_PVCTRL_USE_JUST_ONE_CONTROLLER) {
         RPRINTK(DPRTL_ON, ("talk_to_backend %s: "
@@ -298,19 +411,26 @@ talk_to_backend(struct blkfront_info *info)
                            info->nodename, XENBLK_MAX_SGL_ELEMENTS));
         info->ring_size = 1;
         info->max_segs_per_req = XENBLK_MAX_SGL_ELEMENTS;
+        info->nr_rings = 1;
+        info->cpus_per_ring = 1;
     } else {
         xenblk_get_ring_details(info, &ring_order);
         xenblk_get_xenstore_max_segs(info);
+        xenblk_get_num_rings(info);
     }
 
-    /* Create shared ring, alloc event channel. */
+    /* Create shared rings, alloc event channels. */
     RPRINTK(DPRTL_ON, ("talk_to_backend: irql %x, cpu %x\n",
                        KeGetCurrentIrql(), KeGetCurrentProcessorNumber()));
     DPRINTK(DPRTL_INIT, ("  locks %x\n", info->xenblk_locks));
-    err = setup_blkring(info, old_ring_size);
-    if (err) {
-        goto out;
+    for (r = 0; r < info->nr_rings; r++) {
+        err = setup_blkring(&info->rinfo[r],
+                            RING_SIZE(&info->rinfo[r].ring));
+        if (err) {
+            goto out;
+        }
     }
+    persist = xenblk_alloc_persist(info);
 
 again:
     err = xenbus_transaction_start(&xbt);
@@ -323,16 +443,7 @@ again:
 
     talking_to_backend++;
 
-    if (info->ring_size == 1) {
-        RPRINTK(DPRTL_ON, ("talk_to_backend %s: ring-ref %u\n",
-                           info->nodename, info->ring_refs[0]));
-        err = xenbus_printf(xbt, info->nodename, "ring-ref", "%u",
-                            info->ring_refs[0]);
-        if (err) {
-            message = "writing ring-ref";
-            goto abort_transaction;
-        }
-    } else {
+    if (info->ring_size > 1) {
         RPRINTK(DPRTL_ON, ("talk_to_backend %s: ring-page-order %u\n",
                            info->nodename, ring_order));
         err = xenbus_printf(xbt, info->nodename, "ring-page-order", "%u",
@@ -350,32 +461,24 @@ again:
             message = "writing num-ring-pages";
             goto abort_transaction;
         }
+    }
 
-        for (i = 0; i < info->ring_size; i++) {
-            if (RtlStringCbPrintfA(tbuf, sizeof(tbuf), "ring-ref%u", i)
-                    != STATUS_SUCCESS) {
-                message = "formatting ring-ref";
-                goto abort_transaction;
-            }
-            RPRINTK(DPRTL_ON, ("talk_to_backend %s: %s %u\n",
-                               info->nodename, tbuf, info->ring_refs[i]));
-            err = xenbus_printf(xbt, info->nodename, tbuf, "%u",
-                                info->ring_refs[i]);
-            if (err) {
-                message = "writing ring-ref";
-                goto abort_transaction;
-            }
+    if (info->nr_rings > 1) {
+        RPRINTK(DPRTL_ON, ("talk_to_backend %s: multi-queue-num-queues %u\n",
+                           info->nodename, info->nr_rings));
+        err = xenbus_printf(xbt, info->nodename, "multi-queue-num-queues",
+                            "%u", info->nr_rings);
+        if (err) {
+            message = "writing multi-queue-num-queues";
+            goto abort_transaction;
         }
     }
 
-    RPRINTK(DPRTL_ON, ("talk_to_backend %s: evtchn %u\n",
-                       info->nodename, info->evtchn));
-    err = xenbus_printf(xbt, info->nodename, "event-channel", "%u",
-        info->evtchn);
+    err = xenblk_write_ring_keys(info, xbt, &message);
     if (err) {
-        message = "writing event-channel";
         goto abort_transaction;
     }
+
     RPRINTK(DPRTL_ON, ("talk_to_backend %s: protocol %u\n",
                        info->nodename, XEN_IO_PROTO_ABI_NATIVE));
     err = xenbus_printf(xbt, info->nodename, "protocol", "%s",
@@ -384,6 +487,14 @@ again:
         message = "writing protocol";
         goto abort_transaction;
     }
+    if (persist) {
+        err = xenbus_printf(xbt, info->nodename, "feature-persistent",
+                            "%u", 1);
+        if (err) {
+            message = "writing feature-persistent";
+            goto abort_transaction;
+        }
+    }
 
     err = xenbus_transaction_end(xbt, 0);
     if (err) {
@@ -419,23 +530,24 @@ again:
 
 #ifdef DBG
 static void
-xenblk_dump_ring_info(struct blkfront_info *info)
+xenblk_dump_ring_info(struct blkfront_ring_info *rinfo)
 {
     PRINTK(("  sizeof(blkif_request_t) %u\n", (unsigned int)
             sizeof(blkif_request_t)));
     PRINTK(("  BLK_MAX_RING_SIZE %u\n", (unsigned int)BLK_MAX_RING_SIZE));
     PRINTK(("  BLK_RING_SIZE %u\n", (unsigned int)BLK_RING_SIZE));
     PRINTK(("  __RING_SIZE %u\n",
-            (unsigned int)__WIN_RING_SIZE(info->ring.sring, PAGE_SIZE)));
+            (unsigned int)__WIN_RING_SIZE(rinfo->ring.sring, PAGE_SIZE)));
     PRINTK(("  __RING_SIZE * 4 %u\n",
-            (unsigned int)__WIN_RING_SIZE(info->ring.sring, 4 * PAGE_SIZE)));
+            (unsigned int)__WIN_RING_SIZE(rinfo->ring.sring, 4 * PAGE_SIZE)));
     PRINTK(("  __RD32(%x) / %u\n", (4096 -
-          (ULONG_PTR)&(info->ring.sring)->ring + (ULONG_PTR)(info->ring.sring)),
-            sizeof((info->ring.sring)->ring[0])));
+          (ULONG_PTR)&(rinfo->ring.sring)->ring +
+          (ULONG_PTR)(rinfo->ring.sring)),
+            sizeof((rinfo->ring.sring)->ring[0])));
 
     RPRINTK(DPRTL_ON, ("sring_t %x, req %x, rsp %x, ring %x.\n",
         sizeof(blkif_sring_t), sizeof(blkif_request_t),
-        sizeof(blkif_response_t), __WIN_RING_SIZE(info->ring.sring,
+        sizeof(blkif_response_t), __WIN_RING_SIZE(rinfo->ring.sring,
         PAGE_SIZE)));
     RPRINTK(DPRTL_FRNT, ("off ring %x, h %x, id %x, s %x, seg %x\n",
         offsetof(blkif_sring_t, ring),
@@ -444,15 +556,16 @@ xenblk_dump_ring_info(struct blkfront_info *info)
         offsetof(blkif_request_t, sector_number),
         offsetof(blkif_request_t, seg)));
     RPRINTK(DPRTL_FRNT, ("setup_blkring: sring = %x, mfn ring.sring = %x\n",
-        info->ring.sring, virt_to_mfn(info->ring.sring)));
+        rinfo->ring.sring, virt_to_mfn(rinfo->ring.sring)));
 }
 #else
-#define xenblk_dump_ring_info(info)
+#define xenblk_dump_ring_info(rinfo)
 #endif
 
 static int
-xenblk_setup_sring(struct blkfront_info *info)
+xenblk_setup_sring(struct blkfront_ring_info *rinfo)
 {
+    struct blkfront_info *info = rinfo->info;
     blkif_sring_t *sring;
     unsigned int nr;
     int err = 0;
@@ -470,38 +583,39 @@ xenblk_setup_sring(struct blkfront_info *info)
     XENBLK_INC(info->xbdev->alloc_cnt_s);
 
     for (nr = 0; nr < info->ring_size; nr++) {
-        info->ring_refs[nr] = GRANT_INVALID_REF;
-        info->ring_pages[nr] = (char *)sring + ((size_t)nr * PAGE_SIZE);
+        rinfo->ring_refs[nr] = GRANT_INVALID_REF;
+        rinfo->ring_pages[nr] = (char *)sring + ((size_t)nr * PAGE_SIZE);
         RPRINTK(DPRTL_ON, ("ring_pages[%d] = %p\n",
-                           nr, info->ring_pages[nr]));
+                           nr, rinfo->ring_pages[nr]));
 
         err = xenbus_grant_ring(info->otherend_id,
-                                virt_to_mfn(info->ring_pages[nr]));
+                                virt_to_mfn(rinfo->ring_pages[nr]));
         if (err < 0) {
             PRINTK(("setup_blkring: xenbus_grant_ring failed for page[%d] %p\n",
-                    nr, info->ring_pages[nr]));
+                    nr, rinfo->ring_pages[nr]));
             return err;
         }
-        info->ring_refs[nr] = err;
+        rinfo->ring_refs[nr] = err;
         RPRINTK(DPRTL_FRNT,
-                ("setup_blkring: info->ring_refs[%u] = %x for id %d, err %u\n",
-                 nr, info->ring_refs[nr], info->otherend_id, err));
+                ("setup_blkring: ring_refs[%u] = %x for id %d, err %u\n",
+                 nr, rinfo->ring_refs[nr], info->otherend_id, err));
     }
     SHARED_RING_INIT(sring);
-    WIN_FRONT_RING_INIT(&info->ring, sring, (size_t)nr * PAGE_SIZE);
+    WIN_FRONT_RING_INIT(&rinfo->ring, sring, (size_t)nr * PAGE_SIZE);
     return err;
 }
 
 static NTSTATUS
-xenblk_setup_indirect_refs(struct blkfront_info *info,
+xenblk_setup_indirect_refs(struct blkfront_ring_info *rinfo,
                            unsigned int old_ring_size)
 {
+    struct blkfront_info *info = rinfo->info;
     struct blkif_request_segment **segs;
     unsigned int i, ring_size;
 
-    ring_size = RING_SIZE(&info->ring);
+    ring_size = RING_SIZE(&rinfo->ring);
     if (info->max_segs_per_req > XENBLK_MAX_SGL_ELEMENTS) {
-        if (info->indirect_segs == NULL) {
+        if (rinfo->indirect_segs == NULL) {
             old_ring_size = 0;
         }
         if (old_ring_size < ring_size) {
@@ -513,18 +627,18 @@ xenblk_setup_indirect_refs(struct blkfront_info *info,
             if (segs == NULL) {
                 return STATUS_UNSUCCESSFUL;
             }
-            info->indirect_segs = segs;
+            rinfo->indirect_segs = segs;
             for (i = old_ring_size; i < ring_size; ++i) {
-                info->indirect_segs[i] = NULL;
+                rinfo->indirect_segs[i] = NULL;
             }
         }
         for (i = old_ring_size; i < ring_size; ++i) {
-            info->indirect_segs[i] =
+            rinfo->indirect_segs[i] =
                 ExAllocatePoolWithTag(NonPagedPoolNx,
                                       BLKIF_INDIRECT_PAGES(
                                           info->max_segs_per_req) * PAGE_SIZE,
                                       XENBLK_TAG_GENERAL);
-            if (info->indirect_segs[i] == NULL) {
+            if (rinfo->indirect_segs[i] == NULL) {
                 return STATUS_UNSUCCESSFUL;
             }
         }
@@ -532,77 +646,90 @@ xenblk_setup_indirect_refs(struct blkfront_info *info,
     return STATUS_SUCCESS;
 }
 
-static NTSTATUS xenblk_setup_shadow(struct blkfront_info *info)
+static NTSTATUS xenblk_setup_shadow(struct blkfront_ring_info *rinfo)
 {
+    struct blkfront_info *info = rinfo->info;
     unsigned long *frame;
     unsigned int i, ring_size, shadow_frames;
 
-    ring_size = RING_SIZE(&info->ring);
-    info->shadow_free = 0;
-    info->shadow = ExAllocatePoolWithTag(NonPagedPoolNx,
+    ring_size = RING_SIZE(&rinfo->ring);
+    rinfo->shadow_free = 0;
+    rinfo->shadow = ExAllocatePoolWithTag(NonPagedPoolNx,
         ring_size * sizeof(struct blk_shadow),
         XENBLK_TAG_GENERAL);
-    if (info->shadow == NULL) {
+    if (rinfo->shadow == NULL) {
         return STATUS_UNSUCCESSFUL;
     }
-    memset(info->shadow, 0, ring_size * sizeof(struct blk_shadow));
+    memset(rinfo->shadow, 0, ring_size * sizeof(struct blk_shadow));
     if (info->max_segs_per_req > XENBLK_MAX_SGL_ELEMENTS) {
         shadow_frames = info->max_segs_per_req;
     } else {
         shadow_frames = BLKIF_MAX_SEGMENTS_PER_REQUEST;
     }
     for (i = 0; i < ring_size; i++) {
-        info->shadow[i].frame = ExAllocatePoolWithTag(NonPagedPoolNx,
+        rinfo->shadow[i].frame = ExAllocatePoolWithTag(NonPagedPoolNx,
             (size_t)shadow_frames * sizeof(*frame),
             XENBLK_TAG_GENERAL);
-        if (info->shadow[i].frame == NULL) {
+        if (rinfo->shadow[i].frame == NULL) {
             return STATUS_UNSUCCESSFUL;
         }
-        info->shadow[i].req.id = (uint64_t)i + 1;
-        info->shadow[i].req.nr_segments = 0;
-        info->shadow[i].request = NULL;
-        memset(info->shadow[i].frame, ~0, shadow_frames * sizeof(*frame));
+        rinfo->shadow[i].persist = ExAllocatePoolWithTag(NonPagedPoolNx,
+            (size_t)shadow_frames * sizeof(uint16_t),
+            XENBLK_TAG_GENERAL);
+        rinfo->shadow[i].persist_va = ExAllocatePoolWithTag(NonPagedPoolNx,
+            (size_t)shadow_frames * sizeof(uint8_t *),
+            XENBLK_TAG_GENERAL);
+        if (rinfo->shadow[i].persist == NULL
+                || rinfo->shadow[i].persist_va == NULL) {
+            return STATUS_UNSUCCESSFUL;
+        }
+        rinfo->shadow[i].req.id = (uint64_t)i + 1;
+        rinfo->shadow[i].req.nr_segments = 0;
+        rinfo->shadow[i].request = NULL;
+        memset(rinfo->shadow[i].frame, ~0, shadow_frames * sizeof(*frame));
     }
-    info->shadow[i - 1].req.id = 0x0fffffff;
+    rinfo->shadow[i - 1].req.id = 0x0fffffff;
     return STATUS_SUCCESS;
 }
 
 static int
-setup_blkring(struct blkfront_info *info, unsigned int old_ring_size)
+setup_blkring(struct blkfront_ring_info *rinfo, unsigned int old_ring_size)
 {
+    struct blkfront_info *info = rinfo->info;
     NTSTATUS status;
     int err;
 
-    err = xenblk_setup_sring(info);
+    err = xenblk_setup_sring(rinfo);
     if (err < 0) {
         goto fail;
     }
-    xenblk_dump_ring_info(info);
+    xenblk_dump_ring_info(rinfo);
 
-    status = xenblk_setup_indirect_refs(info, old_ring_size);
+    status = xenblk_setup_indirect_refs(rinfo, old_ring_size);
     if (status != STATUS_SUCCESS) {
         goto fail;
     }
 
-    status = xenblk_setup_shadow(info);
+    status = xenblk_setup_shadow(rinfo);
     if (status != STATUS_SUCCESS) {
         goto fail;
     }
 
-    err = xenbus_alloc_evtchn(info->otherend_id, &info->evtchn);
+    err = xenbus_alloc_evtchn(info->otherend_id, &rinfo->evtchn);
     if (err) {
         PRINTK(("setup_blkring: xenbus_alloc_evtchn failed\n"));
         goto fail;
     }
 #ifdef XENBLK_STORPORT
-    RPRINTK(DPRTL_FRNT, ("setup_blkring: info->evtchn = %d, %p\n",
-                         info->evtchn, blkif_int));
-    err = register_dpc_to_evtchn(info->evtchn, blkif_int, info,
-        &info->has_interrupt);
+    RPRINTK(DPRTL_FRNT, ("setup_blkring: ring %u evtchn = %d, %p\n",
+                         rinfo->ring_idx, rinfo->evtchn, blkif_int));
+    err = register_dpc_to_evtchn(rinfo->evtchn, blkif_int, rinfo,
+        &rinfo->has_interrupt);
 #else
-    RPRINTK(DPRTL_FRNT, ("setup_blkring: info->evtchn = %d\n", info->evtchn));
-    err = register_dpc_to_evtchn(info->evtchn, NULL, NULL,
-        &info->has_interrupt);
+    RPRINTK(DPRTL_FRNT, ("setup_blkring: ring %u evtchn = %d\n",
+                         rinfo->ring_idx, rinfo->evtchn));
+    err = register_dpc_to_evtchn(rinfo->evtchn, NULL, NULL,
+        &rinfo->has_interrupt);
 #endif
 
     if (err < 0) {
@@ -614,7 +741,7 @@ setup_blkring(struct blkfront_info *info, unsigned int old_ring_size)
 
     RPRINTK(DPRTL_INIT,
             ("returning from setup blkring: ring_refs[0] %u, evtchn %u\n",
-             info->ring_refs[0], info->evtchn));
+             rinfo->ring_refs[0], rinfo->evtchn));
     return 0;
 fail:
     blkif_free(info, 0);
@@ -629,11 +756,13 @@ backend_changed(struct xenbus_watch *watch,
     const char **vec, unsigned int len)
 {
     struct blkfront_info *info = (struct blkfront_info *)watch->context;
+    struct blkfront_ring_info *rinfo;
     char *buf;
     XENBLK_LOCK_HANDLE io_lh = {0};
     XenbusState backend_state;
     xenbus_release_device_t release_data;
     uint32_t i;
+    uint32_t r;
     uint32_t found;
 
     if (vec) {
@@ -700,13 +829,16 @@ backend_changed(struct xenbus_watch *watch,
 
         blkif_quiesce(info);
 
-        if (info->evtchn) {
-            RPRINTK(DPRTL_FRNT,
+        for (r = 0; r < info->nr_rings; r++) {
+            rinfo = &info->rinfo[r];
+            if (rinfo->evtchn) {
+                RPRINTK(DPRTL_FRNT,
                     ("      backend_changed:unregister_dpc_from_evtchn %d.\n",
-                     info->evtchn));
-            unregister_dpc_from_evtchn(info->evtchn);
-            xenbus_free_evtchn(info->evtchn);
-            info->evtchn = 0;
+                     rinfo->evtchn));
+                unregister_dpc_from_evtchn(rinfo->evtchn);
+                xenbus_free_evtchn(rinfo->evtchn);
+                rinfo->evtchn = 0;
+            }
         }
 
         info->connected = BLKIF_STATE_DISCONNECTED;
@@ -725,10 +857,13 @@ backend_changed(struct xenbus_watch *watch,
          * do any cleanup up work here.
          */
         found = 0;
-        for (i = 0; i < info->ring_size; i++) {
-            if (info->ring_refs[i] != GRANT_INVALID_REF) {
-                gnttab_end_foreign_access(info->ring_refs[i], 0);
-                info->ring_refs[i] = GRANT_INVALID_REF;
+        for (r = 0; r < info->nr_rings; r++) {
+            rinfo = &info->rinfo[r];
+            for (i = 0; i < info->ring_size; i++) {
+                if (rinfo->ring_refs[i] != GRANT_INVALID_REF) {
+                    gnttab_end_foreign_access(rinfo->ring_refs[i], 0);
+                    rinfo->ring_refs[i] = GRANT_INVALID_REF;
+                }
             }
         }
         for (i = 0; i < info->xbdev->max_targets; i++) {
@@ -753,6 +888,310 @@ backend_changed(struct xenbus_watch *watch,
 }
 
 
+/* Data pages a full ring of the largest requests can have in flight. */
+static uint32_t
+xenblk_persist_pages(struct blkfront_info *info)
+{
+    uint32_t segs;
+
+    if (info->max_segs_per_req > XENBLK_MAX_SGL_ELEMENTS) {
+        segs = info->max_segs_per_req;
+    } else {
+        segs = BLKIF_MAX_SEGMENTS_PER_REQUEST;
+    }
+    return RING_SIZE(&info->rinfo[0].ring) * segs;
+}
+
+/*
+ * Set up each ring's persistent pool before offering feature-persistent.
+ * Once the backend takes it up it keeps every grant it sees mapped, so no
+ * request may use a transient grant any more.  The pool is sized for a
+ * full ring of the largest requests and the indirect pages are granted
+ * here, once.  The data pages are allocated and granted on first use.
+ * Returns FALSE if persistent grants are not to be offered.
+ */
+static BOOLEAN
+xenblk_alloc_persist(struct blkfront_info *info)
+{
+    struct blkfront_ring_info *rinfo;
+    uint32_t pages;
+    uint32_t ind_pages;
+    uint32_t ring_size;
+    uint32_t i;
+    uint32_t j;
+    unsigned int r;
+    int ref;
+
+    pages = xenblk_persist_pages(info);
+    if (pages > BLK_PERSIST_MAX_PAGES) {
+        RPRINTK(DPRTL_FRNT,
+                ("blkfront %s: %u persistent pages needed, max %u\n",
+                 info->nodename, pages, BLK_PERSIST_MAX_PAGES));
+        return FALSE;
+    }
+    ind_pages = info->max_segs_per_req > XENBLK_MAX_SGL_ELEMENTS
+        ? BLKIF_INDIRECT_PAGES(info->max_segs_per_req) : 0;
+
+    for (r = 0; r < info->nr_rings; r++) {
+        rinfo = &info->rinfo[r];
+        if (rinfo->persist != NULL) {
+            continue;
+        }
+        rinfo->persist = ExAllocatePoolWithTag(NonPagedPoolNx,
+            pages * sizeof(struct blk_persist_page),
+            XENBLK_TAG_GENERAL);
+        if (rinfo->persist == NULL) {
+            goto fail;
+        }
+        memset(rinfo->persist, 0, pages * sizeof(struct blk_persist_page));
+        rinfo->persist_max = pages;
+        rinfo->persist_cnt = 0;
+        rinfo->persist_free = BLK_PERSIST_NONE;
+
+        if (ind_pages == 0 || rinfo->indirect_segs == NULL) {
+            continue;
+        }
+        ring_size = RING_SIZE(&rinfo->ring);
+        rinfo->indirect_grefs = ExAllocatePoolWithTag(NonPagedPoolNx,
+            ring_size * ind_pages * sizeof(grant_ref_t),
+            XENBLK_TAG_GENERAL);
+        if (rinfo->indirect_grefs == NULL) {
+            goto fail;
+        }
+        memset(rinfo->indirect_grefs, 0,
+               ring_size * ind_pages * sizeof(grant_ref_t));
+        rinfo->nr_indirect_grefs = ring_size * ind_pages;
+        for (i = 0; i < ring_size; i++) {
+            for (j = 0; j < ind_pages; j++) {
+                ref = gnttab_grant_foreign_access(info->otherend_id,
+                    virt_to_mfn((char *)rinfo->indirect_segs[i]
+                                + ((size_t)j * PAGE_SIZE)),
+                    1);
+                if (ref < 0) {
+                    goto fail;
+                }
+                rinfo->indirect_grefs[(i * ind_pages) + j] = ref;
+            }
+        }
+    }
+    return TRUE;
+
+fail:
+    PRINTK(("blkfront %s: failed to set up persistent grants\n",
+            info->nodename));
+    for (r = 0; r < info->nr_rings; r++) {
+        xenblk_free_persist(&info->rinfo[r]);
+    }
+    return FALSE;
+}
+
+/*
+ * Use the pools set up by xenblk_alloc_persist if the backend took up
+ * feature-persistent, otherwise give them back.
+ */
+static void
+xenblk_setup_persist(struct blkfront_info *info)
+{
+    char *buf;
+    unsigned int r;
+    BOOLEAN persistent;
+
+    if (info->rinfo[0].persist == NULL) {
+        return;
+    }
+
+    persistent = FALSE;
+    buf = xenbus_read(XBT_NIL, info->otherend, "feature-persistent", NULL);
+    if (buf != NULL) {
+        persistent = cmp_strtou64(buf, NULL, 10) != 0;
+        xenbus_free_string(buf);
+    }
+    if (!persistent) {
+        for (r = 0; r < info->nr_rings; r++) {
+            xenblk_free_persist(&info->rinfo[r]);
+        }
+        return;
+    }
+
+    info->flags |= BLKIF_PERSISTENT_F;
+    RPRINTK(DPRTL_FRNT, ("blkfront %s: using persistent grants\n",
+                         info->nodename));
+}
+
+/*
+ * Pick up the backend's discard support.  Granularity and alignment are
+ * given in bytes; keep them in 512 byte sectors to match the ring.
+ */
+static void
+xenblk_setup_discard(struct blkfront_info *info)
+{
+    char *buf;
+
+    buf = xenbus_read(XBT_NIL, info->otherend, "feature-discard", NULL);
+    if (buf == NULL) {
+        return;
+    }
+    if (cmp_strtou64(buf, NULL, 10) == 0) {
+        xenbus_free_string(buf);
+        return;
+    }
+    xenbus_free_string(buf);
+
+    /* Without the keys, assume single sector extents starting at 0. */
+    info->discard_granularity = (uint32_t)(info->sector_size >> 9);
+    info->discard_alignment = 0;
+
+    buf = xenbus_read(XBT_NIL, info->otherend, "discard-granularity", NULL);
+    if (buf != NULL) {
+        info->discard_granularity =
+            (uint32_t)(cmp_strtou64(buf, NULL, 10) >> 9);
+        xenbus_free_string(buf);
+    }
+    if (info->discard_granularity == 0) {
+        info->discard_granularity = 1;
+    }
+
+    buf = xenbus_read(XBT_NIL, info->otherend, "discard-alignment", NULL);
+    if (buf != NULL) {
+        info->discard_alignment = (uint32_t)(cmp_strtou64(buf, NULL, 10) >> 9)
+            % info->discard_granularity;
+        xenbus_free_string(buf);
+    }
+
+    info->flags |= BLKIF_DISCARD_F;
+    RPRINTK(DPRTL_FRNT,
+            ("blkfront %s: discard granularity %u alignment %u sectors\n",
+             info->nodename,
+             info->discard_granularity,
+             info->discard_alignment));
+}
+
+static void
+xenblk_free_persist(struct blkfront_ring_info *rinfo)
+{
+    struct blkfront_info *info = rinfo->info;
+    uint32_t i;
+
+    if (rinfo->persist == NULL) {
+        return;
+    }
+    RPRINTK(DPRTL_ON, ("      blkif_free: free %u persistent pages\n",
+                       rinfo->persist_cnt));
+    for (i = 0; i < rinfo->persist_cnt; i++) {
+        if (!(info->xbdev->state & RESUMING)) {
+            gnttab_end_foreign_access(rinfo->persist[i].gref, 0);
+        }
+        ExFreePool(rinfo->persist[i].va);
+    }
+    ExFreePool(rinfo->persist);
+    rinfo->persist = NULL;
+    rinfo->persist_max = 0;
+    rinfo->persist_cnt = 0;
+    rinfo->persist_free = BLK_PERSIST_NONE;
+
+    if (rinfo->indirect_grefs != NULL) {
+        for (i = 0; i < rinfo->nr_indirect_grefs; i++) {
+            if (rinfo->indirect_grefs[i] != GRANT_INVALID_REF
+                    && !(info->xbdev->state & RESUMING)) {
+                gnttab_end_foreign_access(rinfo->indirect_grefs[i], 0);
+            }
+        }
+        ExFreePool(rinfo->indirect_grefs);
+        rinfo->indirect_grefs = NULL;
+        rinfo->nr_indirect_grefs = 0;
+    }
+}
+
+/*
+ * Take a page from the persistent pool, growing the pool by one granted
+ * page if the free list is empty.  Returns BLK_PERSIST_NONE if the pool
+ * could not grow.
+ */
+static uint16_t
+xenblk_get_persist(struct blkfront_ring_info *rinfo)
+{
+    struct blk_persist_page *p;
+    uint16_t idx;
+    int ref;
+
+    if (!(rinfo->info->flags & BLKIF_PERSISTENT_F)
+            || rinfo->persist == NULL) {
+        return BLK_PERSIST_NONE;
+    }
+    if (rinfo->persist_free != BLK_PERSIST_NONE) {
+        idx = rinfo->persist_free;
+        rinfo->persist_free = rinfo->persist[idx].next;
+        rinfo->persist_hits++;
+        return idx;
+    }
+    if (rinfo->persist_cnt >= rinfo->persist_max) {
+        return BLK_PERSIST_NONE;
+    }
+
+    p = &rinfo->persist[rinfo->persist_cnt];
+    p->va = ExAllocatePoolWithTag(NonPagedPoolNx, PAGE_SIZE,
+                                  XENBLK_TAG_GENERAL);
+    if (p->va == NULL) {
+        return BLK_PERSIST_NONE;
+    }
+    ref = gnttab_grant_foreign_access(rinfo->info->otherend_id,
+                                      virt_to_mfn(p->va), 0);
+    if (ref < 0) {
+        ExFreePool(p->va);
+        p->va = NULL;
+        return BLK_PERSIST_NONE;
+    }
+    p->gref = ref;
+    return (uint16_t)rinfo->persist_cnt++;
+}
+
+static inline void
+xenblk_put_persist(struct blkfront_ring_info *rinfo, uint16_t idx)
+{
+    rinfo->persist[idx].next = rinfo->persist_free;
+    rinfo->persist_free = idx;
+}
+
+/*
+ * Take the persistent pages for all of an srb's segments, or none of them
+ * if the pool can't grow.  The srb is then retried later.
+ */
+static BOOLEAN
+xenblk_get_persist_pages(struct blkfront_ring_info *rinfo, uint16_t *pidx,
+                         int num_pages)
+{
+    int i;
+
+    for (i = 0; i < num_pages; i++) {
+        pidx[i] = xenblk_get_persist(rinfo);
+        if (pidx[i] == BLK_PERSIST_NONE) {
+            while (i--) {
+                xenblk_put_persist(rinfo, pidx[i]);
+            }
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* va is the segment's data in the srb's mapping, see xenblk_get_srb_va(). */
+static void
+xenblk_cp_persist(struct blkfront_ring_info *rinfo, uint16_t idx,
+                  uint8_t *va, unsigned int fsect, unsigned int lsect,
+                  int to_page)
+{
+    unsigned long offset;
+    unsigned long len;
+
+    offset = fsect << 9;
+    len = (lsect - fsect + 1) << 9;
+    if (to_page) {
+        RtlCopyMemory((uint8_t *)rinfo->persist[idx].va + offset, va, len);
+    } else {
+        RtlCopyMemory(va, (uint8_t *)rinfo->persist[idx].va + offset, len);
+    }
+}
+
 /*
  * Invoked when the backend is finally 'ready' (and has told produced
  * the details about the physical device - #sectors, size, etc).
@@ -823,6 +1262,9 @@ connect(struct blkfront_info *info)
         xenbus_free_string(buf);
     }
 
+    xenblk_setup_persist(info);
+    xenblk_setup_discard(info);
+
     RPRINTK(DPRTL_FRNT,
             ("  sectors 0x%llx sector-sz 0x%x last sector 0x%x flags %x\n",
              info->sectors,
@@ -833,101 +1275,97 @@ connect(struct blkfront_info *info)
     (void)xenbus_switch_state(info->nodename, XenbusStateConnected);
 
     info->connected = BLKIF_STATE_CONNECTED;
-
-    /* Kick pending requests. */
-    kick_pending_request_queues(info);
     RPRINTK(DPRTL_FRNT, ("blkfront %s: OUT\n", __func__));
 }
 
 static inline int
-GET_ID_FROM_FREELIST(struct blkfront_info *info)
+GET_ID_FROM_FREELIST(struct blkfront_ring_info *rinfo)
 {
     unsigned long free;
 
-    CDPRINTK(DPRTL_COND, 0, 1, (info->xenblk_locks & BLK_ID_L),
+    CDPRINTK(DPRTL_COND, 0, 1, (rinfo->info->xenblk_locks & BLK_ID_L),
         ("GET_ID_FROM_FREELIST already set: irql %x, cpu %x, xlocks %x on %x\n",
         KeGetCurrentIrql(), KeGetCurrentProcessorNumber(),
-        info->xenblk_locks, info->cpu_locks));
+        rinfo->info->xenblk_locks, rinfo->info->cpu_locks));
 
-    XENBLK_SET_FLAG(info->xenblk_locks, (BLK_ID_L | BLK_GET_L));
-    XENBLK_SET_FLAG(info->cpu_locks, (1 << KeGetCurrentProcessorNumber()));
+    XENBLK_SET_FLAG(rinfo->info->xenblk_locks, (BLK_ID_L | BLK_GET_L));
+    XENBLK_SET_FLAG(rinfo->info->cpu_locks,
+                    (1 << KeGetCurrentProcessorNumber()));
 
-    free = info->shadow_free;
+    free = rinfo->shadow_free;
     ASSERT(free < BLK_RING_SIZE);
-    info->shadow_free = (unsigned long)info->shadow[free].req.id;
-    info->shadow[free].req.id = 0x0fffffee; /* debug */
+    rinfo->shadow_free = (unsigned long)rinfo->shadow[free].req.id;
+    rinfo->shadow[free].req.id = 0x0fffffee; /* debug */
 
-    XENBLK_CLEAR_FLAG(info->xenblk_locks, (BLK_ID_L | BLK_GET_L));
-    XENBLK_CLEAR_FLAG(info->cpu_locks, (1 << KeGetCurrentProcessorNumber()));
+    XENBLK_CLEAR_FLAG(rinfo->info->xenblk_locks, (BLK_ID_L | BLK_GET_L));
+    XENBLK_CLEAR_FLAG(rinfo->info->cpu_locks,
+                      (1 << KeGetCurrentProcessorNumber()));
 
     return free;
 }
 
 static inline void
-ADD_ID_TO_FREELIST(struct blkfront_info *info, unsigned long id)
+ADD_ID_TO_FREELIST(struct blkfront_ring_info *rinfo, unsigned long id)
 {
-    CDPRINTK(DPRTL_COND, 0, 1, (info->xenblk_locks & BLK_ID_L),
+    CDPRINTK(DPRTL_COND, 0, 1, (rinfo->info->xenblk_locks & BLK_ID_L),
         ("ADD_ID_TO_FREELIST already set: irql %x, cpu %x, xlocks %x on %x\n",
         KeGetCurrentIrql(), KeGetCurrentProcessorNumber(),
-        info->xenblk_locks, info->cpu_locks));
+        rinfo->info->xenblk_locks, rinfo->info->cpu_locks));
 
-    XENBLK_SET_FLAG(info->xenblk_locks, (BLK_ID_L | BLK_ADD_L));
-    XENBLK_SET_FLAG(info->cpu_locks, (1 << KeGetCurrentProcessorNumber()));
+    XENBLK_SET_FLAG(rinfo->info->xenblk_locks, (BLK_ID_L | BLK_ADD_L));
+    XENBLK_SET_FLAG(rinfo->info->cpu_locks,
+                    (1 << KeGetCurrentProcessorNumber()));
 
-    info->shadow[id].req.id  = info->shadow_free;
-    info->shadow[id].request = NULL;
-    info->shadow_free = id;
+    rinfo->shadow[id].req.id  = rinfo->shadow_free;
+    rinfo->shadow[id].request = NULL;
+    rinfo->shadow_free = id;
 
-    XENBLK_CLEAR_FLAG(info->xenblk_locks, (BLK_ID_L | BLK_ADD_L));
-    XENBLK_CLEAR_FLAG(info->cpu_locks, (1 << KeGetCurrentProcessorNumber()));
+    XENBLK_CLEAR_FLAG(rinfo->info->xenblk_locks, (BLK_ID_L | BLK_ADD_L));
+    XENBLK_CLEAR_FLAG(rinfo->info->cpu_locks,
+                      (1 << KeGetCurrentProcessorNumber()));
 }
 
 
 static void
-flush_enabled(struct blkfront_info *info)
+flush_enabled(struct blkfront_ring_info *rinfo)
 {
     RPRINTK(DPRTL_TRC, ("flush_enabled - IN irql = %d\n", KeGetCurrentIrql()));
-    notify_remote_via_irq(info->evtchn);
+    notify_remote_via_irq(rinfo->evtchn);
     RPRINTK(DPRTL_TRC, ("flush_enabled - OUT irql = %d\n", KeGetCurrentIrql()));
 }
 
 static inline void
-flush_requests(struct blkfront_info *info)
+flush_requests(struct blkfront_ring_info *rinfo)
 {
     int notify;
 
-    RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(&info->ring, notify);
+    RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(&rinfo->ring, notify);
 
     if (notify) {
-        notify_remote_via_irq(info->evtchn);
+        notify_remote_via_irq(rinfo->evtchn);
     }
 }
 
-static void
-kick_pending_request_queues(struct blkfront_info *info)
-{
-    if (!RING_FULL(&info->ring)) {
-        /* Re-enable calldowns. */
-    }
-}
-
-static void
-blkif_restart_queue(IN PDEVICE_OBJECT DeviceObject, IN PVOID Context)
+/*
+ * Steer a request to the ring serving the issuing processor's group.
+ * StorPort still calls StartIo under its StartIoLock, so submissions are
+ * serialized per adapter either way.  This keeps each ring's shadow,
+ * grant and persistent page state on one group of processors.
+ */
+static inline struct blkfront_ring_info *
+xenblk_select_ring(struct blkfront_info *info)
 {
-    struct blkfront_info *info = (struct blkfront_info *)Context;
+    ULONG cpu;
 
-    if (info->connected == BLKIF_STATE_CONNECTED) {
-        kick_pending_request_queues(info);
+    if (info->nr_rings <= 1) {
+        return &info->rinfo[0];
     }
-}
-
-static void
-blkif_restart_queue_callback(void *arg)
-{
-    struct blkfront_info *info = (struct blkfront_info *)arg;
-
-    xenblk_request_timer_call(RequestTimerCall, info->xbdev,
-        blkif_restart_queue, 100);
+#if (NTDDI_VERSION >= NTDDI_WIN7)
+    cpu = KeGetCurrentProcessorNumberEx(NULL);
+#else
+    cpu = KeGetCurrentProcessorNumber();
+#endif
+    return &info->rinfo[(cpu / info->cpus_per_ring) % info->nr_rings];
 }
 
 #ifdef DBG
@@ -956,9 +1394,10 @@ DumpPacket(uint64_t disk_offset, PUCHAR currentAddress, uint32_t len)
 #endif
 
 static NTSTATUS
-do_blkif_ind_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb,
+do_blkif_ind_request(struct blkfront_ring_info *rinfo, SCSI_REQUEST_BLOCK *srb,
                      int num_pages)
 {
+    struct blkfront_info *info = rinfo->info;
     uint64_t disk_offset;
     xenblk_addr_t addr;
     xenblk_srb_extension *srb_ext;
@@ -969,6 +1408,8 @@ do_blkif_ind_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb,
     XENBLK_LOCK_HANDLE int_lh = {0};
     XEN_LOCK_HANDLE lh;
     grant_ref_t gref_head;
+    uint8_t *data_va;
+    uint16_t pidx;
     ULONG i;
     ULONG j;
     ULONG sidx;
@@ -976,6 +1417,7 @@ do_blkif_ind_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb,
     unsigned long id;
     unsigned long len;
     unsigned long page_offset;
+    unsigned long data_off;
     unsigned int fsect;
     unsigned int lsect;
     int ref;
@@ -991,13 +1433,13 @@ do_blkif_ind_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb,
 
     srb_req_offset(srb, disk_offset);
 
-    XenAcquireSpinLock(&info->lock, &lh);
+    XenAcquireSpinLock(&rinfo->lock, &lh);
 
 #ifdef DBG
-    InterlockedIncrement(&info->depth);
-    if (info->depth > info->max_depth) {
-        info->max_depth = info->depth;
-        PRINTK(("Max queue depth %d\n", info->max_depth));
+    InterlockedIncrement(&rinfo->depth);
+    if (rinfo->depth > rinfo->max_depth) {
+        rinfo->max_depth = rinfo->depth;
+        PRINTK(("Max queue depth %d\n", rinfo->max_depth));
     }
 #endif
     if (gnttab_alloc_grant_references(
@@ -1008,18 +1450,42 @@ do_blkif_ind_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb,
                 ("XenBlk %x: ind req failed to allocate %d grant references\n",
                  srb->TargetId,
                  num_pages + BLKIF_INDIRECT_PAGES(info->max_segs_per_req)));
-        XenReleaseSpinLock(&info->lock, lh);
+        XenReleaseSpinLock(&rinfo->lock, lh);
         return STATUS_UNSUCCESSFUL;
     }
 
     /* Fill out a communications ring structure. */
-    ring_req = RING_GET_REQUEST(&info->ring, info->ring.req_prod_pvt);
+    ring_req = RING_GET_REQUEST(&rinfo->ring, rinfo->ring.req_prod_pvt);
 
     /* scsi already has a spinlock.  Just do it for storport. */
     storport_acquire_spinlock(info->xbdev, InterruptLock, NULL, &int_lh);
-    id = GET_ID_FROM_FREELIST(info);
+    id = GET_ID_FROM_FREELIST(rinfo);
     storport_release_spinlock(info->xbdev, int_lh);
 
+    /*
+     * With persistent grants the segments go through pages of the pool as
+     * in do_blkif_request, and the indirect pages keep the grants they got
+     * in xenblk_alloc_persist.
+     */
+    data_va = NULL;
+    data_off = 0;
+    if (info->flags & BLKIF_PERSISTENT_F) {
+        data_va = xenblk_get_srb_va(info->xbdev, srb, srb_ext);
+        if (data_va == NULL
+                || !xenblk_get_persist_pages(rinfo, rinfo->shadow[id].persist,
+                                             num_pages)) {
+            RPRINTK(DPRTL_UNEXPD,
+                    ("XenBlk %x: no persistent pages for srb %p, va %p\n",
+                     srb->TargetId, srb, data_va));
+            storport_acquire_spinlock(info->xbdev, InterruptLock, NULL,
+                                      &int_lh);
+            ADD_ID_TO_FREELIST(rinfo, id);
+            storport_release_spinlock(info->xbdev, int_lh);
+            gnttab_free_grant_references(gref_head);
+            XenReleaseSpinLock(&rinfo->lock, lh);
+            return STATUS_UNSUCCESSFUL;
+        }
+    }
 
     ring_req->id = id;
     ring_req->sector_number = disk_offset;
@@ -1034,7 +1500,7 @@ do_blkif_ind_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb,
     ind->operation = BLKIF_OP_INDIRECT;
     ind->nr_segments = (uint16_t)num_pages;
     ind->handle = info->handle;
-    segs = info->indirect_segs[id];
+    segs = rinfo->indirect_segs[id];
 
 
 
@@ -1051,6 +1517,11 @@ do_blkif_ind_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb,
 #endif
     /* Grant the pages of the indirect segnemt. */
     for (i = 0; i < BLKIF_INDIRECT_PAGES(num_pages); i++) {
+        if (data_va != NULL) {
+            ind->indirect_grefs[i] = rinfo->indirect_grefs[
+                (id * BLKIF_INDIRECT_PAGES(info->max_segs_per_req)) + i];
+            continue;
+        }
         ref = gnttab_claim_grant_reference(&gref_head);
         if (ref == -1) {
             PRINTK(("do_blkif_ind_request: failed seg claim grant ref\n"));
@@ -1076,20 +1547,36 @@ do_blkif_ind_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb,
         addr = (xenblk_addr_t)sgl->List[i].PhysicalAddress.QuadPart;
         len = sgl->List[i].Length;
         while ((int)len > 0) {
-            ref = gnttab_claim_grant_reference(&gref_head);
-            if (ref == -1) {
-                PRINTK(("do_blkif_ind_request: failed page claim grant ref\n"));
-            }
-            ASSERT(ref != -1);
             buffer_mfn = xenblk_buffer_mfn(info->xbdev, srb, srb_ext, addr);
-            gnttab_grant_foreign_access_ref(
-                ref,
-                info->otherend_id,
-                buffer_mfn,
-                ring_req->operation & 1);
 
             /* Check for page/sector alignment. */
             page_offset = (unsigned long)addr & (PAGE_SIZE - 1);
+            fsect = page_offset >> 9;
+            lsect = page_offset + len >= PAGE_SIZE ? 7 :
+                (uint8_t)(((page_offset + len) >> 9) - 1);
+
+            if (data_va != NULL) {
+                pidx = rinfo->shadow[id].persist[sidx];
+                if (ind->indirect_op == BLKIF_OP_WRITE) {
+                    xenblk_cp_persist(rinfo, pidx, data_va + data_off,
+                                      fsect, lsect, 1);
+                }
+                ref = rinfo->persist[pidx].gref;
+                rinfo->shadow[id].persist_va[sidx] = data_va + data_off;
+                data_off += (lsect - fsect + 1) << 9;
+            } else {
+                ref = gnttab_claim_grant_reference(&gref_head);
+                if (ref == -1) {
+                    PRINTK(("do_blkif_ind_request: "
+                            "failed page claim grant ref\n"));
+                }
+                ASSERT(ref != -1);
+                gnttab_grant_foreign_access_ref(
+                    ref,
+                    info->otherend_id,
+                    buffer_mfn,
+                    ring_req->operation & 1);
+            }
 #ifdef DBG
             if ((ULONG)num_pages > srb_ext->sgl->NumberOfElements) {
                 DPRINTK(DPRTL_IO,
@@ -1098,57 +1585,64 @@ do_blkif_ind_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb,
                          addr, page_offset));
             }
 #endif
-            fsect = page_offset >> 9;
-            lsect = page_offset + len >= PAGE_SIZE ? 7 :
-                (uint8_t)(((page_offset + len) >> 9) - 1);
             addr += PAGE_SIZE - page_offset;
             len -= PAGE_SIZE - page_offset;
 
-            info->shadow[id].frame[i] = mfn_to_pfn(buffer_mfn);
+            rinfo->shadow[id].frame[i] = mfn_to_pfn(buffer_mfn);
             segs[sidx].gref = ref;
             segs[sidx].first_sect = (uint8_t)fsect;
             segs[sidx].last_sect = (uint8_t)lsect;
             sidx++;
         }
     }
-    info->ring.req_prod_pvt++;
+    rinfo->ring.req_prod_pvt++;
 
     /* Keep a private copy so we can reissue requests when recovering. */
-    info->shadow[id].ind = *ind;
-    info->shadow[id].num_ind = sidx;
+    rinfo->shadow[id].ind = *ind;
+    rinfo->shadow[id].num_ind = sidx;
+    if (data_va != NULL) {
+        /* Pages taken for segments the sgl did not need go back. */
+        for (j = sidx; j < (ULONG)num_pages; j++) {
+            xenblk_put_persist(rinfo, rinfo->shadow[id].persist[j]);
+        }
+        rinfo->shadow[id].num_persist = (uint16_t)sidx;
+    } else {
+        rinfo->shadow[id].num_persist = 0;
+        rinfo->transient_grants += sidx;
+    }
     gnttab_free_grant_references(gref_head);
 
 #ifdef DBG
     if (sidx != num_pages) {
         DPRINTK(DPRTL_IO, ("** sidx %d != num_pages %d\n", sidx, num_pages));
     }
-    info->shadow[id].seq = info->seq;
-    InterlockedIncrement(&info->seq);
+    rinfo->shadow[id].seq = rinfo->seq;
+    InterlockedIncrement(&rinfo->seq);
 #endif
-    info->shadow[id].srb_ext = srb_ext;
+    rinfo->shadow[id].srb_ext = srb_ext;
     InterlockedIncrement(&srb_ext->use_cnt);
 
-    info->shadow[id].request = srb;
+    rinfo->shadow[id].request = srb;
 #ifdef DBG
     if (srb->Cdb[0] >= SCSIOP_READ16) {
         DPRINTK(DPRTL_TRC, ("Submitting the SCSIOP 16 request %x.\n",
                             srb->Cdb[0]));
     }
-    InterlockedIncrement(&info->req);
+    InterlockedIncrement(&rinfo->req);
 #endif
 
     /*
      * Check if there are virtual and system addresses that need to be
      * freed and unmapped now that we are at DPC time.
      */
-    xenblk_unmap_system_addresses(info);
+    xenblk_unmap_system_addresses(rinfo);
 
-    RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(&info->ring, notify);
+    RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(&rinfo->ring, notify);
 
-    XenReleaseSpinLock(&info->lock, lh);
+    XenReleaseSpinLock(&rinfo->lock, lh);
 
     if (notify) {
-        notify_remote_via_irq(info->evtchn);
+        notify_remote_via_irq(rinfo->evtchn);
     }
 
     DPRINTK(DPRTL_TRC,
@@ -1161,18 +1655,21 @@ do_blkif_ind_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb,
 NTSTATUS
 do_blkif_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb)
 {
+    struct blkfront_ring_info *rinfo;
     uint64_t disk_offset;
     xenblk_addr_t addr;
     xenblk_srb_extension *srb_ext;
     blkif_request_t *ring_req;
     STOR_SCATTER_GATHER_LIST *sgl;
     uint32_t *ids;
+    uint8_t *data_va;
     ULONG sidx;
     ULONG i;
     unsigned long buffer_mfn;
     unsigned long len;
     unsigned long id;
     unsigned long page_offset;
+    unsigned long data_off;
     unsigned long remaining_bytes;
     unsigned int starting_req_prod_pvt;
     unsigned int fsect;
@@ -1180,6 +1677,9 @@ do_blkif_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb)
     XEN_LOCK_HANDLE lh;
     XENBLK_LOCK_HANDLE int_lh = {0};
     grant_ref_t gref_head;
+    uint16_t pidxs[XENBLK_MAX_SGL_ELEMENTS];
+    uint16_t pidx;
+    int pseg;
     int idx;
     int ref;
     int num_pages;
@@ -1193,20 +1693,22 @@ do_blkif_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb)
         return STATUS_UNSUCCESSFUL;
     }
 
+    rinfo = xenblk_select_ring(info);
+
     /* Figure out how many pages this request will take. */
     srb_pages_in_req(srb_ext, num_pages);
     if (num_pages > XENBLK_MAX_SGL_ELEMENTS) {
-        return do_blkif_ind_request(info, srb, num_pages);
+        return do_blkif_ind_request(rinfo, srb, num_pages);
     }
 
-    XenAcquireSpinLock(&info->lock, &lh);
+    XenAcquireSpinLock(&rinfo->lock, &lh);
 
     /* The total num_segs needed is equal to num_pages. */
     if (gnttab_alloc_grant_references((uint16_t)num_pages, &gref_head) < 0) {
         RPRINTK(DPRTL_UNEXPD,
                 ("XenBlk %x: do req failed to allocate %d grant references\n",
                 srb->TargetId, num_pages));
-        XenReleaseSpinLock(&info->lock, lh);
+        XenReleaseSpinLock(&rinfo->lock, lh);
         return STATUS_UNSUCCESSFUL;
     }
 
@@ -1225,19 +1727,19 @@ do_blkif_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb)
     idx = 0;
 
 #ifdef DBG
-    InterlockedIncrement(&info->depth);
-    if (info->depth > info->max_depth) {
-        info->max_depth = info->depth;
-        PRINTK(("Max queue depth %d\n", info->max_depth));
+    InterlockedIncrement(&rinfo->depth);
+    if (rinfo->depth > rinfo->max_depth) {
+        rinfo->max_depth = rinfo->depth;
+        PRINTK(("Max queue depth %d\n", rinfo->max_depth));
     }
 #endif
-    starting_req_prod_pvt = info->ring.req_prod_pvt;
-    ids = info->id;
+    starting_req_prod_pvt = rinfo->ring.req_prod_pvt;
+    ids = rinfo->id;
 
-    if ((int)(RING_FREE_REQUESTS(&info->ring)) < num_ring_req) {
+    if ((int)(RING_FREE_REQUESTS(&rinfo->ring)) < num_ring_req) {
         PRINTK(("blkif_queue_request - OUT, free %x, required %x, pages %d\n",
-            (int)(RING_FREE_REQUESTS(&info->ring)), num_ring_req, num_pages));
-        XenReleaseSpinLock(&info->lock, lh);
+            (int)(RING_FREE_REQUESTS(&rinfo->ring)), num_ring_req, num_pages));
+        XenReleaseSpinLock(&rinfo->lock, lh);
         return STATUS_UNSUCCESSFUL;
     }
 
@@ -1246,6 +1748,27 @@ do_blkif_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb)
     addr = xenblk_get_buffer_addr(srb, srb_ext);
     sidx = 1;
 
+    /*
+     * With persistent grants every segment goes through a page of the pool,
+     * copied through one mapping of the whole srb.  If either can't be had
+     * the srb is retried, a transient grant would stay mapped for good.
+     */
+    data_va = NULL;
+    data_off = 0;
+    pseg = 0;
+    if (info->flags & BLKIF_PERSISTENT_F) {
+        data_va = xenblk_get_srb_va(info->xbdev, srb, srb_ext);
+        if (data_va == NULL
+                || !xenblk_get_persist_pages(rinfo, pidxs, num_pages)) {
+            RPRINTK(DPRTL_UNEXPD,
+                    ("XenBlk %x: no persistent pages for srb %p, va %p\n",
+                     srb->TargetId, srb, data_va));
+            gnttab_free_grant_references(gref_head);
+            XenReleaseSpinLock(&rinfo->lock, lh);
+            return STATUS_UNSUCCESSFUL;
+        }
+    }
+
     for (; num_ring_req; num_ring_req--) {
         if (num_pages <= BLKIF_MAX_SEGMENTS_PER_REQUEST) {
             num_segs = num_pages;
@@ -1256,11 +1779,11 @@ do_blkif_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb)
         }
 
         /* Fill out a communications ring structure. */
-        ring_req = RING_GET_REQUEST(&info->ring, info->ring.req_prod_pvt);
+        ring_req = RING_GET_REQUEST(&rinfo->ring, rinfo->ring.req_prod_pvt);
 
         /* scsi already has a spinlock.  Just do it for storport. */
         storport_acquire_spinlock(info->xbdev, InterruptLock, NULL, &int_lh);
-        id = GET_ID_FROM_FREELIST(info);
+        id = GET_ID_FROM_FREELIST(rinfo);
         storport_release_spinlock(info->xbdev, int_lh);
 
         ids[idx++] = id;
@@ -1270,19 +1793,45 @@ do_blkif_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb)
             BLKIF_OP_WRITE : BLKIF_OP_READ;
         ring_req->sector_number = disk_offset;
         ring_req->handle = info->handle;
+        rinfo->shadow[id].num_persist = 0;
 
         for (ring_req->nr_segments = 0; num_segs; num_segs--) {
-            ref = gnttab_claim_grant_reference(&gref_head);
-            ASSERT(ref != -1);
-
             buffer_mfn = xenblk_buffer_mfn(info->xbdev, srb, srb_ext, addr);
-            ring_req->seg[ring_req->nr_segments].gref = ref;
 
             /* Check for page/sector alignment. */
             page_offset = (unsigned long)addr & (PAGE_SIZE - 1);
             fsect = page_offset >> 9;
             lsect = page_offset + len >= PAGE_SIZE ? 7 :
                 (uint8_t)(((page_offset + len) >> 9) - 1);
+
+            /*
+             * Copy through a page the backend keeps mapped, or without
+             * persistent grants grant the data page itself for the life
+             * of this request.
+             */
+            pidx = data_va != NULL ? pidxs[pseg++] : BLK_PERSIST_NONE;
+            if (pidx != BLK_PERSIST_NONE) {
+                if (ring_req->operation == BLKIF_OP_WRITE) {
+                    xenblk_cp_persist(rinfo, pidx, data_va + data_off,
+                                      fsect, lsect, 1);
+                }
+                ref = rinfo->persist[pidx].gref;
+                rinfo->shadow[id].persist_va[ring_req->nr_segments] =
+                    data_va + data_off;
+                rinfo->shadow[id].num_persist++;
+            } else {
+                ref = gnttab_claim_grant_reference(&gref_head);
+                ASSERT(ref != -1);
+                gnttab_grant_foreign_access_ref(
+                    ref,
+                    info->otherend_id,
+                    buffer_mfn,
+                    ring_req->operation & 1);
+                rinfo->transient_grants++;
+            }
+            rinfo->shadow[id].persist[ring_req->nr_segments] = pidx;
+            data_off += (lsect - fsect + 1) << 9;
+            ring_req->seg[ring_req->nr_segments].gref = ref;
             addr += PAGE_SIZE - page_offset;
 #ifdef DBG
             if ((int)(len - PAGE_SIZE - page_offset) < 0) {
@@ -1309,53 +1858,47 @@ do_blkif_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb)
             ring_req->seg[ring_req->nr_segments].last_sect = (uint8_t)lsect;
             disk_offset += (((uint64_t)lsect - (uint64_t)fsect) + 1);
 
-            gnttab_grant_foreign_access_ref(
-                ref,
-                info->otherend_id,
-                buffer_mfn,
-                ring_req->operation & 1);
-
-            info->shadow[id].frame[ring_req->nr_segments] =
+            rinfo->shadow[id].frame[ring_req->nr_segments] =
                 mfn_to_pfn(buffer_mfn);
 
             ring_req->nr_segments++;
         }
 
-        info->ring.req_prod_pvt++;
+        rinfo->ring.req_prod_pvt++;
 
         /* Keep a private copy so we can reissue requests when recovering. */
-        info->shadow[id].req = *ring_req;
+        rinfo->shadow[id].req = *ring_req;
 
 #ifdef DBG
-        info->shadow[id].seq = info->seq;
-        InterlockedIncrement(&info->seq);
+        rinfo->shadow[id].seq = rinfo->seq;
+        InterlockedIncrement(&rinfo->seq);
 #endif
-        info->shadow[id].srb_ext = srb_ext;
+        rinfo->shadow[id].srb_ext = srb_ext;
         InterlockedIncrement(&srb_ext->use_cnt);
     }
     gnttab_free_grant_references(gref_head);
 
-    info->shadow[id].request = srb;
+    rinfo->shadow[id].request = srb;
 #ifdef DBG
     if (srb->Cdb[0] >= SCSIOP_READ16) {
         DPRINTK(DPRTL_TRC, ("Submitting the SCSIOP 16 request %x.\n",
                             srb->Cdb[0]));
     }
-    InterlockedIncrement(&info->req);
+    InterlockedIncrement(&rinfo->req);
 #endif
 
     /*
      * Check if there are virtual and system addresses that need to be
      * freed and unmapped now that we are at DPC time.
      */
-    xenblk_unmap_system_addresses(info);
+    xenblk_unmap_system_addresses(rinfo);
 
-    RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(&info->ring, notify);
+    RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(&rinfo->ring, notify);
 
-    XenReleaseSpinLock(&info->lock, lh);
+    XenReleaseSpinLock(&rinfo->lock, lh);
 
     if (notify) {
-        notify_remote_via_irq(info->evtchn);
+        notify_remote_via_irq(rinfo->evtchn);
     }
 
     DPRINTK(DPRTL_TRC,
@@ -1365,8 +1908,162 @@ do_blkif_request(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb)
     return STATUS_SUCCESS;
 }
 
+/*
+ * Turn the UNMAP block descriptor list into one BLKIF_OP_DISCARD request
+ * per descriptor.  Each range is trimmed inward to whole discard extents
+ * so the backend never sees a partial extent.  Returns SRB_STATUS_PENDING
+ * once the requests are on the ring, SRB_STATUS_BUSY if the ring is full,
+ * otherwise the status to complete the srb with.
+ */
+UCHAR
+do_blkif_discard(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb)
+{
+    struct blkfront_ring_info *rinfo;
+    xenblk_srb_extension *srb_ext;
+    blkif_request_discard_t *ring_req;
+    PUNMAP_LIST_HEADER hdr;
+    uint64_t start[XENBLK_MAX_DISCARD_REQS];
+    uint64_t nr_sectors[XENBLK_MAX_DISCARD_REQS];
+    uint64_t end;
+    uint64_t rem;
+    uint32_t count;
+    uint32_t num_desc;
+    uint32_t num_ring_req;
+    uint32_t gran;
+    uint32_t align;
+    uint32_t i;
+    uint16_t desc_len;
+    unsigned long id;
+    XEN_LOCK_HANDLE lh;
+    XENBLK_LOCK_HANDLE int_lh = {0};
+    int notify;
+
+    if (info->connected != BLKIF_STATE_CONNECTED) {
+        return SRB_STATUS_BUSY;
+    }
+    if (!(info->flags & BLKIF_DISCARD_F)
+            || (info->flags & BLKIF_READ_ONLY_F)
+            || srb->DataTransferLength < sizeof(UNMAP_LIST_HEADER)) {
+        return SRB_STATUS_INVALID_REQUEST;
+    }
+
+    hdr = (PUNMAP_LIST_HEADER)srb->DataBuffer;
+    REVERSE_BYTES_SHORT(&desc_len, hdr->BlockDescrDataLength);
+    if (sizeof(UNMAP_LIST_HEADER) + desc_len > srb->DataTransferLength) {
+        return SRB_STATUS_INVALID_REQUEST;
+    }
+    num_desc = desc_len / sizeof(UNMAP_BLOCK_DESCRIPTOR);
+    if (num_desc > XENBLK_MAX_DISCARD_REQS) {
+        PRINTK(("XenBlk %x: %d unmap descriptors, max %d\n",
+                srb->TargetId, num_desc, XENBLK_MAX_DISCARD_REQS));
+        return SRB_STATUS_INVALID_REQUEST;
+    }
+
+    gran = info->discard_granularity;
+    align = info->discard_alignment;
+    num_ring_req = 0;
+    for (i = 0; i < num_desc; i++) {
+        REVERSE_BYTES_QUAD(&start[num_ring_req],
+                           hdr->Descriptors[i].StartingLba);
+        REVERSE_BYTES(&count, hdr->Descriptors[i].LbaCount);
+        if (count == 0) {
+            continue;
+        }
+        end = start[num_ring_req] + count;
+        if (end > info->sectors) {
+            return SRB_STATUS_INVALID_REQUEST;
+        }
+        if (gran > 1) {
+            rem = (start[num_ring_req] + gran - align) % gran;
+            if (rem) {
+                start[num_ring_req] += gran - rem;
+            }
+            end -= (end + gran - align) % gran;
+            if (end <= start[num_ring_req]) {
+                continue;
+            }
+        }
+        nr_sectors[num_ring_req] = end - start[num_ring_req];
+        num_ring_req++;
+    }
+    if (num_ring_req == 0) {
+        /* Nothing covers a whole extent, so there is nothing to free. */
+        return SRB_STATUS_SUCCESS;
+    }
+
+    srb_ext = (xenblk_srb_extension *)srb->SrbExtension;
+    rinfo = xenblk_select_ring(info);
+
+    XenAcquireSpinLock(&rinfo->lock, &lh);
+
+    if (RING_FREE_REQUESTS(&rinfo->ring) < num_ring_req) {
+        XenReleaseSpinLock(&rinfo->lock, lh);
+        return SRB_STATUS_BUSY;
+    }
+
+    srb_ext->next = NULL;
+    srb_ext->srb = srb;
+    srb_ext->use_cnt = 0;
+    srb_ext->va = NULL;
+    srb_ext->bounce_cls = XENBLK_BOUNCE_NONE;
+#ifdef XENBLK_DBG_SRB_REQ
+    srb_ext->sys_sgl = xenblk_build_sgl(info->xbdev, srb);
+    srb_ext->sgl = srb_ext->sys_sgl;
+#endif
+
+#ifdef DBG
+    InterlockedIncrement(&rinfo->depth);
+    if (rinfo->depth > rinfo->max_depth) {
+        rinfo->max_depth = rinfo->depth;
+        PRINTK(("Max queue depth %d\n", rinfo->max_depth));
+    }
+#endif
+
+    for (i = 0; i < num_ring_req; i++) {
+        ring_req = (blkif_request_discard_t *)
+            RING_GET_REQUEST(&rinfo->ring, rinfo->ring.req_prod_pvt);
+
+        storport_acquire_spinlock(info->xbdev, InterruptLock, NULL, &int_lh);
+        id = GET_ID_FROM_FREELIST(rinfo);
+        storport_release_spinlock(info->xbdev, int_lh);
+
+        ring_req->operation = BLKIF_OP_DISCARD;
+        ring_req->flag = 0;
+        ring_req->handle = info->handle;
+        ring_req->id = id;
+        ring_req->sector_number = start[i];
+        ring_req->nr_sectors = nr_sectors[i];
+        rinfo->ring.req_prod_pvt++;
+
+        /* No grants are used, the shadow only needs the operation. */
+        rinfo->shadow[id].req = *(blkif_request_t *)ring_req;
+        rinfo->shadow[id].num_persist = 0;
+#ifdef DBG
+        rinfo->shadow[id].seq = rinfo->seq;
+        InterlockedIncrement(&rinfo->seq);
+#endif
+        rinfo->shadow[id].srb_ext = srb_ext;
+        InterlockedIncrement(&srb_ext->use_cnt);
+    }
+    rinfo->shadow[id].request = srb;
+#ifdef DBG
+    InterlockedIncrement(&rinfo->req);
+#endif
+
+    RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(&rinfo->ring, notify);
+
+    XenReleaseSpinLock(&rinfo->lock, lh);
+
+    if (notify) {
+        notify_remote_via_irq(rinfo->evtchn);
+    }
+
+    XENBLK_INC_SRB(io_srbs_seen);
+    return SRB_STATUS_PENDING;
+}
+
 static void
-XenBlkCompleteRequest(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb,
+XenBlkCompleteRequest(struct blkfront_ring_info *rinfo, SCSI_REQUEST_BLOCK *srb,
     unsigned int status)
 {
     xenblk_srb_extension *srb_ext;
@@ -1390,6 +2087,8 @@ XenBlkCompleteRequest(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb,
                     (" xenblk_cp_to_sa: srb %p, ext %p, va %p, sa %p\n",
                      srb, srb_ext, srb_ext->va, srb_ext->sa));
             xenblk_cp_to_sa(srb_ext->sa, srb_ext->sys_sgl, srb_ext->va);
+            InterlockedExchangeAdd64(&rinfo->info->xbdev->bounce_bytes,
+                                     srb->DataTransferLength);
             DPRINTK(DPRTL_MM, ("\tRtlCopyMemory done.\n"));
 #ifdef XENBLK_REQUEST_VERIFIER
             pu32 = (uint32_t *)(srb_ext->va + srb->DataTransferLength);
@@ -1405,17 +2104,17 @@ XenBlkCompleteRequest(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb,
          * Save the virtual and system addresses so that they can be
          * freed and unmapped at DPC time rather than at interrupt time.
          */
-        xenblk_save_system_address(info, srb_ext);
+        xenblk_save_system_address(rinfo, srb_ext);
         DPRINTK(DPRTL_MM, ("\tabout to complete %p.\n", srb));
     }
 #ifdef XENBLK_DBG_MAP_SGL_ONLY
     else {
         if (srb->Cdb[0] == SCSIOP_READ || srb->Cdb[0] == SCSIOP_READ16) {
-            xenblk_save_system_address(info, srb_ext);
+            xenblk_save_system_address(rinfo, srb_ext);
         }
     }
 #endif
-    xenblk_save_req(info, srb, srb_ext);
+    xenblk_save_req(rinfo->info, srb, srb_ext);
 
     if (status == BLKIF_RSP_OKAY) {
         srb->SrbStatus = SRB_STATUS_SUCCESS;
@@ -1435,17 +2134,18 @@ XenBlkCompleteRequest(struct blkfront_info *info, SCSI_REQUEST_BLOCK *srb,
             disk_offset));
     }
 
-    xenblk_next_request(NextRequest, info->xbdev);
+    xenblk_next_request(NextRequest, rinfo->info->xbdev);
     XENBLK_INC_SRB(srbs_returned);
     XENBLK_INC_SRB(io_srbs_returned);
     XENBLK_INC_SRB(sio_srbs_returned);
-    xenblk_request_complete(RequestComplete, info->xbdev, srb);
+    xenblk_request_complete(RequestComplete, rinfo->info->xbdev, srb);
     DPRINTK(DPRTL_TRC, ("    XenBlkCompleteRequest - out\n"));
 }
 
 uint32_t
-blkif_complete_int(struct blkfront_info *info)
+blkif_complete_int(struct blkfront_ring_info *rinfo)
 {
+    struct blkfront_info *info = rinfo->info;
     XEN_LOCK_HANDLE lh;
     SCSI_REQUEST_BLOCK *srb;
     blkif_response_t *bret;
@@ -1462,106 +2162,106 @@ blkif_complete_int(struct blkfront_info *info)
     DPRINTK(DPRTL_FRNT, ("  blkif_complete_int - IN irql = %d\n",
                          KeGetCurrentIrql()));
 
-    XenAcquireSpinLock(&info->lock, &lh);
+    XenAcquireSpinLock(&rinfo->lock, &lh);
     if (info->connected) {
         while (more_to_do) {
-            rp = info->ring.sring->rsp_prod;
+            rp = rinfo->ring.sring->rsp_prod;
             rmb(); /* Ensure we see queued responses up to 'rp'. */
 
-            for (i = info->ring.rsp_cons; i != rp; i++) {
-                bret = RING_GET_RESPONSE(&info->ring, i);
+            for (i = rinfo->ring.rsp_cons; i != rp; i++) {
+                bret = RING_GET_RESPONSE(&rinfo->ring, i);
                 id = (unsigned long)bret->id;
 
-                blkif_completion(info, id);
+                blkif_completion(rinfo, id);
                 /*
                  * blkif_completion(&info->shadow[id]);
                  * is done right after GET_ID_FROM_FREE_LIST
                  */
 
 #ifdef DBG
-                if (info->shadow[id].seq > info->cseq) {
+                if (rinfo->shadow[id].seq > rinfo->cseq) {
                     DPRINTK(DPRTL_FRNT,
                             ("XENBLK: sequence, %x - %x: req %p, status %x\n",
-                             info->shadow[id].seq, info->cseq,
-                             info->shadow[id].request, bret->status));
+                             rinfo->shadow[id].seq, rinfo->cseq,
+                             rinfo->shadow[id].request, bret->status));
                     xenblk_print_cur_req(info,
-                        (SCSI_REQUEST_BLOCK *)info->shadow[id].request);
+                        (SCSI_REQUEST_BLOCK *)rinfo->shadow[id].request);
                     o++;
 
                 } else if (o) {
                     DPRINTK(DPRTL_FRNT,
                         ("XENBLK: sequence, %x - %x: req %p, status %x, o %d\n",
-                        info->shadow[id].seq, info->cseq,
-                        info->shadow[id].request, bret->status, o));
+                        rinfo->shadow[id].seq, rinfo->cseq,
+                        rinfo->shadow[id].request, bret->status, o));
                     o = 0;
 
                 }
-                InterlockedIncrement(&info->cseq);
+                InterlockedIncrement(&rinfo->cseq);
 #endif
-                InterlockedDecrement(&info->shadow[id].srb_ext->use_cnt);
+                InterlockedDecrement(&rinfo->shadow[id].srb_ext->use_cnt);
 
-                if (info->shadow[id].request) {
+                if (rinfo->shadow[id].request) {
 #ifdef DBG
-                    if (info->shadow[id].srb_ext->use_cnt) {
+                    if (rinfo->shadow[id].srb_ext->use_cnt) {
                         DPRINTK(DPRTL_FRNT,
                                 ("XENBLK: srb %p  use count %x\n",
-                                 info->shadow[id].request,
-                                 info->shadow[id].srb_ext->use_cnt));
+                                 rinfo->shadow[id].request,
+                                 rinfo->shadow[id].srb_ext->use_cnt));
                         outoforder = 1;
-                        info->queued_srb_ext++;
+                        rinfo->queued_srb_ext++;
                     }
-                    InterlockedDecrement(&info->req);
+                    InterlockedDecrement(&rinfo->req);
 #endif
-                    info->shadow[id].srb_ext->status = bret->status;
-                    xenblk_add_tail(info, info->shadow[id].srb_ext);
-                    if (info->shadow[id].srb_ext->next != NULL) {
+                    rinfo->shadow[id].srb_ext->status = bret->status;
+                    xenblk_add_tail(rinfo, rinfo->shadow[id].srb_ext);
+                    if (rinfo->shadow[id].srb_ext->next != NULL) {
                         PRINTK(("XENBLK: srb_ext->next sn %p tn %p x %p\n",
-                                info->shadow[id].srb_ext->next,
-                                info->tsrb_ext->next,
-                                info->shadow[id].srb_ext));
+                                rinfo->shadow[id].srb_ext->next,
+                                rinfo->tsrb_ext->next,
+                                rinfo->shadow[id].srb_ext));
                     }
                 }
 
-                ADD_ID_TO_FREELIST(info, id);
+                ADD_ID_TO_FREELIST(rinfo, id);
                 did_work++;
             }
 
-            info->ring.rsp_cons = i;
+            rinfo->ring.rsp_cons = i;
 
-            if (i != info->ring.req_prod_pvt) {
-                RING_FINAL_CHECK_FOR_RESPONSES(&info->ring, more_to_do);
+            if (i != rinfo->ring.req_prod_pvt) {
+                RING_FINAL_CHECK_FOR_RESPONSES(&rinfo->ring, more_to_do);
             } else {
-                info->ring.sring->rsp_event = i + 1;
+                rinfo->ring.sring->rsp_event = i + 1;
                 more_to_do = 0;
             }
         }
 
-        while (info->hsrb_ext) {
-            if (info->hsrb_ext->use_cnt == 0) {
+        while (rinfo->hsrb_ext) {
+            if (rinfo->hsrb_ext->use_cnt == 0) {
 #ifdef DBG
                 if (outoforder) {
                     DPRINTK(DPRTL_FRNT,
                             ("XENBLK: completing sequenced srb %p\n",
-                             info->hsrb_ext->srb));
-                    info->queued_srb_ext--;
-                } else if (info->queued_srb_ext) {
+                             rinfo->hsrb_ext->srb));
+                    rinfo->queued_srb_ext--;
+                } else if (rinfo->queued_srb_ext) {
                     DPRINTK(DPRTL_FRNT,
                             ("XENBLK: completing queued, srb %p\n",
-                             info->hsrb_ext->srb));
-                    info->queued_srb_ext--;
+                             rinfo->hsrb_ext->srb));
+                    rinfo->queued_srb_ext--;
                 }
-                InterlockedDecrement(&info->depth);
+                InterlockedDecrement(&rinfo->depth);
 #endif
-                srb = info->hsrb_ext->srb;
-                status = info->hsrb_ext->status;
-                info->hsrb_ext = info->hsrb_ext->next;
-                XenBlkCompleteRequest(info, srb, status);
+                srb = rinfo->hsrb_ext->srb;
+                status = rinfo->hsrb_ext->status;
+                rinfo->hsrb_ext = rinfo->hsrb_ext->next;
+                XenBlkCompleteRequest(rinfo, srb, status);
             } else {
-                if ((int32_t)info->hsrb_ext->use_cnt < 0) {
+                if ((int32_t)rinfo->hsrb_ext->use_cnt < 0) {
                     PRINTK(("** XENBLK: srb %p, status %x, use_count = %x.\n",
-                        info->hsrb_ext->srb,
-                        info->hsrb_ext->status,
-                        info->hsrb_ext->use_cnt));
+                        rinfo->hsrb_ext->srb,
+                        rinfo->hsrb_ext->status,
+                        rinfo->hsrb_ext->use_cnt));
                 }
                 break;
             }
@@ -1570,7 +2270,7 @@ blkif_complete_int(struct blkfront_info *info)
 
     DPRINTK(DPRTL_FRNT, ("  blkif_complete_int - OUT\n"));
 
-    XenReleaseSpinLock(&info->lock, lh);
+    XenReleaseSpinLock(&rinfo->lock, lh);
     return did_work;
 }
 
@@ -1578,66 +2278,76 @@ blkif_complete_int(struct blkfront_info *info)
 void
 blkif_int_dpc(PKDPC dpc, PVOID dcontext, PVOID sa1, PVOID sa2)
 {
-    struct blkfront_info *info = (struct blkfront_info *)sa1;
+    struct blkfront_ring_info *rinfo = (struct blkfront_ring_info *)sa1;
 
-    if (info == NULL) {
+    if (rinfo == NULL) {
         return;
     }
-    blkif_complete_int(info);
+    blkif_complete_int(rinfo);
 }
 
 void
 blkif_int(KDPC *dpc, void *context, void *s1, void *s2)
 {
-    struct blkfront_info *info = (struct blkfront_info *)context;
+    struct blkfront_ring_info *rinfo = (struct blkfront_ring_info *)context;
 
-    if (info == NULL) {
+    if (rinfo == NULL) {
         return;
     }
-    StorPortIssueDpc(info->xbdev, &info->dpc, info, NULL);
+    StorPortIssueDpc(rinfo->info->xbdev, &rinfo->dpc, rinfo, NULL);
 }
 #endif
 
-void
-blkif_quiesce(struct blkfront_info *info)
+static void
+blkif_quiesce_ring(struct blkfront_ring_info *rinfo)
 {
     LARGE_INTEGER timeout;
     uint32_t j;
 
-    XENBLK_ZERO_VALUE(conditional_times_to_print_limit);
-
-    DPRINTK(DPRTL_ON, ("blkif_quiesce: IN\n"));
+    DPRINTK(DPRTL_ON, ("blkif_quiesce: ring %u IN\n", rinfo->ring_idx));
     for (j = 0; j < BLK_RING_SIZE; j++) {
-        if (info->shadow[j].request) {
+        if (rinfo->shadow[j].request) {
             PRINTK(("blkif-quiesce: %d, waiting for %p\n",
-                    j, info->shadow[j].request));
+                    j, rinfo->shadow[j].request));
         }
     }
-    if (info->ring.rsp_cons != info->ring.req_prod_pvt) {
+    if (rinfo->ring.rsp_cons != rinfo->ring.req_prod_pvt) {
         PRINTK(("blkif-quiesce: outstanding reqs %x, pvt %x, cons %x\n",
-                info->ring.req_prod_pvt - info->ring.rsp_cons,
-                info->ring.req_prod_pvt, info->ring.rsp_cons));
+                rinfo->ring.req_prod_pvt - rinfo->ring.rsp_cons,
+                rinfo->ring.req_prod_pvt, rinfo->ring.rsp_cons));
         timeout.QuadPart = -1000000; /* .1 second */
         for (j = 0;
-                j < 100 && info->ring.rsp_cons != info->ring.req_prod_pvt;
+                j < 100 && rinfo->ring.rsp_cons != rinfo->ring.req_prod_pvt;
                 j++) {
             DPRINTK(DPRTL_FRNT, ("blkif_quiesce outstanding reqs %p: %x %x\n",
-                info, info->ring.rsp_cons, info->ring.req_prod_pvt));
+                rinfo, rinfo->ring.rsp_cons, rinfo->ring.req_prod_pvt));
             KeDelayExecutionThread(KernelMode, FALSE, &timeout);
-            blkif_complete_int(info);
+            blkif_complete_int(rinfo);
         }
         PRINTK(("%s: waited %d time(s) - remaining reqs %x, pvt %x, cons %x\n",
                 __func__, j,
-                info->ring.req_prod_pvt - info->ring.rsp_cons,
-                info->ring.req_prod_pvt, info->ring.rsp_cons));
+                rinfo->ring.req_prod_pvt - rinfo->ring.rsp_cons,
+                rinfo->ring.req_prod_pvt, rinfo->ring.rsp_cons));
     }
 
     /* Clear out any grants that may still be around. */
     DPRINTK(DPRTL_ON, ("blkif_quiesce: doing shadow completion\n"));
     for (j = 0; j < BLK_RING_SIZE; j++) {
-        blkif_completion(info, j);
+        blkif_completion(rinfo, j);
+    }
+    DPRINTK(DPRTL_ON, ("blkif_quiesce: ring %u OUT\n", rinfo->ring_idx));
+}
+
+void
+blkif_quiesce(struct blkfront_info *info)
+{
+    unsigned int r;
+
+    XENBLK_ZERO_VALUE(conditional_times_to_print_limit);
+
+    for (r = 0; r < info->nr_rings; r++) {
+        blkif_quiesce_ring(&info->rinfo[r]);
     }
-    DPRINTK(DPRTL_ON, ("blkif_quiesce: OUT\n"));
     DPR_SRB("Q");
 }
 
@@ -1649,7 +2359,9 @@ blkif_disconnect_backend(XENBLK_DEVICE_EXTENSION *dev_ext)
     char *buf;
     enum xenbus_state backend_state;
     struct blkfront_info *info;
+    struct blkfront_ring_info *rinfo;
     unsigned int nr;
+    unsigned int r;
 
     RPRINTK(DPRTL_ON, ("blkif_disconnect_backend: IN.\n"));
     for (i = 0; i < dev_ext->max_targets; i++) {
@@ -1660,13 +2372,16 @@ blkif_disconnect_backend(XENBLK_DEVICE_EXTENSION *dev_ext)
              * we wont get a callback after we have freed resources.
              */
             unregister_xenbus_watch(&info->watch);
-            if (info->evtchn) {
-                RPRINTK(DPRTL_FRNT,
+            for (r = 0; r < info->nr_rings; r++) {
+                rinfo = &info->rinfo[r];
+                if (rinfo->evtchn) {
+                    RPRINTK(DPRTL_FRNT,
                         ("      disconnect unregister_dpc_from_evtchn %d.\n",
-                         info->evtchn));
-                unregister_dpc_from_evtchn(info->evtchn);
-                xenbus_free_evtchn(info->evtchn);
-                info->evtchn = 0;
+                         rinfo->evtchn));
+                    unregister_dpc_from_evtchn(rinfo->evtchn);
+                    xenbus_free_evtchn(rinfo->evtchn);
+                    rinfo->evtchn = 0;
+                }
             }
             blkif_quiesce(info);
 
@@ -1721,15 +2436,19 @@ blkif_disconnect_backend(XENBLK_DEVICE_EXTENSION *dev_ext)
                     }
                 }
             }
-            for (nr = 0; nr < info->ring_size; nr++) {
-                if (info->ring_refs[nr] != GRANT_INVALID_REF) {
-                    gnttab_end_foreign_access(info->ring_refs[nr], 0);
-                    info->ring_refs[nr] = GRANT_INVALID_REF;
+            for (r = 0; r < info->nr_rings; r++) {
+                rinfo = &info->rinfo[r];
+                for (nr = 0; nr < info->ring_size; nr++) {
+                    if (rinfo->ring_refs[nr] != GRANT_INVALID_REF) {
+                        gnttab_end_foreign_access(rinfo->ring_refs[nr], 0);
+                        rinfo->ring_refs[nr] = GRANT_INVALID_REF;
+                    }
                 }
             }
         }
     }
     XenBlkFreeAllResources(dev_ext, RELEASE_ONLY);
+    xenblk_bounce_free(dev_ext);
     RPRINTK(DPRTL_ON, ("blkif_disconnect_backend: OUT.\n"));
     DPRINTK(DPRTL_ON,
             ("  alloc_cnt i %d, s %d, v %d\n",
@@ -1743,86 +2462,117 @@ void
 blkif_free(struct blkfront_info *info, int suspend)
 {
     XENBLK_LOCK_HANDLE lh = {0};
+    struct blkfront_ring_info *rinfo;
     void *mem_to_free;
-    unsigned int i, ring_size;
+    unsigned int i, r, ring_size;
 
     /* Prevent new requests being issued until we fix things up. */
-    xenblk_acquire_spinlock(info->xbdev, &info->lock, InterruptLock, NULL, &lh);
-    XENBLK_SET_FLAG(info->xenblk_locks, (BLK_FRE_L | BLK_INT_L));
-    XENBLK_SET_FLAG(info->cpu_locks, (1 << KeGetCurrentProcessorNumber()));
-    info->connected = suspend ?
-        BLKIF_STATE_SUSPENDED : BLKIF_STATE_DISCONNECTED;
-    XENBLK_CLEAR_FLAG(info->xenblk_locks, (BLK_FRE_L | BLK_INT_L));
-    XENBLK_CLEAR_FLAG(info->cpu_locks, (1 << KeGetCurrentProcessorNumber()));
-    xenblk_release_spinlock(info->xbdev, &info->lock, lh);
-
-    gnttab_cancel_free_callback(&info->callback);
-
-    /* Free resources associated with old device channel. */
-    for (i = 0; i < info->ring_size; i++) {
-        if (info->ring_refs[i] != GRANT_INVALID_REF) {
+    for (r = 0; r < XENBLK_MAX_RINGS; r++) {
+        rinfo = &info->rinfo[r];
+        xenblk_acquire_spinlock(info->xbdev, &rinfo->lock, InterruptLock,
+                                NULL, &lh);
+        XENBLK_SET_FLAG(info->xenblk_locks, (BLK_FRE_L | BLK_INT_L));
+        XENBLK_SET_FLAG(info->cpu_locks,
+                        (1 << KeGetCurrentProcessorNumber()));
+        if (r == 0) {
+            info->connected = suspend ?
+                BLKIF_STATE_SUSPENDED : BLKIF_STATE_DISCONNECTED;
+        }
+        XENBLK_CLEAR_FLAG(info->xenblk_locks, (BLK_FRE_L | BLK_INT_L));
+        XENBLK_CLEAR_FLAG(info->cpu_locks,
+                          (1 << KeGetCurrentProcessorNumber()));
+        xenblk_release_spinlock(info->xbdev, &rinfo->lock, lh);
+    }
+
+    for (r = 0; r < XENBLK_MAX_RINGS; r++) {
+        rinfo = &info->rinfo[r];
+        gnttab_cancel_free_callback(&rinfo->callback);
+
+        /* Free resources associated with old device channel. */
+        for (i = 0; i < info->ring_size; i++) {
+            if (rinfo->ring_refs[i] != GRANT_INVALID_REF) {
+                if (!(info->xbdev->state & RESUMING)) {
+                    RPRINTK(DPRTL_ON,
+                            ("      blkif_free: end grant access %d\n",
+                             (rinfo->ring_refs[i])));
+                    gnttab_end_foreign_access(rinfo->ring_refs[i], 0);
+                }
+                rinfo->ring_refs[i] = GRANT_INVALID_REF;
+            }
+        }
+
+        if (rinfo->evtchn) {
             if (!(info->xbdev->state & RESUMING)) {
                 RPRINTK(DPRTL_ON,
-                        ("      blkif_free: end grant access %d\n",
-                         (info->ring_refs[i])));
-                gnttab_end_foreign_access(info->ring_refs[i], 0);
+                        ("      blkif_free:unregister_dpc_from_evtchn %d.\n",
+                         rinfo->evtchn));
+                unregister_dpc_from_evtchn(rinfo->evtchn);
+                xenbus_free_evtchn(rinfo->evtchn);
             }
-            info->ring_refs[i] = GRANT_INVALID_REF;
+            rinfo->evtchn = 0;
         }
-    }
 
-    if (info->evtchn) {
-        if (!(info->xbdev->state & RESUMING)) {
-            RPRINTK(DPRTL_ON,
-                    ("      blkif_free:unregister_dpc_from_evtchn %d.\n",
-                     info->evtchn));
-            unregister_dpc_from_evtchn(info->evtchn);
-            xenbus_free_evtchn(info->evtchn);
+        if (rinfo->ring.sring) {
+            RPRINTK(DPRTL_ON, ("      blkif_free: free sring %u\n", r));
+            ExFreePool(rinfo->ring.sring);
+            rinfo->ring.sring = NULL;
+            XENBLK_DEC(info->xbdev->alloc_cnt_s);
         }
-        info->evtchn = 0;
-    }
 
-    if (info->ring.sring) {
-        RPRINTK(DPRTL_ON, ("      blkif_free: free sring\n"));
-        ExFreePool(info->ring.sring);
-        info->ring.sring = NULL;
-        XENBLK_DEC(info->xbdev->alloc_cnt_s);
-    }
+        ring_size = RING_SIZE(&rinfo->ring);
 
-    ring_size = RING_SIZE(&info->ring);
-    if (info->indirect_segs != NULL) {
-        RPRINTK(DPRTL_ON, ("      blkif_free: free indirect_segs\n"));
-        for (i = 0; i < ring_size; i++) {
-            /* Use mem_to_free to fix DVL error. */
-            mem_to_free = info->indirect_segs[i];
-            if (mem_to_free != NULL) {
-                ExFreePool(mem_to_free);
+        /* Persistent grants of the indirect pages end before the free. */
+        xenblk_free_persist(rinfo);
+
+        if (rinfo->indirect_segs != NULL) {
+            RPRINTK(DPRTL_ON, ("      blkif_free: free indirect_segs\n"));
+            for (i = 0; i < ring_size; i++) {
+                /* Use mem_to_free to fix DVL error. */
+                mem_to_free = rinfo->indirect_segs[i];
+                if (mem_to_free != NULL) {
+                    ExFreePool(mem_to_free);
+                }
             }
+            ExFreePool(rinfo->indirect_segs);
+            rinfo->indirect_segs = NULL;
         }
-        ExFreePool(info->indirect_segs);
-        info->indirect_segs = NULL;
-    }
 
-    info->shadow_free = 0;
-    if (info->shadow != NULL) {
-        RPRINTK(DPRTL_ON, ("      blkif_free: free shadow\n"));
-        for (i = 0; i < ring_size; i++) {
-            /* Use mem_to_free to fix DVL error. */
-            mem_to_free = info->shadow[i].frame;
-            if (mem_to_free != NULL) {
-                ExFreePool(mem_to_free);
+        rinfo->shadow_free = 0;
+        if (rinfo->shadow != NULL) {
+            RPRINTK(DPRTL_ON, ("      blkif_free: free shadow\n"));
+            for (i = 0; i < ring_size; i++) {
+                /* Use mem_to_free to fix DVL error. */
+                mem_to_free = rinfo->shadow[i].frame;
+                if (mem_to_free != NULL) {
+                    ExFreePool(mem_to_free);
+                }
+                mem_to_free = rinfo->shadow[i].persist;
+                if (mem_to_free != NULL) {
+                    ExFreePool(mem_to_free);
+                }
+                mem_to_free = rinfo->shadow[i].persist_va;
+                if (mem_to_free != NULL) {
+                    ExFreePool(mem_to_free);
+                }
             }
+            ExFreePool(rinfo->shadow);
+            rinfo->shadow = NULL;
         }
-        ExFreePool(info->shadow);
-        info->shadow = NULL;
     }
+    info->flags &= ~(BLKIF_PERSISTENT_F | BLKIF_DISCARD_F);
 
-    if (info->mm.ring[0].mapped_addr) {
+    rinfo = &info->rinfo[0];
+    if (rinfo->mm.ring[0].mapped_addr) {
         /* This was all allocated in one chunck so just free the first one. */
         RPRINTK(DPRTL_ON, ("      blkif_free: mapped_addr %p\n",
-                           info->mm.ring[0].mapped_addr));
-        ExFreePool(info->mm.ring[0].mapped_addr);
-        info->mm.ring[0].mapped_addr = NULL;
+                           rinfo->mm.ring[0].mapped_addr));
+        ExFreePool(rinfo->mm.ring[0].mapped_addr);
+        for (r = 0; r < XENBLK_MAX_RINGS; r++) {
+            for (i = 0; i < BLK_RING_SIZE; i++) {
+                info->rinfo[r].mm.ring[i].mapped_addr = NULL;
+                info->rinfo[r].mm.ring[i].mapped_len = NULL;
+            }
+        }
     }
 }
 
@@ -1859,41 +2609,66 @@ blkif_completion_checks(struct blk_shadow *s,
 #endif
 
 static void
-blkif_completion(struct blkfront_info *info, unsigned long id)
+blkif_completion(struct blkfront_ring_info *rinfo, unsigned long id)
 {
     struct blk_shadow *s;
     struct blkif_request_segment *ind_segs;
     uint32_t i;
     uint32_t nr_segs;
 
-    s = &info->shadow[id];
+    s = &rinfo->shadow[id];
     switch (s->req.operation) {
     case BLKIF_OP_DISCARD:
         break;
 
     case BLKIF_OP_INDIRECT: {
         nr_segs = BLKIF_INDIRECT_PAGES(s->ind.nr_segments);
-        ind_segs = info->indirect_segs[id];
+        ind_segs = rinfo->indirect_segs[id];
         blkif_completion_checks(s, ind_segs, nr_segs);
-        for (i = 0; i < s->num_ind; i++) {
-            gnttab_end_foreign_access(ind_segs[i].gref, 0UL);
-        }
+        if (s->num_persist) {
+            /* The indirect pages stay granted for the next request. */
+            for (i = 0; i < s->num_ind; i++) {
+                if (s->ind.indirect_op == BLKIF_OP_READ) {
+                    xenblk_cp_persist(rinfo, s->persist[i],
+                                      s->persist_va[i],
+                                      ind_segs[i].first_sect,
+                                      ind_segs[i].last_sect, 0);
+                }
+                xenblk_put_persist(rinfo, s->persist[i]);
+            }
+        } else {
+            for (i = 0; i < s->num_ind; i++) {
+                gnttab_end_foreign_access(ind_segs[i].gref, 0UL);
+            }
 
-        for (i = 0; i < nr_segs; i++) {
-            gnttab_end_foreign_access(s->ind.indirect_grefs[i], 0UL);
+            for (i = 0; i < nr_segs; i++) {
+                gnttab_end_foreign_access(s->ind.indirect_grefs[i], 0UL);
+            }
         }
         s->num_ind = 0;
+        s->num_persist = 0;
         s->ind.nr_segments = 0;
         break;
     }
     default:
         for (i = 0; i < s->req.nr_segments; i++) {
+            if (s->num_persist && s->persist[i] != BLK_PERSIST_NONE) {
+                if (s->req.operation == BLKIF_OP_READ) {
+                    xenblk_cp_persist(rinfo, s->persist[i],
+                                      s->persist_va[i],
+                                      s->req.seg[i].first_sect,
+                                      s->req.seg[i].last_sect, 0);
+                }
+                xenblk_put_persist(rinfo, s->persist[i]);
+                continue;
+            }
             gnttab_end_foreign_access(s->req.seg[i].gref, 0);
             CDPRINTK(DPRTL_COND, 0, 0, 1,
                 ("blkif_completion: end_foreign_access i = %d, gref = %x.\n",
                 i, s->req.seg[i].gref));
         }
         s->req.nr_segments = 0;
+        s->num_persist = 0;
         break;
     }
 }
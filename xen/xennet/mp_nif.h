@@ -56,6 +56,10 @@ typedef struct _vnif_virtio_s {
 
 #define VNIF_ADD_RCB_TO_RING VNIFX_ADD_RCB_TO_RING
 
+#define VNIF_RX_RING_PUBLISH VNIFX_RX_RING_PUBLISH
+
+#define VNIF_RX_RING_REARM VNIFX_RX_RING_REARM
+
 #define VNIF_NOTIFY_REMOTE VNIFX_NOTIFY_REMOTE
 
 #define VNIFRegisterNdisInterrupt VNIFX_RegisterNdisInterrupt
@@ -148,6 +152,7 @@ typedef struct _vnif_virtio_s {
 
 #define VNIF_SETUP_PATH_INFO_EX vnifx_setup_path_info_ex
 
+
 #ifndef NDIS60_MINIPORT
 #define DriverEntryEx MPX_DriverEntryEx
 #endif
@@ -1088,6 +1088,8 @@ VNIFInitTxGrants(PVNIF_ADAPTER adapter)
                 gnttab_claim_grant_reference(
                     &adapter->path[p].u.xq.gref_tx_head);
         }
+        adapter->path[p].tcb_free_cnt = NET_TX_RING_SIZE;
+        vnif_bql_init(&adapter->path[p].tx_bql);
         adapter->path[p].u.xq.tx_id_alloc_head = 0;
     }
 
@@ -1575,7 +1577,7 @@ MPResume(PVNIF_ADAPTER adapter, uint32_t suspend_canceled)
                     __func__, adapter->pv_stats->rx_to_process_cnt));
         }
         for (i = 0; i < adapter->num_rcv_queues; ++i) {
-            if (!IsListEmpty(&adapter->rcv_q[i].rcv_to_process)) {
+            if (vnif_rcv_q_pending(adapter, i)) {
                 PRINTK(("%s: RecvToProcess[%d] not empty\n", __func__, i));
             }
         }
@@ -1661,7 +1663,7 @@ MPSuspend(PVNIF_ADAPTER adapter, uint32_t reason)
                     __func__, adapter->pv_stats->rx_to_process_cnt));
         }
         for (i = 0; i < adapter->num_rcv_queues; ++i) {
-            if (!IsListEmpty(&adapter->rcv_q[i].rcv_to_process)) {
+            if (vnif_rcv_q_pending(adapter, i)) {
                 PRINTK(("%s: RecvToProcess[%d] not empty\n", __func__, i));
             }
         }
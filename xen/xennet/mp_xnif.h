@@ -83,6 +83,8 @@ void vnifx_ndis_queue_dpc(struct _VNIF_ADAPTER *adapter,
 void VNIFX_FREE_SHARED_MEMORY(struct _VNIF_ADAPTER *adapter, void *va,
     PHYSICAL_ADDRESS pa, uint32_t len, NDIS_HANDLE hndl);
 void VNIFX_ADD_RCB_TO_RING(struct _VNIF_ADAPTER *adapter, struct _RCB *rcb);
+void VNIFX_RX_RING_PUBLISH(struct _VNIF_ADAPTER *adapter, UINT path_id);
+void VNIFX_RX_RING_REARM(struct _VNIF_ADAPTER *adapter, UINT path_id);
 ULONG VNIFX_RX_RING_SIZE(struct _VNIF_ADAPTER *adapter);
 ULONG VNIFX_TX_RING_SIZE(struct _VNIF_ADAPTER *adapter);
 void VNIFX_GET_TX_REQ_PROD_PVT(struct _VNIF_ADAPTER *adapter, UINT path_id,
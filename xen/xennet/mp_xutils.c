@@ -28,6 +28,25 @@
 #include <ndis.h>
 #include "miniport.h"
 
+/*
+ * RING_FINAL_CHECK_FOR_RESPONSES asked for an event on the next response.
+ * When the path's rx interrupts are moderated, move it out to rx_bufs
+ * responses.  The moderation timer picks up anything left below that.
+ */
+static __inline VOID
+vnifx_moderate_rx_event(PVNIF_ADAPTER adapter, UINT path_id)
+{
+    struct netif_rx_front_ring *rx;
+    UINT rx_bufs;
+
+    rx_bufs = adapter->path[path_id].rx_mod.rx_bufs;
+    if (rx_bufs > 1) {
+        rx = &adapter->path[path_id].u.xq.rx_front_ring;
+        rx->sring->rsp_event = rx->rsp_cons + rx_bufs;
+        KeMemoryBarrier();
+    }
+}
+
 VOID
 vnifx_interrupt_dpc(
   IN PKDPC Dpc,
@@ -56,6 +75,7 @@ vnifx_interrupt_dpc(
                             VNF_ADAPTER_RX_DPC_IN_PROGRESS,
                             path->path_id,
                             NDIS_INDICATE_ALL_NBLS);
+    vnifx_moderate_rx_event(path->adapter, path->path_id);
 
     /*
      * Xenbus will mask the evtchn before scheduling the DPC.
@@ -90,6 +110,7 @@ vnifx_split_interrupt_dpc(vnif_xq_path_t *path, ULONG txrx_ind)
      * Unmask here to allow xen to inject more interrupts.
      */
     if (txrx_ind == VNF_ADAPTER_RX_DPC_IN_PROGRESS) {
+        vnifx_moderate_rx_event(path->adapter, path->path_id);
         DPRINTK(DPRTL_RXDPC, ("VNIF: %s path_id %d cpu %d.\n",
                               __func__,
                               path->path_id,
@@ -505,14 +526,29 @@ VNIFX_ADD_RCB_TO_RING(VNIF_ADAPTER *adapter, RCB *rcb)
                            req_prod);
     req->gref = rcb->grant_rx_ref;
     req->id = (UINT16) rcb->index;
-    KeMemoryBarrier();
 
     DPRINTK(DPRTL_TRC, ("Put rcb:  %p, idx %x back on the ring at %x.\n",
         rcb, rcb->index, req_prod));
     adapter->path[path_id].u.xq.rx_front_ring.req_prod_pvt = req_prod + 1;
+}
+
+void
+VNIFX_RX_RING_PUBLISH(VNIF_ADAPTER *adapter, UINT path_id)
+{
     RING_PUSH_REQUESTS(&adapter->path[path_id].u.xq.rx_front_ring);
 }
 
+/* Interrupt on the next received buffer instead of the moderated count. */
+void
+VNIFX_RX_RING_REARM(VNIF_ADAPTER *adapter, UINT path_id)
+{
+    struct netif_rx_front_ring *rx;
+
+    rx = &adapter->path[path_id].u.xq.rx_front_ring;
+    rx->sring->rsp_event = rx->rsp_cons + 1;
+    KeMemoryBarrier();
+}
+
 ULONG
 VNIFX_RX_RING_SIZE(VNIF_ADAPTER *adapter)
 {